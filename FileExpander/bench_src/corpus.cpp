@@ -0,0 +1,303 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <ftw.h>
+#include <sys/stat.h>
+#include "corpus.h"
+
+static const char *corpus_names[CORPUS_COUNT] = { "tiny", "huge", "deep", "text", "random" };
+
+// words of the compressible data
+static const char *corpus_words[] = {
+    "archive", "member", "folder", "expand", "list", "header", "block", "stream",
+    "the", "of", "and", "a", "to", "in", "is", "for", "that", "with", "on", "as",
+    "file", "data", "size", "time", "name", "path", "link", "mode", "user", "group",
+    "gzip", "bzip2", "tar", "zip", "xz", "zstd", "compress", "decode", "write", "read",
+    "static", "int", "char", "void", "return", "if", "else", "while", "struct", "const",
+    "0", "1", "2", "16", "64", "512", "4096", "65536", "{", "}", "(", ")", ";", "="
+};
+
+enum Content_Kind
+{
+    CONTENT_TEXT,
+    CONTENT_RANDOM,
+    CONTENT_SPARSE // zeros with a random block every megabyte
+};
+
+//
+// Generator - xorshift64* (the same numbers everywhere)
+//
+class Generator
+{
+    public:
+        Generator(uint64_t nSeed) : m_nState(nSeed ? nSeed : 1) {}
+        uint64_t Next()
+        {
+            m_nState ^= m_nState >> 12;
+            m_nState ^= m_nState << 25;
+            m_nState ^= m_nState >> 27;
+            return m_nState * 2685821657736338717ULL;
+        }
+        unsigned int Below(unsigned int n) { return Next() % n; }
+        void Fill(int nKind, char *pBuffer, size_t nSize, uint64_t nOffset);
+    private:
+        uint64_t m_nState;
+};
+
+void Generator::Fill(int nKind, char *pBuffer, size_t nSize, uint64_t nOffset)
+{
+    size_t i = 0;
+
+    switch (nKind)
+    {
+        case CONTENT_RANDOM:
+            for (; i + 8 <= nSize; i += 8)
+            {
+                uint64_t n = Next();
+                memcpy(pBuffer + i, &n, 8);
+            }
+            for (; i < nSize; i++)
+                pBuffer[i] = Next();
+            break;
+
+        case CONTENT_SPARSE:
+            memset(pBuffer, 0, nSize);
+            for (; i < nSize; i++)
+            {
+                if (((nOffset + i) & 0xfffff) < 4096)
+                    pBuffer[i] = Next();
+            }
+            break;
+
+        default:
+            while (i < nSize)
+            {
+                const char *pzWord = corpus_words[Below(sizeof(corpus_words) / sizeof(corpus_words[0]))];
+                while (*pzWord && i < nSize)
+                    pBuffer[i++] = *pzWord++;
+                if (i < nSize)
+                    pBuffer[i++] = Below(12) ? ' ' : '\n';
+            }
+    }
+}
+
+const char *CorpusName(int nKind)
+{
+    return (nKind >= 0 && nKind < CORPUS_COUNT) ? corpus_names[nKind] : NULL;
+}
+
+static uint64_t Scaled(uint64_t n, unsigned int nScale)
+{
+    n = n * nScale / 100;
+    return n ? n : 1;
+}
+
+// MakeFile - writing a generated file (noting it in the totals)
+static bool MakeFile(const std::string &cPath, Generator *psGen, int nKind, uint64_t nSize, corpus_info *psInfo, std::string *pcError)
+{
+    static char aBuffer[CORPUS_BUFSIZE];
+    int nFd = open(cPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+
+    if (nFd < 0)
+    {
+        *pcError = cPath + ": " + strerror(errno);
+        return false;
+    }
+    for (uint64_t nDone = 0; nDone < nSize;)
+    {
+        size_t nChunk = (nSize - nDone < CORPUS_BUFSIZE) ? nSize - nDone : CORPUS_BUFSIZE;
+        psGen->Fill(nKind, aBuffer, nChunk, nDone);
+        if (write(nFd, aBuffer, nChunk) != (ssize_t)nChunk)
+        {
+            *pcError = cPath + ": " + strerror(errno);
+            close(nFd);
+            return false;
+        }
+        nDone += nChunk;
+    }
+    close(nFd);
+
+    psInfo->files++;
+    psInfo->bytes += nSize;
+    if (psInfo->single.empty() || nSize > psInfo->single_size)
+    {
+        psInfo->single = cPath;
+        psInfo->single_size = nSize;
+    }
+    return true;
+}
+
+static bool MakeFolder(const std::string &cPath, std::string *pcError)
+{
+    if (mkdir(cPath.c_str(), 0755) < 0 && errno != EEXIST)
+    {
+        *pcError = cPath + ": " + strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+// SetTime - the same modification time for everything (nftw callback)
+static int SetTime(const char *pzPath, const struct stat *psStat, int nFlag, struct FTW *psFtw)
+{
+    struct timespec asTime[2];
+
+    asTime[0].tv_sec = asTime[1].tv_sec = CORPUS_MTIME;
+    asTime[0].tv_nsec = asTime[1].tv_nsec = 0;
+    utimensat(AT_FDCWD, pzPath, asTime, AT_SYMLINK_NOFOLLOW);
+    return 0;
+}
+
+// Generate - creating the files of the corpus
+static bool Generate(int nKind, const std::string &cDir, unsigned int nScale, Generator *psGen, corpus_info *psInfo, std::string *pcError)
+{
+    char zName[64];
+
+    switch (nKind)
+    {
+        case CORPUS_TINY:
+        {
+            // 20000 files of up to 1 KB in 20 x 10 folders
+            uint64_t nFiles = Scaled(20000, nScale);
+            for (uint64_t i = 0; i < nFiles; i++)
+            {
+                sprintf(zName, "/d%02u", (unsigned int)(i % 20));
+                std::string cPath = cDir + zName;
+                if (i < 20 && !MakeFolder(cPath, pcError))
+                    return false;
+                sprintf(zName, "/e%u", (unsigned int)(i / 20 % 10));
+                cPath += zName;
+                if (i < 200 && !MakeFolder(cPath, pcError))
+                    return false;
+                sprintf(zName, "/f%06u.txt", (unsigned int)i);
+                if (!MakeFile(cPath + zName, psGen, CONTENT_TEXT, psGen->Below(1024), psInfo, pcError))
+                    return false;
+            }
+            return true;
+        }
+
+        case CORPUS_HUGE:
+        {
+            // three files of 64 MB: text, random and mostly zeros
+            static const char *apzName[] = { "/huge-text.dat", "/huge-random.dat", "/huge-sparse.dat" };
+            static const int anContent[] = { CONTENT_TEXT, CONTENT_RANDOM, CONTENT_SPARSE };
+            for (int i = 0; i < 3; i++)
+            {
+                if (!MakeFile(cDir + apzName[i], psGen, anContent[i], Scaled(64 << 20, nScale), psInfo, pcError))
+                    return false;
+            }
+            return true;
+        }
+
+        case CORPUS_DEEP:
+        {
+            // 16 chains of 48 nested folders, two small files in each
+            uint64_t nChains = Scaled(16, nScale);
+            for (uint64_t i = 0; i < nChains; i++)
+            {
+                sprintf(zName, "/chain%02u", (unsigned int)i);
+                std::string cPath = cDir + zName;
+                if (!MakeFolder(cPath, pcError))
+                    return false;
+                for (int nLevel = 0; nLevel < 48; nLevel++)
+                {
+                    sprintf(zName, "/level%02d", nLevel);
+                    cPath += zName;
+                    if (!MakeFolder(cPath, pcError) ||
+                        !MakeFile(cPath + "/a.txt", psGen, CONTENT_TEXT, psGen->Below(4096), psInfo, pcError) ||
+                        !MakeFile(cPath + "/b.bin", psGen, CONTENT_RANDOM, psGen->Below(4096), psInfo, pcError))
+                        return false;
+                }
+            }
+            return true;
+        }
+
+        default:
+        {
+            // 256 files of 256 KB
+            uint64_t nFiles = Scaled(256, nScale);
+            for (uint64_t i = 0; i < nFiles; i++)
+            {
+                sprintf(zName, "/%s%03u.dat", nKind == CORPUS_TEXT ? "text" : "random", (unsigned int)i);
+                if (!MakeFile(cDir + zName, psGen, nKind == CORPUS_TEXT ? CONTENT_TEXT : CONTENT_RANDOM, 256 << 10, psInfo, pcError))
+                    return false;
+            }
+            return true;
+        }
+    }
+}
+
+bool MakeCorpus(int nKind, const char *pzRoot, unsigned int nScale, uint64_t nSeed, corpus_info *psInfo, std::string *pcError)
+{
+    const char *pzName = CorpusName(nKind);
+    char zDir[128];
+
+    if (!pzName)
+    {
+        *pcError = "unknown corpus";
+        return false;
+    }
+    sprintf(zDir, "/%s-s%u-r%llu", pzName, nScale, (unsigned long long)nSeed);
+    psInfo->name = pzName;
+    psInfo->path = std::string(pzRoot) + zDir;
+    psInfo->single.clear();
+    psInfo->files = psInfo->bytes = psInfo->single_size = 0;
+
+    // a finished corpus has its totals next to it
+    std::string cDone = psInfo->path + ".done";
+    FILE *psDone = fopen(cDone.c_str(), "r");
+    if (psDone)
+    {
+        unsigned long long nFiles, nBytes, nSingle;
+        char zSingle[1024];
+        bool bRead = fscanf(psDone, "%llu %llu %llu %1023s", &nFiles, &nBytes, &nSingle, zSingle) == 4;
+        fclose(psDone);
+        if (bRead)
+        {
+            psInfo->files = nFiles;
+            psInfo->bytes = nBytes;
+            psInfo->single_size = nSingle;
+            psInfo->single = psInfo->path + "/" + zSingle;
+            return true;
+        }
+    }
+
+    // the same seed gives the same corpus; every kind has its own numbers
+    Generator sGen(nSeed * 0x9e3779b97f4a7c15ULL + nKind + 1);
+    if (system(("rm -rf '" + psInfo->path + "'").c_str()) != 0 || !MakeFolder(psInfo->path, pcError) ||
+        !Generate(nKind, psInfo->path, nScale, &sGen, psInfo, pcError))
+        return false;
+    nftw(psInfo->path.c_str(), SetTime, 16, FTW_DEPTH | FTW_PHYS);
+
+    psDone = fopen(cDone.c_str(), "w");
+    if (!psDone)
+    {
+        *pcError = cDone + ": " + strerror(errno);
+        return false;
+    }
+    fprintf(psDone, "%llu %llu %llu %s\n", (unsigned long long)psInfo->files, (unsigned long long)psInfo->bytes,
+            (unsigned long long)psInfo->single_size, psInfo->single.substr(psInfo->path.size() + 1).c_str());
+    fclose(psDone);
+    return true;
+}
@@ -0,0 +1,63 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _NRUSLAN_CORPUS_H_
+#define _NRUSLAN_CORPUS_H_
+
+//
+// Synthetic corpora for the benchmark. Every corpus is made from a seeded
+// generator, so the same seed and scale give the same files (with the same
+// modification time) on every machine; a corpus which is already there is
+// reused.
+//
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <string>
+
+enum Corpus_Kind
+{
+    CORPUS_TINY, // many tiny files in many folders
+    CORPUS_HUGE, // a few huge files
+    CORPUS_DEEP, // deeply nested folders
+    CORPUS_TEXT, // highly compressible data
+    CORPUS_RANDOM, // incompressible data
+    CORPUS_COUNT
+};
+
+enum Corpus_Settings
+{
+    CORPUS_MTIME = 1000000000, // modification time of all files and folders
+    CORPUS_BUFSIZE = 65536
+};
+
+struct corpus_info
+{
+    std::string name; // e.g. "tiny"
+    std::string path; // folder with the files
+    std::string single; // the biggest file (for single file formats)
+    uint64_t files, bytes; // regular files
+    uint64_t single_size;
+};
+
+const char *CorpusName(int nKind);
+// nScale - percents of the default size
+bool MakeCorpus(int nKind, const char *pzRoot, unsigned int nScale, uint64_t nSeed, corpus_info *psInfo, std::string *pcError);
+
+#endif /* _NRUSLAN_CORPUS_H_ */
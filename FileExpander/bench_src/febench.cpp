@@ -0,0 +1,688 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+//
+// febench - FileExpander benchmark. Generates the synthetic corpora, packs
+// each into every format which has a rule in FileExpander.rules and times
+// listing, expanding and testing them by the rule's commands and by the
+// native reader. Runs without the GUI; results go out as CSV and JSON.
+//
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <ftw.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/utsname.h>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include "rules.h"
+#include "archive.h"
+#include "extract.h"
+#include "corpus.h"
+
+#define BENCH_VERSION "0.7"
+#define BENCH_RULES "../src/FileExpander.rules"
+#define BENCH_WORKDIR "febench-work"
+
+// reproducible tar archives (GNU tar)
+#define TAR_FLAGS "--sort=name --owner=0 --group=0 --numeric-owner"
+
+enum Bench_Settings
+{
+    BENCH_REPEATS = 3,
+    BENCH_SCALE = 100, // percents of the default corpus sizes
+    BENCH_SEED = 1
+};
+
+// Engines and operations
+enum Bench_Engine
+{
+    ENGINE_COMMAND, // list and extract commands of the rule
+    ENGINE_NATIVE, // in-process reader, pipelined extraction
+    ENGINE_SERIAL, // in-process reader, one thread
+    ENGINE_COUNT
+};
+
+enum Bench_Operation
+{
+    OP_LIST,
+    OP_EXTRACT,
+    OP_TEST, // decoding all data (checksums are verified), nothing written
+    OP_COUNT
+};
+
+static const char *engine_names[ENGINE_COUNT] = { "command", "native", "serial" };
+static const char *op_names[OP_COUNT] = { "list", "extract", "test" };
+
+// Archive formats the benchmark can pack (%o - archive, %i - the single file)
+struct bench_format
+{
+    const char *ext;
+    const char *tool; // needed for packing
+    const char *pack; // run in the corpus folder
+    bool single; // one compressed file
+};
+
+static const bench_format bench_formats[] = {
+    { "tar", "tar", "tar " TAR_FLAGS " -cf %o .", false },
+    { "tar.gz", "gzip", "tar " TAR_FLAGS " -cf - . | gzip -n > %o", false },
+    { "tar.bz2", "bzip2", "tar " TAR_FLAGS " -cf - . | bzip2 > %o", false },
+    { "tar.Z", "compress", "tar " TAR_FLAGS " -cf - . | compress -c > %o", false },
+    { "tar.xz", "xz", "tar " TAR_FLAGS " -cf - . | xz -T1 > %o", false },
+    { "tar.zst", "zstd", "tar " TAR_FLAGS " -cf - . | zstd -q > %o", false },
+    { "zip", "zip", "find . -mindepth 1 | LC_ALL=C sort | zip -qX -@ %o", false },
+    { "gz", "gzip", "gzip -cn %i > %o", true },
+    { "bz2", "bzip2", "bzip2 -c %i > %o", true },
+    { "Z", "compress", "compress -c %i > %o", true }
+};
+
+// One line of the results
+struct bench_result
+{
+    std::string corpus, format, engine, op, status;
+    uint64_t archive_size, files, bytes;
+    unsigned int runs;
+    double wall_min, wall_median, cpu_median; // seconds
+};
+
+// Time of one run
+struct run_time
+{
+    double wall, cpu;
+};
+
+static std::vector<bench_result> results;
+
+//
+// helpers
+//
+
+static std::string Quote(const std::string &cText)
+{
+    return "'" + cText + "'";
+}
+
+static bool HasTool(const char *pzTool)
+{
+    return system((std::string("command -v ") + pzTool + " >/dev/null 2>&1").c_str()) == 0;
+}
+
+// Command - rule command for the archive (password parts are left out)
+static std::string Command(const char *pzRule, const std::string &cArchive)
+{
+    std::string cCommand;
+
+    for (const char *p = pzRule; *p; p++)
+    {
+        if (*p == '[')
+        {
+            while (*p && *p != ']')
+                p++;
+            if (!*p)
+                break;
+        }
+        else if (p[0] == '%' && p[1] == 's')
+        {
+            cCommand += "\"" + cArchive + "\"";
+            p++;
+        }
+        else
+            cCommand += *p;
+    }
+    return cCommand;
+}
+
+static double Now()
+{
+    struct timespec sTime;
+    clock_gettime(CLOCK_MONOTONIC, &sTime);
+    return sTime.tv_sec + sTime.tv_nsec / 1e9;
+}
+
+// CpuTime - processor time of the benchmark and its finished commands
+static double CpuTime()
+{
+    struct rusage sSelf, sChildren;
+    getrusage(RUSAGE_SELF, &sSelf);
+    getrusage(RUSAGE_CHILDREN, &sChildren);
+    return sSelf.ru_utime.tv_sec + sSelf.ru_stime.tv_sec + sChildren.ru_utime.tv_sec + sChildren.ru_stime.tv_sec +
+        (sSelf.ru_utime.tv_usec + sSelf.ru_stime.tv_usec + sChildren.ru_utime.tv_usec + sChildren.ru_stime.tv_usec) / 1e6;
+}
+
+// expanded files are counted after every run
+static uint64_t tree_files, tree_bytes;
+
+static int CountFile(const char *pzPath, const struct stat *psStat, int nFlag, struct FTW *psFtw)
+{
+    if (nFlag == FTW_F && S_ISREG(psStat->st_mode))
+    {
+        tree_files++;
+        tree_bytes += psStat->st_size;
+    }
+    return 0;
+}
+
+static int RemoveFile(const char *pzPath, const struct stat *psStat, int nFlag, struct FTW *psFtw)
+{
+    if (nFlag == FTW_DP)
+        rmdir(pzPath);
+    else
+        unlink(pzPath);
+    return 0;
+}
+
+static void CountTree(const std::string &cDir)
+{
+    tree_files = tree_bytes = 0;
+    nftw(cDir.c_str(), CountFile, 16, FTW_PHYS);
+}
+
+static void RemoveTree(const std::string &cDir)
+{
+    nftw(cDir.c_str(), RemoveFile, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+// Matches - is the line chosen by -m (missing or empty parts of the name match anything)
+static bool Matches(const std::string &cPattern, const char *pzCorpus, const char *pzFormat, const char *pzEngine, const char *pzOp)
+{
+    const char *apzPart[] = { pzCorpus, pzFormat, pzEngine, pzOp };
+    std::string::size_type nStart = 0;
+
+    for (int i = 0; i < 4 && nStart <= cPattern.size(); i++)
+    {
+        std::string::size_type nEnd = cPattern.find('/', nStart);
+        if (nEnd == std::string::npos)
+            nEnd = cPattern.size();
+        if (apzPart[i] && nEnd > nStart && fnmatch(cPattern.substr(nStart, nEnd - nStart).c_str(), apzPart[i], 0))
+            return false;
+        nStart = nEnd + 1;
+    }
+    return true;
+}
+
+//
+// operations (false on error, *pcError tells why)
+//
+
+static bool NativeList(const char *pzFormat, const std::string &cArchive, uint64_t *pnFiles, uint64_t *pnBytes, std::string *pcError)
+{
+    ArchiveReader *pcReader = OpenArchive(pzFormat, cArchive.c_str(), pcError);
+    archive_entry sEntry;
+    int nResult;
+
+    if (!pcReader)
+        return false;
+    while ((nResult = pcReader->NextEntry(&sEntry)) > 0)
+    {
+        if (sEntry.type == ENTRY_FILE)
+        {
+            (*pnFiles)++;
+            *pnBytes += sEntry.size;
+        }
+    }
+    if (nResult < 0)
+        *pcError = pcReader->GetError();
+    delete pcReader;
+    return nResult == 0;
+}
+
+static bool NativeTest(const char *pzFormat, const std::string &cArchive, uint64_t *pnFiles, uint64_t *pnBytes, std::string *pcError)
+{
+    static char aBuffer[ARCHIVE_BUFSIZE];
+    ArchiveReader *pcReader = OpenArchive(pzFormat, cArchive.c_str(), pcError);
+    archive_entry sEntry;
+    int nResult;
+    ssize_t nRead = 0;
+
+    if (!pcReader)
+        return false;
+    while ((nResult = pcReader->NextEntry(&sEntry)) > 0)
+    {
+        if (sEntry.type != ENTRY_FILE)
+            continue;
+        (*pnFiles)++;
+        while ((nRead = pcReader->ReadData(aBuffer, sizeof(aBuffer))) > 0)
+            *pnBytes += nRead;
+        if (nRead < 0)
+            break;
+    }
+    if (nResult < 0 || nRead < 0)
+        *pcError = pcReader->GetError();
+    delete pcReader;
+    return nResult == 0 && nRead >= 0;
+}
+
+static bool NativeExtract(const char *pzFormat, const std::string &cArchive, const std::string &cDest, bool bPipeline, std::string *pcError)
+{
+    ArchiveReader *pcReader = OpenArchive(pzFormat, cArchive.c_str(), pcError);
+    if (!pcReader)
+        return false;
+
+    ExtractJob *psJob = new ExtractJob(open(cDest.c_str(), O_RDONLY | O_DIRECTORY), NULL, NULL);
+    psJob->SetPipeline(bPipeline);
+    bool bResult = psJob->Run(pcReader);
+    if (!bResult)
+        *pcError = pcReader->GetError();
+    delete psJob;
+    delete pcReader;
+    return bResult;
+}
+
+// RunCommand - rule command in the folder (its output is dropped)
+static bool RunCommand(const std::string &cCommand, const std::string &cDir, std::string *pcError)
+{
+    int nStatus = system(("cd " + Quote(cDir) + " && " + cCommand + " >/dev/null 2>&1").c_str());
+    if (nStatus != 0)
+        *pcError = "command failed: " + cCommand;
+    return nStatus == 0;
+}
+
+//
+// benchmark
+//
+
+struct bench_options
+{
+    std::string root, rules, csv, json, match;
+    unsigned int scale, repeats;
+    uint64_t seed;
+};
+
+// Measure - running one operation several times
+static void Measure(const bench_options &sOptions, const corpus_info &sCorpus, const bench_format &sFormat, char **ppzRule,
+                    const std::string &cArchive, int nEngine, int nOp)
+{
+    bench_result sResult;
+    sResult.corpus = sCorpus.name;
+    sResult.format = sFormat.ext;
+    sResult.engine = engine_names[nEngine];
+    sResult.op = op_names[nOp];
+    sResult.files = sResult.bytes = 0;
+    sResult.runs = 0;
+    sResult.wall_min = sResult.wall_median = sResult.cpu_median = 0;
+
+    std::string cName = sResult.corpus + "/" + sResult.format + "/" + sResult.engine + "/" + sResult.op;
+    if (!Matches(sOptions.match, sCorpus.name.c_str(), sFormat.ext, engine_names[nEngine], op_names[nOp]))
+        return;
+
+    struct stat stbuf;
+    sResult.archive_size = stat(cArchive.c_str(), &stbuf) == 0 ? stbuf.st_size : 0;
+
+    // what a complete run gives
+    uint64_t nFiles = sFormat.single ? 1 : sCorpus.files;
+    uint64_t nBytes = sFormat.single ? sCorpus.single_size : sCorpus.bytes;
+
+    std::string cDest = sOptions.root + "/out", cError;
+    std::vector<run_time> asTime;
+    bool bResult = true;
+    sResult.status = "ok";
+
+    for (unsigned int i = 0; i < sOptions.repeats && bResult; i++)
+    {
+        RemoveTree(cDest);
+        mkdir(cDest.c_str(), 0755);
+        sResult.files = sResult.bytes = 0;
+
+        run_time sTime;
+        double fCpu = CpuTime();
+        sTime.wall = Now();
+        if (nEngine == ENGINE_COMMAND)
+            bResult = RunCommand(Command(ppzRule[nOp == OP_LIST ? 0 : 1], cArchive), cDest, &cError);
+        else if (nOp == OP_LIST)
+            bResult = NativeList(ppzRule[RULE_FORMAT], cArchive, &sResult.files, &sResult.bytes, &cError);
+        else if (nOp == OP_TEST)
+            bResult = NativeTest(ppzRule[RULE_FORMAT], cArchive, &sResult.files, &sResult.bytes, &cError);
+        else
+            bResult = NativeExtract(ppzRule[RULE_FORMAT], cArchive, cDest, nEngine == ENGINE_NATIVE, &cError);
+        sTime.wall = Now() - sTime.wall;
+        sTime.cpu = CpuTime() - fCpu;
+        asTime.push_back(sTime);
+
+        if (nOp == OP_EXTRACT)
+        {
+            CountTree(cDest);
+            sResult.files = tree_files;
+            sResult.bytes = tree_bytes;
+        }
+    }
+    RemoveTree(cDest);
+
+    if (!bResult)
+        sResult.status = "error: " + cError;
+    // a command's listing isn't parsed (its format is the tool's own)
+    else if ((nOp != OP_LIST || nEngine != ENGINE_COMMAND) && (sResult.files != nFiles || (nOp != OP_LIST && sResult.bytes != nBytes)))
+        sResult.status = "mismatch";
+
+    if (bResult)
+    {
+        std::vector<double> afWall, afCpu;
+        for (unsigned int i = 0; i < asTime.size(); i++)
+        {
+            afWall.push_back(asTime[i].wall);
+            afCpu.push_back(asTime[i].cpu);
+        }
+        std::sort(afWall.begin(), afWall.end());
+        std::sort(afCpu.begin(), afCpu.end());
+        sResult.runs = asTime.size();
+        sResult.wall_min = afWall[0];
+        sResult.wall_median = afWall[afWall.size() / 2];
+        sResult.cpu_median = afCpu[afCpu.size() / 2];
+    }
+
+    fprintf(stderr, "febench: %-40s %9.3f s  %s\n", cName.c_str(), sResult.wall_median, sResult.status.c_str());
+    results.push_back(sResult);
+}
+
+static void Skipped(const corpus_info &sCorpus, const bench_format &sFormat, const char *pzEngine, const std::string &cReason)
+{
+    bench_result sResult;
+    sResult.corpus = sCorpus.name;
+    sResult.format = sFormat.ext;
+    sResult.engine = pzEngine;
+    sResult.status = "skipped: " + cReason;
+    sResult.archive_size = sResult.files = sResult.bytes = 0;
+    sResult.runs = 0;
+    sResult.wall_min = sResult.wall_median = sResult.cpu_median = 0;
+    fprintf(stderr, "febench: %s/%s/%s %s\n", sCorpus.name.c_str(), sFormat.ext, pzEngine, sResult.status.c_str());
+    results.push_back(sResult);
+}
+
+// Pack - making the archive of the corpus (kept for later runs)
+static bool Pack(const bench_options &sOptions, const corpus_info &sCorpus, const bench_format &sFormat, std::string *pcArchive)
+{
+    std::string cPath = sCorpus.path + "." + sFormat.ext;
+    struct stat stbuf;
+
+    *pcArchive = cPath;
+    if (stat(cPath.c_str(), &stbuf) == 0)
+        return true;
+
+    std::string cCommand, cTemp = cPath + ".part";
+    for (const char *p = sFormat.pack; *p; p++)
+    {
+        if (p[0] == '%' && p[1] == 'o')
+            cCommand += Quote(cTemp), p++;
+        else if (p[0] == '%' && p[1] == 'i')
+            cCommand += Quote(sCorpus.single), p++;
+        else
+            cCommand += *p;
+    }
+    unlink(cTemp.c_str());
+    if (system(("cd " + Quote(sCorpus.path) + " && " + cCommand + " 2>/dev/null").c_str()) != 0)
+    {
+        unlink(cTemp.c_str());
+        return false;
+    }
+    return rename(cTemp.c_str(), cPath.c_str()) == 0;
+}
+
+static void Run(const bench_options &sOptions, RuleTable *psRules)
+{
+    for (int nKind = 0; nKind < CORPUS_COUNT; nKind++)
+    {
+        corpus_info sCorpus;
+        std::string cError;
+
+        // corpora which are filtered out entirely aren't generated
+        if (!Matches(sOptions.match, CorpusName(nKind), NULL, NULL, NULL))
+            continue;
+
+        fprintf(stderr, "febench: generating %s corpus\n", CorpusName(nKind));
+        if (!MakeCorpus(nKind, sOptions.root.c_str(), sOptions.scale, sOptions.seed, &sCorpus, &cError))
+        {
+            fprintf(stderr, "febench: %s\n", cError.c_str());
+            continue;
+        }
+
+        for (unsigned int i = 0; i < sizeof(bench_formats) / sizeof(bench_formats[0]); i++)
+        {
+            const bench_format &sFormat = bench_formats[i];
+            std::string cArchive = "x." + std::string(sFormat.ext);
+            char **ppzRule = psRules->MatchName(cArchive.c_str());
+
+            if (!ppzRule || !Matches(sOptions.match, sCorpus.name.c_str(), sFormat.ext, NULL, NULL))
+                continue; // not in the rules or filtered out
+            if (!HasTool(sFormat.tool))
+            {
+                Skipped(sCorpus, sFormat, "*", std::string(sFormat.tool) + " not found");
+                continue;
+            }
+            if (!Pack(sOptions, sCorpus, sFormat, &cArchive))
+            {
+                Skipped(sCorpus, sFormat, "*", "packing failed");
+                continue;
+            }
+
+            bool bNative = ppzRule[RULE_FORMAT] && IsNativeFormat(ppzRule[RULE_FORMAT]);
+            for (int nEngine = 0; nEngine < ENGINE_COUNT; nEngine++)
+            {
+                if ((nEngine == ENGINE_COMMAND ? !*ppzRule[0] || !*ppzRule[1] : !bNative) ||
+                    !Matches(sOptions.match, sCorpus.name.c_str(), sFormat.ext, engine_names[nEngine], NULL))
+                    continue;
+                if (nEngine == ENGINE_COMMAND)
+                {
+                    std::string cProgram = ppzRule[1];
+                    cProgram = cProgram.substr(0, cProgram.find(' '));
+                    if (!HasTool(cProgram.c_str()))
+                    {
+                        Skipped(sCorpus, sFormat, engine_names[nEngine], cProgram + " not found");
+                        continue;
+                    }
+                }
+                for (int nOp = 0; nOp < OP_COUNT; nOp++)
+                {
+                    // the rules have no test command; listing is the same for both native engines
+                    if ((nOp == OP_TEST && nEngine == ENGINE_COMMAND) || (nOp != OP_EXTRACT && nEngine == ENGINE_SERIAL))
+                        continue;
+                    Measure(sOptions, sCorpus, sFormat, ppzRule, cArchive, nEngine, nOp);
+                }
+            }
+        }
+    }
+}
+
+//
+// output
+//
+
+static std::string CsvField(const std::string &cText)
+{
+    if (cText.find_first_of(",\"\n") == std::string::npos)
+        return cText;
+    std::string cResult = "\"";
+    for (unsigned int i = 0; i < cText.size(); i++)
+        cResult += (cText[i] == '"') ? std::string("\"\"") : std::string(1, cText[i]);
+    return cResult + "\"";
+}
+
+static std::string JsonString(const std::string &cText)
+{
+    std::string cResult = "\"";
+    char zBuf[8];
+
+    for (unsigned int i = 0; i < cText.size(); i++)
+    {
+        unsigned char ch = cText[i];
+        if (ch == '"' || ch == '\\')
+            cResult += '\\', cResult += ch;
+        else if (ch < 0x20)
+        {
+            sprintf(zBuf, "\\u%04x", ch);
+            cResult += zBuf;
+        }
+        else
+            cResult += ch;
+    }
+    return cResult + "\"";
+}
+
+// throughput of the uncompressed data (the fastest run)
+static double Speed(const bench_result &sResult)
+{
+    return sResult.wall_min > 0 ? sResult.bytes / sResult.wall_min / 1048576 : 0;
+}
+
+static bool WriteCsv(const std::string &cPath)
+{
+    FILE *psFile = cPath == "-" ? stdout : fopen(cPath.c_str(), "w");
+    if (!psFile)
+        return false;
+
+    fprintf(psFile, "corpus,format,engine,operation,status,archive_bytes,files,bytes,runs,wall_min_s,wall_median_s,cpu_median_s,mb_per_s\n");
+    for (unsigned int i = 0; i < results.size(); i++)
+    {
+        const bench_result &r = results[i];
+        fprintf(psFile, "%s,%s,%s,%s,%s,%llu,%llu,%llu,%u,%.6f,%.6f,%.6f,%.2f\n", r.corpus.c_str(), r.format.c_str(),
+                r.engine.c_str(), r.op.c_str(), CsvField(r.status).c_str(), (unsigned long long)r.archive_size,
+                (unsigned long long)r.files, (unsigned long long)r.bytes, r.runs, r.wall_min, r.wall_median, r.cpu_median, Speed(r));
+    }
+    return psFile == stdout ? fflush(psFile) == 0 : fclose(psFile) == 0;
+}
+
+static bool WriteJson(const std::string &cPath, const bench_options &sOptions)
+{
+    FILE *psFile = cPath == "-" ? stdout : fopen(cPath.c_str(), "w");
+    struct utsname sName;
+    char zDate[32];
+    time_t nNow = time(NULL);
+
+    if (!psFile)
+        return false;
+    uname(&sName);
+    strftime(zDate, sizeof(zDate), "%Y-%m-%dT%H:%M:%SZ", gmtime(&nNow));
+
+    fprintf(psFile, "{\n  \"tool\": \"febench\",\n  \"version\": \"%s\",\n  \"date\": \"%s\",\n", BENCH_VERSION, zDate);
+    fprintf(psFile, "  \"host\": %s,\n  \"system\": %s,\n  \"processors\": %ld,\n", JsonString(sName.nodename).c_str(),
+            JsonString(std::string(sName.sysname) + " " + sName.release + " " + sName.machine).c_str(), sysconf(_SC_NPROCESSORS_ONLN));
+    fprintf(psFile, "  \"scale\": %u,\n  \"seed\": %llu,\n  \"repeats\": %u,\n  \"results\": [", sOptions.scale,
+            (unsigned long long)sOptions.seed, sOptions.repeats);
+    for (unsigned int i = 0; i < results.size(); i++)
+    {
+        const bench_result &r = results[i];
+        fprintf(psFile, "%s\n    {\"corpus\": %s, \"format\": %s, \"engine\": %s, \"operation\": %s, \"status\": %s, "
+                "\"archive_bytes\": %llu, \"files\": %llu, \"bytes\": %llu, \"runs\": %u, "
+                "\"wall_min_s\": %.6f, \"wall_median_s\": %.6f, \"cpu_median_s\": %.6f, \"mb_per_s\": %.2f}",
+                i ? "," : "", JsonString(r.corpus).c_str(), JsonString(r.format).c_str(), JsonString(r.engine).c_str(),
+                JsonString(r.op).c_str(), JsonString(r.status).c_str(), (unsigned long long)r.archive_size,
+                (unsigned long long)r.files, (unsigned long long)r.bytes, r.runs, r.wall_min, r.wall_median, r.cpu_median, Speed(r));
+    }
+    fprintf(psFile, "\n  ]\n}\n");
+    return psFile == stdout ? fflush(psFile) == 0 : fclose(psFile) == 0;
+}
+
+static void Usage(const char *pzName)
+{
+    fprintf(stderr, "FileExpander benchmark " BENCH_VERSION "\n"
+        "Using: %s [options]\n"
+        "  -w folder   corpora, archives and expanded files (default " BENCH_WORKDIR ")\n"
+        "  -f rules    rules file (default " BENCH_RULES ")\n"
+        "  -s percent  corpus size (default %d)\n"
+        "  -S seed     corpus generator seed (default %d)\n"
+        "  -r count    runs of every operation (default %d)\n"
+        "  -m pattern  only corpus/format/engine/operation matching it, e.g. \"tiny/tar.*/*/extract\"\n"
+        "  -c file     CSV results (default standard output)\n"
+        "  -j file     JSON results\n", pzName, BENCH_SCALE, BENCH_SEED, BENCH_REPEATS);
+}
+
+int main(int argc, char *argv[])
+{
+    bench_options sOptions;
+    int nOption;
+
+    sOptions.root = BENCH_WORKDIR;
+    sOptions.rules = BENCH_RULES;
+    sOptions.csv = "-";
+    sOptions.scale = BENCH_SCALE;
+    sOptions.repeats = BENCH_REPEATS;
+    sOptions.seed = BENCH_SEED;
+
+    while ((nOption = getopt(argc, argv, "w:f:s:S:r:m:c:j:h")) != -1)
+    {
+        switch (nOption)
+        {
+            case 'w': sOptions.root = optarg; break;
+            case 'f': sOptions.rules = optarg; break;
+            case 's': sOptions.scale = strtoul(optarg, NULL, 10); break;
+            case 'S': sOptions.seed = strtoull(optarg, NULL, 10); break;
+            case 'r': sOptions.repeats = strtoul(optarg, NULL, 10); break;
+            case 'm': sOptions.match = optarg; break;
+            case 'c': sOptions.csv = optarg; break;
+            case 'j': sOptions.json = optarg; break;
+            default:
+                Usage(argv[0]);
+                return 1;
+        }
+    }
+    if (!sOptions.scale || !sOptions.repeats)
+    {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    RuleTable *psRules = RuleTable::Load(sOptions.rules.c_str(), NULL);
+    if (!psRules)
+    {
+        fprintf(stderr, "febench: can't read rules %s\n", sOptions.rules.c_str());
+        return 1;
+    }
+    mkdir(sOptions.root.c_str(), 0755);
+    char *pzRoot = realpath(sOptions.root.c_str(), NULL);
+    if (!pzRoot)
+    {
+        fprintf(stderr, "febench: %s: %s\n", sOptions.root.c_str(), strerror(errno));
+        return 1;
+    }
+    sOptions.root = pzRoot;
+    free(pzRoot);
+
+    Run(sOptions, psRules);
+    psRules->Release();
+
+    bool bResult = WriteCsv(sOptions.csv);
+    if (!sOptions.json.empty())
+        bResult = WriteJson(sOptions.json, sOptions) && bResult;
+    if (!bResult)
+        fprintf(stderr, "febench: can't write results\n");
+
+    // errors and mismatches make the run fail (skipped formats don't), and so
+    // does a run which measured nothing
+    unsigned int nMeasured = 0;
+    for (unsigned int i = 0; i < results.size(); i++)
+    {
+        if (!results[i].status.compare(0, 2, "ok"))
+            nMeasured++;
+        else if (results[i].status.compare(0, 7, "skipped"))
+            bResult = false;
+    }
+    if (!nMeasured)
+    {
+        fprintf(stderr, "febench: nothing was measured (check -m)\n");
+        bResult = false;
+    }
+    return bResult ? 0 : 2;
+}
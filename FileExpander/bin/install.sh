@@ -20,6 +20,7 @@ if [ $ACCEPT_LICENSE == "y" ]; then
     cp -f ./FileExpander /system/bin/FileExpander
     cp -L -f ./FileExpander.rules /etc/FileExpander.rules
     cp -f ./scripts/unpack-fe /usr/bin/unpack-fe
+    mkdir -p /usr/lib/FileExpander
 
     # linking LBrowser
     if [ -e "/system/bin/FileBrowser" ]
@@ -43,6 +44,8 @@ if [ $ACCEPT_LICENSE == "y" ]; then
             ./ftreg "tar.gz file" application/x-gtar /system/bin/FileExpander /system/icons/filetypes/tgz-file.png tgz tar.gz
             ./ftreg "tar.bz2 file" application/x-btar /system/bin/FileExpander /system/icons/filetypes/tbz-file.png tbz tar.bz2
             ./ftreg "tar.Z file" application/x-ztar /system/bin/FileExpander /system/icons/filetypes/Z-file.png tar.Z
+            ./ftreg "tar.xz file" application/x-xz-compressed-tar /system/bin/FileExpander /system/icons/filetypes/tar-file.png txz tar.xz
+            ./ftreg "tar.zst file" application/x-zstd-compressed-tar /system/bin/FileExpander /system/icons/filetypes/tar-file.png tzst tar.zst
             ./ftreg "tar file" application/x-tar /system/bin/FileExpander /system/icons/filetypes/tar-file.png tar
             ./ftreg "gzip file" application/x-gzip /system/bin/FileExpander /system/icons/filetypes/gzip-file.png gz
             ./ftreg "bzip2 file" application/x-bzip /system/bin/FileExpander /system/icons/filetypes/bzip2-file.png bz2
@@ -19,10 +19,13 @@
 
 // Headers
 #include <fcntl.h>
+#include <errno.h>
 #include <unistd.h>
 #include <libgen.h>
 #include <signal.h>
 #include <wait.h>
+#include <atheos/threads.h>
+#include <atheos/time.h>
 #include <atheos/filesystem.h>
 #include <atheos/fs_attribs.h>
 #include <util/invoker.h>
@@ -42,28 +45,46 @@
 #include <gui/checkbox.h>
 #include <gui/image.h>
 #include <gui/bitmap.h>
+#include <storage/nodemonitor.h>
+#include <storage/registrar.h>
 #include <iostream>
 #include "etextview.h"
+#include "rules.h"
+#include "extract.h"
+#include "cache.h"
+#include "seekindex.h"
+#include "space.h"
+#include "convert.h"
+#include "search.h"
+#include "catalog.h"
+#include "pathtrie.h"
+#include "plugin.h"
+#include "prefetch.h"
+#include "errlog.h"
+#include "launch.h"
+#include "throttle.h"
+#include "trace.h"
+#include "spool.h"
 
 // Constants
 #define GUI_FILE_BROWSER "FileBrowser"
 #define SHELL "/bin/bash"
 #define EXPANDER_VERSION "0.7.1"
 #define EXPANDER_SETTINGS "config/FileExpander.cfg"
+#define EXPANDER_TIMING "FILEEXPANDER_TIMING"
+#define EXPANDER_TRACE "FILEEXPANDER_TRACE" // folder of trace files (or any other value)
 
 enum Expander_Settings
 {
     EXPANDER_EXTRA = 300,
     EXPANDER_EXTRA_BORDER = 10,
     TEXTBUF_MAXINDEX = 4095,
-    HASH_SIZE = 256,
-    HASH_COUNT = 2,
-    HASH_FULL_SIZE = HASH_SIZE * HASH_COUNT,
-    HASH_MULTIPLIER = 31,
-    RULE_COUNT = 2,
     STATUS_STRING = 15,
-    FBROWSERLEN = 12,
-    COMMAND_MAX = 2 * PATH_MAX
+    EXPANDER_HEIGHT = 125,
+    WINDOW_CASCADE = 20, // offset of every next window
+    TREE_STATUS_STEP = 65536, // members between listing status updates
+    COMMAND_MAX = 2 * PATH_MAX,
+    LIST_PAGE = 64 * 1048576 // spooled listing text shown at once when there is no memory budget
 };
 
 // Preferences settings
@@ -74,30 +95,44 @@ enum Prefs_Settings
     OPENFOLDER = 04,
     AUTOLISTING = 010,
     DESTFOLDER_BIT1 = 020,
-    DESTFOLDER_BIT2 = 040
-    // free: 0100 (for 1 byte)
-    // free: 0200 (for 1 byte)
+    DESTFOLDER_BIT2 = 040,
+    MANIFEST = 0100,
+    UPDATE = 0200
 };
 
-static char prefs_settings; // preferences variable
-
-// Expander status
-static char StatusBuffer[NAME_MAX + STATUS_STRING + 1] = "Expanding file ";
-
-// File browser execute command
-static char g_pzFileBrowser[FBROWSERLEN + PATH_MAX + 15] = GUI_FILE_BROWSER " ";
-
-// Hash struct
-struct hash_struct
+// Extended preferences (stored after NUL-terminated destination path)
+enum Prefs_Extra
 {
-   char *name;
-   char **rule;
-   hash_struct *next;
+    UPDATE_CRC = 01,
+    TREE_LISTING = 02, // contents as folder tree (native formats)
+    LINK_IDENTICAL = 04, // members with equal contents are linked
+    BACKGROUND = 010, // new windows expand in background
+    SYNC_FILES = 020, // files are on disk when expanding is done
+    ATOMIC_EXPAND = 040, // expanded into a hidden folder moved into place when complete
+    TRACE_JOBS = 0100 // phases of list and extract jobs are traced
 };
 
-// Global variables
-static char *defDestPath, *pzTextBuffer, **rule;
-static hash_struct **hash_table;
+// Preferences are shared by all windows of the application; a job takes
+// a copy of the ones it needs when it is started
+static char prefs_settings; // preferences variable
+static uint32 prefs_extra;
+static uint32 prefs_limit; // writing limit of background expanding (MB/s, 0 - none)
+static uint32 prefs_memory = 64; // listing text kept in memory (MB, 0 - no limit); the rest is spooled
+static char defDestPath[PATH_MAX + 1];
+
+// Rules loading thread (rules are parsed while the window is being shown
+// and rebuilt when rules files are changed)
+static thread_id rules_thread = -1;
+static volatile bool rules_ready = false;
+
+// Startup timing
+static bigtime_t startup_time;
+enum Startup_Event
+{
+    STARTUP_RULES = 01,
+    STARTUP_RESOURCES = 02 // deferred resources of the first window
+};
+static volatile int startup_pending = STARTUP_RULES | STARTUP_RESOURCES;
 
 // Main window errors
 const static char *ExpanderError[] =
@@ -106,7 +141,10 @@ const static char *ExpanderError[] =
     "Source file not found! ",
     "Source is a directory! ",
     "Unrecognized file format! ",
-    "File unpacking/listing in progress now! "
+    "File unpacking/listing in progress now! ",
+    "Members of this archive can't be opened! ",
+    "This archive can't be converted! ",
+    "Unknown target format (use .tar, .tar.gz, .tar.bz2, .tar.xz or .tar.zst)! "
 };
 
 //
@@ -116,7 +154,8 @@ const static char *ExpanderStatus[] =
 {
     "Expanding aborted",
     "File expanded",
-    "Error occurred"
+    "Error occurred",
+    "Converting aborted"
 };
 
 //
@@ -135,7 +174,8 @@ static struct g_sExpanderMenuItem {
 
     // File
     { "Set source...", "Ctrl+S", "source16x16.png" }, { "Set destination...", "Ctrl+D", "dest16x16.png" }, { "Set password...", "Ctrl+W", "passw16x16.png" },
-    { "", NULL, NULL }, { "Expand", "Ctrl+E", "expand16x16.png" }, { "Show contents", "Ctrl+L", "show16x16.png" },
+    { "", NULL, NULL }, { "Expand", "Ctrl+E", "expand16x16.png" }, { "Convert to...", "Ctrl+T", NULL },
+    { "Show contents", "Ctrl+L", "show16x16.png" }, { "Find in archive...", "Ctrl+F", NULL },
     { NULL, NULL, NULL },
 
     // Edit
@@ -153,15 +193,59 @@ static char *g_apzFE_Bitmap[] = {
 // "C"-style functions
 extern "C" {
     static void ExpanderList(void *pData);
+    static void ExpanderTreeList(void *pData);
     static void ExpanderExtract(void *pData);
-    static unsigned int hash(char *p);
+    static void ExpanderNativeExtract(void *pData);
+    static void ExpanderConvert(void *pData);
+    static void ExpanderSearch(void *pData);
+    static void ExpanderOpenMember(void *pData);
+    static void ExpanderIndex(void *pData);
+    static void ExpanderRules(void *pData);
 }
 
 // "C++"-style functions
 os::Bitmap *CopyBitmap(os::Bitmap *pcSrcIcon);
+static void StartupTiming(const char *pzEvent);
+static void ApplyTracing();
+static void StartupReady(int nEvent);
+static void WaitForRules();
+static void ExtractLog(void *pData, const char *pzText);
+static bool PrefetchFormat(void *pData, const char *pzPath, std::string *pcFormat);
+static void LaunchOpen(void *pData, const std::vector<std::string> &acPaths);
 
 class ExpanderWindow;
 
+// Listing of the source (a newer one supersedes it)
+struct list_request
+{
+    ExpanderWindow *window;
+    int generation; // the window's listing generation when it was started
+    std::string source, format, password; // folder tree listing
+    Prefetch *prefetch; // speculative listing of the source (or NULL)
+    trace_job *trace; // phases of the listing (NULL - not traced)
+    uint64_t budget; // bytes of text put into the pane (0 - no limit)
+};
+
+// Seek index of a listed archive; the window deletes it after its thread
+// is done (a superseded one is cancelled and runs out meanwhile)
+struct index_request
+{
+    std::string source, format;
+    volatile bool cancel, done;
+    thread_id thread;
+};
+
+// Archive member to be opened from the listing
+struct member_request
+{
+    ExpanderWindow *window;
+    std::string archive, format, line;
+};
+
+static void OpenFolder(const char *pzPath);
+static void ExtractFinished(ExpanderWindow *expwin, bool bError, bool bAborted, const char *pzReport = NULL);
+static bool SpaceCheck(ExpanderWindow *expwin);
+
 class ExpanderPassw : public os::Window
 {
     public:
@@ -183,6 +267,45 @@ class ExpanderPassw : public os::Window
         };
 };
 
+// "Find in archive" window (the path may be an archive or a folder of archives)
+class ExpanderFind : public os::Window
+{
+    public:
+        ExpanderFind(ExpanderWindow *pcParent, const char *pzPath);
+        virtual bool OkToQuit();
+        virtual void HandleMessage(os::Message *pcMessage);
+        virtual ~ExpanderFind();
+        bool IsSearching() const { return m_bBusy; }
+        void AddText(const char *pzText);
+
+        enum m_eFindMessages {
+            M_FIND_START,
+            M_FIND_INDEX,
+            M_FIND_DONE
+        };
+
+        enum Find_Mode {
+            FIND_SCAN, // reading archives
+            FIND_CATALOG, // member names from the catalog
+            FIND_INDEX // updating the catalog
+        };
+
+        Matcher m_cMatcher;
+        SearchJob *m_psSearch; // FIND_SCAN
+        int m_nMode;
+        volatile bool m_bCancel;
+        std::string m_cPath;
+    private:
+        ExpanderWindow *m_pcParent;
+        os::View *m_pcView;
+        os::TextView *m_pcPattern, *m_pcPath, *m_pcResults;
+        os::CheckBox *m_pcRegex, *m_pcIgnoreCase, *m_pcNamesOnly, *m_pcCatalog;
+        os::StringView *m_pcStatus;
+        os::Button *m_pcFind, *m_pcIndex;
+        bool m_bBusy;
+        bool m_bClose; // closing when the search is stopped
+};
+
 class ExpanderPreferences : public os::Window
 {
 public:
@@ -201,7 +324,14 @@ private:
         M_PREF_USE_DIR,
         M_PREF_SELECT,
         M_PREF_OPEN_DIST_EXTR,
-        M_PREF_AUTO_CONTENTS
+        M_PREF_AUTO_CONTENTS,
+        M_PREF_MANIFEST,
+        M_PREF_UPDATE,
+        M_PREF_TREE,
+        M_PREF_LINK,
+        M_PREF_BACKGROUND,
+        M_PREF_SYNC,
+        M_PREF_TRACE
     };
 
     void SetPrefBit(bool nValue, int nBit);
@@ -211,7 +341,10 @@ private:
     ExpanderWindow *m_pcParent;
     os::Button *m_pcSaveButton, *m_pcCancelButton, *m_pcSelectButton;
     os::StringView *m_pcExpansionString, *m_pcDestination, *m_pcOtherString;
-    os::CheckBox *m_pcAutoExpand, *m_pcCloseWindow, *m_pcOpenDistExtr, *m_pcAutoContents;
+    os::CheckBox *m_pcAutoExpand, *m_pcCloseWindow, *m_pcOpenDistExtr, *m_pcAutoContents, *m_pcManifest;
+    os::CheckBox *m_pcUpdate, *m_pcUpdateCrc, *m_pcTree, *m_pcLink, *m_pcBackground, *m_pcSync, *m_pcAtomic, *m_pcTrace;
+    os::StringView *m_pcLimitString, *m_pcLimitUnit, *m_pcMemoryString, *m_pcMemoryUnit;
+    os::TextView *m_pcLimitText, *m_pcMemoryText;
     os::RadioButton *m_pcLeaveEmpty, *m_pcSameDir, *m_pcUseDir;
     os::TextView *m_pcDirText;
     os::FileRequester *m_pcFileReq;
@@ -225,10 +358,29 @@ class ExpanderErrors : public os::Window
 public:
     ExpanderErrors(const os::Rect &cFrame, ExpanderWindow *parentWindow);
     void AddErrorText();
+    virtual void HandleMessage(os::Message *pcMessage);
     virtual ~ExpanderErrors();
     os::TextView *m_pcErrorText;
     os::View *m_pcView;
     ExpanderWindow *m_pcParent;
+    ErrorLog *m_psLog; // messages of the job (the window shows a summary)
+    os::FileRequester *m_pcSaveLog;
+
+    enum Errors_Index
+    {
+        M_ERR_SAVE,
+        M_ERR_SAVE_PATH
+    };
+};
+
+// Main view (notes the first paint for startup timing)
+class ExpanderView : public os::View
+{
+public:
+    ExpanderView(const os::Rect &cFrame, const os::String &cTitle, uint32 nResizeMask);
+    virtual void Paint(const os::Rect &cUpdateRect);
+private:
+    bool m_bPainted;
 };
 
 class ExpanderWindow : public os::Window
@@ -237,19 +389,51 @@ public:
     ExpanderWindow(const os::Rect &cFrame, const char *pzPath);
     virtual bool OkToQuit();
     void ListUnLock(bool anAction);
+    void StartListing();
+    void ShowListPage(uint64_t nFirst);
+    void SupersedeListing();
+    void StartPrefetch(const char *pzPath);
+    void StopIndexing(bool bCancel, bool bWait);
+    bool IsListCancelled(int nGeneration) const { return nGeneration != m_nListGeneration; }
     void SwitchExpand();
     void UpdateInfo();
+    void ShowMessage(const char *pzText);
+    os::Bitmap *GetBitmap(int nIndex);
     virtual void HandleMessage(os::Message *pcMessage);
     virtual ~ExpanderWindow();
     char *m_sysPath[RULE_COUNT], *CWDPath;
     os::String m_pcPasswString;
     pid_t shell_process, list_process;
-    os::TextView *pcListArchive;
+    EtextView *pcListArchive;
     os::StringView *pcExpandStatus;
-    os::CheckBox *m_pcList;
+    os::CheckBox *m_pcList, *m_pcBackground;
     ExpanderPreferences *m_pcPrefWind;
     ExpanderPassw *m_pcPasswWind;
+    ExpanderFind *m_pcFindWind;
     ExpanderErrors *m_pcErrWind;
+    ExtractJob *m_psJob; // in-process extraction (NULL for extract commands)
+    trace_job *m_psTrace; // phases of the expanding job (NULL - not traced)
+    std::string m_cJobSource, m_cJobFormat;
+    std::string m_cJobDest; // destination folder (the process never changes its own)
+    int m_nJobDestFd; // opened destination for extract commands (or -1)
+    char m_nJobPrefs; // preferences when the job was started
+    bool m_bJobBackground; // lower priority (and writing throttled for native jobs)
+    bool m_bJobSync; // syncing the destination after an extract command
+    std::string m_cSizeProbe; // size probe command (if the rule has one)
+    std::string m_cJobPassword; // given to the native reader, not to a command line
+    ConvertJob *m_psConvert; // "Convert to..." in progress
+    std::string m_cConvertSource, m_cConvertFormat, m_cConvertTarget;
+    volatile int m_nOpenCount; // members being opened from the listing
+    std::vector<index_request *> m_apsIndex; // seek index threads (the last one may be running for the listed archive)
+    PathTrie *m_psTrie; // listing shown as folder tree (NULL for list commands)
+    std::vector<uint32_t> m_anTrieLine; // node of every listing line
+    volatile bool m_bTreeListing;
+    volatile int m_nListGeneration; // bumped when a listing is superseded
+    volatile int m_nListThreads; // running (also superseded) listing threads
+    LineSpool *m_psSpool; // listing beyond the memory budget (NULL if it fits into the pane)
+    uint64_t m_nPageFirst; // first spooled line shown
+    unsigned int m_nPageLines;
+    Prefetch *m_psPrefetch; // speculative work on the chosen source
     bool m_cExpandList, m_nPasswEnable, IsNotFullyListed;
 
     enum Window_Index
@@ -261,7 +445,9 @@ public:
         M_MENU_FILE_DEST,
         M_MENU_FILE_PASSW,
         M_MENU_FILE_EXPAND,
+        M_MENU_FILE_CONVERT,
         M_MENU_FILE_LIST,
+        M_MENU_FILE_FIND,
         M_MENU_EDIT_CUT,
         M_MENU_EDIT_COPY,
         M_MENU_EDIT_PASTE,
@@ -270,10 +456,14 @@ public:
         MENU_ITEM_COUNT, // count of menu items
         M_FILEREQ_LOAD,
         M_FILEREQ_SAVE,
+        M_FILEREQ_CONVERT,
         M_CHECKBOX_LIST,
+        M_CHECKBOX_BACKGROUND,
         M_TEXTVIEW_SOURCE,
         M_TEXTVIEW_DEST,
-        M_TEXTVIEW_LIST
+        M_TEXTVIEW_LIST,
+        M_LIST_OPEN,
+        M_DEFERRED_INIT
     };
 
     enum m_eFE_Bitmaps {
@@ -296,7 +486,10 @@ private:
         ERR_SOURCE_NOT_FOUND,
         ERR_SOURCE_IS_DIR,
         ERR_UNKNOWN_FORMAT,
-        ERR_QUIT
+        ERR_QUIT,
+        ERR_NO_MEMBER_OPEN,
+        ERR_NO_CONVERT,
+        ERR_CONVERT_FORMAT
     };
 
     enum Menu_Index
@@ -311,15 +504,20 @@ private:
     void ShowError(int nCode);
     void UpdatingMenu(os::Menu *menuName, bool expr, os::MenuItem *trueItem, os::MenuItem *falseItem);
     void SetFunctionsEnable(bool bStatus);
+    void LoadIcons();
+    os::FileRequester *GetFileRequester(bool bSource);
     char *GetSource(char *srcPath);
     bool GetRule(unsigned int i, char *pzText);
     os::Menu *pcMenuBar, *m_pcMenu[MENU_COUNT];
     os::MenuItem *hideList, *stopMenuItem, *m_pcMenuItem[MENU_ITEM_COUNT];
-    os::FileRequester *pcSetSource, *pcSetDest;
+    os::FileRequester *pcSetSource, *pcSetDest, *pcConvertTarget;
     os::Button *pcSourceButton, *pcDestButton, *pcExpandButton, *pcStopButton;
     os::TextView *pcSourceText, *pcDestText, *curTextView;
     os::View *m_pcView;
-    char *m_oldListPath, *m_pcStatusBuffer;
+    char *m_oldListPath;
+    char m_zStatusBuffer[NAME_MAX + STATUS_STRING + 1];
+    RuleTable *m_psRules; // rules which the current rule belongs to
+    char **m_ppzRule; // the current rule (in m_psRules)
 
     // flags
     bool IsExpand, IsFileReq;
@@ -328,26 +526,54 @@ private:
 class ExpanderApp : public os::Application
 {
     public:
-        ExpanderApp(const char *pzParams);
+        ExpanderApp(int nCount, char **ppzParams, LaunchForward *psLaunch);
+        void LoadRules();
+        void OpenWindow(const char *pzPath);
+        virtual void HandleMessage(os::Message *pcMessage);
         virtual bool OkToQuit();
         virtual ~ExpanderApp();
+
+        enum App_Messages {
+            M_RULES_LOADED = 1,
+            M_WINDOW_CLOSED,
+            M_OPEN_WINDOWS, // forwarded by a later launch
+            M_LAST_WINDOW
+        };
     private:
-        ExpanderWindow *m_pcWind;
-        struct hash_struct *elem, **hash_ptr;
-        char *FileBuf;
+
+        enum Monitor_Index {
+            MONITOR_SYSTEM_RULES,
+            MONITOR_USER_RULES,
+            MONITOR_USER_CONFIG,
+            MONITOR_COUNT
+        };
+
+        void ReloadRules();
+        void WatchRules();
+
+        std::vector<ExpanderWindow *> m_apcWind; // every window hosts its own jobs
+        os::Rect m_cWindowFrame; // frame of the next window
+        bool m_bStarted; // rules file was found
+        LaunchForward *m_psLaunch; // serving later launches (or NULL)
+        os::NodeMonitor *m_apcMonitor[MONITOR_COUNT];
+        os::String m_cUserRules;
+        bool m_bReloading, m_bReloadAgain;
 };
 
 // ExpanderWindow constructor
 ExpanderWindow::ExpanderWindow(const os::Rect &aRect, const char *pzPath)
     : os::Window(aRect, "FileExpander", "FileExpander", os::WND_NOT_V_RESIZABLE | os::WND_NO_ZOOM_BUT),
-      m_pcPasswString(""), shell_process(0), list_process(0), m_pcPrefWind(NULL), m_pcPasswWind(NULL),
-      m_cExpandList(false), m_nPasswEnable(false), IsNotFullyListed(true), curTextView(NULL),
-      m_pcStatusBuffer(StatusBuffer + STATUS_STRING), IsExpand(true), IsFileReq(false)
+      m_pcPasswString(""), shell_process(0), list_process(0), m_pcPrefWind(NULL), m_pcPasswWind(NULL), m_pcFindWind(NULL), m_psJob(NULL), m_psConvert(NULL), m_nOpenCount(0),
+      m_psTrie(NULL), m_bTreeListing(false), m_nListGeneration(0), m_nListThreads(0), m_psSpool(NULL), m_psPrefetch(NULL), m_cExpandList(false), m_nPasswEnable(false), IsNotFullyListed(true), pcSetSource(NULL), pcSetDest(NULL), pcConvertTarget(NULL),
+      curTextView(NULL), m_psRules(NULL), m_ppzRule(NULL), IsExpand(true), IsFileReq(false)
 {
-    os::ResStream *pcResStream;
     os::Rect rect = GetBounds();
 
     CWDPath = getcwd(NULL, 0);
+    m_nJobDestFd = -1;
+    m_bJobBackground = m_bJobSync = false;
+    m_psTrace = NULL;
+    strcpy(m_zStatusBuffer, "Expanding file ");
     os::Rect cMenuRect = rect;
     cMenuRect.bottom = 18.0f;
     rect.top = 19.0f;
@@ -358,18 +584,15 @@ ExpanderWindow::ExpanderWindow(const os::Rect &aRect, const char *pzPath)
         m_sysPath[i] = new char[COMMAND_MAX + 1];
     m_oldListPath = new char[COMMAND_MAX + 1];
 
-    // open resources
-    os::Resources pcFEResources(get_image_id());
+    // bitmaps are decoded on the first use (see GetBitmap)
+    for (i = 0; i < FEBITMAP_COUNT; i++)
+        m_apcBitmap[i] = NULL;
 
-    // creating dynamic objects
-    pcResStream = pcFEResources.GetResourceStream("hide16x16.png");
-    hideList = new os::MenuItem("Hide contents", new os::Message(M_MENU_FILE_LIST), "Ctrl+L", new os::BitmapImage(pcResStream));
-    delete pcResStream;
+    // creating dynamic objects (icons are attached later by LoadIcons)
+    hideList = new os::MenuItem("Hide contents", new os::Message(M_MENU_FILE_LIST), "Ctrl+L");
     hideList->SetTarget(this);
 
-    pcResStream = pcFEResources.GetResourceStream("stop16x16.png");
-    stopMenuItem = new os::MenuItem("Stop", new os::Message(M_MENU_FILE_EXPAND), "Ctrl+S", new os::BitmapImage(pcResStream));
-    delete pcResStream;
+    stopMenuItem = new os::MenuItem("Stop", new os::Message(M_MENU_FILE_EXPAND), "Ctrl+S");
     stopMenuItem->SetTarget(this);
 
     // creating and attaching menu
@@ -391,14 +614,9 @@ ExpanderWindow::ExpanderWindow(const os::Rect &aRect, const char *pzPath)
                     tmpMenu->AddItem(new os::MenuSeparator);
                     break;
                 default:
-                {
-                    pcResStream = psMenuItem->icon ? pcFEResources.GetResourceStream(psMenuItem->icon) : NULL;
-                    m_pcMenuItem[i] = new os::MenuItem(psMenuItem->title, new os::Message(i), psMenuItem->shortcut,  pcResStream ? new os::BitmapImage(pcResStream) : NULL);
-                    if (pcResStream)
-                        delete pcResStream;
+                    m_pcMenuItem[i] = new os::MenuItem(psMenuItem->title, new os::Message(i), psMenuItem->shortcut);
                     tmpMenu->AddItem(m_pcMenuItem[i++]);
                     break;
-                }
             }
             psMenuItem++;
         }
@@ -409,7 +627,7 @@ ExpanderWindow::ExpanderWindow(const os::Rect &aRect, const char *pzPath)
     AddChild(pcMenuBar);
 
     // creating Expander View
-    m_pcView = new os::View(rect, "expander_view", os::CF_FOLLOW_ALL);
+    m_pcView = new ExpanderView(rect, "expander_view", os::CF_FOLLOW_ALL);
     AddChild(m_pcView);
     SetFocusChild(m_pcView);
 
@@ -439,8 +657,13 @@ ExpanderWindow::ExpanderWindow(const os::Rect &aRect, const char *pzPath)
     m_pcList = new os::CheckBox(os::Rect(rect.right - 120, 75, rect.right - 15, 90), "archive_list", "  Show contents", new os::Message(M_CHECKBOX_LIST), os::CF_FOLLOW_RIGHT);
     m_pcView->AddChild(m_pcList);
 
+    // the next expansion of this window runs in background (preferences give the default)
+    m_pcBackground = new os::CheckBox(os::Rect(rect.right - 215, 75, rect.right - 125, 90), "background", "  Background", new os::Message(M_CHECKBOX_BACKGROUND), os::CF_FOLLOW_RIGHT);
+    m_pcBackground->SetValue(prefs_extra & BACKGROUND, false);
+    m_pcView->AddChild(m_pcBackground);
+
     // creating StringView object
-    pcExpandStatus = new os::StringView(os::Rect(100, 75, rect.right - 130, 90), "expand_status", "", os::ALIGN_LEFT, os::CF_FOLLOW_LEFT | os::CF_FOLLOW_RIGHT);
+    pcExpandStatus = new os::StringView(os::Rect(100, 75, rect.right - 225, 90), "expand_status", "", os::ALIGN_LEFT, os::CF_FOLLOW_LEFT | os::CF_FOLLOW_RIGHT);
     m_pcView->AddChild(pcExpandStatus);
 
     // creating and adding TextView object (list archive)
@@ -450,55 +673,110 @@ ExpanderWindow::ExpanderWindow(const os::Rect &aRect, const char *pzPath)
     pcListArchive->SetMultiLine();
     pcListArchive->SetMessage(new os::Message(M_TEXTVIEW_LIST));
     pcListArchive->SetMaxUndoSize(0);
+    pcListArchive->SetOpenMessage(new os::Message(M_LIST_OPEN));
     os::Font *pcListFont = new os::Font(DEFAULT_FONT_FIXED);
     pcListArchive->SetFont(pcListFont);
     m_pcView->AddChild(pcListArchive);
 
+    // set destination path
+    UpdateInfo();
+
+    // source from the command line is read ahead while the window appears
+    StartPrefetch(pzPath);
+
+    // icons are decoded when the window is already on the screen
+    PostMessage(M_DEFERRED_INIT, this);
+}
+
+// LoadIcons - attaching menu and window icons (deferred from the constructor)
+void ExpanderWindow::LoadIcons()
+{
+    os::Resources pcFEResources(get_image_id());
+    os::ResStream *pcResStream;
+    struct g_sExpanderMenuItem *psMenuItem = g_asExpanderMenuItem;
+    char **ExpMenu = ExpanderMenu;
+    int i = 0;
+
+    // menu items (the same order as in the constructor)
+    for (; *ExpMenu; ExpMenu++, psMenuItem++)
+    {
+        for (; psMenuItem->title; psMenuItem++)
+        {
+            if (!*(psMenuItem->title))
+                continue;
+            if (psMenuItem->icon && (pcResStream = pcFEResources.GetResourceStream(psMenuItem->icon)))
+            {
+                m_pcMenuItem[i]->SetImage(new os::BitmapImage(pcResStream));
+                delete pcResStream;
+            }
+            i++;
+        }
+    }
+
+    pcResStream = pcFEResources.GetResourceStream("hide16x16.png");
+    hideList->SetImage(new os::BitmapImage(pcResStream));
+    delete pcResStream;
+
+    pcResStream = pcFEResources.GetResourceStream("stop16x16.png");
+    stopMenuItem->SetImage(new os::BitmapImage(pcResStream));
+    delete pcResStream;
+
     // window icon
     pcResStream = pcFEResources.GetResourceStream("icon24x24.png");
     os::BitmapImage *pcBitmapImage = new os::BitmapImage(pcResStream);
     delete pcResStream;
     SetIcon(pcBitmapImage->LockBitmap());
     delete pcBitmapImage;
+}
 
-    // set destination path
-    UpdateInfo();
-
-    // filerequester dialogs
-    pcResStream = pcFEResources.GetResourceStream("source24x24.png");
-    pcBitmapImage = new os::BitmapImage(pcResStream);
-    delete pcResStream;
-    pcSetSource = new os::FileRequester(os::FileRequester::LOAD_REQ, new os::Messenger(this), NULL, os::FileRequester::NODE_FILE, false, new os::Message(M_FILEREQ_LOAD), NULL, true, true, "Open", "Cancel");
-    pcSetSource->SetIcon(pcBitmapImage->LockBitmap());
-    pcSetSource->Start();
-    delete pcBitmapImage;
+// GetBitmap - decoding bitmap resource on the first use
+os::Bitmap *ExpanderWindow::GetBitmap(int nIndex)
+{
+    if (!m_apcBitmap[nIndex])
+    {
+        os::Resources pcFEResources(get_image_id());
+        os::ResStream *pcResStream = pcFEResources.GetResourceStream(g_apzFE_Bitmap[nIndex]);
+        os::BitmapImage *pcBitmapImage = new os::BitmapImage(pcResStream);
+        delete pcResStream;
+        m_apcBitmap[nIndex] = CopyBitmap(pcBitmapImage->LockBitmap());
+        delete pcBitmapImage;
+    }
+    return m_apcBitmap[nIndex];
+}
 
-    pcResStream = pcFEResources.GetResourceStream("dest24x24.png");
-    pcBitmapImage = new os::BitmapImage(pcResStream);
-    delete pcResStream;
-    pcSetDest = new os::FileRequester(os::FileRequester::LOAD_REQ, new os::Messenger(this), NULL, os::FileRequester::NODE_DIR, false, new os::Message(M_FILEREQ_SAVE), NULL, true, true, "Select", "Cancel");
-    pcSetDest->SetIcon(pcBitmapImage->LockBitmap());
-    pcSetDest->Start();
-    delete pcBitmapImage;
+// GetFileRequester - creating filerequester dialogs on the first use
+os::FileRequester *ExpanderWindow::GetFileRequester(bool bSource)
+{
+    os::FileRequester **ppcFileReq = bSource ? &pcSetSource : &pcSetDest;
 
-    // getting some other bitmaps
-    for (i = 0; i < FEBITMAP_COUNT; i++) {
-        pcResStream = pcFEResources.GetResourceStream(g_apzFE_Bitmap[i]);
-        pcBitmapImage = new os::BitmapImage(pcResStream);
+    if (!*ppcFileReq)
+    {
+        os::Resources pcFEResources(get_image_id());
+        os::ResStream *pcResStream = pcFEResources.GetResourceStream(bSource ? "source24x24.png" : "dest24x24.png");
+        os::BitmapImage *pcBitmapImage = new os::BitmapImage(pcResStream);
         delete pcResStream;
-        m_apcBitmap[i] = CopyBitmap(pcBitmapImage->LockBitmap());
+        if (bSource)
+            *ppcFileReq = new os::FileRequester(os::FileRequester::LOAD_REQ, new os::Messenger(this), NULL, os::FileRequester::NODE_FILE, false, new os::Message(M_FILEREQ_LOAD), NULL, true, true, "Open", "Cancel");
+        else
+            *ppcFileReq = new os::FileRequester(os::FileRequester::LOAD_REQ, new os::Messenger(this), NULL, os::FileRequester::NODE_DIR, false, new os::Message(M_FILEREQ_SAVE), NULL, true, true, "Select", "Cancel");
+        (*ppcFileReq)->SetIcon(pcBitmapImage->LockBitmap());
+        (*ppcFileReq)->Start();
         delete pcBitmapImage;
     }
+    return *ppcFileReq;
 }
 
 // virtual method: OkToQuit
 bool ExpanderWindow::OkToQuit()
 {
-    if (list_process || shell_process)
+    if (list_process || m_nListThreads || shell_process || m_psJob || m_psConvert || m_nOpenCount || (m_pcFindWind && m_pcFindWind->IsSearching()))
         ShowError(ERR_QUIT);
 
     else
     {
+        // index is not needed anymore
+        StopIndexing(true, true);
+
         // save settings
         os::Rect wRect = GetFrame();
 
@@ -514,7 +792,10 @@ bool ExpanderWindow::OkToQuit()
             write(fd, &(wRect.right), sizeof(float));
             write(fd, &(wRect.top), sizeof(float));
             write(fd, &prefs_settings, sizeof(prefs_settings));
-            write(fd, defDestPath, strlen(defDestPath));
+            write(fd, defDestPath, strlen(defDestPath) + 1);
+            write(fd, &prefs_extra, sizeof(prefs_extra));
+            write(fd, &prefs_limit, sizeof(prefs_limit));
+            write(fd, &prefs_memory, sizeof(prefs_memory));
 
             // close file descriptor
             close(fd);
@@ -522,7 +803,11 @@ bool ExpanderWindow::OkToQuit()
         else
             std::cerr << "Error writing settings!" << std::endl;
 
-        os::Application::GetInstance()->PostMessage(os::M_QUIT);
+        // the application quits with its last window
+        os::Message *pcClosed = new os::Message(ExpanderApp::M_WINDOW_CLOSED);
+        pcClosed->AddPointer("window", this);
+        os::Application::GetInstance()->PostMessage(pcClosed);
+        return true;
     }
     return false;
 }
@@ -538,8 +823,8 @@ void ExpanderWindow::HandleMessage(os::Message *pcMessage)
 
         case M_MENU_APPLICATION_ABOUT:
         {
-            os::Alert *pcAbout = new os::Alert("About", "FileExpander " EXPANDER_VERSION "\nGUI files extractor for Syllable\n\nThis program is distributed under the\nterms of GNU GPL 2.0 (see COPYING file) \n\nCopyright (c) 2004 Ruslan Nickolaev\nE-mail: nruslan@hotbox.ru", CopyBitmap(m_apcBitmap[FEBITMAP_ABOUT32X32]), os::WND_NO_CLOSE_BUT | os::WND_NO_ZOOM_BUT | os::WND_NO_DEPTH_BUT | os::WND_NOT_RESIZABLE, "Great", NULL);
-            pcAbout->SetIcon(m_apcBitmap[FEBITMAP_ABOUT24X24]);
+            os::Alert *pcAbout = new os::Alert("About", "FileExpander " EXPANDER_VERSION "\nGUI files extractor for Syllable\n\nThis program is distributed under the\nterms of GNU GPL 2.0 (see COPYING file) \n\nCopyright (c) 2004 Ruslan Nickolaev\nE-mail: nruslan@hotbox.ru", CopyBitmap(GetBitmap(FEBITMAP_ABOUT32X32)), os::WND_NO_CLOSE_BUT | os::WND_NO_ZOOM_BUT | os::WND_NO_DEPTH_BUT | os::WND_NOT_RESIZABLE, "Great", NULL);
+            pcAbout->SetIcon(GetBitmap(FEBITMAP_ABOUT24X24));
             pcAbout->CenterInWindow(this);
             pcAbout->Go(new os::Invoker);
             break;
@@ -549,7 +834,7 @@ void ExpanderWindow::HandleMessage(os::Message *pcMessage)
             if (!IsFileReq)
             {
                 IsFileReq = true;
-                pcSetSource->CenterInWindow(this);
+                GetFileRequester(true)->CenterInWindow(this);
                 pcSetSource->Show();
                 pcSetSource->MakeFocus();
             }
@@ -559,7 +844,7 @@ void ExpanderWindow::HandleMessage(os::Message *pcMessage)
             if (!IsFileReq)
             {
                 IsFileReq = true;
-                pcSetDest->CenterInWindow(this);
+                GetFileRequester(false)->CenterInWindow(this);
                 pcSetDest->Show();
                 pcSetDest->MakeFocus();
             }
@@ -569,11 +854,23 @@ void ExpanderWindow::HandleMessage(os::Message *pcMessage)
 	    {
             const char *SourcePath;
             if (pcMessage->FindString("file/path", &SourcePath) == 0)
+            {
                 pcSourceText->Set(SourcePath);
+                StartPrefetch(SourcePath);
+            }
             IsFileReq = false;
             UpdateInfo();
             if (m_pcList->GetValue())
-                m_pcList->SetValue(false, true);
+            {
+                // the listing in progress is superseded by the new source
+                if (list_process || m_bTreeListing)
+                {
+                    SupersedeListing();
+                    StartListing();
+                }
+                else
+                    m_pcList->SetValue(false, true);
+            }
             break;
         }
 
@@ -591,6 +888,39 @@ void ExpanderWindow::HandleMessage(os::Message *pcMessage)
             IsFileReq = false;
             break;
 
+        case M_FILEREQ_CONVERT:
+        {
+            const char *TargetPath;
+            IsFileReq = false;
+            if (!IsExpand || pcMessage->FindString("file/path", &TargetPath) != 0)
+                break;
+            const char *pzFormat = GetConvertFormat(TargetPath);
+            if (!pzFormat)
+            {
+                ShowError(ERR_CONVERT_FORMAT);
+                break;
+            }
+
+            SwitchExpand();
+            std::string cStatus = "Converting ";
+            cStatus += m_cConvertSource.substr(m_cConvertSource.rfind('/') + 1);
+            pcExpandStatus->SetString(cStatus.c_str());
+
+            m_pcErrWind = new ExpanderErrors(os::Rect(0, 0, 400, 300), this);
+            m_pcErrWind->CenterInWindow(this);
+
+            m_cJobSource = m_cConvertSource;
+            m_cJobFormat = m_cConvertFormat;
+            m_cConvertTarget = TargetPath;
+            m_cConvertFormat = pzFormat;
+            if (m_nPasswEnable)
+                m_cJobPassword = m_pcPasswString.c_str();
+            m_psConvert = new ConvertJob(ExtractLog, this);
+            thread_id convert_thread = spawn_thread("expander convert", (void *)ExpanderConvert, NORMAL_PRIORITY, 0, this);
+            resume_thread(convert_thread);
+            break;
+        }
+
         case M_MENU_FILE_PASSW:
         {
             if (!m_pcPasswWind)
@@ -611,37 +941,104 @@ void ExpanderWindow::HandleMessage(os::Message *pcMessage)
                 SwitchExpand();
                 pcExpandStatus->SetString("");
                 char *sourcePath = (char *)pcSourceText->GetBuffer()[0].c_str();
+                TraceThread("window");
+                m_psTrace = TraceBegin("extract", sourcePath);
+                uint64_t nTraceStart = TraceStart(m_psTrace);
                 char *BaseName = GetSource(sourcePath);
+                TraceSpan(m_psTrace, TRACE_RULE, nTraceStart);
                 if (BaseName)
                 {
+                    // the destination is kept open instead of becoming the current
+                    // folder, which is shared by all windows of the process
                     const char *DestPath = pcDestText->GetBuffer()[0].c_str();
-                    mkdir(DestPath, 0777 & ~umask(0));
-                    if (chdir(DestPath)) ShowError(ERR_DEST_NOT_FOUND);
+                    mkdir(DestPath, 0777);
+                    int nDestFd = open(DestPath, O_RDONLY | O_DIRECTORY);
+                    if (nDestFd < 0) ShowError(ERR_DEST_NOT_FOUND);
                     else
                     {
+                        // commands are run in the destination, so the source is given by its full path
+                        std::string cSource = sourcePath;
+                        if (*sourcePath != '/')
+                            cSource = std::string(CWDPath) + "/" + sourcePath;
+                        const char *pzPassw = m_nPasswEnable ? m_pcPasswString.c_str() : NULL;
+
                         // getting a command
-                        GetCommand(m_sysPath[1], sourcePath, rule[1], m_nPasswEnable ? m_pcPasswString.c_str() : NULL);
+                        nTraceStart = TraceStart(m_psTrace);
+                        GetCommand(m_sysPath[1], cSource.c_str(), m_ppzRule[1], pzPassw);
+                        TraceSpan(m_psTrace, TRACE_COMMAND, nTraceStart);
 
                         // updating a status string
                         if (strlen(BaseName) <= NAME_MAX)
-                            strcpy(m_pcStatusBuffer, BaseName);
+                            strcpy(m_zStatusBuffer + STATUS_STRING, BaseName);
                         else
-                            *m_pcStatusBuffer = '\0';
-                        pcExpandStatus->SetString(StatusBuffer);
+                            m_zStatusBuffer[STATUS_STRING] = '\0';
+                        pcExpandStatus->SetString(m_zStatusBuffer);
 
                         // creating ExpanderErrors window
                         m_pcErrWind = new ExpanderErrors(os::Rect(0, 0, 400, 300), this);
                         m_pcErrWind->CenterInWindow(this);
 
-                        // creating expander extract thread
-                        thread_id extract_thread = spawn_thread("expander extract", (void *)ExpanderExtract, NORMAL_PRIORITY, 0, this);
+                        // free space is checked by the extracting thread
+                        m_cJobSource = cSource;
+                        m_cJobFormat = m_ppzRule[RULE_FORMAT] ? m_ppzRule[RULE_FORMAT] : "";
+                        m_cJobDest = DestPath;
+                        m_nJobPrefs = prefs_settings;
+                        m_bJobBackground = m_pcBackground->GetValue();
+                        uint32 nExtra = prefs_extra;
+                        m_bJobSync = nExtra & SYNC_FILES;
+                        m_cSizeProbe.clear();
+                        if (m_ppzRule[RULE_SIZE])
+                        {
+                            char *pzProbe = new char[COMMAND_MAX + 1];
+                            nTraceStart = TraceStart(m_psTrace);
+                            GetCommand(pzProbe, cSource.c_str(), m_ppzRule[RULE_SIZE], pzPassw);
+                            TraceSpan(m_psTrace, TRACE_COMMAND, nTraceStart);
+                            m_cSizeProbe = pzProbe;
+                            delete [] pzProbe;
+                        }
+
+                        // manifest, update mode, linking and atomic expanding need the data, so the archive is read in-process;
+                        // so are zip archives with password (it mustn't be seen in the process list)
+                        // and formats of decoder plugins (they have no commands)
+                        thread_id extract_thread;
+                        bool bNative = IsNativeFormat(m_ppzRule[RULE_FORMAT]) && (IsPluginFormat(m_ppzRule[RULE_FORMAT]) ||
+                          (m_nPasswEnable ? HasPasswords(m_ppzRule[RULE_FORMAT]) : ((m_nJobPrefs & (MANIFEST | UPDATE)) != 0 || (nExtra & (LINK_IDENTICAL | SYNC_FILES)))));
+                        if (bNative)
+                        {
+                            m_psJob = new ExtractJob(nDestFd, ExtractLog, this);
+                            m_psJob->SetTrace(m_psTrace);
+                            if (m_nPasswEnable)
+                                m_cJobPassword = m_pcPasswString.c_str();
+                            if (m_nJobPrefs & MANIFEST)
+                                m_psJob->SetManifest(BaseName, -1);
+                            if (m_nJobPrefs & UPDATE)
+                                m_psJob->SetUpdate(nExtra & UPDATE_CRC);
+                            if (nExtra & LINK_IDENTICAL)
+                                m_psJob->SetDedup();
+                            if (m_bJobBackground)
+                                m_psJob->SetBackground((uint64)prefs_limit << 20);
+                            if (nExtra & SYNC_FILES)
+                                m_psJob->SetDurability((nExtra & ATOMIC_EXPAND) ? DURABLE_ATOMIC : DURABLE_SAFE);
+                            extract_thread = spawn_thread("expander extract", (void *)ExpanderNativeExtract, NORMAL_PRIORITY, 0, this);
+                        }
+                        else
+                        {
+                            m_nJobDestFd = nDestFd; // the command is started in it
+                            extract_thread = spawn_thread("expander extract", (void *)ExpanderExtract, NORMAL_PRIORITY, 0, this);
+                        }
                         resume_thread(extract_thread);
 
                         break;
                     }
                 }
+                TraceEnd(m_psTrace);
+                m_psTrace = NULL;
                 SwitchExpand();
             }
+            else if (m_psConvert)
+                m_psConvert->Cancel();
+            else if (m_psJob)
+                m_psJob->Cancel();
             else
             {
                 pid_t shellproc = -shell_process;
@@ -651,6 +1048,43 @@ void ExpanderWindow::HandleMessage(os::Message *pcMessage)
             break;
         }
 
+        case M_MENU_FILE_CONVERT:
+        {
+            // members are re-encoded by the native reader, so the rule needs format:"..."
+            char *sourcePath = (char *)pcSourceText->GetBuffer()[0].c_str();
+            if (IsFileReq || !GetSource(sourcePath))
+                break;
+            if (!IsNativeFormat(m_ppzRule[RULE_FORMAT]) || IsSingleFormat(m_ppzRule[RULE_FORMAT]))
+            {
+                ShowError(ERR_NO_CONVERT);
+                break;
+            }
+            m_cConvertSource = sourcePath;
+            m_cConvertFormat = m_ppzRule[RULE_FORMAT];
+
+            IsFileReq = true;
+            if (!pcConvertTarget)
+            {
+                const char *pzDest = pcDestText->GetBuffer()[0].c_str();
+                pcConvertTarget = new os::FileRequester(os::FileRequester::SAVE_REQ, new os::Messenger(this), *pzDest ? pzDest : NULL, os::FileRequester::NODE_FILE, false, new os::Message(M_FILEREQ_CONVERT), NULL, true, true, "Convert", "Cancel");
+                pcConvertTarget->Start();
+            }
+            pcConvertTarget->CenterInWindow(this);
+            pcConvertTarget->Show();
+            pcConvertTarget->MakeFocus();
+            break;
+        }
+
+        case M_MENU_FILE_FIND:
+            if (!m_pcFindWind)
+            {
+                m_pcFindWind = new ExpanderFind(this, pcSourceText->GetBuffer()[0].c_str());
+                m_pcFindWind->CenterInWindow(this);
+                m_pcFindWind->Show();
+            }
+            m_pcFindWind->MakeFocus();
+            break;
+
         case M_MENU_FILE_LIST:
             // we are simply reverse status of our CheckBox
             m_pcList->SetValue(!(m_pcList->GetValue()), true);
@@ -670,39 +1104,73 @@ void ExpanderWindow::HandleMessage(os::Message *pcMessage)
             UpdatingMenu(m_pcMenu[M_MENU_FILE], IsList, hideList, m_pcMenuItem[M_MENU_FILE_LIST]);
 
             if (IsList)
+                StartListing();
+            else if (list_process || m_bTreeListing)
             {
-                ListUnLock(false);
-                char *sourcePath = (char *)pcSourceText->GetBuffer()[0].c_str();
-                if (IsNotFullyListed || strcmp(sourcePath, m_oldListPath))
+                // the listing thread runs out without touching the pane, so it
+                // can't show up next to the one of the pane shown again
+                SupersedeListing();
+                ListUnLock(true);
+                if (m_cExpandList)
                 {
-                    pcListArchive->Clear();
-
-                    if (GetSource(sourcePath))
-                    {
-                        IsNotFullyListed = false;
-
-                        // saving path
-                        strcpy(m_oldListPath, sourcePath);
-
-                        // getting a command
-                        GetCommand(m_sysPath[0], sourcePath, rule[0], m_nPasswEnable ? m_pcPasswString.c_str() : NULL);
+                    m_cExpandList = false;
+                    os::Invoker *pcParentInvoker = new os::Invoker(new os::Message(M_MENU_FILE_EXPAND), this);
+                    pcParentInvoker->Invoke();
+                }
+            }
+            break;
+        }
 
-                        thread_id list_thread = spawn_thread("expander_list", (void *)ExpanderList, NORMAL_PRIORITY, 0, this);
-                        resume_thread(list_thread);
-                        break;
-                    }
-                    else
-                    {
-                        m_cExpandList = false;
-                        IsNotFullyListed = true;
-                    }
+        case M_LIST_OPEN:
+        {
+            // only the member shown by the line is extracted (into cache)
+            unsigned int nLine = pcListArchive->GetCursor().y;
+            std::string cMember;
+            if (m_psTrie)
+            {
+                // folder tree: directories are opened and closed in place
+                if (nLine >= m_anTrieLine.size() || m_anTrieLine[nLine] == TRIE_NONE)
+                    break;
+                if (m_psTrie->Toggle(m_anTrieLine[nLine]))
+                {
+                    std::string cText;
+                    m_psTrie->Render(&cText, &m_anTrieLine);
+                    pcListArchive->Clear();
+                    pcListArchive->Insert(cText.c_str());
+                    pcListArchive->SetCursor(0, nLine);
+                    break;
                 }
-                ListUnLock(true);
+                cMember = m_psTrie->GetPath(m_anTrieLine[nLine]);
+            }
+            else if (m_psSpool && nLine == 0 && m_nPageFirst > 0)
+            {
+                // spooled listing: the marker lines page it
+                ShowListPage(m_nPageFirst > m_nPageLines ? m_nPageFirst - m_nPageLines : 0);
+                break;
+            }
+            else if (m_psSpool && nLine + 1 == pcListArchive->GetBuffer().size() &&
+                     m_nPageFirst + m_nPageLines < m_psSpool->GetLineCount())
+            {
+                ShowListPage(m_nPageFirst + m_nPageLines);
+                break;
             }
-            else if (list_process)
+            else if (nLine < pcListArchive->GetBuffer().size())
+                cMember = pcListArchive->GetBuffer()[nLine].c_str();
+            if (!cMember.empty() && GetSource(m_oldListPath))
             {
-                 IsNotFullyListed = true;
-                 kill(-list_process, SIGINT);
+                if (m_nPasswEnable || !IsNativeFormat(m_ppzRule[RULE_FORMAT]))
+                    ShowError(ERR_NO_MEMBER_OPEN);
+                else
+                {
+                    member_request *psRequest = new member_request;
+                    psRequest->window = this;
+                    psRequest->archive = m_oldListPath;
+                    psRequest->format = m_ppzRule[RULE_FORMAT];
+                    psRequest->line = cMember;
+                    m_nOpenCount++;
+                    thread_id open_thread = spawn_thread("expander_open", (void *)ExpanderOpenMember, NORMAL_PRIORITY, 0, psRequest);
+                    resume_thread(open_thread);
+                }
             }
             break;
         }
@@ -745,12 +1213,33 @@ void ExpanderWindow::HandleMessage(os::Message *pcMessage)
                 curTextView->SelectAll();
             break;
 
+        case M_DEFERRED_INIT:
+        {
+            LoadIcons();
+
+            // checking window position (desktop is queried after the first paint)
+            os::Desktop *pcDesk = new os::Desktop;
+            os::Point deskPoint(pcDesk->GetResolution());
+            delete pcDesk;
+
+            os::Rect wRect = GetFrame();
+            if ((wRect.left > deskPoint.x) || (wRect.top > deskPoint.y))
+            {
+                std::cerr << "Window position information isn't correct!" << std::endl;
+                wRect.bottom = wRect.bottom - wRect.top + 100.0f;
+                wRect.left = 20.0f; wRect.right = 450.0f; wRect.top = 100.0f;
+                SetFrame(wRect);
+            }
+            StartupReady(STARTUP_RESOURCES);
+            break;
+        }
+
         // Preferences
         case M_MENU_APPLICATION_PREFS:
             // Expander Preferences
             if (!m_pcPrefWind)
             {
-               m_pcPrefWind = new ExpanderPreferences(os::Rect(200, 200, 500, 540), this);
+               m_pcPrefWind = new ExpanderPreferences(os::Rect(200, 200, 500, 765), this);
                m_pcPrefWind->CenterInWindow(this);
                m_pcPrefWind->Show();
                m_pcPrefWind->MakeFocus();
@@ -864,11 +1353,13 @@ void ExpanderWindow::SetFunctionsEnable(bool bStatus)
     m_pcMenuItem[M_MENU_FILE_SOURCE]->SetEnable(bStatus);
     m_pcMenuItem[M_MENU_FILE_DEST]->SetEnable(bStatus);
     m_pcMenuItem[M_MENU_FILE_PASSW]->SetEnable(bStatus);
+    m_pcMenuItem[M_MENU_FILE_CONVERT]->SetEnable(bStatus);
     m_pcMenuItem[M_MENU_APPLICATION_PREFS]->SetEnable(bStatus);
     pcSourceButton->SetEnable(bStatus);
     pcDestButton->SetEnable(bStatus);
     pcSourceText->SetEnable(bStatus);
     pcDestText->SetEnable(bStatus);
+    m_pcBackground->SetEnable(bStatus);
 }
 
 // Expand switching function
@@ -907,6 +1398,154 @@ void ExpanderWindow::ListUnLock(bool anAction)
     pcExpandButton->SetEnable(anAction);
     m_pcMenuItem[M_MENU_FILE_EXPAND]->SetEnable(anAction);
     SetFunctionsEnable(anAction);
+
+    // a new source may be chosen while listing (it supersedes the listing)
+    m_pcMenuItem[M_MENU_FILE_SOURCE]->SetEnable(true);
+    pcSourceButton->SetEnable(true);
+    pcSourceText->SetEnable(true);
+}
+
+// StartListing - listing the source into the contents pane
+void ExpanderWindow::StartListing()
+{
+    ListUnLock(false);
+    char *sourcePath = (char *)pcSourceText->GetBuffer()[0].c_str();
+    if (IsNotFullyListed || strcmp(sourcePath, m_oldListPath))
+    {
+        pcListArchive->Clear();
+        delete m_psTrie;
+        m_psTrie = NULL;
+        m_anTrieLine.clear();
+        delete m_psSpool;
+        m_psSpool = NULL;
+
+        TraceThread("window");
+        trace_job *psTrace = TraceBegin("list", sourcePath);
+        uint64_t nTraceStart = TraceStart(psTrace);
+        bool bRule = GetSource(sourcePath);
+        TraceSpan(psTrace, TRACE_RULE, nTraceStart);
+        if (bRule)
+        {
+            IsNotFullyListed = false;
+
+            // saving path
+            strcpy(m_oldListPath, sourcePath);
+
+            list_request *psRequest = new list_request;
+            psRequest->window = this;
+            psRequest->generation = m_nListGeneration;
+            psRequest->prefetch = NULL;
+            psRequest->trace = psTrace;
+            psRequest->budget = (uint64_t)prefs_memory << 20;
+            m_nListThreads++;
+
+            thread_id list_thread;
+            if (IsNativeFormat(m_ppzRule[RULE_FORMAT]) &&
+                (IsPluginFormat(m_ppzRule[RULE_FORMAT]) || ((prefs_extra & TREE_LISTING) && !m_nPasswEnable)))
+            {
+                // members are read in-process into the folder tree
+                psRequest->source = sourcePath;
+                psRequest->format = m_ppzRule[RULE_FORMAT];
+                if (m_nPasswEnable)
+                    psRequest->password = m_pcPasswString.c_str();
+                else if (m_psPrefetch)
+                {
+                    // the source may have been listed already while it was being chosen
+                    m_psPrefetch->AddRef();
+                    psRequest->prefetch = m_psPrefetch;
+                }
+                m_bTreeListing = true;
+                list_thread = spawn_thread("expander_list", (void *)ExpanderTreeList, NORMAL_PRIORITY, 0, psRequest);
+            }
+            else
+            {
+                // getting a command
+                nTraceStart = TraceStart(psTrace);
+                GetCommand(m_sysPath[0], sourcePath, m_ppzRule[0], m_nPasswEnable ? m_pcPasswString.c_str() : NULL);
+                TraceSpan(psTrace, TRACE_COMMAND, nTraceStart);
+                list_thread = spawn_thread("expander_list", (void *)ExpanderList, NORMAL_PRIORITY, 0, psRequest);
+            }
+            resume_thread(list_thread);
+
+            // seek index for opening members is built meanwhile; the ones
+            // of other sources are cancelled and left to run out
+            StopIndexing(false, false);
+            bool bIndexing = false;
+            for (unsigned int i = 0; i < m_apsIndex.size(); i++)
+            {
+                if (m_apsIndex[i]->source != sourcePath)
+                    m_apsIndex[i]->cancel = true;
+                else if (!m_apsIndex[i]->cancel)
+                    bIndexing = true;
+            }
+            if (!m_nPasswEnable && !bIndexing && SeekIndex::IsIndexable(m_ppzRule[RULE_FORMAT]))
+            {
+                index_request *psIndex = new index_request;
+                psIndex->source = sourcePath;
+                psIndex->format = m_ppzRule[RULE_FORMAT];
+                psIndex->cancel = psIndex->done = false;
+                psIndex->thread = spawn_thread("expander_index", (void *)ExpanderIndex, LOW_PRIORITY, 0, psIndex);
+                if (psIndex->thread < 0)
+                    delete psIndex;
+                else
+                {
+                    m_apsIndex.push_back(psIndex);
+                    resume_thread(psIndex->thread);
+                }
+            }
+            return;
+        }
+        else
+        {
+            TraceEnd(psTrace);
+            m_cExpandList = false;
+            IsNotFullyListed = true;
+        }
+    }
+    ListUnLock(true);
+}
+
+// SupersedeListing - dropping the listing in progress at once; its thread
+// finds out that it is stale and leaves the pane alone
+void ExpanderWindow::SupersedeListing()
+{
+    m_nListGeneration++;
+    if (list_process)
+        kill(-list_process, SIGINT);
+    list_process = 0;
+    m_bTreeListing = false;
+    StopIndexing(true, false);
+    IsNotFullyListed = true;
+}
+
+// StopIndexing - cancelling seek index threads (if bCancel is set); the
+// ones which are done are deleted (all of them if bWait is set)
+void ExpanderWindow::StopIndexing(bool bCancel, bool bWait)
+{
+    for (unsigned int i = m_apsIndex.size(); i-- > 0;)
+    {
+        index_request *psIndex = m_apsIndex[i];
+        if (bCancel)
+            psIndex->cancel = true;
+        if (bWait || psIndex->done)
+        {
+            wait_for_thread(psIndex->thread);
+            delete psIndex;
+            m_apsIndex.erase(m_apsIndex.begin() + i);
+        }
+    }
+}
+
+// StartPrefetch - speculative work on the chosen source (the previous
+// one is cancelled)
+void ExpanderWindow::StartPrefetch(const char *pzPath)
+{
+    if (m_psPrefetch)
+    {
+        m_psPrefetch->Cancel();
+        m_psPrefetch->Release();
+    }
+    m_psPrefetch = *pzPath ? Prefetch::Start(pzPath, PrefetchFormat, NULL) : NULL;
 }
 
 // GetSource - collecting source information
@@ -939,14 +1578,13 @@ char *ExpanderWindow::GetSource(char *srcPath)
                 if (read_attr(fd, "os::MimeType", ATTR_TYPE_STRING, mime_buf, 0, mime_info.ai_size) == mime_info.ai_size)
                 {
                     mime_buf[mime_info.ai_size] = '\0'; // NULL-terminating
-                    getres = GetRule(0, mime_buf);                
+                    getres = GetRule(LOOKUP_MIME, mime_buf);
                 }
                 delete [] mime_buf;
             }
 
             if (!getres)
-                for (tmpSrcPath = BaseName; *tmpSrcPath; tmpSrcPath++)
-                    if ((*tmpSrcPath == '.') && (getres = GetRule(1, tmpSrcPath))) break;
+                getres = GetRule(LOOKUP_NAME, BaseName);
             if (!getres)
             {
                 ShowError(ERR_UNKNOWN_FORMAT);
@@ -958,21 +1596,71 @@ char *ExpanderWindow::GetSource(char *srcPath)
     return BaseName;
 }
 
+// ShowListPage - spooled listing lines from nFirst which fit into the memory
+// budget; the lines before and after them are reached through marker lines
+void ExpanderWindow::ShowListPage(uint64_t nFirst)
+{
+    uint64_t nBudget = prefs_memory ? (uint64_t)prefs_memory << 20 : (uint64_t)LIST_PAGE;
+    std::string cText;
+    char zMarker[96];
+
+    if (nFirst > 0)
+    {
+        sprintf(zMarker, "... %llu earlier lines (double click to show them)\n", (unsigned long long)nFirst);
+        cText = zMarker;
+    }
+    std::string cPage;
+    m_nPageFirst = nFirst;
+    m_nPageLines = m_psSpool->GetLines(nFirst, nBudget, &cPage);
+    cText += cPage;
+    uint64_t nLeft = m_psSpool->GetLineCount() - nFirst - m_nPageLines;
+    if (nLeft > 0)
+    {
+        sprintf(zMarker, "... %llu more lines (double click to show them)", (unsigned long long)nLeft);
+        cText += zMarker;
+    }
+    pcListArchive->Clear();
+    pcListArchive->Insert(cText.c_str());
+    pcListArchive->SetCursor(0, 0);
+}
+
 // Thread function: listing archive
 void ExpanderList(void *pData)
 {
     int aPipe[2];
-    ExpanderWindow *expwin = (ExpanderWindow *)pData;
-
+    list_request *psRequest = (list_request *)pData;
+    ExpanderWindow *expwin = psRequest->window;
+    int nGeneration = psRequest->generation;
+    trace_job *psTrace = psRequest->trace;
+    uint64_t nBudget = psRequest->budget;
+    delete psRequest;
+
+    TraceThread("list");
     pipe(aPipe);
 
+    uint64_t nTraceStart = TraceStart(psTrace);
     pid_t pid = fork();
 
     if (pid)
     {
-        expwin->list_process = pid;
+        TraceSpan(psTrace, TRACE_SPAWN, nTraceStart);
+
+        // superseded before it started: the command is stopped at once
+        expwin->Lock();
+        if (nGeneration == expwin->m_nListGeneration)
+            expwin->list_process = pid;
+        else
+        {
+            kill(pid, SIGINT);
+            kill(-pid, SIGINT);
+        }
+        expwin->Unlock();
+
         int i = 0, g = 1, list_in = aPipe[0];
-        char ch;
+        char ch, zBuffer[TEXTBUF_MAXINDEX + 1]; // text buffer of this listing
+        bool bOutput = false;
+        uint64_t nShown = 0;
+        LineSpool *psSpool = NULL; // output beyond the budget
         os::TextView *pcListArchive = expwin->pcListArchive;
         close(aPipe[1]);
 
@@ -980,28 +1668,82 @@ void ExpanderList(void *pData)
         {
             if ((i == TEXTBUF_MAXINDEX) || ((g = read(list_in, &ch, 1)) != 1))
             {
-                pzTextBuffer[i] = '\0';
+                zBuffer[i] = '\0';
+                nTraceStart = TraceStart(psTrace);
+                if (psSpool)
+                    psSpool->Add(zBuffer, i); // the pane is paged when the listing is done
+                else
+                {
+                    expwin->Lock();
+                    if (nGeneration == expwin->m_nListGeneration)
+                    {
+                        if (nBudget && nShown + i > nBudget && (psSpool = new LineSpool)->IsOpen())
+                        {
+                            // over the budget: the whole listing goes to a temporary file
+                            const std::vector<os::String> &acLines = pcListArchive->GetBuffer();
+                            for (unsigned int j = 0; j < acLines.size(); j++)
+                            {
+                                if (j > 0)
+                                    psSpool->Add("\n", 1);
+                                psSpool->Add(acLines[j].c_str(), acLines[j].size());
+                            }
+                            psSpool->Add(zBuffer, i);
+                        }
+                        else
+                        {
+                            if (psSpool)
+                            {
+                                // no temporary file: everything is kept in memory
+                                delete psSpool;
+                                psSpool = NULL;
+                                nBudget = 0;
+                            }
+                            pcListArchive->Insert(zBuffer);
+                            nShown += i;
+                        }
+                    }
+                    expwin->Unlock();
+                }
+                TraceSpan(psTrace, TRACE_UI, nTraceStart);
                 i = 0;
-                expwin->Lock();
-                pcListArchive->Insert(pzTextBuffer);
-                expwin->Unlock();
             }
             else
-                pzTextBuffer[i++] = ch;
+            {
+                if (!bOutput)
+                {
+                    bOutput = true;
+                    TraceFirstByte(psTrace);
+                }
+                zBuffer[i++] = ch;
+            }
         }
         while (g == 1);
 
         close(list_in);
+        if (psSpool)
+            psSpool->Finish();
         expwin->Lock();
-        expwin->list_process = 0;
-        expwin->ListUnLock(true);
-        if (expwin->m_cExpandList)
+        if (nGeneration == expwin->m_nListGeneration)
         {
-            expwin->m_cExpandList = false;
-            os::Invoker *pcParentInvoker = new os::Invoker(new os::Message(ExpanderWindow::M_MENU_FILE_EXPAND), expwin);
-            pcParentInvoker->Invoke();
+            if (psSpool)
+            {
+                expwin->m_psSpool = psSpool;
+                psSpool = NULL;
+                expwin->ShowListPage(0);
+            }
+            expwin->list_process = 0;
+            expwin->ListUnLock(true);
+            if (expwin->m_cExpandList)
+            {
+                expwin->m_cExpandList = false;
+                os::Invoker *pcParentInvoker = new os::Invoker(new os::Message(ExpanderWindow::M_MENU_FILE_EXPAND), expwin);
+                pcParentInvoker->Invoke();
+            }
         }
+        expwin->m_nListThreads--;
         expwin->Unlock();
+        delete psSpool;
+        TraceEnd(psTrace);
     }
     else
     {
@@ -1014,100 +1756,568 @@ void ExpanderList(void *pData)
     }
 }
 
-// Thread function: extract archive
-void ExpanderExtract(void *pData)
+// Thread function: listing archive into the folder tree; only the lines of
+// open directories are put into the listing pane
+void ExpanderTreeList(void *pData)
 {
-    int aPipe[2];
-    ExpanderWindow *expwin = (ExpanderWindow *)pData;
-
-    pipe(aPipe);
-    pid_t pid = fork();
-
+    list_request *psRequest = (list_request *)pData;
+    ExpanderWindow *expwin = psRequest->window;
+    int nGeneration = psRequest->generation;
+    trace_job *psTrace = psRequest->trace;
+    PathTrie *psTrie = NULL;
+    archive_entry sEntry;
+    std::string cError, cText;
+    std::vector<uint32_t> anLine;
+    unsigned int nCount = 0;
+    int nResult = 0;
+    char zStatus[64], zSize[32], zCompressed[32];
+
+    // taking the speculative listing (waiting for it if it is on the way)
+    TraceThread("list");
+    uint64_t nTraceStart = TraceStart(psTrace);
+    if (psRequest->prefetch)
+    {
+        while (!psRequest->prefetch->Wait(100) && !expwin->IsListCancelled(nGeneration));
+        psTrie = psRequest->prefetch->TakeTree(psRequest->source.c_str(), psRequest->format.c_str());
+        psRequest->prefetch->Release();
+    }
+    if (psTrie)
+        TraceSpan(psTrace, TRACE_DECODE, nTraceStart);
+
+    nTraceStart = TraceStart(psTrace);
+    ArchiveReader *pcReader = psTrie ? NULL : OpenArchive(psRequest->format.c_str(), psRequest->source.c_str(), &cError);
+    if (!psTrie)
+        psTrie = new PathTrie;
+    if (pcReader)
+    {
+        TraceSpan(psTrace, TRACE_SPAWN, nTraceStart);
+        if (!psRequest->password.empty())
+            pcReader->SetPassword(psRequest->password.c_str());
+        nTraceStart = TraceStart(psTrace);
+        while (!expwin->IsListCancelled(nGeneration) && (nResult = pcReader->NextEntry(&sEntry)) == 1)
+        {
+            if (!nCount)
+                TraceFirstByte(psTrace);
+            psTrie->Add(sEntry);
+            if (++nCount % TREE_STATUS_STEP == 0)
+            {
+                TraceSpan(psTrace, TRACE_DECODE, nTraceStart);
+                nTraceStart = TraceStart(psTrace);
+                sprintf(zStatus, "Listing: %u members", nCount);
+                expwin->Lock();
+                if (nGeneration == expwin->m_nListGeneration)
+                    expwin->pcExpandStatus->SetString(zStatus);
+                expwin->Unlock();
+                TraceSpan(psTrace, TRACE_UI, nTraceStart);
+                nTraceStart = TraceStart(psTrace);
+            }
+        }
+        TraceSpan(psTrace, TRACE_DECODE, nTraceStart);
+        if (nResult < 0)
+            cError = pcReader->GetError();
+        delete pcReader;
+    }
+    delete psRequest;
+    nTraceStart = TraceStart(psTrace);
+    psTrie->Render(&cText, &anLine);
+
+    const trie_node &sRoot = psTrie->GetNode(psTrie->GetRoot());
+    FormatSize(sRoot.size, zSize);
+    FormatSize(sRoot.csize, zCompressed);
+    sprintf(zStatus, "%u files, %s (%s packed)", sRoot.files, zSize, zCompressed);
+
+    expwin->Lock();
+    if (nGeneration == expwin->m_nListGeneration)
+    {
+        delete expwin->m_psTrie;
+        expwin->m_psTrie = psTrie;
+        expwin->m_anTrieLine.swap(anLine);
+        expwin->pcListArchive->Insert(cText.c_str());
+        expwin->pcExpandStatus->SetString(zStatus);
+        if (!cError.empty())
+            expwin->ShowMessage((cError + " ").c_str());
+        expwin->m_bTreeListing = false;
+        expwin->ListUnLock(true);
+        if (expwin->m_cExpandList)
+        {
+            expwin->m_cExpandList = false;
+            os::Invoker *pcParentInvoker = new os::Invoker(new os::Message(ExpanderWindow::M_MENU_FILE_EXPAND), expwin);
+            pcParentInvoker->Invoke();
+        }
+    }
+    else
+        delete psTrie;
+    expwin->m_nListThreads--;
+    expwin->Unlock();
+    TraceSpan(psTrace, TRACE_UI, nTraceStart);
+    TraceEnd(psTrace);
+}
+
+// SpaceCheck - refusing to expand when the contents don't fit into the
+// destination; false if refused
+bool SpaceCheck(ExpanderWindow *expwin)
+{
+    archive_size sSize;
+    std::string cError, cMessage;
+    bool bKnown;
+
+    // files being updated mostly exist already
+    if (expwin->m_psJob && (expwin->m_nJobPrefs & UPDATE))
+        return true;
+
+    if (!expwin->m_cSizeProbe.empty())
+        bKnown = ProbeSize(expwin->m_cSizeProbe.c_str(), &sSize, &cError);
+    else
+        bKnown = EstimateSize(expwin->m_cJobFormat.c_str(), expwin->m_cJobSource.c_str(), &sSize, &cError);
+
+    if (!bKnown || CheckSpace(expwin->m_cJobDest.c_str(), sSize, &cMessage))
+        return true;
+
+    ExtractLog(expwin, (cMessage + "\n").c_str());
+    ExtractFinished(expwin, true, false);
+    return false;
+}
+
+// Thread function: extract archive
+void ExpanderExtract(void *pData)
+{
+    int aPipe[2];
+    ExpanderWindow *expwin = (ExpanderWindow *)pData;
+    trace_job *psTrace = expwin->m_psTrace;
+
+    TraceThread("extract");
+    if (!SpaceCheck(expwin))
+        return;
+
+    pipe(aPipe);
+    uint64_t nTraceStart = TraceStart(psTrace);
+    pid_t pid = fork();
+
     if (pid)
     {
-        int i = 0, g = 1, unpack_in = aPipe[0];
-        char ch;
-        ExpanderErrors *errwin = expwin->m_pcErrWind;
-        os::TextView *pcErrorText = errwin->m_pcErrorText;
+        TraceSpan(psTrace, TRACE_SPAWN, nTraceStart);
+        int unpack_in = aPipe[0];
+        char zBuffer[TEXTBUF_MAXINDEX + 1];
+        ssize_t nRead;
+        ErrorLog *psLog = expwin->m_pcErrWind->m_psLog;
 
         expwin->shell_process = pid;
         close(aPipe[1]);
 
-        do
+        // stderr is kept by the bounded log, not by the text view
+        while ((nRead = read(unpack_in, zBuffer, sizeof(zBuffer))) > 0 || (nRead < 0 && errno == EINTR))
         {
-            if ((i == TEXTBUF_MAXINDEX) || ((g = read(unpack_in, &ch, 1)) != 1))
-            {
-                pzTextBuffer[i] = '\0';
-                i = 0;
-                pcErrorText->Insert(pzTextBuffer);
-            }
-            else
-                pzTextBuffer[i++] = ch;
+            if (nRead > 0)
+                psLog->Add(zBuffer, nRead);
         }
-        while (g == 1);
 
         close(unpack_in);
 
-        // open FileBrowser window
-        if (prefs_settings & OPENFOLDER)
+        // (the command's own idea of durability isn't known)
+        if (expwin->m_bJobSync && expwin->shell_process)
         {
-            char *pzCWDPath = getcwd(NULL, 0), *pzFBPath = g_pzFileBrowser + FBROWSERLEN;
-            strcpy(pzFBPath, pzCWDPath);
-            strcpy(pzFBPath + strlen(pzCWDPath), " >>/dev/null &");
-            free(pzCWDPath);
-            system(g_pzFileBrowser);
+            nTraceStart = TraceStart(psTrace);
+            SyncFolder(expwin->m_nJobDestFd);
+            TraceSpan(psTrace, TRACE_FINISH, nTraceStart);
         }
 
-        const char *str_ptr;
+        // anything on stderr => error occured
+        ExtractFinished(expwin, psLog->GetBytes() != 0, !expwin->shell_process);
+    }
+
+    else
+    {
+        setsid();
+        close(aPipe[0]);
+        dup2(aPipe[1], STDERR_FILENO);
+        if (expwin->m_bJobBackground)
+            SetBackgroundPriority(); // the command can't be throttled, only made less important
+        if (fchdir(expwin->m_nJobDestFd) == 0)
+            execlp(SHELL, SHELL, "-c", expwin->m_sysPath[1], NULL);
+        close(aPipe[1]);
+        _exit(1);
+    }
+}
+
+// StageTiming - reporting how busy the extraction stages were (only if FILEEXPANDER_TIMING is set)
+static void StageTiming(ExtractJob *psJob)
+{
+    static const char *apzStage[STAGE_COUNT] = { "decode", "write", "metadata" };
+    stage_time asTime[STAGE_COUNT];
+
+    if (!getenv(EXPANDER_TIMING) || !psJob->GetStageTimes(asTime))
+        return;
+    for (int i = 0; i < STAGE_COUNT; i++)
+    {
+        uint64_t nTotal = asTime[i].busy + asTime[i].wait;
+        std::cerr << "FileExpander: " << apzStage[i] << " busy " << asTime[i].busy / 1000.0 << " ms, waiting "
+            << asTime[i].wait / 1000.0 << " ms (" << (nTotal ? asTime[i].busy * 100 / nTotal : 0) << "% used)" << std::endl;
+    }
+    if (psJob->GetThrottleTime())
+        std::cerr << "FileExpander: write throttled " << psJob->GetThrottleTime() / 1000.0 << " ms" << std::endl;
+}
+
+// Thread function: extract archive in-process (writing manifest)
+void ExpanderNativeExtract(void *pData)
+{
+    ExpanderWindow *expwin = (ExpanderWindow *)pData;
+    ExtractJob *psJob = expwin->m_psJob;
+    std::string cError;
+    bool bError = true;
 
-        // error occured => open error window
-        if (*pzTextBuffer)
+    TraceThread("extract");
+    if (!SpaceCheck(expwin))
+    {
+        delete psJob;
+        return;
+    }
+
+    uint64_t nTraceStart = TraceStart(expwin->m_psTrace);
+    ArchiveReader *pcReader = OpenArchive(expwin->m_cJobFormat.c_str(), expwin->m_cJobSource.c_str(), &cError);
+    if (pcReader)
+    {
+        TraceSpan(expwin->m_psTrace, TRACE_SPAWN, nTraceStart);
+        if (!expwin->m_cJobPassword.empty())
+            pcReader->SetPassword(expwin->m_cJobPassword.c_str());
+        bError = !psJob->Run(pcReader) && !psJob->IsCancelled();
+        delete pcReader;
+        StageTiming(psJob);
+    }
+    else
+        ExtractLog(expwin, (cError + "\n").c_str());
+
+    // update mode: "12 written (3.1 MB), 1034 skipped (2.0 GB)"
+    std::string cReport;
+    if (expwin->m_nJobPrefs & UPDATE)
+    {
+        char zWritten[32], zSkipped[32], zReport[128];
+        FormatSize(psJob->GetBytes(), zWritten);
+        FormatSize(psJob->GetSkippedBytes(), zSkipped);
+        sprintf(zReport, "%u written (%s), %u skipped (%s)", psJob->GetFileCount(), zWritten, psJob->GetSkippedCount(), zSkipped);
+        cReport = zReport;
+    }
+
+    // links: "File expanded, 500 linked (476.8 MB saved)"
+    if (psJob->GetLinkedCount())
+    {
+        char zSaved[32], zReport[128];
+        FormatSize(psJob->GetSavedBytes(), zSaved);
+        sprintf(zReport, "%s, %u linked (%s saved)", cReport.empty() ? ExpanderStatus[1] : "", psJob->GetLinkedCount(), zSaved);
+        cReport += zReport;
+    }
+
+    ExtractFinished(expwin, bError, psJob->IsCancelled(), cReport.empty() ? NULL : cReport.c_str());
+    delete psJob;
+}
+
+// Thread function: re-encode archive into another format ("Convert to...")
+void ExpanderConvert(void *pData)
+{
+    ExpanderWindow *expwin = (ExpanderWindow *)pData;
+    ConvertJob *psConvert = expwin->m_psConvert;
+    std::string cError, cReport;
+    bool bError = true;
+
+    ArchiveReader *pcReader = OpenArchive(expwin->m_cJobFormat.c_str(), expwin->m_cJobSource.c_str(), &cError);
+    if (pcReader)
+    {
+        if (!expwin->m_cJobPassword.empty())
+            pcReader->SetPassword(expwin->m_cJobPassword.c_str());
+        bError = !psConvert->Run(pcReader, expwin->m_cConvertFormat.c_str(), expwin->m_cConvertTarget.c_str()) && !psConvert->IsCancelled();
+        delete pcReader;
+    }
+    else
+        ExtractLog(expwin, (cError + "\n").c_str());
+
+    // "1034 files (2.0 GB) converted"
+    if (!bError && !psConvert->IsCancelled())
+    {
+        char zSize[32], zReport[64];
+        FormatSize(psConvert->GetBytes(), zSize);
+        sprintf(zReport, "%u files (%s) converted", psConvert->GetFileCount(), zSize);
+        cReport = zReport;
+    }
+
+    ExtractFinished(expwin, bError, psConvert->IsCancelled(), cReport.empty() ? NULL : cReport.c_str());
+    delete psConvert;
+}
+
+// SearchFormat - native format of the archive by its name (pData is the rule table)
+static const char *SearchFormat(void *pData, const char *pzPath)
+{
+    const char *pzName = strrchr(pzPath, '/');
+    char **ppzRule = ((RuleTable *)pData)->MatchName(pzName ? pzName + 1 : pzPath);
+    return ppzRule && IsNativeFormat(ppzRule[RULE_FORMAT]) ? ppzRule[RULE_FORMAT] : NULL;
+}
+
+// PrefetchFormat - format of the chosen source by its name, if it is to
+// be listed into the folder tree (prefetch worker)
+static bool PrefetchFormat(void *pData, const char *pzPath, std::string *pcFormat)
+{
+    const char *pzName = strrchr(pzPath, '/');
+    bool bList = false;
+
+    WaitForRules();
+    RuleTable *psRules = AcquireRules();
+    if (!psRules)
+        return false;
+    char **ppzRule = psRules->MatchName(pzName ? pzName + 1 : pzPath);
+    if (ppzRule && IsNativeFormat(ppzRule[RULE_FORMAT]) && (IsPluginFormat(ppzRule[RULE_FORMAT]) || (prefs_extra & TREE_LISTING)))
+    {
+        *pcFormat = ppzRule[RULE_FORMAT];
+        bList = true;
+    }
+    psRules->Release();
+    return bList;
+}
+
+// SearchReport - adding a hit to the "Find in archive" window
+static void SearchReport(void *pData, const search_hit &sHit)
+{
+    char zOffset[32];
+    std::string cLine = sHit.archive;
+    cLine += ": ";
+    cLine += sHit.member;
+    if (sHit.name)
+        cLine += " (name)";
+    else if (!(((ExpanderFind *)pData)->m_cMatcher.GetFlags() & SEARCH_NAMES_ONLY))
+    {
+        sprintf(zOffset, " @%llu", (unsigned long long)sHit.offset);
+        cLine += zOffset;
+    }
+    ((ExpanderFind *)pData)->AddText((cLine + "\n").c_str());
+}
+
+static void SearchLog(void *pData, const char *pzText)
+{
+    ((ExpanderFind *)pData)->AddText(pzText);
+}
+
+// Thread function: search archives or the catalog, or update the catalog ("Find in archive")
+void ExpanderSearch(void *pData)
+{
+    ExpanderFind *pcFind = (ExpanderFind *)pData;
+    std::vector<search_target> asTarget;
+    std::string cError, cCatalogPath = std::string(getenv("HOME")) + "/" EXPANDER_CATALOG;
+    const char *pzPath = pcFind->m_cPath.c_str();
+    struct stat sStat;
+    char zStatus[128];
+    Catalog cCatalog;
+
+    // the rule table is kept while formats are looked up
+    WaitForRules();
+    RuleTable *psRules = AcquireRules();
+    if (!psRules)
+        cError = "No rules";
+
+    else if (pcFind->m_nMode == ExpanderFind::FIND_INDEX)
+    {
+        cCatalog.Load(cCatalogPath.c_str());
+        if (cCatalog.Update(pzPath, SearchFormat, psRules, -1, &pcFind->m_bCancel, SearchLog, pcFind) &&
+            cCatalog.Save(cCatalogPath.c_str(), &cError))
+            sprintf(zStatus, "%u archives (%u listed now), %llu members in the catalog", cCatalog.GetArchiveCount(),
+              cCatalog.GetListedCount(), (unsigned long long)cCatalog.GetMemberCount());
+        else if (cError.empty())
+            strcpy(zStatus, pcFind->m_bCancel ? "Indexing stopped" : "Error occurred");
+    }
+
+    else if (pcFind->m_nMode == ExpanderFind::FIND_CATALOG)
+    {
+        if (!cCatalog.Load(cCatalogPath.c_str()))
+            cError = "No catalog yet: index the folder first";
+        else
+            sprintf(zStatus, "%u members found in the catalog", cCatalog.Find(&pcFind->m_cMatcher, pzPath, SearchReport, pcFind));
+    }
+
+    else if (stat(pzPath, &sStat) < 0)
+        cError = std::string(pzPath) + ": " + strerror(errno);
+    else if (S_ISDIR(sStat.st_mode))
+        FindArchives(pzPath, SearchFormat, psRules, &asTarget, &cError);
+    else
+    {
+        const char *pzFormat = SearchFormat(psRules, pzPath);
+        if (pzFormat)
         {
-            errwin->Show();
-            errwin->MakeFocus();
-            errwin->Lock();
-            errwin->AddErrorText();
-            errwin->Unlock();
-            str_ptr = ExpanderStatus[2];
+            search_target sTarget;
+            sTarget.path = pzPath;
+            sTarget.format = pzFormat;
+            asTarget.push_back(sTarget);
         }
-        // no errors => close error window
         else
+            cError = std::string(pzPath) + ": this archive can't be searched";
+    }
+    if (psRules)
+        psRules->Release();
+
+    SearchJob *psSearch = pcFind->m_psSearch;
+    if (!cError.empty())
+    {
+        pcFind->AddText((cError + "\n").c_str());
+        strcpy(zStatus, "Error occurred");
+    }
+    else if (psSearch)
+    {
+        psSearch->Run(asTarget, -1);
+        sprintf(zStatus, "%s%u hits in %u of %u archives", psSearch->IsCancelled() ? "Stopped: " : "",
+          psSearch->GetHitCount(), psSearch->GetArchiveCount(), (unsigned int)asTarget.size());
+    }
+
+    // the message is copied by PostMessage
+    os::Message cDone(ExpanderFind::M_FIND_DONE);
+    cDone.AddString("status", zStatus);
+    pcFind->PostMessage(&cDone, pcFind);
+}
+
+// Thread function: open archive member in its handler
+void ExpanderOpenMember(void *pData)
+{
+    member_request *psRequest = (member_request *)pData;
+    ExpanderWindow *expwin = psRequest->window;
+    std::string cError;
+
+    std::string cPath = OpenMember(psRequest->archive.c_str(), psRequest->format.c_str(), psRequest->line.c_str(), &cError);
+    if (!cPath.empty())
+    {
+        try
         {
-            errwin->Close();
-            str_ptr = expwin->shell_process ? ExpanderStatus[1] : ExpanderStatus[0];
+            os::RegistrarManager *pcManager = os::RegistrarManager::Get();
+            if (pcManager->Launch(expwin, cPath.c_str()) < 0)
+                cError = "No handler for " + cPath;
+            pcManager->Put();
         }
+        catch (...)
+        {
+            cError = "Registrar isn't running";
+        }
+    }
 
-        expwin->Lock();
-        chdir(expwin->CWDPath);
-        expwin->SwitchExpand();
-        expwin->pcExpandStatus->SetString(str_ptr);
-        expwin->shell_process = 0;
-        expwin->Unlock();
+    expwin->Lock();
+    if (!cError.empty())
+        expwin->ShowMessage((cError + " ").c_str());
+    expwin->m_nOpenCount--;
+    expwin->Unlock();
+    delete psRequest;
+}
+
+// Thread function: build seek index of the listed archive
+void ExpanderIndex(void *pData)
+{
+    index_request *psIndex = (index_request *)pData;
+    std::string cError;
+
+    // without index members are read from the beginning, so failure is not reported
+    IndexArchive(psIndex->source.c_str(), psIndex->format.c_str(), &psIndex->cancel, &cError);
+    psIndex->done = true;
+}
+
+// ExtractLog - adding extraction message to the error window
+void ExtractLog(void *pData, const char *pzText)
+{
+    ((ExpanderWindow *)pData)->m_pcErrWind->m_psLog->Add(pzText, strlen(pzText));
+}
+
+// OpenFolder - showing the folder in FileBrowser (the browser isn't waited for)
+void OpenFolder(const char *pzPath)
+{
+    char *pzFullPath = realpath(pzPath, NULL);
+    pid_t pid = fork();
 
-        // if error occured we aren't closing any windows
-        if (!(*pzTextBuffer) && (prefs_settings & CLOSEWIN))
+    if (pid == 0)
+    {
+        // the browser is left to init, so no zombie remains
+        if (fork() == 0)
         {
-            os::Invoker *pcParentInvoker = new os::Invoker(new os::Message(os::M_QUIT), expwin);
-            pcParentInvoker->Invoke();
+            setsid();
+            int nNull = open("/dev/null", O_WRONLY);
+            if (nNull >= 0)
+                dup2(nNull, STDOUT_FILENO);
+            execlp(GUI_FILE_BROWSER, GUI_FILE_BROWSER, pzFullPath ? pzFullPath : pzPath, NULL);
         }
+        _exit(0);
     }
+    if (pid > 0)
+        waitpid(pid, NULL, 0);
+    free(pzFullPath);
+}
+
+// ExtractFinished - updating windows when extraction thread is done
+// (pzReport replaces the "done" status)
+void ExtractFinished(ExpanderWindow *expwin, bool bError, bool bAborted, const char *pzReport)
+{
+    ExpanderErrors *errwin = expwin->m_pcErrWind;
+    bool bConvert = expwin->m_psConvert != NULL; // nothing was expanded
+    trace_job *psTrace = expwin->m_psTrace;
+    uint64_t nTraceStart = TraceStart(psTrace);
+
+    // open FileBrowser window
+    if ((expwin->m_nJobPrefs & OPENFOLDER) && !bConvert)
+        OpenFolder(expwin->m_cJobDest.c_str());
+
+    const char *str_ptr;
 
+    // error occured => open error window
+    if (bError)
+    {
+        errwin->Show();
+        errwin->MakeFocus();
+        errwin->Lock();
+        errwin->m_psLog->Finish();
+        errwin->m_pcErrorText->Set(errwin->m_psLog->GetText().c_str());
+        errwin->AddErrorText();
+        errwin->Unlock();
+        str_ptr = ExpanderStatus[2];
+    }
+    // no errors => close error window
     else
     {
-        setsid();
-        close(aPipe[0]);
-        dup2(aPipe[1], STDERR_FILENO);
-        execlp(SHELL, SHELL, "-c", expwin->m_sysPath[1], NULL);
-        close(aPipe[1]);
-        _exit(1);
+        errwin->Close();
+        str_ptr = bAborted ? ExpanderStatus[bConvert ? 3 : 0] : (pzReport ? pzReport : ExpanderStatus[1]);
+    }
+
+    expwin->Lock();
+    TraceSpan(psTrace, TRACE_UI, nTraceStart);
+    nTraceStart = TraceStart(psTrace);
+    if (expwin->m_nJobDestFd >= 0)
+    {
+        close(expwin->m_nJobDestFd);
+        expwin->m_nJobDestFd = -1;
+    }
+    TraceSpan(psTrace, TRACE_FINISH, nTraceStart);
+    nTraceStart = TraceStart(psTrace);
+    expwin->SwitchExpand();
+    expwin->pcExpandStatus->SetString(str_ptr);
+    expwin->shell_process = 0;
+    expwin->m_psJob = NULL;
+    expwin->m_psConvert = NULL;
+    if (!expwin->m_cJobPassword.empty())
+    {
+        memset(&expwin->m_cJobPassword[0], 0, expwin->m_cJobPassword.size());
+        expwin->m_cJobPassword.clear();
+    }
+    expwin->m_psTrace = NULL;
+    expwin->Unlock();
+    TraceSpan(psTrace, TRACE_UI, nTraceStart);
+    TraceEnd(psTrace);
+
+    // if error occured we aren't closing any windows
+    if (!bError && !bConvert && (expwin->m_nJobPrefs & CLOSEWIN))
+    {
+        os::Invoker *pcParentInvoker = new os::Invoker(new os::Message(os::M_QUIT), expwin);
+        pcParentInvoker->Invoke();
     }
 }
 
 // Show Error message (nCode is code of the error)
 void ExpanderWindow::ShowError(int nCode)
 {
-    os::Alert *pcError = new os::Alert("Error", ExpanderError[nCode], CopyBitmap(m_apcBitmap[FEBITMAP_ERROR32X32]), os::WND_NO_CLOSE_BUT | os::WND_NO_ZOOM_BUT | os::WND_NO_DEPTH_BUT | os::WND_NOT_RESIZABLE, "OK", NULL);
-    pcError->SetIcon(m_apcBitmap[FEBITMAP_ERROR24X24]);
+    ShowMessage(ExpanderError[nCode]);
+}
+
+// Show Error message with the text
+void ExpanderWindow::ShowMessage(const char *pzText)
+{
+    os::Alert *pcError = new os::Alert("Error", pzText, CopyBitmap(GetBitmap(FEBITMAP_ERROR32X32)), os::WND_NO_CLOSE_BUT | os::WND_NO_ZOOM_BUT | os::WND_NO_DEPTH_BUT | os::WND_NOT_RESIZABLE, "OK", NULL);
+    pcError->SetIcon(GetBitmap(FEBITMAP_ERROR24X24));
     pcError->CenterInWindow(this);
     pcError->Go(new os::Invoker);
 }
@@ -1115,36 +2325,59 @@ void ExpanderWindow::ShowError(int nCode)
 // Getting Rule
 bool ExpanderWindow::GetRule(unsigned int i, char *pzText)
 {
-    struct hash_struct *elem = hash_table[hash(pzText) + HASH_SIZE * i];
-    while (elem)
+    char **ppzRule = NULL;
+
+    WaitForRules();
+
+    // rules may be replaced at any moment; the window keeps a reference
+    // to the tables which the found rule belongs to
+    RuleTable *psRules = AcquireRules();
+    if (psRules)
     {
-        if (!strcmp(elem->name, pzText))
+        if ((ppzRule = psRules->GetRule(i, pzText)))
         {
-            rule = elem->rule;
-            return true;
+            if (m_psRules)
+                m_psRules->Release();
+            m_psRules = psRules;
+            m_ppzRule = ppzRule;
         }
-        elem = elem->next;
+        else
+            psRules->Release();
     }
-    return false;
+    return ppzRule != NULL;
 }
 
 // ExpanderWindow destructor
 ExpanderWindow::~ExpanderWindow()
 {
-    // remove all bitmaps
+    // remove all bitmaps (delete is safe for bitmaps which were never decoded)
     for (os::Bitmap **ppcBitmap = m_apcBitmap + FEBITMAP_COUNT - 1; ppcBitmap >= m_apcBitmap; ppcBitmap--)
         delete (*ppcBitmap);
 
     // remove CWD Path buffer
     free(CWDPath);
 
+    if (m_psRules)
+        m_psRules->Release();
+    delete m_psTrie;
+    delete m_psSpool;
+    if (m_psPrefetch)
+    {
+        m_psPrefetch->Cancel();
+        m_psPrefetch->Release();
+    }
+
     // removing commans buffers
     for (int i = 0; i < RULE_COUNT; i++)
         delete [] m_sysPath[i];
     delete [] m_oldListPath;
 
-    pcSetSource->Close();
-    pcSetDest->Close();
+    if (pcSetSource)
+        pcSetSource->Close();
+    if (pcSetDest)
+        pcSetDest->Close();
+    if (pcConvertTarget)
+        pcConvertTarget->Close();
 
     if (m_pcPrefWind)
         m_pcPrefWind->Close();
@@ -1200,6 +2433,42 @@ ExpanderPreferences::ExpanderPreferences(const os::Rect &cFrame, ExpanderWindow
     m_pcFrameView->AddChild(m_pcOpenDistExtr);
     m_pcAutoContents = new os::CheckBox(os::Rect(20, 240, 250, 255), "auto_contents", "Automatically show contents listing", new os::Message(M_PREF_AUTO_CONTENTS), os::CF_FOLLOW_NONE);
     m_pcFrameView->AddChild(m_pcAutoContents);
+    m_pcManifest = new os::CheckBox(os::Rect(20, 260, 250, 275), "manifest", "Write SHA-256 manifest when expanding", new os::Message(M_PREF_MANIFEST), os::CF_FOLLOW_NONE);
+    m_pcFrameView->AddChild(m_pcManifest);
+    m_pcUpdate = new os::CheckBox(os::Rect(20, 280, 250, 295), "update", "Update: skip unchanged files", new os::Message(M_PREF_UPDATE), os::CF_FOLLOW_NONE);
+    m_pcFrameView->AddChild(m_pcUpdate);
+    m_pcUpdateCrc = new os::CheckBox(os::Rect(40, 300, 250, 315), "update_crc", "Compare CRC when stored", new os::Message(M_PREF_UPDATE), os::CF_FOLLOW_NONE);
+    m_pcFrameView->AddChild(m_pcUpdateCrc);
+    m_pcTree = new os::CheckBox(os::Rect(20, 320, 250, 335), "tree", "Show contents as folder tree", new os::Message(M_PREF_TREE), os::CF_FOLLOW_NONE);
+    m_pcFrameView->AddChild(m_pcTree);
+    m_pcLink = new os::CheckBox(os::Rect(20, 340, 250, 355), "link", "Link identical files when expanding", new os::Message(M_PREF_LINK), os::CF_FOLLOW_NONE);
+    m_pcFrameView->AddChild(m_pcLink);
+    m_pcBackground = new os::CheckBox(os::Rect(20, 360, 250, 375), "background", "Expand in background (low priority)", new os::Message(M_PREF_BACKGROUND), os::CF_FOLLOW_NONE);
+    m_pcFrameView->AddChild(m_pcBackground);
+    m_pcLimitString = new os::StringView(os::Rect(40, 382, 140, 395), "limit_string", "Limit writing to", os::ALIGN_LEFT, os::CF_FOLLOW_NONE);
+    m_pcFrameView->AddChild(m_pcLimitString);
+    char zLimit[16];
+    sprintf(zLimit, "%u", (unsigned int)prefs_limit);
+    m_pcLimitText = new EtextView(os::Rect(140, 380, 185, 397), "limit_text", zLimit, os::CF_FOLLOW_NONE);
+    m_pcLimitText->SetMaxUndoSize(0);
+    m_pcFrameView->AddChild(m_pcLimitText);
+    m_pcLimitUnit = new os::StringView(os::Rect(190, 382, 270, 395), "limit_unit", "MB/s (0 - no)", os::ALIGN_LEFT, os::CF_FOLLOW_NONE);
+    m_pcFrameView->AddChild(m_pcLimitUnit);
+    m_pcSync = new os::CheckBox(os::Rect(20, 400, 250, 415), "sync", "Sync files to disk when expanding", new os::Message(M_PREF_SYNC), os::CF_FOLLOW_NONE);
+    m_pcFrameView->AddChild(m_pcSync);
+    m_pcAtomic = new os::CheckBox(os::Rect(40, 420, 250, 435), "atomic", "Show files only when all are expanded", new os::Message(M_PREF_SYNC), os::CF_FOLLOW_NONE);
+    m_pcFrameView->AddChild(m_pcAtomic);
+    m_pcTrace = new os::CheckBox(os::Rect(20, 440, 250, 455), "trace", "Trace jobs (timing on stderr)", new os::Message(M_PREF_TRACE), os::CF_FOLLOW_NONE);
+    m_pcFrameView->AddChild(m_pcTrace);
+    m_pcMemoryString = new os::StringView(os::Rect(20, 462, 140, 475), "memory_string", "Keep in memory", os::ALIGN_LEFT, os::CF_FOLLOW_NONE);
+    m_pcFrameView->AddChild(m_pcMemoryString);
+    char zMemory[16];
+    sprintf(zMemory, "%u", (unsigned int)prefs_memory);
+    m_pcMemoryText = new EtextView(os::Rect(140, 460, 185, 477), "memory_text", zMemory, os::CF_FOLLOW_NONE);
+    m_pcMemoryText->SetMaxUndoSize(0);
+    m_pcFrameView->AddChild(m_pcMemoryText);
+    m_pcMemoryUnit = new os::StringView(os::Rect(190, 462, 270, 475), "memory_unit", "MB of listing", os::ALIGN_LEFT, os::CF_FOLLOW_NONE);
+    m_pcFrameView->AddChild(m_pcMemoryUnit);
 
     // Updating rectangle
     aRect.top = aRect.bottom + 15;
@@ -1230,6 +2499,18 @@ ExpanderPreferences::ExpanderPreferences(const os::Rect &cFrame, ExpanderWindow
     m_pcCloseWindow->SetValue(prefs_settings & CLOSEWIN, true);
     m_pcOpenDistExtr->SetValue(prefs_settings & OPENFOLDER, true);
     m_pcAutoContents->SetValue(prefs_settings & AUTOLISTING, true);
+    m_pcManifest->SetValue(prefs_settings & MANIFEST, true);
+    m_pcUpdate->SetValue(prefs_settings & UPDATE, true);
+    m_pcUpdateCrc->SetValue(prefs_extra & UPDATE_CRC, true);
+    m_pcUpdateCrc->SetEnable(prefs_settings & UPDATE);
+    m_pcTree->SetValue(prefs_extra & TREE_LISTING, true);
+    m_pcLink->SetValue(prefs_extra & LINK_IDENTICAL, true);
+    m_pcBackground->SetValue(prefs_extra & BACKGROUND, true);
+    m_pcLimitText->SetEnable(prefs_extra & BACKGROUND);
+    m_pcSync->SetValue(prefs_extra & SYNC_FILES, true);
+    m_pcAtomic->SetValue(prefs_extra & ATOMIC_EXPAND, true);
+    m_pcAtomic->SetEnable(prefs_extra & SYNC_FILES);
+    m_pcTrace->SetValue(prefs_extra & TRACE_JOBS, true);
 
     // filerequester dialog
     m_pcFileReq = new os::FileRequester(os::FileRequester::LOAD_REQ, new os::Messenger(this), NULL, os::FileRequester::NODE_DIR, false, NULL, NULL, true, true, "Select", "Cancel");
@@ -1239,7 +2520,7 @@ ExpanderPreferences::ExpanderPreferences(const os::Rect &cFrame, ExpanderWindow
     SetDefaultButton(m_pcSaveButton);
 
     // set icon
-    SetIcon(m_pcParent->m_apcBitmap[ExpanderWindow::FEBITMAP_PREFS24X24]);
+    SetIcon(m_pcParent->GetBitmap(ExpanderWindow::FEBITMAP_PREFS24X24));
 }
 
 // ExpanderPreferences destructor
@@ -1305,6 +2586,18 @@ void ExpanderPreferences::HandleMessage(os::Message *pcMessage)
             IsFileReq = false;
             break;
 
+        case M_PREF_UPDATE:
+            m_pcUpdateCrc->SetEnable(m_pcUpdate->GetValue());
+            break;
+
+        case M_PREF_BACKGROUND:
+            m_pcLimitText->SetEnable(m_pcBackground->GetValue());
+            break;
+
+        case M_PREF_SYNC:
+            m_pcAtomic->SetEnable(m_pcSync->GetValue());
+            break;
+
         case M_PREF_SAVE:
         {
             if (m_pcLeaveEmpty->GetValue())
@@ -1324,6 +2617,39 @@ void ExpanderPreferences::HandleMessage(os::Message *pcMessage)
             SetPrefBit(m_pcCloseWindow->GetValue(), CLOSEWIN);
             SetPrefBit(m_pcOpenDistExtr->GetValue(), OPENFOLDER);
             SetPrefBit(m_pcAutoContents->GetValue(), AUTOLISTING);
+            SetPrefBit(m_pcManifest->GetValue(), MANIFEST);
+            SetPrefBit(m_pcUpdate->GetValue(), UPDATE);
+            if (m_pcUpdateCrc->GetValue())
+                prefs_extra |= UPDATE_CRC;
+            else
+                prefs_extra &= ~UPDATE_CRC;
+            if (m_pcTree->GetValue())
+                prefs_extra |= TREE_LISTING;
+            else
+                prefs_extra &= ~TREE_LISTING;
+            if (m_pcLink->GetValue())
+                prefs_extra |= LINK_IDENTICAL;
+            else
+                prefs_extra &= ~LINK_IDENTICAL;
+            if (m_pcBackground->GetValue())
+                prefs_extra |= BACKGROUND;
+            else
+                prefs_extra &= ~BACKGROUND;
+            if (m_pcSync->GetValue())
+                prefs_extra |= SYNC_FILES;
+            else
+                prefs_extra &= ~SYNC_FILES;
+            if (m_pcAtomic->GetValue())
+                prefs_extra |= ATOMIC_EXPAND;
+            else
+                prefs_extra &= ~ATOMIC_EXPAND;
+            if (m_pcTrace->GetValue())
+                prefs_extra |= TRACE_JOBS;
+            else
+                prefs_extra &= ~TRACE_JOBS;
+            ApplyTracing();
+            prefs_limit = strtoul(m_pcLimitText->GetBuffer()[0].c_str(), NULL, 10);
+            prefs_memory = strtoul(m_pcMemoryText->GetBuffer()[0].c_str(), NULL, 10);
 
             // getting default path
             const char *dirPath = m_pcDirText->GetBuffer()[0].c_str();
@@ -1385,8 +2711,17 @@ ExpanderErrors::ExpanderErrors(const os::Rect &cFrame, ExpanderWindow *parentWin
     m_pcView->AddChild(pcButton);
     SetDefaultButton(pcButton);
 
+    // the whole log is written out only when asked for
+    cRect.right = cRect.left - 10;
+    cRect.left = cRect.right - 80;
+    os::Button *pcSaveButton = new os::Button(cRect, "err_save", "Save log...", new os::Message(M_ERR_SAVE), os::CF_FOLLOW_RIGHT);
+    m_pcView->AddChild(pcSaveButton);
+
+    m_psLog = new ErrorLog;
+    m_pcSaveLog = NULL;
+
     // set icon
-    SetIcon(m_pcParent->m_apcBitmap[ExpanderWindow::FEBITMAP_ERROR24X24]);
+    SetIcon(m_pcParent->GetBitmap(ExpanderWindow::FEBITMAP_ERROR24X24));
 }
 
 // AddErrorText - attaching error text view
@@ -1395,20 +2730,48 @@ void ExpanderErrors::AddErrorText()
     m_pcView->AddChild(m_pcErrorText);
 }
 
-// ExpanderErrors destructor
-ExpanderErrors::~ExpanderErrors()
+// ExpanderErrors messages
+void ExpanderErrors::HandleMessage(os::Message *pcMessage)
 {
-    m_pcParent->m_pcErrWind = NULL;
+    switch (pcMessage->GetCode())
+    {
+        case M_ERR_SAVE:
+            if (!m_pcSaveLog)
+            {
+                m_pcSaveLog = new os::FileRequester(os::FileRequester::SAVE_REQ, new os::Messenger(this), NULL, os::FileRequester::NODE_FILE, false, new os::Message(M_ERR_SAVE_PATH), NULL, true, true, "Save", "Cancel");
+                m_pcSaveLog->Start();
+            }
+            m_pcSaveLog->CenterInWindow(this);
+            m_pcSaveLog->Show();
+            m_pcSaveLog->MakeFocus();
+            break;
+
+        case M_ERR_SAVE_PATH:
+        {
+            const char *pzPath;
+            std::string cError;
+            if (pcMessage->FindString("file/path", &pzPath) == 0 && !m_psLog->Save(pzPath, &cError))
+            {
+                os::Alert *pcError = new os::Alert("Error", (cError + " ").c_str(), CopyBitmap(m_pcParent->GetBitmap(ExpanderWindow::FEBITMAP_ERROR32X32)), os::WND_NO_CLOSE_BUT | os::WND_NO_ZOOM_BUT | os::WND_NO_DEPTH_BUT | os::WND_NOT_RESIZABLE, "OK", NULL);
+                pcError->CenterInWindow(this);
+                pcError->Go(new os::Invoker);
+            }
+            break;
+        }
+
+        default:
+            os::Window::HandleMessage(pcMessage);
+            break;
+    }
 }
 
-// Hash function
-unsigned int hash(char *p)
+// ExpanderErrors destructor
+ExpanderErrors::~ExpanderErrors()
 {
-    unsigned int h = 0;
-    unsigned char *ptr = (unsigned char *)p;
-    while (*ptr)
-        h = HASH_MULTIPLIER * h + *ptr++;
-    return h % HASH_SIZE;
+    if (m_pcSaveLog)
+        m_pcSaveLog->Close();
+    delete m_psLog;
+    m_pcParent->m_pcErrWind = NULL;
 }
 
 // Copy bitmap function
@@ -1456,7 +2819,7 @@ ExpanderPassw::ExpanderPassw(ExpanderWindow *pcParent)
     m_pcView->AddChild(m_pcDiscard);
 
     // set icon
-    SetIcon(m_pcParent->m_apcBitmap[ExpanderWindow::FEBITMAP_PASSW24X24]);
+    SetIcon(m_pcParent->GetBitmap(ExpanderWindow::FEBITMAP_PASSW24X24));
 }
 
 // virtual method: HandleMessage
@@ -1503,28 +2866,171 @@ ExpanderPassw::~ExpanderPassw()
     m_pcParent->m_pcPasswWind = NULL;
 }
 
+// ExpanderFind ("Find in archive" window) constructor
+ExpanderFind::ExpanderFind(ExpanderWindow *pcParent, const char *pzPath)
+  : os::Window(os::Rect(0, 0, 540, 360), "find_archive", "Find in archive", os::WND_NO_ZOOM_BUT | os::WND_NO_DEPTH_BUT),
+    m_psSearch(NULL), m_nMode(FIND_SCAN), m_bCancel(false), m_pcParent(pcParent), m_bBusy(false), m_bClose(false)
+{
+    os::Rect cRect = GetBounds();
+    SetSizeLimits(os::Point(cRect.right, cRect.bottom), os::Point(os::COORD_MAX, os::COORD_MAX));
+    m_pcView = new os::View(cRect, "find_view", os::CF_FOLLOW_ALL);
+    AddChild(m_pcView);
+
+    // pattern and archive (or folder)
+    m_pcView->AddChild(new os::StringView(os::Rect(10, 10, 60, 30), "find_string", "Find:"));
+    m_pcPattern = new EtextView(os::Rect(65, 10, cRect.right - 10, 30), "find_pattern", "", os::CF_FOLLOW_LEFT | os::CF_FOLLOW_RIGHT);
+    m_pcPattern->SetMaxUndoSize(0);
+    m_pcView->AddChild(m_pcPattern);
+
+    m_pcView->AddChild(new os::StringView(os::Rect(10, 40, 60, 60), "in_string", "In:"));
+    m_pcPath = new EtextView(os::Rect(65, 40, cRect.right - 10, 60), "find_path", pzPath, os::CF_FOLLOW_LEFT | os::CF_FOLLOW_RIGHT);
+    m_pcPath->SetMaxUndoSize(0);
+    m_pcView->AddChild(m_pcPath);
+
+    // options
+    m_pcRegex = new os::CheckBox(os::Rect(10, 70, 150, 90), "find_regex", "Regular expression", NULL, os::CF_FOLLOW_NONE);
+    m_pcView->AddChild(m_pcRegex);
+    m_pcIgnoreCase = new os::CheckBox(os::Rect(160, 70, 260, 90), "find_icase", "Ignore case", NULL, os::CF_FOLLOW_NONE);
+    m_pcView->AddChild(m_pcIgnoreCase);
+    m_pcNamesOnly = new os::CheckBox(os::Rect(270, 70, 430, 90), "find_names", "Matching members only", NULL, os::CF_FOLLOW_NONE);
+    m_pcView->AddChild(m_pcNamesOnly);
+    m_pcCatalog = new os::CheckBox(os::Rect(440, 70, cRect.right - 10, 90), "find_catalog", "In catalog", NULL, os::CF_FOLLOW_NONE);
+    m_pcView->AddChild(m_pcCatalog);
+
+    // hits: "archive: member @offset"
+    m_pcResults = new EtextView(os::Rect(10, 100, cRect.right - 10, cRect.bottom - 40), "find_results", "", os::CF_FOLLOW_ALL);
+    m_pcResults->SetReadOnly();
+    m_pcResults->SetMultiLine();
+    m_pcResults->SetMaxUndoSize(0);
+    m_pcResults->SetFont(new os::Font(DEFAULT_FONT_FIXED));
+    m_pcView->AddChild(m_pcResults);
+
+    m_pcStatus = new os::StringView(os::Rect(10, cRect.bottom - 30, cRect.right - 170, cRect.bottom - 10), "find_status", "", os::ALIGN_LEFT, os::CF_FOLLOW_LEFT | os::CF_FOLLOW_RIGHT | os::CF_FOLLOW_BOTTOM);
+    m_pcView->AddChild(m_pcStatus);
+    m_pcFind = new os::Button(os::Rect(cRect.right - 80, cRect.bottom - 30, cRect.right - 10, cRect.bottom - 10), "find_button", "Find", new os::Message(M_FIND_START), os::CF_FOLLOW_RIGHT | os::CF_FOLLOW_BOTTOM);
+    m_pcView->AddChild(m_pcFind);
+    SetDefaultButton(m_pcFind);
+    m_pcIndex = new os::Button(os::Rect(cRect.right - 160, cRect.bottom - 30, cRect.right - 90, cRect.bottom - 10), "index_button", "Index", new os::Message(M_FIND_INDEX), os::CF_FOLLOW_RIGHT | os::CF_FOLLOW_BOTTOM);
+    m_pcView->AddChild(m_pcIndex);
+    SetFocusChild(m_pcPattern);
+}
+
+// AddText - adding hits and messages (called by search workers)
+void ExpanderFind::AddText(const char *pzText)
+{
+    Lock();
+    m_pcResults->Insert(pzText);
+    Unlock();
+}
+
+// virtual method: OkToQuit (search is stopped first)
+bool ExpanderFind::OkToQuit()
+{
+    if (!m_bBusy)
+        return true;
+    m_bClose = true;
+    m_bCancel = true;
+    if (m_psSearch)
+        m_psSearch->Cancel();
+    return false;
+}
+
+// virtual method: HandleMessage
+void ExpanderFind::HandleMessage(os::Message *pcMessage)
+{
+    switch (pcMessage->GetCode())
+    {
+        case M_FIND_START:
+        case M_FIND_INDEX:
+        {
+            // Find and Index are Stop while busy
+            if (m_bBusy)
+            {
+                m_bCancel = true;
+                if (m_psSearch)
+                    m_psSearch->Cancel();
+                break;
+            }
+
+            if (pcMessage->GetCode() == M_FIND_INDEX)
+            {
+                m_nMode = FIND_INDEX;
+                m_pcStatus->SetString("Indexing...");
+            }
+            else
+            {
+                std::string cError;
+                int nFlags = (m_pcRegex->GetValue() ? SEARCH_REGEX : 0) | (m_pcIgnoreCase->GetValue() ? SEARCH_ICASE : 0) |
+                  (m_pcNamesOnly->GetValue() ? SEARCH_NAMES_ONLY : 0);
+                if (!m_cMatcher.Compile(m_pcPattern->GetBuffer()[0].c_str(), nFlags, &cError))
+                {
+                    m_pcStatus->SetString(cError.c_str());
+                    break;
+                }
+                m_nMode = m_pcCatalog->GetValue() ? FIND_CATALOG : FIND_SCAN;
+                if (m_nMode == FIND_SCAN)
+                    m_psSearch = new SearchJob(&m_cMatcher, SearchReport, SearchLog, this);
+                m_pcStatus->SetString("Searching...");
+            }
+
+            m_cPath = m_pcPath->GetBuffer()[0].c_str();
+            m_pcResults->Clear();
+            m_pcFind->SetLabel("Stop");
+            m_pcIndex->SetEnable(false);
+            m_bBusy = true;
+            m_bCancel = false;
+            thread_id search_thread = spawn_thread("expander search", (void *)ExpanderSearch, NORMAL_PRIORITY, 0, this);
+            resume_thread(search_thread);
+            break;
+        }
+
+        case M_FIND_DONE:
+        {
+            const char *pzStatus;
+            if (pcMessage->FindString("status", &pzStatus) == 0)
+                m_pcStatus->SetString(pzStatus);
+            m_pcFind->SetLabel("Find");
+            m_pcIndex->SetEnable(true);
+            delete m_psSearch;
+            m_psSearch = NULL;
+            m_bBusy = false;
+            if (m_bClose)
+                PostMessage(os::M_QUIT);
+            break;
+        }
+
+        default:
+            os::Window::HandleMessage(pcMessage);
+            break;
+    }
+}
+
+// ExpanderFind destructor
+ExpanderFind::~ExpanderFind()
+{
+    m_pcParent->m_pcFindWind = NULL;
+}
+
 // ExpanderApp constructor
-ExpanderApp::ExpanderApp(const char *pzParams)
+ExpanderApp::ExpanderApp(int nCount, char **ppzParams, LaunchForward *psLaunch)
   : Application("application/x-vnd.syllable-FileExpander")
 {
     // variables
     struct stat stbuf;
-    unsigned int j, st_size;
+    unsigned int st_size;
     int fd, dir_fd;
-    char *tmpFileBuf, *maxFileBuf;
     float winpos[3] = { 0, 0, 0 };
     const unsigned int winpos_size = 3u * sizeof(float);
     const unsigned int min_st_size = winpos_size + sizeof(prefs_settings);
-    const float yOffSet = 125.0f;
-
-    m_pcWind = NULL;
 
-    // opening file descriptor
-    fd = open("/etc/FileExpander.rules", O_RDONLY);
+    m_bStarted = false;
+    m_psLaunch = psLaunch;
+    m_bReloading = m_bReloadAgain = false;
+    for (int i = 0; i < MONITOR_COUNT; i++)
+        m_apcMonitor[i] = NULL;
 
-    if (fstat(fd, &stbuf) < 0)
+    if (stat(EXPANDER_RULES, &stbuf) < 0)
     {
-        close(fd);
         os::Resources pcFEResources(get_image_id());
         os::ResStream *pcResStream = pcFEResources.GetResourceStream("error32x32.png");
         os::BitmapImage *pcBitmapImage = new os::BitmapImage(pcResStream);
@@ -1540,68 +3046,23 @@ ExpanderApp::ExpanderApp(const char *pzParams)
         return;
     }
 
-    // creating and reading file buffer
-    st_size = stbuf.st_size;
-    FileBuf = new char[st_size + 1];
-    read(fd, FileBuf, st_size);
-    close(fd);
-    maxFileBuf = FileBuf + st_size;
-    *maxFileBuf = '\n';
-
-    // creating text buffer
-    pzTextBuffer = new char[TEXTBUF_MAXINDEX + 1];
-
-    // creating hash-tables
-    hash_table = new hash_struct*[HASH_FULL_SIZE];
-    for (hash_ptr = hash_table + HASH_FULL_SIZE; hash_ptr != hash_table; hash_ptr--)
-        *hash_ptr = NULL;
-
-    tmpFileBuf = FileBuf;
-    while (tmpFileBuf < maxFileBuf)
-    {
-        while (*tmpFileBuf == ' ') tmpFileBuf++;
-        if (*tmpFileBuf == '\"')
-        {
-            rule = new char*[RULE_COUNT];
-            for (j = 0; j < RULE_COUNT; j++)
-            {
-                while (*tmpFileBuf++ != '\"');
-                rule[j] = tmpFileBuf;
-                while (*tmpFileBuf != '\"') tmpFileBuf++;
-                *tmpFileBuf = '\0';
-            }
-            for (j = 0; j < HASH_FULL_SIZE; j += HASH_SIZE)
-            {
-                while (*tmpFileBuf++ != '\"');
-                elem = new hash_struct;
-                elem->name = tmpFileBuf;
-                elem->rule = rule;
-                while (*tmpFileBuf != '\"') tmpFileBuf++;
-                *tmpFileBuf = '\0';
-                hash_ptr = hash_table + hash(elem->name) + j;
-                elem->next = *hash_ptr;
-                *hash_ptr = elem;
-            }
-        }
-        while (*tmpFileBuf++ != '\n');
-    }
-
-    os::Desktop *pcDesk = new os::Desktop;
-    os::Point deskPoint(pcDesk->GetResolution());
-    delete pcDesk;
+    // reading rules and creating hash-tables in the background
+    m_cUserRules = getenv("HOME");
+    m_cUserRules += "/" EXPANDER_USER_RULES;
+    m_bReloading = true;
+    rules_thread = spawn_thread("expander_rules", (void *)ExpanderRules, NORMAL_PRIORITY, 0, this);
+    resume_thread(rules_thread);
 
     // opening settings file descriptor
     dir_fd = open(getenv("HOME"), O_RDONLY);
     fd = based_open(dir_fd, EXPANDER_SETTINGS, O_RDONLY);
     close(dir_fd);
 
-    // creating destination path buffer
-    defDestPath = new char[PATH_MAX + 1];
-
     if (fstat(fd, &stbuf) < 0 || ((st_size = stbuf.st_size) < min_st_size))
     {
         std::cerr << "Settings file not found or incorrect" << std::endl;
         prefs_settings = 024;
+        prefs_extra = TREE_LISTING;
         *defDestPath = '\0';
     }
 
@@ -1613,73 +3074,228 @@ ExpanderApp::ExpanderApp(const char *pzParams)
         // load prefs
         read(fd, &prefs_settings, sizeof(prefs_settings));
 
-        // getting destination path
+        // getting destination path (older files end with it, newer ones
+        // have NUL and extended settings after it)
         st_size -= min_st_size;
-        read(fd, defDestPath, st_size);
-        defDestPath[st_size] = '\0';
+        char *pzRest = new char[st_size + 1];
+        int nRead = read(fd, pzRest, st_size);
+        pzRest[nRead > 0 ? nRead : 0] = '\0';
+        unsigned int nPathLen = strlen(pzRest);
+        if (nPathLen > PATH_MAX)
+            nPathLen = 0;
+        memcpy(defDestPath, pzRest, nPathLen);
+        defDestPath[nPathLen] = '\0';
+        if (nRead > 0 && nPathLen + 1 + sizeof(prefs_extra) <= (unsigned int)nRead)
+            memcpy(&prefs_extra, pzRest + nPathLen + 1, sizeof(prefs_extra));
+        if (nRead > 0 && nPathLen + 1 + sizeof(prefs_extra) + sizeof(prefs_limit) <= (unsigned int)nRead)
+            memcpy(&prefs_limit, pzRest + nPathLen + 1 + sizeof(prefs_extra), sizeof(prefs_limit));
+        if (nRead > 0 && nPathLen + 1 + sizeof(prefs_extra) + sizeof(prefs_limit) + sizeof(prefs_memory) <= (unsigned int)nRead)
+            memcpy(&prefs_memory, pzRest + nPathLen + 1 + sizeof(prefs_extra) + sizeof(prefs_limit), sizeof(prefs_memory));
+        delete [] pzRest;
     }
 
     // close file descriptor
     close(fd);
+    ApplyTracing();
 
-    // checking window position
-    if ((winpos[0] >= winpos[1]) || (winpos[0] > deskPoint.x) || (winpos[2] > deskPoint.y))
+    // checking window position (the desktop resolution is checked by the window later)
+    if (winpos[0] >= winpos[1])
     {
         std::cerr << "Window position information isn't correct!" << std::endl;
         winpos[0] = 20.0f; winpos[1] = 450.0f; winpos[2] = 100.0f;
     }
 
-    // creating window
-    m_pcWind = new ExpanderWindow(os::Rect(winpos[0], winpos[2], winpos[1], winpos[2] + yOffSet), pzParams);
-    m_pcWind->SetSizeLimits(os::Point(430.0f, yOffSet), os::Point(os::COORD_MAX, yOffSet + EXPANDER_EXTRA));
-    m_pcWind->Show();
-    m_pcWind->MakeFocus();
+    // creating windows (one for every archive)
+    m_bStarted = true;
+    m_cWindowFrame = os::Rect(winpos[0], winpos[2], winpos[1], winpos[2] + EXPANDER_HEIGHT);
+    if (nCount == 0)
+        OpenWindow("");
+    for (int i = 0; i < nCount; i++)
+        OpenWindow(ppzParams[i]);
+
+    // later launches only give their archives to this instance
+    if (m_psLaunch)
+        m_psLaunch->Serve(LaunchOpen, this);
+}
 
-    if (*pzParams)
+// OpenWindow - creating a window for the archive (or an empty one)
+void ExpanderApp::OpenWindow(const char *pzPath)
+{
+    ExpanderWindow *pcWind = new ExpanderWindow(m_cWindowFrame, pzPath);
+    pcWind->SetSizeLimits(os::Point(430.0f, EXPANDER_HEIGHT), os::Point(os::COORD_MAX, EXPANDER_HEIGHT + EXPANDER_EXTRA));
+    m_apcWind.push_back(pcWind);
+    m_cWindowFrame.left += WINDOW_CASCADE;
+    m_cWindowFrame.right += WINDOW_CASCADE;
+    m_cWindowFrame.top += WINDOW_CASCADE;
+    m_cWindowFrame.bottom += WINDOW_CASCADE;
+    pcWind->Show();
+    pcWind->MakeFocus();
+
+    if (*pzPath)
     {
         const int autoexpand = prefs_settings & AUTOEXPAND, autolisting = prefs_settings & AUTOLISTING;
 
         if (autoexpand && autolisting)
-            m_pcWind->m_cExpandList = true;
+            pcWind->m_cExpandList = true;
         else if (autoexpand) {
-            os::Invoker *pcParentInvoker = new os::Invoker(new os::Message(ExpanderWindow::M_MENU_FILE_EXPAND), m_pcWind);
+            os::Invoker *pcParentInvoker = new os::Invoker(new os::Message(ExpanderWindow::M_MENU_FILE_EXPAND), pcWind);
             pcParentInvoker->Invoke();
         }
 
         if (autolisting) {
-            os::Invoker *pcParentInvoker = new os::Invoker(new os::Message(ExpanderWindow::M_MENU_FILE_LIST), m_pcWind);
+            os::Invoker *pcParentInvoker = new os::Invoker(new os::Message(ExpanderWindow::M_MENU_FILE_LIST), pcWind);
             pcParentInvoker->Invoke();
         }
     }
 }
 
-// virtual method: OkToQuit
-bool ExpanderApp::OkToQuit()
+// LoadRules - reading rules files and creating hash-tables (rules thread)
+void ExpanderApp::LoadRules()
+{
+    RuleTable *psRules = RuleTable::Load(EXPANDER_RULES, m_cUserRules.c_str());
+
+    // lookups in progress keep using old tables until they are done
+    if (psRules)
+        PublishRules(psRules);
+    else
+        std::cerr << "Error reading rules file! Previous rules are kept." << std::endl;
+
+    if (!rules_ready)
+    {
+        __sync_synchronize();
+        rules_ready = true;
+        StartupReady(STARTUP_RULES);
+    }
+    PostMessage(M_RULES_LOADED);
+}
+
+// ReloadRules - rebuilding rules in the background if rules files were changed
+void ExpanderApp::ReloadRules()
 {
-    // (if FileExpander.rules presents then object should be created)
-    if (m_pcWind)
+    if (m_bReloading)
     {
-        struct hash_struct *tmpelem;
+        m_bReloadAgain = true;
+        return;
+    }
+
+    RuleTable *psRules = AcquireRules();
+    bool bStale = !psRules || psRules->IsStale(EXPANDER_RULES, m_cUserRules.c_str());
+    if (psRules)
+        psRules->Release();
+
+    if (bStale)
+    {
+        m_bReloading = true;
+        rules_thread = spawn_thread("expander_rules", (void *)ExpanderRules, NORMAL_PRIORITY, 0, this);
+        resume_thread(rules_thread);
+    }
+}
+
+// WatchRules - (re)creating node monitors (files may be replaced by editors)
+void ExpanderApp::WatchRules()
+{
+    os::String cUserConfig = getenv("HOME");
+    cUserConfig += "/config";
+    const char *apzPath[MONITOR_COUNT] = { EXPANDER_RULES, m_cUserRules.c_str(), cUserConfig.c_str() };
+    const uint32 anFlags[MONITOR_COUNT] = { NWATCH_STAT | NWATCH_NAME, NWATCH_STAT | NWATCH_NAME, NWATCH_DIR };
 
-        m_pcWind->Close();
+    for (int i = 0; i < MONITOR_COUNT; i++)
+    {
+        delete m_apcMonitor[i];
+        m_apcMonitor[i] = NULL;
+        if (access(apzPath[i], F_OK) == 0)
+            m_apcMonitor[i] = new os::NodeMonitor(apzPath[i], anFlags[i], this);
+    }
+}
 
-        // removing objects
-        for (hash_ptr = hash_table + HASH_FULL_SIZE; hash_ptr != hash_table; hash_ptr--)
+// virtual method: HandleMessage
+void ExpanderApp::HandleMessage(os::Message *pcMessage)
+{
+    switch (pcMessage->GetCode())
+    {
+        case os::M_NODE_MONITOR:
+            ReloadRules();
+            break;
+
+        case M_RULES_LOADED:
+            m_bReloading = false;
+            WatchRules();
+            if (m_bReloadAgain)
+            {
+                m_bReloadAgain = false;
+                ReloadRules();
+            }
+            break;
+
+        case M_WINDOW_CLOSED:
         {
-            elem = *hash_ptr;
-            while (elem)
+            void *pWindow;
+            if (pcMessage->FindPointer("window", &pWindow) == 0)
             {
-                delete [] elem->rule;
-                tmpelem = elem->next;
-                delete elem;
-                elem = tmpelem;
+                for (unsigned int i = 0; i < m_apcWind.size(); i++)
+                {
+                    if (m_apcWind[i] == pWindow)
+                    {
+                        m_apcWind.erase(m_apcWind.begin() + i);
+                        break;
+                    }
+                }
+            }
+
+            // launches already taken are queued before M_LAST_WINDOW
+            if (m_apcWind.empty())
+            {
+                if (m_psLaunch)
+                    m_psLaunch->Stop();
+                PostMessage(M_LAST_WINDOW);
             }
+            break;
+        }
+
+        case M_LAST_WINDOW:
+            if (m_apcWind.empty())
+                PostMessage(os::M_QUIT);
+            else if (m_psLaunch)
+                m_psLaunch->Serve(LaunchOpen, this);
+            break;
+
+        case M_OPEN_WINDOWS:
+        {
+            const char *pzPath;
+            int i;
+            for (i = 0; pcMessage->FindString("file/path", &pzPath, i) == 0; i++)
+                OpenWindow(pzPath);
+            if (i == 0)
+                OpenWindow("");
+            break;
         }
 
-        delete [] hash_table;
-        delete [] FileBuf;
-        delete [] pzTextBuffer;
-        delete [] defDestPath;
+        default:
+            os::Application::HandleMessage(pcMessage);
+            break;
+    }
+}
+
+// virtual method: OkToQuit
+bool ExpanderApp::OkToQuit()
+{
+    // no launch is forwarded to a quitting instance
+    delete m_psLaunch;
+    m_psLaunch = NULL;
+
+    // (if FileExpander.rules presents then objects should be created)
+    if (m_bStarted)
+    {
+        for (unsigned int i = 0; i < m_apcWind.size(); i++)
+            m_apcWind[i]->Close();
+        m_apcWind.clear();
+
+        // waiting for the rules thread and removing objects
+        if (m_bReloading)
+            wait_for_thread(rules_thread);
+        for (int i = 0; i < MONITOR_COUNT; i++)
+            delete m_apcMonitor[i];
+        PublishRules(NULL);
     }
     return true;
 }
@@ -1689,10 +3305,96 @@ ExpanderApp::~ExpanderApp()
 {
 }
 
+// LaunchOpen - opening windows for a later launch (launch thread)
+void LaunchOpen(void *pData, const std::vector<std::string> &acPaths)
+{
+    os::Message *pcMessage = new os::Message(ExpanderApp::M_OPEN_WINDOWS);
+    for (unsigned int i = 0; i < acPaths.size(); i++)
+        pcMessage->AddString("file/path", acPaths[i]);
+    ((ExpanderApp *)pData)->PostMessage(pcMessage);
+}
+
+// Thread function: reading rules
+void ExpanderRules(void *pData)
+{
+    ((ExpanderApp *)pData)->LoadRules();
+}
+
+// WaitForRules - waiting for the rules thread (if rules aren't loaded yet)
+void WaitForRules()
+{
+    if (!rules_ready)
+        wait_for_thread(rules_thread);
+}
+
+// StartupTiming - reporting startup event (only if FILEEXPANDER_TIMING is set)
+void StartupTiming(const char *pzEvent)
+{
+    if (getenv(EXPANDER_TIMING))
+        std::cerr << "FileExpander: " << pzEvent << " " << (get_system_time() - startup_time) / 1000.0 << " ms" << std::endl;
+}
+
+// ApplyTracing - tracing jobs if FILEEXPANDER_TRACE is set or the preference
+// is on; trace files go into the folder it names, or into the private folder
+void ApplyTracing()
+{
+    const char *pzFolder = getenv(EXPANDER_TRACE);
+    std::string cRoot, cError;
+    struct stat stbuf;
+
+    if (!pzFolder && !(prefs_extra & TRACE_JOBS))
+        TraceDisable();
+    else if (pzFolder && stat(pzFolder, &stbuf) == 0 && S_ISDIR(stbuf.st_mode))
+        TraceEnable(pzFolder);
+    else
+        TraceEnable(GetCacheRoot(&cRoot, &cError) ? cRoot.c_str() : NULL);
+}
+
+// StartupReady - rules or deferred resources are ready (the last one reports
+// time-to-ready); every event counts once, so later windows report nothing
+void StartupReady(int nEvent)
+{
+    if (__sync_fetch_and_and(&startup_pending, ~nEvent) == nEvent)
+        StartupTiming("time-to-ready");
+}
+
+// ExpanderView constructor
+ExpanderView::ExpanderView(const os::Rect &cFrame, const os::String &cTitle, uint32 nResizeMask)
+  : os::View(cFrame, cTitle, nResizeMask), m_bPainted(false)
+{
+}
+
+// virtual method: Paint
+void ExpanderView::Paint(const os::Rect &cUpdateRect)
+{
+    if (!m_bPainted)
+    {
+        m_bPainted = true;
+        StartupTiming("time-to-first-paint");
+    }
+    os::View::Paint(cUpdateRect);
+}
+
 // Main function
 int main(int argc, char *argv[])
 {
-    ExpanderApp *pcExpApp = new ExpanderApp(argc > 1 ? argv[1] : "");
+    startup_time = get_system_time();
+
+    // a running FileExpander opens the windows with everything loaded already
+    LaunchForward *psLaunch = new LaunchForward;
+    int nLaunch = psLaunch->Forward(argc - 1, argv + 1);
+    if (nLaunch != LAUNCH_PRIMARY)
+    {
+        delete psLaunch;
+        psLaunch = NULL;
+    }
+    if (nLaunch == LAUNCH_FORWARDED)
+    {
+        StartupTiming("forwarded");
+        return 0;
+    }
+
+    ExpanderApp *pcExpApp = new ExpanderApp(argc - 1, argv + 1, psLaunch);
     pcExpApp->Run();
     return 0;
 }
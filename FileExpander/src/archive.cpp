@@ -0,0 +1,1532 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <signal.h>
+#include <libgen.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <pthread.h>
+#include <zlib.h>
+#include <bzlib.h>
+#include "archive.h"
+#include "zipcrypt.h"
+#include "plugin.h"
+
+enum Zip_Settings
+{
+    ZIP_KEY_WORKERS = 8,
+    ZIP_KEYS_AHEAD = 64 // members whose keys may be derived before they are read
+};
+
+// Little-endian fields (zip)
+static inline uint32_t get16(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static inline uint32_t get32(const unsigned char *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline uint64_t get64(const unsigned char *p)
+{
+    return get32(p) | ((uint64_t)get32(p + 4) << 32);
+}
+
+uint32_t archive_crc32(uint32_t nCrc, const void *pData, size_t nSize)
+{
+    return crc32(nCrc, (const Bytef *)pData, nSize);
+}
+
+//
+// ByteSource
+//
+ByteSource::ByteSource()
+  : m_nPosition(0)
+{
+}
+
+ByteSource::~ByteSource()
+{
+}
+
+bool ByteSource::ReadFull(void *pBuf, size_t nSize)
+{
+    char *p = (char *)pBuf;
+    while (nSize)
+    {
+        ssize_t nRead = Read(p, nSize);
+        if (nRead <= 0)
+        {
+            if (nRead == 0 && m_cError.empty())
+                m_cError = "Unexpected end of archive";
+            return false;
+        }
+        p += nRead;
+        nSize -= nRead;
+    }
+    return true;
+}
+
+bool ByteSource::Skip(uint64_t nSize)
+{
+    char aBuf[8192];
+    while (nSize)
+    {
+        size_t nPart = nSize < sizeof(aBuf) ? nSize : sizeof(aBuf);
+        if (!ReadFull(aBuf, nPart))
+            return false;
+        nSize -= nPart;
+    }
+    return true;
+}
+
+// Plain file
+class FdSource : public ByteSource
+{
+    public:
+        FdSource(int nFd) : m_nFd(nFd) {}
+        virtual ~FdSource() { close(m_nFd); }
+        virtual ssize_t Read(void *pBuf, size_t nSize);
+        virtual bool Skip(uint64_t nSize);
+    private:
+        int m_nFd;
+};
+
+// Skip - seeking over data (reading if the descriptor is not seekable)
+bool FdSource::Skip(uint64_t nSize)
+{
+    if (lseek(m_nFd, nSize, SEEK_CUR) < 0)
+        return ByteSource::Skip(nSize);
+    m_nPosition += nSize;
+    return true;
+}
+
+ssize_t FdSource::Read(void *pBuf, size_t nSize)
+{
+    ssize_t nRead;
+    while ((nRead = read(m_nFd, pBuf, nSize)) < 0 && errno == EINTR);
+    if (nRead < 0)
+        m_cError = strerror(errno);
+    else
+        m_nPosition += nRead;
+    return nRead;
+}
+
+// gzip (concatenated members are allowed)
+class GzipSource : public ByteSource
+{
+    public:
+        GzipSource(int nFd);
+        virtual ~GzipSource();
+        virtual ssize_t Read(void *pBuf, size_t nSize);
+    private:
+        int m_nFd;
+        z_stream m_sStream;
+        unsigned char m_aInput[ARCHIVE_BUFSIZE];
+        bool m_bEnd;
+};
+
+GzipSource::GzipSource(int nFd)
+  : m_nFd(nFd), m_bEnd(false)
+{
+    memset(&m_sStream, 0, sizeof(m_sStream));
+    inflateInit2(&m_sStream, 15 + 32);
+}
+
+GzipSource::~GzipSource()
+{
+    inflateEnd(&m_sStream);
+    close(m_nFd);
+}
+
+ssize_t GzipSource::Read(void *pBuf, size_t nSize)
+{
+    m_sStream.next_out = (Bytef *)pBuf;
+    m_sStream.avail_out = nSize;
+
+    while (m_sStream.avail_out == nSize && !m_bEnd)
+    {
+        if (!m_sStream.avail_in)
+        {
+            ssize_t nRead;
+            while ((nRead = read(m_nFd, m_aInput, sizeof(m_aInput))) < 0 && errno == EINTR);
+            if (nRead < 0)
+            {
+                m_cError = strerror(errno);
+                return -1;
+            }
+            if (!nRead)
+            {
+                m_cError = "Unexpected end of compressed data";
+                return -1;
+            }
+            m_sStream.next_in = m_aInput;
+            m_sStream.avail_in = nRead;
+        }
+
+        int nResult = inflate(&m_sStream, Z_NO_FLUSH);
+        if (nResult == Z_STREAM_END)
+        {
+            // next gzip member (if any); zeros after a member are padding,
+            // as gzip takes them (members start with a non-zero magic)
+            while (!m_bEnd)
+            {
+                while (m_sStream.avail_in && !*m_sStream.next_in)
+                {
+                    m_sStream.next_in++;
+                    m_sStream.avail_in--;
+                }
+                if (m_sStream.avail_in)
+                    break;
+                ssize_t nRead;
+                while ((nRead = read(m_nFd, m_aInput, sizeof(m_aInput))) < 0 && errno == EINTR);
+                if (nRead <= 0)
+                    m_bEnd = true;
+                m_sStream.next_in = m_aInput;
+                m_sStream.avail_in = nRead > 0 ? nRead : 0;
+            }
+            if (m_bEnd)
+                break;
+            inflateReset(&m_sStream);
+        }
+        else if (nResult != Z_OK && nResult != Z_BUF_ERROR)
+        {
+            m_cError = m_sStream.msg ? m_sStream.msg : "Compressed data is damaged";
+            return -1;
+        }
+    }
+
+    size_t nRead = nSize - m_sStream.avail_out;
+    m_nPosition += nRead;
+    return nRead;
+}
+
+// bzip2 (concatenated streams are allowed)
+class Bzip2Source : public ByteSource
+{
+    public:
+        Bzip2Source(int nFd);
+        virtual ~Bzip2Source();
+        virtual ssize_t Read(void *pBuf, size_t nSize);
+    private:
+        int m_nFd;
+        bz_stream m_sStream;
+        char m_aInput[ARCHIVE_BUFSIZE];
+        bool m_bEnd;
+};
+
+Bzip2Source::Bzip2Source(int nFd)
+  : m_nFd(nFd), m_bEnd(false)
+{
+    memset(&m_sStream, 0, sizeof(m_sStream));
+    BZ2_bzDecompressInit(&m_sStream, 0, 0);
+}
+
+Bzip2Source::~Bzip2Source()
+{
+    BZ2_bzDecompressEnd(&m_sStream);
+    close(m_nFd);
+}
+
+ssize_t Bzip2Source::Read(void *pBuf, size_t nSize)
+{
+    m_sStream.next_out = (char *)pBuf;
+    m_sStream.avail_out = nSize;
+
+    while (m_sStream.avail_out == nSize && !m_bEnd)
+    {
+        if (!m_sStream.avail_in)
+        {
+            ssize_t nRead;
+            while ((nRead = read(m_nFd, m_aInput, sizeof(m_aInput))) < 0 && errno == EINTR);
+            if (nRead < 0)
+            {
+                m_cError = strerror(errno);
+                return -1;
+            }
+            if (!nRead)
+            {
+                m_cError = "Unexpected end of compressed data";
+                return -1;
+            }
+            m_sStream.next_in = m_aInput;
+            m_sStream.avail_in = nRead;
+        }
+
+        int nResult = BZ2_bzDecompress(&m_sStream);
+        if (nResult == BZ_STREAM_END)
+        {
+            if (!m_sStream.avail_in)
+            {
+                ssize_t nRead;
+                while ((nRead = read(m_nFd, m_aInput, sizeof(m_aInput))) < 0 && errno == EINTR);
+                if (nRead <= 0)
+                {
+                    m_bEnd = true;
+                    break;
+                }
+                m_sStream.next_in = m_aInput;
+                m_sStream.avail_in = nRead;
+            }
+            char *pzNext = m_sStream.next_in;
+            unsigned int nAvail = m_sStream.avail_in;
+            BZ2_bzDecompressEnd(&m_sStream);
+            memset(&m_sStream, 0, sizeof(m_sStream));
+            BZ2_bzDecompressInit(&m_sStream, 0, 0);
+            m_sStream.next_in = pzNext;
+            m_sStream.avail_in = nAvail;
+            m_sStream.next_out = (char *)pBuf + (nSize - m_sStream.avail_out);
+            m_sStream.avail_out = nSize - (m_sStream.next_out - (char *)pBuf);
+        }
+        else if (nResult != BZ_OK)
+        {
+            m_cError = "Compressed data is damaged";
+            return -1;
+        }
+    }
+
+    size_t nRead = nSize - m_sStream.avail_out;
+    m_nPosition += nRead;
+    return nRead;
+}
+
+// External decompressor (reads the archive from stdin, writes to stdout)
+class CommandSource : public ByteSource
+{
+    public:
+        CommandSource(int nFd, const char *pzCommand);
+        virtual ~CommandSource();
+        virtual ssize_t Read(void *pBuf, size_t nSize);
+    private:
+        int m_nPipe;
+        pid_t m_nPid;
+};
+
+CommandSource::CommandSource(int nFd, const char *pzCommand)
+  : m_nPipe(-1), m_nPid(-1)
+{
+    int aPipe[2];
+
+    if (pipe(aPipe) == 0)
+    {
+        m_nPid = fork();
+        if (!m_nPid)
+        {
+            dup2(nFd, STDIN_FILENO);
+            dup2(aPipe[1], STDOUT_FILENO);
+            close(aPipe[0]);
+            close(aPipe[1]);
+            close(nFd);
+            execlp("/bin/sh", "/bin/sh", "-c", pzCommand, (char *)NULL);
+            _exit(127);
+        }
+        close(aPipe[1]);
+        m_nPipe = aPipe[0];
+        if (m_nPid < 0)
+        {
+            close(m_nPipe);
+            m_nPipe = -1;
+        }
+    }
+    close(nFd);
+    if (m_nPipe < 0)
+        m_cError = "Unable to start decompressor";
+}
+
+CommandSource::~CommandSource()
+{
+    if (m_nPipe >= 0)
+        close(m_nPipe);
+    if (m_nPid > 0)
+    {
+        kill(m_nPid, SIGTERM);
+        waitpid(m_nPid, NULL, 0);
+    }
+}
+
+ssize_t CommandSource::Read(void *pBuf, size_t nSize)
+{
+    ssize_t nRead;
+
+    if (m_nPipe < 0)
+        return -1;
+    while ((nRead = read(m_nPipe, pBuf, nSize)) < 0 && errno == EINTR);
+    if (nRead < 0)
+        m_cError = strerror(errno);
+    else if (nRead == 0 && m_nPid > 0)
+    {
+        // checking decompressor exit status
+        int nStatus;
+        waitpid(m_nPid, &nStatus, 0);
+        m_nPid = -1;
+        if (!WIFEXITED(nStatus) || WEXITSTATUS(nStatus))
+        {
+            m_cError = "Decompressor failed";
+            return -1;
+        }
+    }
+    else
+        m_nPosition += nRead;
+    return nRead;
+}
+
+ByteSource *OpenSource(const char *pzFilter, int nFd, std::string *pcError)
+{
+    ByteSource *psSource;
+
+    if (!*pzFilter)
+        psSource = new FdSource(nFd);
+    else if (!strcmp(pzFilter, "gz"))
+        psSource = new GzipSource(nFd);
+    else if (!strcmp(pzFilter, "bz2"))
+        psSource = new Bzip2Source(nFd);
+    else if (!strcmp(pzFilter, "Z"))
+        psSource = new CommandSource(nFd, "gzip -dc");
+    else if (!strcmp(pzFilter, "xz"))
+        psSource = new CommandSource(nFd, "xz -dc");
+    else if (!strcmp(pzFilter, "zst"))
+        psSource = new CommandSource(nFd, "zstd -dc");
+    else
+    {
+        close(nFd);
+        *pcError = "Unknown compression format";
+        return NULL;
+    }
+
+    if (*psSource->GetError())
+    {
+        *pcError = psSource->GetError();
+        delete psSource;
+        return NULL;
+    }
+    return psSource;
+}
+
+//
+// ArchiveReader
+//
+ArchiveReader::~ArchiveReader()
+{
+}
+
+bool ArchiveReader::GetTotals(archive_size *psSize)
+{
+    return false;
+}
+
+void ArchiveReader::SetPassword(const char *pzPassword)
+{
+}
+
+// tar (ustar, GNU long names and pax extended headers)
+class TarReader : public ArchiveReader
+{
+    public:
+        TarReader(ByteSource *psSource) : m_psSource(psSource), m_nLeft(0), m_nPadding(0) {}
+        virtual ~TarReader() { delete m_psSource; }
+        virtual int NextEntry(archive_entry *psEntry);
+        virtual ssize_t ReadData(void *pBuf, size_t nSize);
+    private:
+        bool ReadString(uint64_t nSize, std::string *pcString);
+        void ParsePax(const std::string &cPax, archive_entry *psEntry, bool *pbSize, bool *pbName, bool *pbLink);
+
+        ByteSource *m_psSource;
+        uint64_t m_nLeft; // data bytes left in the current entry
+        uint64_t m_nPadding;
+};
+
+// parsing octal or base-256 number
+static uint64_t tar_number(const char *p, size_t nSize)
+{
+    uint64_t nValue = 0;
+
+    if (*(const unsigned char *)p & 0x80)
+    {
+        nValue = *(const unsigned char *)p & 0x3f;
+        while (--nSize)
+            nValue = (nValue << 8) | *(const unsigned char *)++p;
+        return nValue;
+    }
+
+    while (nSize && (*p == ' ' || *p == '\0'))
+    {
+        p++;
+        nSize--;
+    }
+    for (; nSize && *p >= '0' && *p <= '7'; p++, nSize--)
+        nValue = (nValue << 3) | (*p - '0');
+    return nValue;
+}
+
+static std::string tar_field(const char *p, size_t nSize)
+{
+    return std::string(p, strnlen(p, nSize));
+}
+
+bool TarReader::ReadString(uint64_t nSize, std::string *pcString)
+{
+    if (nSize > (1 << 20))
+    {
+        m_cError = "Extended header is too big";
+        return false;
+    }
+    pcString->resize(nSize);
+    if (nSize && !m_psSource->ReadFull(&(*pcString)[0], nSize))
+        return false;
+    return m_psSource->Skip((TAR_BLOCK - nSize % TAR_BLOCK) % TAR_BLOCK);
+}
+
+void TarReader::ParsePax(const std::string &cPax, archive_entry *psEntry, bool *pbSize, bool *pbName, bool *pbLink)
+{
+    size_t nPos = 0;
+
+    // records: "<length> <key>=<value>\n"
+    while (nPos < cPax.size())
+    {
+        size_t nLength = strtoul(cPax.c_str() + nPos, NULL, 10);
+        size_t nSpace = cPax.find(' ', nPos);
+        if (!nLength || nSpace == std::string::npos || nPos + nLength > cPax.size())
+            break;
+        size_t nEqual = cPax.find('=', nSpace);
+        if (nEqual != std::string::npos && nEqual < nPos + nLength)
+        {
+            std::string cKey = cPax.substr(nSpace + 1, nEqual - nSpace - 1);
+            std::string cValue = cPax.substr(nEqual + 1, nPos + nLength - nEqual - 2);
+            if (cKey == "path")
+            {
+                psEntry->name = cValue;
+                *pbName = true;
+            }
+            else if (cKey == "linkpath")
+            {
+                psEntry->link = cValue;
+                *pbLink = true;
+            }
+            else if (cKey == "size")
+            {
+                psEntry->size = strtoull(cValue.c_str(), NULL, 10);
+                *pbSize = true;
+            }
+            else if (cKey == "mtime")
+                psEntry->mtime = strtoll(cValue.c_str(), NULL, 10);
+        }
+        nPos += nLength;
+    }
+}
+
+int TarReader::NextEntry(archive_entry *psEntry)
+{
+    unsigned char aHeader[TAR_BLOCK];
+    bool bSize = false, bName = false, bLink = false, bTime = false;
+    archive_entry sExt;
+
+    // skipping the rest of the previous entry
+    if (!m_psSource->Skip(m_nLeft + m_nPadding))
+    {
+        m_cError = m_psSource->GetError();
+        return -1;
+    }
+    m_nLeft = m_nPadding = 0;
+
+    psEntry->offset = m_psSource->GetPosition();
+    sExt.mtime = 0;
+
+    while (true)
+    {
+        ssize_t nRead = m_psSource->Read(aHeader, 1);
+        if (nRead == 0)
+            return 0; // archive without end blocks
+        if (nRead < 0 || !m_psSource->ReadFull(aHeader + 1, TAR_BLOCK - 1))
+        {
+            m_cError = m_psSource->GetError();
+            return -1;
+        }
+
+        // end of archive
+        unsigned int i, nSum = 0;
+        for (i = 0; i < TAR_BLOCK && !aHeader[i]; i++);
+        if (i == TAR_BLOCK)
+            return 0;
+
+        // checksum (the field itself is counted as spaces)
+        for (i = 0; i < TAR_BLOCK; i++)
+            nSum += (i >= 148 && i < 156) ? ' ' : aHeader[i];
+        if (nSum != tar_number((char *)aHeader + 148, 8))
+        {
+            m_cError = "Damaged tar header";
+            return -1;
+        }
+
+        const char *pzHeader = (const char *)aHeader;
+        char nType = pzHeader[156];
+        uint64_t nSize = tar_number(pzHeader + 124, 12);
+
+        // extended headers apply to the next entry
+        if (nType == 'L' || nType == 'K' || nType == 'x' || nType == 'g')
+        {
+            std::string cData;
+            if (!ReadString(nSize, &cData))
+            {
+                if (m_cError.empty())
+                    m_cError = m_psSource->GetError();
+                return -1;
+            }
+            if (nType == 'L')
+            {
+                sExt.name = cData.c_str();
+                bName = true;
+            }
+            else if (nType == 'K')
+            {
+                sExt.link = cData.c_str();
+                bLink = true;
+            }
+            else if (nType == 'x')
+            {
+                ParsePax(cData, &sExt, &bSize, &bName, &bLink);
+                bTime = sExt.mtime != 0;
+            }
+            continue;
+        }
+
+        // ustar prefix
+        if (bName)
+            psEntry->name = sExt.name;
+        else if (!memcmp(pzHeader + 257, "ustar", 5) && pzHeader[345])
+            psEntry->name = tar_field(pzHeader + 345, 155) + "/" + tar_field(pzHeader, 100);
+        else
+            psEntry->name = tar_field(pzHeader, 100);
+        psEntry->link = bLink ? sExt.link : tar_field(pzHeader + 157, 100);
+        psEntry->mode = tar_number(pzHeader + 100, 8) & 07777;
+        psEntry->mtime = bTime ? sExt.mtime : (time_t)tar_number(pzHeader + 136, 12);
+        psEntry->size = bSize ? sExt.size : nSize;
+        psEntry->has_crc = false;
+        psEntry->encrypted = false;
+
+        switch (nType)
+        {
+            case '0': case '\0': case '7':
+                psEntry->type = ENTRY_FILE;
+                break;
+            case '1':
+                psEntry->type = ENTRY_HARDLINK;
+                break;
+            case '2':
+                psEntry->type = ENTRY_SYMLINK;
+                break;
+            case '5':
+                psEntry->type = ENTRY_DIR;
+                break;
+            default:
+                psEntry->type = ENTRY_OTHER;
+                break;
+        }
+
+        // old tar marks directories with a trailing slash only
+        while (psEntry->name.size() > 1 && psEntry->name[psEntry->name.size() - 1] == '/')
+        {
+            psEntry->name.erase(psEntry->name.size() - 1);
+            if (psEntry->type == ENTRY_FILE)
+                psEntry->type = ENTRY_DIR;
+        }
+
+        // links and directories have no data
+        if (psEntry->type == ENTRY_HARDLINK || psEntry->type == ENTRY_SYMLINK || psEntry->type == ENTRY_DIR)
+            psEntry->size = 0;
+        if (nType == '1' || nType == '2' || nType == '3' || nType == '4' || nType == '5' || nType == '6')
+            nSize = 0;
+        else if (bSize)
+            nSize = sExt.size;
+        psEntry->csize = psEntry->size;
+
+        m_nLeft = nSize;
+        m_nPadding = (TAR_BLOCK - nSize % TAR_BLOCK) % TAR_BLOCK;
+        if (psEntry->type != ENTRY_FILE)
+            psEntry->size = 0;
+        return 1;
+    }
+}
+
+ssize_t TarReader::ReadData(void *pBuf, size_t nSize)
+{
+    if (nSize > m_nLeft)
+        nSize = m_nLeft;
+    if (!nSize)
+        return 0;
+    ssize_t nRead = m_psSource->Read(pBuf, nSize);
+    if (nRead <= 0)
+    {
+        m_cError = nRead ? m_psSource->GetError() : "Unexpected end of archive";
+        return -1;
+    }
+    m_nLeft -= nRead;
+    return nRead;
+}
+
+// zip (central directory based)
+class ZipReader : public ArchiveReader
+{
+    public:
+        ZipReader(int nFd);
+        virtual ~ZipReader();
+        virtual int NextEntry(archive_entry *psEntry);
+        virtual ssize_t ReadData(void *pBuf, size_t nSize);
+        virtual bool GetTotals(archive_size *psSize);
+        virtual void SetPassword(const char *pzPassword);
+    private:
+        struct zip_member
+        {
+            archive_entry entry;
+            uint32_t method, flags;
+            uint32_t dostime; // for ZipCrypto check byte
+            int aes_strength; // WinZip AES (0 if not)
+            uint64_t header; // local header offset
+        };
+
+        // AES keys derived by key workers
+        struct zip_keys
+        {
+            bool ready, failed;
+            unsigned char keys[WZAES_KEYS];
+            unsigned char verifier[WZAES_VERIFIER];
+            uint64_t data; // encrypted data offset
+        };
+
+        enum Zip_Cipher
+        {
+            CIPHER_NONE,
+            CIPHER_ZIPCRYPTO,
+            CIPHER_AES
+        };
+
+        bool ReadDirectory();
+        bool ReadAt(void *pBuf, size_t nSize, uint64_t nOffset);
+        bool ReadRaw(void *pBuf, size_t nSize);
+        bool StartDecrypt(archive_entry *psEntry);
+        bool DeriveKeys(unsigned int nMember, zip_keys *psKeys);
+        static void *KeyWorker(void *pData);
+        void StopKeyWorkers();
+
+        int m_nFd;
+        std::vector<zip_member> m_asMember;
+        size_t m_nIndex;
+        bool m_bDamaged; // central directory or local header (errors stay, other members can't be reached)
+
+        // current entry (its data can't be read if it failed; the error is
+        // cleared by the next entry)
+        zip_member *m_psCurrent;
+        bool m_bFailed;
+        uint64_t m_nDataPos, m_nDataLeft, m_nOutLeft;
+        uint32_t m_nCrc;
+        z_stream m_sStream;
+        bool m_bInflate;
+        unsigned char m_aInput[ARCHIVE_BUFSIZE];
+
+        // decryption
+        std::string m_cPassword;
+        int m_nCipher;
+        zipcrypto_ctx m_sZipCrypto;
+        wzaes_ctx m_sAes;
+        std::vector<zip_keys> m_asKeys;
+        std::vector<pthread_t> m_ahKeyThread;
+        pthread_mutex_t m_hKeyLock;
+        pthread_cond_t m_hKeyReady, m_hKeyWake;
+        size_t m_nNextKey;
+        bool m_bKeyStop;
+};
+
+ZipReader::ZipReader(int nFd)
+  : m_nFd(nFd), m_nIndex(0), m_psCurrent(NULL), m_bFailed(false), m_bInflate(false), m_nCipher(CIPHER_NONE),
+    m_nNextKey(0), m_bKeyStop(false)
+{
+    memset(&m_sStream, 0, sizeof(m_sStream));
+    inflateInit2(&m_sStream, -15);
+    pthread_mutex_init(&m_hKeyLock, NULL);
+    pthread_cond_init(&m_hKeyReady, NULL);
+    pthread_cond_init(&m_hKeyWake, NULL);
+    m_bDamaged = !ReadDirectory();
+}
+
+ZipReader::~ZipReader()
+{
+    StopKeyWorkers();
+    pthread_cond_destroy(&m_hKeyWake);
+    pthread_cond_destroy(&m_hKeyReady);
+    pthread_mutex_destroy(&m_hKeyLock);
+    inflateEnd(&m_sStream);
+    close(m_nFd);
+
+    // not leaving the password and keys in freed memory
+    if (!m_cPassword.empty())
+        memset(&m_cPassword[0], 0, m_cPassword.size());
+    if (!m_asKeys.empty())
+        memset(&m_asKeys[0], 0, m_asKeys.size() * sizeof(zip_keys));
+    memset(&m_sZipCrypto, 0, sizeof(m_sZipCrypto));
+    memset(&m_sAes, 0, sizeof(m_sAes));
+}
+
+// pread of the whole buffer (usable by key workers, doesn't touch m_cError)
+static bool pread_full(int nFd, void *pBuf, size_t nSize, uint64_t nOffset)
+{
+    while (nSize)
+    {
+        ssize_t nRead = pread(nFd, pBuf, nSize, nOffset);
+        if (nRead < 0 && errno == EINTR)
+            continue;
+        if (nRead <= 0)
+        {
+            if (!nRead)
+                errno = 0;
+            return false;
+        }
+        pBuf = (char *)pBuf + nRead;
+        nSize -= nRead;
+        nOffset += nRead;
+    }
+    return true;
+}
+
+bool ZipReader::ReadAt(void *pBuf, size_t nSize, uint64_t nOffset)
+{
+    if (!pread_full(m_nFd, pBuf, nSize, nOffset))
+    {
+        m_cError = errno ? strerror(errno) : "Unexpected end of archive";
+        return false;
+    }
+    return true;
+}
+
+// DOS date and time to time_t
+static time_t zip_time(uint32_t nTime, uint32_t nDate)
+{
+    struct tm sTm;
+    memset(&sTm, 0, sizeof(sTm));
+    sTm.tm_sec = (nTime & 0x1f) * 2;
+    sTm.tm_min = (nTime >> 5) & 0x3f;
+    sTm.tm_hour = nTime >> 11;
+    sTm.tm_mday = nDate & 0x1f;
+    sTm.tm_mon = ((nDate >> 5) & 0x0f) - 1;
+    sTm.tm_year = (nDate >> 9) + 80;
+    sTm.tm_isdst = -1;
+    return mktime(&sTm);
+}
+
+// GetTotals - sizes from the central directory
+bool ZipReader::GetTotals(archive_size *psSize)
+{
+    psSize->bytes = 0;
+    psSize->files = m_asMember.size();
+    for (unsigned int i = 0; i < m_asMember.size(); i++)
+        psSize->bytes += m_asMember[i].entry.size;
+    return m_cError.empty();
+}
+
+bool ZipReader::ReadDirectory()
+{
+    struct stat stbuf;
+    unsigned char *pBuf;
+    uint64_t nEntries, nDirSize, nDirOffset;
+
+    if (fstat(m_nFd, &stbuf) < 0 || stbuf.st_size < 22)
+    {
+        m_cError = "Not a zip archive";
+        return false;
+    }
+
+    // looking for the end of central directory record
+    size_t nTail = stbuf.st_size < 65557 ? stbuf.st_size : 65557;
+    std::vector<unsigned char> aTail(nTail);
+    if (!ReadAt(&aTail[0], nTail, stbuf.st_size - nTail))
+        return false;
+
+    long nEnd = nTail - 22;
+    for (; nEnd >= 0 && get32(&aTail[nEnd]) != 0x06054b50; nEnd--);
+    if (nEnd < 0)
+    {
+        m_cError = "Not a zip archive";
+        return false;
+    }
+
+    pBuf = &aTail[nEnd];
+    nEntries = get16(pBuf + 10);
+    nDirSize = get32(pBuf + 12);
+    nDirOffset = get32(pBuf + 16);
+
+    // zip64 end of central directory
+    uint64_t nEndPos = stbuf.st_size - nTail + nEnd;
+    if (nEndPos >= 20)
+    {
+        unsigned char aLocator[20], aEnd64[56];
+        if (ReadAt(aLocator, 20, nEndPos - 20) && get32(aLocator) == 0x07064b50 &&
+            ReadAt(aEnd64, 56, get64(aLocator + 8)) && get32(aEnd64) == 0x06064b50)
+        {
+            nEntries = get64(aEnd64 + 32);
+            nDirSize = get64(aEnd64 + 40);
+            nDirOffset = get64(aEnd64 + 48);
+        }
+    }
+    m_cError.clear();
+
+    if (nDirOffset + nDirSize > (uint64_t)stbuf.st_size || nDirSize > (1u << 30))
+    {
+        m_cError = "Damaged zip central directory";
+        return false;
+    }
+
+    std::vector<unsigned char> aDir(nDirSize + 1);
+    if (!ReadAt(&aDir[0], nDirSize, nDirOffset))
+        return false;
+
+    size_t nPos = 0;
+    m_asMember.reserve(nEntries);
+    while (nPos + 46 <= nDirSize && get32(&aDir[nPos]) == 0x02014b50)
+    {
+        pBuf = &aDir[nPos];
+        uint32_t nNameLen = get16(pBuf + 28), nExtraLen = get16(pBuf + 30), nCommentLen = get16(pBuf + 32);
+        if (nPos + 46 + nNameLen + nExtraLen + nCommentLen > nDirSize)
+            break;
+
+        zip_member sMember;
+        archive_entry *psEntry = &sMember.entry;
+        uint32_t nMadeBy = get16(pBuf + 4) >> 8, nAttr = get32(pBuf + 38);
+
+        sMember.flags = get16(pBuf + 8);
+        sMember.method = get16(pBuf + 10);
+        sMember.dostime = get16(pBuf + 12);
+        sMember.aes_strength = 0;
+        psEntry->crc = get32(pBuf + 16);
+        psEntry->has_crc = true;
+        psEntry->encrypted = sMember.flags & 1;
+        psEntry->csize = get32(pBuf + 20);
+        psEntry->size = get32(pBuf + 24);
+        sMember.header = get32(pBuf + 42);
+        psEntry->mtime = zip_time(get16(pBuf + 12), get16(pBuf + 14));
+        psEntry->name.assign((char *)pBuf + 46, nNameLen);
+        psEntry->offset = sMember.header;
+
+        // extra fields: zip64 sizes, unix time and WinZip AES
+        unsigned char *pExtra = pBuf + 46 + nNameLen, *pExtraEnd = pExtra + nExtraLen;
+        while (pExtra + 4 <= pExtraEnd)
+        {
+            uint32_t nId = get16(pExtra), nSize = get16(pExtra + 2);
+            unsigned char *pData = pExtra + 4;
+            if (pData + nSize > pExtraEnd)
+                break;
+            if (nId == 0x0001)
+            {
+                if (psEntry->size == 0xffffffff && nSize >= 8)
+                {
+                    psEntry->size = get64(pData);
+                    pData += 8; nSize -= 8;
+                }
+                if (psEntry->csize == 0xffffffff && nSize >= 8)
+                {
+                    psEntry->csize = get64(pData);
+                    pData += 8; nSize -= 8;
+                }
+                if (sMember.header == 0xffffffff && nSize >= 8)
+                    sMember.header = get64(pData);
+            }
+            else if (nId == 0x5455 && nSize >= 5 && (pData[0] & 1))
+                psEntry->mtime = (int32_t)get32(pData + 1);
+            else if (nId == 0x9901 && nSize >= 7 && sMember.method == 99)
+            {
+                // AE-2 stores no CRC (the authentication code protects data)
+                sMember.aes_strength = pData[4];
+                sMember.method = get16(pData + 5);
+                if (get16(pData) == 2)
+                    psEntry->has_crc = false;
+            }
+            pExtra += 4 + get16(pExtra + 2);
+        }
+
+        // file type and permissions
+        psEntry->type = ENTRY_FILE;
+        psEntry->mode = 0644;
+        if (nMadeBy == 3 && (nAttr >> 16))
+        {
+            mode_t nMode = nAttr >> 16;
+            psEntry->mode = nMode & 07777;
+            if (S_ISDIR(nMode))
+                psEntry->type = ENTRY_DIR;
+            else if (S_ISLNK(nMode))
+                psEntry->type = ENTRY_SYMLINK;
+            else if (!S_ISREG(nMode) && (nMode & S_IFMT))
+                psEntry->type = ENTRY_OTHER; // no type bits - a file (as Info-ZIP takes it)
+        }
+        while (psEntry->name.size() > 1 && psEntry->name[psEntry->name.size() - 1] == '/')
+        {
+            psEntry->name.erase(psEntry->name.size() - 1);
+            psEntry->type = ENTRY_DIR;
+        }
+        if (psEntry->type == ENTRY_DIR && !(nMadeBy == 3 && (nAttr >> 16)))
+            psEntry->mode = 0755;
+
+        m_asMember.push_back(sMember);
+        nPos += 46 + nNameLen + nExtraLen + nCommentLen;
+    }
+    return true;
+}
+
+// SetPassword - starting key workers if there are AES members
+void ZipReader::SetPassword(const char *pzPassword)
+{
+    StopKeyWorkers();
+    m_cPassword = pzPassword ? pzPassword : "";
+
+    bool bAes = false;
+    for (unsigned int i = 0; i < m_asMember.size() && !bAes; i++)
+        bAes = m_asMember[i].entry.encrypted && m_asMember[i].aes_strength;
+    if (!bAes || m_cPassword.empty())
+        return;
+
+    // PBKDF2 takes milliseconds per member, so keys are derived ahead
+    // in parallel while members are decompressed
+    zip_keys sEmpty;
+    memset(&sEmpty, 0, sizeof(sEmpty));
+    m_asKeys.assign(m_asMember.size(), sEmpty);
+    m_nNextKey = m_nIndex;
+    m_bKeyStop = false;
+
+    long nWorkers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nWorkers > ZIP_KEY_WORKERS)
+        nWorkers = ZIP_KEY_WORKERS;
+    for (long i = 0; i < nWorkers; i++)
+    {
+        pthread_t hThread;
+        if (pthread_create(&hThread, NULL, KeyWorker, this) == 0)
+            m_ahKeyThread.push_back(hThread);
+    }
+}
+
+void ZipReader::StopKeyWorkers()
+{
+    pthread_mutex_lock(&m_hKeyLock);
+    m_bKeyStop = true;
+    pthread_cond_broadcast(&m_hKeyWake);
+    pthread_mutex_unlock(&m_hKeyLock);
+    for (unsigned int i = 0; i < m_ahKeyThread.size(); i++)
+        pthread_join(m_ahKeyThread[i], NULL);
+    m_ahKeyThread.clear();
+}
+
+// DeriveKeys - reading salt and verifier of the member and deriving keys
+bool ZipReader::DeriveKeys(unsigned int nMember, zip_keys *psKeys)
+{
+    const zip_member *psMember = &m_asMember[nMember];
+    unsigned char aLocal[30], aSalt[WZAES_MAX_KEY / 2];
+    int nSalt = wzaes_salt_size(psMember->aes_strength);
+
+    if (!nSalt || !pread_full(m_nFd, aLocal, sizeof(aLocal), psMember->header) || get32(aLocal) != 0x04034b50)
+        return false;
+    psKeys->data = psMember->header + 30 + get16(aLocal + 26) + get16(aLocal + 28);
+    if (!pread_full(m_nFd, aSalt, nSalt, psKeys->data) ||
+        !pread_full(m_nFd, psKeys->verifier, WZAES_VERIFIER, psKeys->data + nSalt))
+        return false;
+    psKeys->data += nSalt + WZAES_VERIFIER;
+    wzaes_derive(m_cPassword.c_str(), psMember->aes_strength, aSalt, psKeys->keys);
+    return true;
+}
+
+// Key worker - members are taken in order, not too far ahead of the reader
+void *ZipReader::KeyWorker(void *pData)
+{
+    ZipReader *pcReader = (ZipReader *)pData;
+
+    pthread_mutex_lock(&pcReader->m_hKeyLock);
+    while (!pcReader->m_bKeyStop)
+    {
+        size_t i = pcReader->m_nNextKey;
+        if (i >= pcReader->m_asMember.size())
+            break;
+        const zip_member &sMember = pcReader->m_asMember[i];
+        if (!sMember.entry.encrypted || !sMember.aes_strength || !sMember.entry.csize ||
+            sMember.entry.type == ENTRY_DIR || sMember.entry.type == ENTRY_OTHER)
+        {
+            pcReader->m_nNextKey++;
+            continue;
+        }
+        if (i >= pcReader->m_nIndex + ZIP_KEYS_AHEAD)
+        {
+            pthread_cond_wait(&pcReader->m_hKeyWake, &pcReader->m_hKeyLock);
+            continue;
+        }
+        pcReader->m_nNextKey++;
+        pthread_mutex_unlock(&pcReader->m_hKeyLock);
+
+        zip_keys sKeys;
+        sKeys.failed = !pcReader->DeriveKeys(i, &sKeys);
+
+        pthread_mutex_lock(&pcReader->m_hKeyLock);
+        sKeys.ready = true;
+        pcReader->m_asKeys[i] = sKeys;
+        memset(&sKeys, 0, sizeof(sKeys));
+        pthread_cond_broadcast(&pcReader->m_hKeyReady);
+    }
+    pthread_mutex_unlock(&pcReader->m_hKeyLock);
+    return NULL;
+}
+
+// StartDecrypt - checking password and setting up the cipher for the entry
+bool ZipReader::StartDecrypt(archive_entry *psEntry)
+{
+    if (m_cPassword.empty())
+    {
+        m_cError = "Password is needed: " + psEntry->name;
+        return false;
+    }
+    if (m_psCurrent->flags & 0x40)
+    {
+        m_cError = "Unsupported encryption: " + psEntry->name;
+        return false;
+    }
+
+    if (!m_psCurrent->aes_strength)
+    {
+        unsigned char aHeader[ZIPCRYPTO_HEADER];
+        if (m_nDataLeft < ZIPCRYPTO_HEADER || !ReadAt(aHeader, ZIPCRYPTO_HEADER, m_nDataPos))
+        {
+            if (m_cError.empty())
+                m_cError = "Damaged encrypted entry: " + psEntry->name;
+            return false;
+        }
+        m_nDataPos += ZIPCRYPTO_HEADER;
+        m_nDataLeft -= ZIPCRYPTO_HEADER;
+
+        // the last header byte is the high byte of CRC (or of time with data descriptor)
+        zipcrypto_init(&m_sZipCrypto, m_cPassword.c_str());
+        zipcrypto_decrypt(&m_sZipCrypto, aHeader, ZIPCRYPTO_HEADER);
+        unsigned char nCheck = (m_psCurrent->flags & 8) ? m_psCurrent->dostime >> 8 : psEntry->crc >> 24;
+        if (aHeader[ZIPCRYPTO_HEADER - 1] != nCheck)
+        {
+            m_cError = "Wrong password: " + psEntry->name;
+            return false;
+        }
+        m_nCipher = CIPHER_ZIPCRYPTO;
+        return true;
+    }
+
+    // WinZip AES: salt, verifier, data, authentication code
+    zip_keys sKeys;
+    size_t nMember = m_psCurrent - &m_asMember[0];
+    if (!m_ahKeyThread.empty())
+    {
+        pthread_mutex_lock(&m_hKeyLock);
+        pthread_cond_broadcast(&m_hKeyWake);
+        while (!m_asKeys[nMember].ready)
+            pthread_cond_wait(&m_hKeyReady, &m_hKeyLock);
+        sKeys = m_asKeys[nMember];
+        memset(&m_asKeys[nMember], 0, sizeof(zip_keys));
+        pthread_mutex_unlock(&m_hKeyLock);
+    }
+    else
+        sKeys.failed = !DeriveKeys(nMember, &sKeys);
+
+    int nSalt = wzaes_salt_size(m_psCurrent->aes_strength);
+    bool bResult = false;
+    if (!nSalt)
+        m_cError = "Unsupported encryption: " + psEntry->name;
+    else if (sKeys.failed || m_nDataLeft < (uint64_t)nSalt + WZAES_VERIFIER + WZAES_AUTH)
+        m_cError = "Damaged encrypted entry: " + psEntry->name;
+    else if (!wzaes_start(&m_sAes, m_psCurrent->aes_strength, sKeys.keys, sKeys.verifier))
+        m_cError = "Wrong password: " + psEntry->name;
+    else
+    {
+        m_nDataLeft -= nSalt + WZAES_VERIFIER + WZAES_AUTH;
+        m_nDataPos = sKeys.data;
+        m_nCipher = CIPHER_AES;
+        bResult = true;
+    }
+    memset(&sKeys, 0, sizeof(sKeys));
+    return bResult;
+}
+
+// ReadRaw - reading (and decrypting) member data
+bool ZipReader::ReadRaw(void *pBuf, size_t nSize)
+{
+    if (!ReadAt(pBuf, nSize, m_nDataPos))
+        return false;
+    m_nDataPos += nSize;
+    m_nDataLeft -= nSize;
+
+    if (m_nCipher == CIPHER_ZIPCRYPTO)
+        zipcrypto_decrypt(&m_sZipCrypto, (unsigned char *)pBuf, nSize);
+    else if (m_nCipher == CIPHER_AES)
+    {
+        wzaes_decrypt(&m_sAes, (unsigned char *)pBuf, nSize);
+        unsigned char aAuth[WZAES_AUTH];
+        if (!m_nDataLeft && (!ReadAt(aAuth, WZAES_AUTH, m_nDataPos) || !wzaes_finish(&m_sAes, aAuth)))
+        {
+            if (m_cError.empty())
+                m_cError = "Authentication failed (data is damaged): " + m_psCurrent->entry.name;
+            return false;
+        }
+    }
+    return true;
+}
+
+int ZipReader::NextEntry(archive_entry *psEntry)
+{
+    unsigned char aLocal[30];
+
+    if (m_bDamaged)
+        return -1;
+    m_cError.clear();
+    m_bFailed = false;
+    if (m_nIndex >= m_asMember.size())
+        return 0;
+
+    pthread_mutex_lock(&m_hKeyLock);
+    m_psCurrent = &m_asMember[m_nIndex++];
+    pthread_mutex_unlock(&m_hKeyLock);
+    *psEntry = m_psCurrent->entry;
+
+    if (!ReadAt(aLocal, sizeof(aLocal), m_psCurrent->header) || get32(aLocal) != 0x04034b50)
+    {
+        if (m_cError.empty())
+            m_cError = "Damaged zip local header";
+        m_bDamaged = true;
+        return -1;
+    }
+
+    m_nDataPos = m_psCurrent->header + 30 + get16(aLocal + 26) + get16(aLocal + 28);
+    m_nDataLeft = psEntry->csize;
+    m_nOutLeft = psEntry->size;
+    m_nCrc = 0;
+    m_bInflate = m_psCurrent->method == 8;
+    inflateReset(&m_sStream);
+    m_sStream.avail_in = 0;
+
+    if (psEntry->type == ENTRY_DIR || psEntry->type == ENTRY_OTHER)
+        m_nDataLeft = m_nOutLeft = 0;
+    else if (m_psCurrent->method != 0 && m_psCurrent->method != 8)
+    {
+        // the member is reported, reading its data fails
+        m_cError = "Unsupported compression method: " + psEntry->name;
+        m_bFailed = true;
+    }
+    m_nCipher = CIPHER_NONE;
+    if (!m_bFailed && psEntry->encrypted && m_nDataLeft && !StartDecrypt(psEntry))
+        m_bFailed = true;
+
+    // symbolic link target is stored as data
+    if (psEntry->type == ENTRY_SYMLINK)
+    {
+        char aLink[4096];
+        ssize_t nRead, nTotal = 0;
+        while (nTotal < (ssize_t)sizeof(aLink) && (nRead = ReadData(aLink + nTotal, sizeof(aLink) - nTotal)) > 0)
+            nTotal += nRead;
+        if (nRead < 0)
+            return -1;
+        psEntry->link.assign(aLink, nTotal);
+        psEntry->size = 0;
+    }
+    return 1;
+}
+
+ssize_t ZipReader::ReadData(void *pBuf, size_t nSize)
+{
+    size_t nOut;
+
+    if (m_bFailed)
+        return -1;
+    if (!m_nOutLeft)
+        return 0;
+    if (nSize > m_nOutLeft)
+        nSize = m_nOutLeft;
+
+    if (!m_bInflate)
+    {
+        if (nSize > m_nDataLeft)
+        {
+            m_cError = "Unexpected end of data: " + m_psCurrent->entry.name;
+            return -1;
+        }
+        if (!ReadRaw(pBuf, nSize))
+            return -1;
+        nOut = nSize;
+    }
+    else
+    {
+        m_sStream.next_out = (Bytef *)pBuf;
+        m_sStream.avail_out = nSize;
+        while (m_sStream.avail_out == nSize)
+        {
+            if (!m_sStream.avail_in)
+            {
+                size_t nPart = m_nDataLeft < sizeof(m_aInput) ? m_nDataLeft : sizeof(m_aInput);
+                if (!nPart || !ReadRaw(m_aInput, nPart))
+                {
+                    if (m_cError.empty())
+                        m_cError = "Unexpected end of compressed data";
+                    return -1;
+                }
+                m_sStream.next_in = m_aInput;
+                m_sStream.avail_in = nPart;
+            }
+            int nResult = inflate(&m_sStream, Z_NO_FLUSH);
+            if (nResult == Z_STREAM_END)
+                break;
+            if (nResult != Z_OK && nResult != Z_BUF_ERROR)
+            {
+                m_cError = "Compressed data is damaged: " + m_psCurrent->entry.name;
+                return -1;
+            }
+        }
+        nOut = nSize - m_sStream.avail_out;
+        if (!nOut)
+        {
+            m_cError = "Unexpected end of compressed data: " + m_psCurrent->entry.name;
+            return -1;
+        }
+    }
+
+    m_nCrc = archive_crc32(m_nCrc, pBuf, nOut);
+    m_nOutLeft -= nOut;
+    if (!m_nOutLeft && m_psCurrent->entry.has_crc && m_nCrc != m_psCurrent->entry.crc)
+    {
+        m_cError = "CRC error: " + m_psCurrent->entry.name;
+        return -1;
+    }
+    return nOut;
+}
+
+// Single compressed file (gz, bz2, Z)
+class RawReader : public ArchiveReader
+{
+    public:
+        RawReader(ByteSource *psSource, const char *pzPath, const char *pzSuffix);
+        virtual ~RawReader() { delete m_psSource; }
+        virtual int NextEntry(archive_entry *psEntry);
+        virtual ssize_t ReadData(void *pBuf, size_t nSize);
+    private:
+        ByteSource *m_psSource;
+        archive_entry m_sEntry;
+        bool m_bDone;
+};
+
+RawReader::RawReader(ByteSource *psSource, const char *pzPath, const char *pzSuffix)
+  : m_psSource(psSource), m_bDone(false)
+{
+    struct stat stbuf;
+    char *pzBuf = strdup(pzPath);
+
+    // the same name as unpack-fe creates
+    m_sEntry.name = basename(pzBuf);
+    free(pzBuf);
+    size_t nSuffix = strlen(pzSuffix);
+    if (m_sEntry.name.size() > nSuffix + 1 && m_sEntry.name[m_sEntry.name.size() - nSuffix - 1] == '.' &&
+        !m_sEntry.name.compare(m_sEntry.name.size() - nSuffix, nSuffix, pzSuffix))
+        m_sEntry.name.erase(m_sEntry.name.size() - nSuffix - 1);
+    else
+        m_sEntry.name += ".out";
+
+    m_sEntry.type = ENTRY_FILE;
+    m_sEntry.mode = 0644;
+    m_sEntry.mtime = stat(pzPath, &stbuf) == 0 ? stbuf.st_mtime : time(NULL);
+    m_sEntry.size = m_sEntry.csize = 0;
+    m_sEntry.has_crc = m_sEntry.encrypted = false;
+    m_sEntry.offset = 0;
+}
+
+int RawReader::NextEntry(archive_entry *psEntry)
+{
+    if (m_bDone)
+        return 0;
+    m_bDone = true;
+    *psEntry = m_sEntry;
+    return 1;
+}
+
+ssize_t RawReader::ReadData(void *pBuf, size_t nSize)
+{
+    ssize_t nRead = m_psSource->Read(pBuf, nSize);
+    if (nRead < 0)
+        m_cError = m_psSource->GetError();
+    return nRead;
+}
+
+// Splitting format into container and compression filter
+static bool ParseFormat(const char *pzFormat, std::string *pcContainer, std::string *pcFilter)
+{
+    const char *pzDot = strchr(pzFormat, '.');
+
+    if (!strcmp(pzFormat, "zip") || !strcmp(pzFormat, "tar"))
+    {
+        *pcContainer = pzFormat;
+        pcFilter->clear();
+    }
+    else if (pzDot && !strncmp(pzFormat, "tar.", 4))
+    {
+        *pcContainer = "tar";
+        *pcFilter = pzDot + 1;
+    }
+    else
+    {
+        *pcContainer = "raw";
+        *pcFilter = pzFormat;
+    }
+    return *pcContainer != "raw" || *pcFilter == "gz" || *pcFilter == "bz2" || *pcFilter == "Z";
+}
+
+bool IsBuiltinFormat(const char *pzFormat)
+{
+    std::string cContainer, cFilter;
+    if (!pzFormat || !ParseFormat(pzFormat, &cContainer, &cFilter))
+        return false;
+    return cFilter.empty() || cFilter == "gz" || cFilter == "bz2" || cFilter == "Z" ||
+           (cContainer == "tar" && (cFilter == "xz" || cFilter == "zst"));
+}
+
+bool IsNativeFormat(const char *pzFormat)
+{
+    return IsBuiltinFormat(pzFormat) || IsPluginFormat(pzFormat);
+}
+
+ArchiveReader *OpenTar(ByteSource *psSource)
+{
+    return new TarReader(psSource);
+}
+
+bool IsSingleFormat(const char *pzFormat)
+{
+    std::string cContainer, cFilter;
+    return IsNativeFormat(pzFormat) && ParseFormat(pzFormat, &cContainer, &cFilter) && cContainer == "raw";
+}
+
+bool HasPasswords(const char *pzFormat)
+{
+    return pzFormat && (!strcmp(pzFormat, "zip") || PluginHasPasswords(pzFormat));
+}
+
+ArchiveReader *OpenArchive(const char *pzFormat, const char *pzPath, std::string *pcError)
+{
+    std::string cContainer, cFilter;
+    ArchiveReader *pcReader;
+
+    if (!IsBuiltinFormat(pzFormat))
+        return OpenPlugin(pzFormat, pzPath, pcError);
+    ParseFormat(pzFormat, &cContainer, &cFilter);
+
+    int nFd = open(pzPath, O_RDONLY);
+    if (nFd < 0)
+    {
+        *pcError = strerror(errno);
+        return NULL;
+    }
+
+    if (cContainer == "zip")
+        pcReader = new ZipReader(nFd);
+    else
+    {
+        ByteSource *psSource = OpenSource(cFilter.c_str(), nFd, pcError);
+        if (!psSource)
+            return NULL;
+        if (cContainer == "tar")
+            pcReader = new TarReader(psSource);
+        else
+            pcReader = new RawReader(psSource, pzPath, cFilter.c_str());
+    }
+
+    if (*pcReader->GetError())
+    {
+        *pcError = pcReader->GetError();
+        delete pcReader;
+        return NULL;
+    }
+    return pcReader;
+}
+
+// gzip ISIZE trailer (size of the last member modulo 4 GB)
+static bool GzipSize(const char *pzPath, uint64_t *pnSize, std::string *pcError)
+{
+    struct stat stbuf;
+    unsigned char aTrailer[4];
+
+    int nFd = open(pzPath, O_RDONLY);
+    if (nFd < 0 || fstat(nFd, &stbuf) < 0 || stbuf.st_size < 18 ||
+        pread(nFd, aTrailer, sizeof(aTrailer), stbuf.st_size - 4) != sizeof(aTrailer))
+    {
+        *pcError = nFd < 0 ? strerror(errno) : "Damaged gzip file";
+        if (nFd >= 0)
+            close(nFd);
+        return false;
+    }
+    close(nFd);
+
+    // deflate hardly ever grows data, so a size much smaller than the
+    // compressed one means it wrapped
+    uint64_t nSize = get32(aTrailer);
+    while (nSize + (nSize >> 10) + 1024 < (uint64_t)stbuf.st_size)
+        nSize += 0x100000000ULL;
+    *pnSize = nSize;
+    return true;
+}
+
+bool EstimateSize(const char *pzFormat, const char *pzPath, archive_size *psSize, std::string *pcError)
+{
+    std::string cContainer, cFilter;
+
+    if (!IsNativeFormat(pzFormat))
+        return false;
+    ParseFormat(pzFormat, &cContainer, &cFilter);
+
+    psSize->bytes = psSize->files = 0;
+    if (cFilter == "gz")
+    {
+        // the tar stream size is close enough for a tar.gz
+        if (!GzipSize(pzPath, &psSize->bytes, pcError))
+            return false;
+        if (cContainer == "raw")
+            psSize->files = 1;
+        return true;
+    }
+    if (!cFilter.empty())
+        return false;
+
+    ArchiveReader *pcReader = OpenArchive(pzFormat, pzPath, pcError);
+    if (!pcReader)
+        return false;
+    bool bResult = pcReader->GetTotals(psSize);
+    if (!bResult && cContainer == "tar")
+    {
+        // walking headers (plain file data is seeked over)
+        archive_entry sEntry;
+        int nResult;
+        while ((nResult = pcReader->NextEntry(&sEntry)) > 0)
+        {
+            psSize->files++;
+            if (sEntry.type == ENTRY_FILE)
+                psSize->bytes += sEntry.size;
+        }
+        bResult = nResult == 0;
+        if (!bResult)
+            *pcError = pcReader->GetError();
+    }
+    delete pcReader;
+    return bResult;
+}
@@ -0,0 +1,126 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _NRUSLAN_ARCHIVE_H_
+#define _NRUSLAN_ARCHIVE_H_
+
+//
+// Native archive readers. Rules with a format:"..." field can be read
+// in-process (tar, tar.gz, tar.bz2, tar.Z, tar.xz, tar.zst, zip, gz, bz2,
+// Z, and formats of decoder plugins); this code uses plain POSIX calls
+// only, so it works without the GUI as well.
+//
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+enum Archive_Settings
+{
+    ARCHIVE_BUFSIZE = 65536,
+    TAR_BLOCK = 512
+};
+
+// Entry types
+enum Archive_EntryType
+{
+    ENTRY_FILE,
+    ENTRY_DIR,
+    ENTRY_SYMLINK,
+    ENTRY_HARDLINK,
+    ENTRY_OTHER // devices, fifos (skipped on extraction)
+};
+
+// Uncompressed size of the archive contents
+struct archive_size
+{
+    uint64_t bytes;
+    uint64_t files; // 0 if unknown
+};
+
+// Archive member
+struct archive_entry
+{
+    std::string name; // relative path ('/' separated)
+    std::string link; // symbolic or hard link target
+    int type;
+    mode_t mode; // permission bits
+    time_t mtime;
+    uint64_t size; // uncompressed size (0 if unknown)
+    uint64_t csize; // compressed size (zip) or size
+    uint32_t crc; // CRC-32 of the data (if has_crc)
+    bool has_crc;
+    bool encrypted;
+    uint64_t offset; // position of the member header in the decoded stream
+};
+
+//
+// ByteSource - decoded byte stream of the archive file
+//
+class ByteSource
+{
+    public:
+        ByteSource();
+        virtual ~ByteSource();
+        virtual ssize_t Read(void *pBuf, size_t nSize) = 0; // 0 at the end, -1 on error
+        bool ReadFull(void *pBuf, size_t nSize); // false on the end or error
+        virtual bool Skip(uint64_t nSize);
+        uint64_t GetPosition() const { return m_nPosition; }
+        const char *GetError() const { return m_cError.c_str(); }
+    protected:
+        uint64_t m_nPosition; // count of decoded bytes
+        std::string m_cError;
+};
+
+// pzFilter: "" (none), "gz", "bz2", "Z", "xz", "zst"; takes the file descriptor
+ByteSource *OpenSource(const char *pzFilter, int nFd, std::string *pcError);
+
+//
+// ArchiveReader - sequential access to archive members
+//
+class ArchiveReader
+{
+    public:
+        virtual ~ArchiveReader();
+        virtual int NextEntry(archive_entry *psEntry) = 0; // 1 - entry, 0 - end, -1 - error
+        virtual ssize_t ReadData(void *pBuf, size_t nSize) = 0; // data of the current entry
+        virtual bool GetTotals(archive_size *psSize); // false if not known without reading
+        virtual void SetPassword(const char *pzPassword); // for encrypted members (zip)
+        const char *GetError() const { return m_cError.c_str(); }
+    protected:
+        std::string m_cError;
+};
+
+bool IsNativeFormat(const char *pzFormat); // read by FileExpander itself or by a plugin
+bool IsBuiltinFormat(const char *pzFormat);
+bool IsSingleFormat(const char *pzFormat); // one compressed file (gz, bz2, Z)
+bool HasPasswords(const char *pzFormat); // members may be encrypted (zip, some plugins)
+ArchiveReader *OpenArchive(const char *pzFormat, const char *pzPath, std::string *pcError);
+ArchiveReader *OpenTar(ByteSource *psSource); // takes the source
+
+// Estimating uncompressed size from the archive metadata: zip central
+// directory, gzip ISIZE trailer or tar headers (false if it can't be
+// done without decompressing everything, e.g. tar.bz2)
+bool EstimateSize(const char *pzFormat, const char *pzPath, archive_size *psSize, std::string *pcError);
+
+// CRC-32 (zip, gzip)
+uint32_t archive_crc32(uint32_t nCrc, const void *pData, size_t nSize);
+
+#endif /* _NRUSLAN_ARCHIVE_H_ */
@@ -0,0 +1,345 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "cache.h"
+#include "extract.h"
+#include "seekindex.h"
+
+// Collecting extraction messages
+static void CollectLog(void *pData, const char *pzText)
+{
+    *(std::string *)pData += pzText;
+}
+
+void RemoveTree(int nDirFd, const char *pzName)
+{
+    struct dirent *psEntry;
+
+    if (unlinkat(nDirFd, pzName, 0) == 0)
+        return;
+
+    int nFd = openat(nDirFd, pzName, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+    if (nFd < 0)
+        return;
+    DIR *psDir = fdopendir(nFd);
+    if (!psDir)
+    {
+        close(nFd);
+        return;
+    }
+    while ((psEntry = readdir(psDir)))
+    {
+        if (strcmp(psEntry->d_name, ".") && strcmp(psEntry->d_name, ".."))
+            RemoveTree(nFd, psEntry->d_name);
+    }
+    closedir(psDir);
+    unlinkat(nDirFd, pzName, AT_REMOVEDIR);
+}
+
+bool MatchMemberLine(const std::string &cLine, const std::string &cName)
+{
+    size_t nEnd = cLine.size();
+
+    while (nEnd && isspace((unsigned char)cLine[nEnd - 1]))
+        nEnd--;
+    if (!cName.empty() && nEnd >= cName.size() && !cLine.compare(nEnd - cName.size(), cName.size(), cName))
+        return nEnd == cName.size() || isspace((unsigned char)cLine[nEnd - cName.size() - 1]);
+
+    // the folder tree shows names without leading "./" and "/"
+    size_t nStart = 0;
+    while (cName.compare(nStart, 2, "./") == 0 || cName.compare(nStart, 1, "/") == 0)
+        nStart += cName[nStart] == '/' ? 1 : 2;
+    return nStart && nStart < cName.size() && !cLine.compare(0, nEnd, cName, nStart, std::string::npos);
+}
+
+// GetCacheRoot - creating private cache folder of the user
+bool GetCacheRoot(std::string *pcRoot, std::string *pcError)
+{
+    struct stat stbuf;
+    char zUid[16];
+
+    sprintf(zUid, "%u", (unsigned int)getuid());
+    *pcRoot = std::string(MEMBER_CACHE_DIR) + zUid;
+    mkdir(pcRoot->c_str(), 0700);
+
+    // somebody else's folder or symbolic link must not be used
+    if (lstat(pcRoot->c_str(), &stbuf) < 0 || !S_ISDIR(stbuf.st_mode) ||
+        stbuf.st_uid != getuid() || (stbuf.st_mode & 077))
+    {
+        *pcError = "Cache folder is not private: " + *pcRoot;
+        return false;
+    }
+    return true;
+}
+
+// FindMember - the longest member name which the line shows (-1 if none)
+static int FindMember(const std::vector<std::string> &acName, const std::string &cLine)
+{
+    int nFound = -1;
+
+    for (unsigned int i = 0; i < acName.size(); i++)
+    {
+        if ((nFound < 0 || acName[i].size() > acName[nFound].size()) && MatchMemberLine(cLine, acName[i]))
+            nFound = i;
+    }
+    return nFound;
+}
+
+// LoadNames - reading member names saved by SaveNames
+static bool LoadNames(const std::string &cPath, std::vector<std::string> *pacName)
+{
+    std::string cName;
+    int c;
+
+    FILE *psFile = fopen(cPath.c_str(), "rb");
+    if (!psFile)
+        return false;
+    while ((c = getc(psFile)) != EOF)
+    {
+        if (c)
+            cName += (char)c;
+        else
+        {
+            pacName->push_back(cName);
+            cName.clear();
+        }
+    }
+    bool bResult = !ferror(psFile) && cName.empty();
+    fclose(psFile);
+    return bResult;
+}
+
+// SaveNames - keeping member names ('\0' terminated) for the next lines opened
+static void SaveNames(const std::string &cPath, const std::vector<std::string> &acName)
+{
+    std::string cTemp = cPath + ".tmp";
+
+    FILE *psFile = fopen(cTemp.c_str(), "wb");
+    if (!psFile)
+        return;
+    for (unsigned int i = 0; i < acName.size(); i++)
+        fwrite(acName[i].c_str(), acName[i].size() + 1, 1, psFile);
+    bool bResult = !ferror(psFile);
+    if (fclose(psFile) || !bResult || rename(cTemp.c_str(), cPath.c_str()) < 0)
+        unlink(cTemp.c_str());
+}
+
+// ListMembers - names of the archive files, read from its headers
+static bool ListMembers(const char *pzArchive, const char *pzFormat, std::vector<std::string> *pacName, std::string *pcError)
+{
+    archive_entry sEntry;
+    int nResult;
+
+    ArchiveReader *pcReader = OpenArchive(pzFormat, pzArchive, pcError);
+    if (!pcReader)
+        return false;
+    while ((nResult = pcReader->NextEntry(&sEntry)) > 0)
+    {
+        if (sEntry.type == ENTRY_FILE)
+            pacName->push_back(sEntry.name);
+    }
+    if (nResult < 0)
+        *pcError = pcReader->GetError();
+    delete pcReader;
+    return nResult == 0;
+}
+
+// PruneStale - removing cached members of the previous archive versions
+static void PruneStale(const std::string &cRoot, const std::string &cPrefix, const std::string &cKey)
+{
+    struct dirent *psEntry;
+
+    int nFd = open(cRoot.c_str(), O_RDONLY | O_DIRECTORY);
+    if (nFd < 0)
+        return;
+    DIR *psDir = fdopendir(nFd);
+    if (!psDir)
+    {
+        close(nFd);
+        return;
+    }
+    while ((psEntry = readdir(psDir)))
+    {
+        if (!strncmp(psEntry->d_name, cPrefix.c_str(), cPrefix.size()) && cKey != psEntry->d_name &&
+            cKey + SEEK_INDEX_SUFFIX != psEntry->d_name && cKey + MEMBER_LIST_SUFFIX != psEntry->d_name)
+            RemoveTree(nFd, psEntry->d_name);
+    }
+    closedir(psDir);
+}
+
+std::string GetCacheDir(const char *pzArchive, std::string *pcError)
+{
+    struct stat stbuf;
+    std::string cRoot;
+    char zKey[128];
+
+    if (stat(pzArchive, &stbuf) < 0)
+    {
+        *pcError = std::string(pzArchive) + ": " + strerror(errno);
+        return "";
+    }
+    if (!GetCacheRoot(&cRoot, pcError))
+        return "";
+
+    // archive identity: device and inode, then size and mtime
+    int nPrefix = sprintf(zKey, "%llx-%llx-", (unsigned long long)stbuf.st_dev, (unsigned long long)stbuf.st_ino);
+    sprintf(zKey + nPrefix, "%llx-%lx", (unsigned long long)stbuf.st_size, (long)stbuf.st_mtime);
+    std::string cDir = cRoot + "/" + zKey;
+    if (mkdir(cDir.c_str(), 0700) == 0)
+        PruneStale(cRoot, std::string(zKey, nPrefix), zKey);
+    return cDir;
+}
+
+bool IndexArchive(const char *pzArchive, const char *pzFormat, volatile bool *pbCancel, std::string *pcError)
+{
+    struct stat stbuf;
+
+    std::string cDir = GetCacheDir(pzArchive, pcError);
+    if (cDir.empty())
+        return false;
+    std::string cPath = cDir + SEEK_INDEX_SUFFIX;
+    if (stat(cPath.c_str(), &stbuf) == 0)
+        return true;
+
+    SeekIndex *psIndex = SeekIndex::Build(pzFormat, pzArchive, pbCancel, pcError);
+    if (!psIndex)
+        return false;
+    bool bResult = psIndex->Save(cPath.c_str());
+    if (!bResult)
+        *pcError = cPath + ": " + strerror(errno);
+    delete psIndex;
+    return bResult;
+}
+
+std::string OpenMember(const char *pzArchive, const char *pzFormat, const char *pzLine, std::string *pcError)
+{
+    struct stat stbuf;
+    std::string cRoot, cLine = pzLine, cResult;
+    archive_entry sEntry;
+    ArchiveReader *pcReader = NULL;
+    int nResult;
+
+    std::string cDir = GetCacheDir(pzArchive, pcError);
+    if (cDir.empty() || !GetCacheRoot(&cRoot, pcError))
+        return "";
+
+    // the member is chosen among real names (a line may end with several),
+    // they come from the seek index or the list kept by the first scan
+    std::vector<std::string> acName;
+    SeekIndex *psIndex = SeekIndex::IsIndexable(pzFormat) ? SeekIndex::Load((cDir + SEEK_INDEX_SUFFIX).c_str()) : NULL;
+    if (psIndex)
+    {
+        const std::vector<seek_member> &asMember = psIndex->GetMembers();
+        for (unsigned int i = 0; i < asMember.size(); i++)
+            acName.push_back(asMember[i].name);
+    }
+    else if (!LoadNames(cDir + MEMBER_LIST_SUFFIX, &acName))
+    {
+        acName.clear();
+        if (!ListMembers(pzArchive, pzFormat, &acName, pcError))
+            return "";
+        SaveNames(cDir + MEMBER_LIST_SUFFIX, acName);
+    }
+
+    // single file archives have no names in the listing
+    int nMember = IsSingleFormat(pzFormat) ? (acName.empty() ? -1 : 0) : FindMember(acName, cLine);
+    if (nMember < 0)
+    {
+        *pcError = "The line doesn't show a file of the archive";
+        delete psIndex;
+        return "";
+    }
+    std::string cName = acName[nMember];
+    std::string cPath = SafePath(cName);
+    if (cPath.empty())
+    {
+        *pcError = "Unsafe member name: " + cName;
+        delete psIndex;
+        return "";
+    }
+    cResult = cDir + "/" + cPath;
+    if (lstat(cResult.c_str(), &stbuf) == 0 && S_ISREG(stbuf.st_mode))
+    {
+        delete psIndex;
+        return cResult;
+    }
+    cResult.clear();
+
+    // seek index lets decoding start near the member
+    if (psIndex)
+    {
+        pcReader = psIndex->OpenReader(pzArchive, psIndex->GetMembers()[nMember].offset, pcError);
+        delete psIndex;
+    }
+    if (!pcReader)
+        pcReader = OpenArchive(pzFormat, pzArchive, pcError);
+    if (!pcReader)
+        return "";
+
+    while ((nResult = pcReader->NextEntry(&sEntry)) > 0)
+    {
+        if (sEntry.type != ENTRY_FILE || sEntry.name != cName)
+            continue;
+        cResult = cDir + "/" + cPath;
+
+        // extracting into a temporary folder and moving the file into cache
+        std::string cTemp = cRoot + "/.tmp-XXXXXX";
+        if (!mkdtemp(&cTemp[0]))
+        {
+            *pcError = cRoot + ": " + strerror(errno);
+            cResult.clear();
+            break;
+        }
+
+        ExtractJob sJob(open(cTemp.c_str(), O_RDONLY | O_DIRECTORY), CollectLog, pcError);
+        bool bDone = sJob.ExtractEntry(pcReader, sEntry);
+        sJob.Finish();
+
+        if (bDone)
+        {
+            for (size_t nPos = 0; (nPos = cPath.find('/', nPos)) != std::string::npos; nPos++)
+                mkdir((cDir + "/" + cPath.substr(0, nPos)).c_str(), 0700);
+            if (rename((cTemp + "/" + cPath).c_str(), cResult.c_str()) < 0)
+            {
+                *pcError = cResult + ": " + strerror(errno);
+                bDone = false;
+            }
+        }
+        RemoveTree(AT_FDCWD, cTemp.c_str());
+        if (!bDone)
+            cResult.clear();
+        break;
+    }
+
+    if (nResult < 0)
+        *pcError = pcReader->GetError();
+    else if (!nResult)
+        *pcError = "The line doesn't show a file of the archive";
+    delete pcReader;
+    return cResult;
+}
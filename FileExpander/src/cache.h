@@ -0,0 +1,55 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _NRUSLAN_CACHE_H_
+#define _NRUSLAN_CACHE_H_
+
+//
+// Member cache - archive members opened from the contents listing are
+// extracted one at a time into a private folder (one subfolder per archive
+// identity) and reused while the archive keeps its inode, size and mtime.
+//
+
+#include <string>
+
+#define MEMBER_CACHE_DIR "/tmp/FileExpander-" // + user id
+#define SEEK_INDEX_SUFFIX ".idx" // seek index is kept next to the member folder
+#define MEMBER_LIST_SUFFIX ".names" // so are member names of archives with no seek index
+
+// Whether a listing line shows the member (the line ends with its name,
+// or is the name without leading "./" and "/"); several members may match
+// one line ("b" and "x b"), the longest name is the one shown
+bool MatchMemberLine(const std::string &cLine, const std::string &cName);
+
+// Creating private folder of the user (it is also used for other private files)
+bool GetCacheRoot(std::string *pcRoot, std::string *pcError);
+
+// Getting cache folder of the archive (older versions are removed)
+std::string GetCacheDir(const char *pzArchive, std::string *pcError);
+
+// Building seek index of the archive (tar.gz, tar.bz2) if there is none
+bool IndexArchive(const char *pzArchive, const char *pzFormat, volatile bool *pbCancel, std::string *pcError);
+
+// Getting path of the cached member shown by the listing line
+std::string OpenMember(const char *pzArchive, const char *pzFormat, const char *pzLine, std::string *pcError);
+
+// Removing a file or a whole folder
+void RemoveTree(int nDirFd, const char *pzName);
+
+#endif /* _NRUSLAN_CACHE_H_ */
@@ -0,0 +1,429 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include "catalog.h"
+
+#define CATALOG_MAGIC "FECAT1"
+
+// Listing shared by worker threads
+struct Catalog::list_work
+{
+    std::vector<catalog_archive *> archives;
+    unsigned int next;
+    pthread_mutex_t lock;
+    volatile bool *cancel;
+    extract_log log;
+    void *log_data;
+};
+
+static void put_varint(std::string *pcData, uint32_t nValue)
+{
+    while (nValue >= 0x80)
+    {
+        *pcData += (char)(nValue | 0x80);
+        nValue >>= 7;
+    }
+    *pcData += (char)nValue;
+}
+
+static uint32_t get_varint(const unsigned char **ppData)
+{
+    uint32_t nValue = 0;
+    int nShift = 0;
+    while (**ppData & 0x80)
+    {
+        nValue |= (uint32_t)(*(*ppData)++ & 0x7f) << nShift;
+        nShift += 7;
+    }
+    return nValue | (uint32_t)*(*ppData)++ << nShift;
+}
+
+// Whether the path is the root or below it
+static bool is_below(const std::string &cPath, const std::string &cRoot)
+{
+    if (cRoot == "/")
+        return true;
+    return !cPath.compare(0, cRoot.size(), cRoot) && (cPath.size() == cRoot.size() || cPath[cRoot.size()] == '/');
+}
+
+static bool archive_less(const catalog_archive &sFirst, const catalog_archive &sSecond)
+{
+    return sFirst.path < sSecond.path;
+}
+
+Catalog::Catalog()
+  : m_nListed(0)
+{
+}
+
+uint64_t Catalog::GetMemberCount() const
+{
+    uint64_t nCount = 0;
+    for (unsigned int i = 0; i < m_asArchive.size(); i++)
+        nCount += m_asArchive[i].members;
+    return nCount;
+}
+
+void Catalog::ListArchive(catalog_archive *psArchive, list_work *psWork)
+{
+    std::vector<std::string> acName;
+    std::string cError;
+
+    ArchiveReader *pcReader = OpenArchive(psArchive->format.c_str(), psArchive->path.c_str(), &cError);
+    if (pcReader)
+    {
+        archive_entry sEntry;
+        int nResult = 0;
+        while (!*psWork->cancel && (nResult = pcReader->NextEntry(&sEntry)) > 0)
+        {
+            if (sEntry.type == ENTRY_DIR)
+                continue;
+            // "./a" and "/a" are looked up as "a"
+            size_t nStart = 0;
+            while (true)
+            {
+                if (!sEntry.name.compare(nStart, 2, "./"))
+                    nStart += 2;
+                else if (!sEntry.name.compare(nStart, 1, "/"))
+                    nStart++;
+                else
+                    break;
+            }
+            if (nStart < sEntry.name.size())
+                acName.push_back(sEntry.name.substr(nStart));
+        }
+        if (nResult < 0)
+            cError = pcReader->GetError();
+        delete pcReader;
+    }
+
+    psArchive->failed = !cError.empty() || *psWork->cancel;
+    if (!cError.empty() && psWork->log)
+    {
+        pthread_mutex_lock(&psWork->lock);
+        psWork->log(psWork->log_data, (psArchive->path + ": " + cError + "\n").c_str());
+        pthread_mutex_unlock(&psWork->lock);
+    }
+
+    // front coding
+    std::sort(acName.begin(), acName.end());
+    psArchive->names.clear();
+    psArchive->members = acName.size();
+    for (unsigned int i = 0; i < acName.size(); i++)
+    {
+        size_t nShared = 0;
+        if (i)
+        {
+            const std::string &cPrevious = acName[i - 1];
+            while (nShared < cPrevious.size() && nShared < acName[i].size() && cPrevious[nShared] == acName[i][nShared])
+                nShared++;
+        }
+        put_varint(&psArchive->names, nShared);
+        put_varint(&psArchive->names, acName[i].size() - nShared);
+        psArchive->names.append(acName[i], nShared, std::string::npos);
+    }
+}
+
+void *Catalog::Worker(void *pData)
+{
+    list_work *psWork = (list_work *)pData;
+
+    while (!*psWork->cancel)
+    {
+        pthread_mutex_lock(&psWork->lock);
+        unsigned int nIndex = psWork->next++;
+        pthread_mutex_unlock(&psWork->lock);
+        if (nIndex >= psWork->archives.size())
+            break;
+        ListArchive(psWork->archives[nIndex], psWork);
+    }
+    return NULL;
+}
+
+bool Catalog::Update(const char *pzRoot, search_format pfFormat, void *pData, int nWorkers, volatile bool *pbCancel,
+                     extract_log pfLog, void *pLogData)
+{
+    std::vector<search_target> asTarget;
+    std::vector<catalog_archive> asNew;
+    std::string cError;
+    struct stat sStat;
+
+    char *pzReal = realpath(pzRoot, NULL);
+    if (!pzReal || stat(pzReal, &sStat) < 0)
+    {
+        if (pfLog)
+            pfLog(pLogData, (std::string(pzRoot) + ": " + strerror(errno) + "\n").c_str());
+        free(pzReal);
+        return false;
+    }
+    std::string cRoot = pzReal;
+    free(pzReal);
+
+    if (S_ISDIR(sStat.st_mode))
+        FindArchives(cRoot.c_str(), pfFormat, pData, &asTarget, &cError);
+    else if (pfFormat(pData, cRoot.c_str()))
+    {
+        search_target sTarget;
+        sTarget.path = cRoot;
+        sTarget.format = pfFormat(pData, cRoot.c_str());
+        asTarget.push_back(sTarget);
+    }
+
+    // other trees are kept as they are; archives which are gone are dropped
+    for (unsigned int i = 0; i < m_asArchive.size(); i++)
+    {
+        if (!is_below(m_asArchive[i].path, cRoot))
+            asNew.push_back(m_asArchive[i]);
+    }
+
+    std::vector<unsigned int> anChanged;
+    for (unsigned int i = 0; i < asTarget.size(); i++)
+    {
+        if (stat(asTarget[i].path.c_str(), &sStat) < 0)
+            continue;
+
+        catalog_archive sArchive;
+        sArchive.path = asTarget[i].path;
+        std::vector<catalog_archive>::const_iterator iOld = std::lower_bound(m_asArchive.begin(), m_asArchive.end(), sArchive, archive_less);
+        if (iOld != m_asArchive.end() && iOld->path == sArchive.path && iOld->format == asTarget[i].format &&
+            iOld->size == (uint64_t)sStat.st_size && iOld->mtime == sStat.st_mtime && !iOld->failed)
+        {
+            asNew.push_back(*iOld);
+            continue;
+        }
+        sArchive.format = asTarget[i].format;
+        sArchive.size = sStat.st_size;
+        sArchive.mtime = sStat.st_mtime;
+        sArchive.members = 0;
+        sArchive.failed = false;
+        anChanged.push_back(asNew.size());
+        asNew.push_back(sArchive);
+    }
+
+    // listing new and changed archives in parallel
+    list_work sWork;
+    for (unsigned int i = 0; i < anChanged.size(); i++)
+        sWork.archives.push_back(&asNew[anChanged[i]]);
+    sWork.next = 0;
+    sWork.cancel = pbCancel;
+    sWork.log = pfLog;
+    sWork.log_data = pLogData;
+    pthread_mutex_init(&sWork.lock, NULL);
+
+    if (nWorkers < 0)
+        nWorkers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nWorkers > (int)anChanged.size())
+        nWorkers = anChanged.size();
+    std::vector<pthread_t> ahThread;
+    for (int i = 1; i < nWorkers; i++)
+    {
+        pthread_t hThread;
+        if (pthread_create(&hThread, NULL, Worker, &sWork) == 0)
+            ahThread.push_back(hThread);
+    }
+    Worker(&sWork);
+    for (unsigned int i = 0; i < ahThread.size(); i++)
+        pthread_join(ahThread[i], NULL);
+    pthread_mutex_destroy(&sWork.lock);
+
+    if (*pbCancel)
+        return false;
+    std::sort(asNew.begin(), asNew.end(), archive_less);
+    m_asArchive.swap(asNew);
+    m_nListed = anChanged.size();
+    return true;
+}
+
+unsigned int Catalog::Find(const Matcher *pcMatcher, const char *pzRoot, search_report pfReport, void *pData) const
+{
+    unsigned int nHits = 0;
+    std::string cRoot = pzRoot, cName;
+
+    char *pzReal = realpath(pzRoot, NULL);
+    if (pzReal)
+    {
+        cRoot = pzReal;
+        free(pzReal);
+    }
+
+    for (unsigned int i = 0; i < m_asArchive.size(); i++)
+    {
+        const catalog_archive &sArchive = m_asArchive[i];
+        if (!is_below(sArchive.path, cRoot))
+            continue;
+
+        const unsigned char *pName = (const unsigned char *)sArchive.names.data();
+        cName.clear();
+        for (uint32_t n = 0; n < sArchive.members; n++)
+        {
+            uint32_t nShared = get_varint(&pName);
+            uint32_t nRest = get_varint(&pName);
+            cName.resize(nShared);
+            cName.append((const char *)pName, nRest);
+            pName += nRest;
+
+            if (pcMatcher->MatchName(cName))
+            {
+                search_hit sHit = { sArchive.path.c_str(), cName.c_str(), 0, true };
+                pfReport(pData, sHit);
+                nHits++;
+            }
+        }
+    }
+    return nHits;
+}
+
+//
+// Catalog file
+//
+static bool read_field(FILE *psFile, void *pData, size_t nSize)
+{
+    return fread(pData, 1, nSize, psFile) == nSize;
+}
+
+static bool read_string(FILE *psFile, std::string *pcString, uint32_t nMax)
+{
+    uint32_t nSize;
+    if (!read_field(psFile, &nSize, sizeof(nSize)) || nSize > nMax)
+        return false;
+    pcString->resize(nSize);
+    return !nSize || read_field(psFile, &(*pcString)[0], nSize);
+}
+
+static void write_string(FILE *psFile, const std::string &cString)
+{
+    uint32_t nSize = cString.size();
+    fwrite(&nSize, sizeof(nSize), 1, psFile);
+    fwrite(cString.data(), 1, nSize, psFile);
+}
+
+// bounded varint (for checking the file)
+static bool read_varint(const unsigned char **ppData, const unsigned char *pEnd, uint32_t *pnValue)
+{
+    const unsigned char *pData = *ppData;
+    for (int i = 0; i < 5 && pData + i < pEnd; i++)
+    {
+        if (!(pData[i] & 0x80))
+        {
+            *pnValue = get_varint(ppData);
+            return true;
+        }
+    }
+    return false;
+}
+
+// names blob must decode into exactly "members" names
+static bool check_names(const catalog_archive &sArchive)
+{
+    const unsigned char *pData = (const unsigned char *)sArchive.names.data();
+    const unsigned char *pEnd = pData + sArchive.names.size();
+    uint32_t nLength = 0, nShared, nRest;
+
+    for (uint32_t n = 0; n < sArchive.members; n++)
+    {
+        if (!read_varint(&pData, pEnd, &nShared) || !read_varint(&pData, pEnd, &nRest) ||
+            nShared > nLength || nRest > (uint32_t)(pEnd - pData))
+            return false;
+        nLength = nShared + nRest;
+        pData += nRest;
+    }
+    return pData == pEnd;
+}
+
+bool Catalog::Load(const char *pzPath)
+{
+    char zMagic[sizeof(CATALOG_MAGIC)];
+    uint64_t nCount;
+    bool bResult = false;
+
+    FILE *psFile = fopen(pzPath, "rb");
+    if (!psFile)
+        return false;
+
+    std::vector<catalog_archive> asArchive;
+    if (read_field(psFile, zMagic, sizeof(zMagic)) && !memcmp(zMagic, CATALOG_MAGIC, sizeof(zMagic)) &&
+        read_field(psFile, &nCount, sizeof(nCount)))
+    {
+        bResult = true;
+        for (uint64_t i = 0; i < nCount && bResult; i++)
+        {
+            catalog_archive sArchive;
+            uint8_t nFailed;
+            bResult = read_string(psFile, &sArchive.path, 1 << 16) && read_string(psFile, &sArchive.format, 256) &&
+                      read_field(psFile, &sArchive.size, sizeof(sArchive.size)) && read_field(psFile, &sArchive.mtime, sizeof(sArchive.mtime)) &&
+                      read_field(psFile, &nFailed, sizeof(nFailed)) && read_field(psFile, &sArchive.members, sizeof(sArchive.members)) &&
+                      read_string(psFile, &sArchive.names, 0x7fffffff) && check_names(sArchive);
+            sArchive.failed = nFailed;
+            asArchive.push_back(sArchive);
+        }
+    }
+    fclose(psFile);
+
+    if (!bResult)
+        return false;
+    std::sort(asArchive.begin(), asArchive.end(), archive_less);
+    m_asArchive.swap(asArchive);
+    return true;
+}
+
+// Save - writing catalog (replaced atomically)
+bool Catalog::Save(const char *pzPath, std::string *pcError) const
+{
+    std::string cTemp = std::string(pzPath) + ".tmp";
+    uint64_t nCount = m_asArchive.size();
+
+    FILE *psFile = fopen(cTemp.c_str(), "wb");
+    if (!psFile)
+    {
+        *pcError = cTemp + ": " + strerror(errno);
+        return false;
+    }
+
+    fwrite(CATALOG_MAGIC, sizeof(CATALOG_MAGIC), 1, psFile);
+    fwrite(&nCount, sizeof(nCount), 1, psFile);
+    for (unsigned int i = 0; i < m_asArchive.size(); i++)
+    {
+        const catalog_archive &sArchive = m_asArchive[i];
+        uint8_t nFailed = sArchive.failed;
+        write_string(psFile, sArchive.path);
+        write_string(psFile, sArchive.format);
+        fwrite(&sArchive.size, sizeof(sArchive.size), 1, psFile);
+        fwrite(&sArchive.mtime, sizeof(sArchive.mtime), 1, psFile);
+        fwrite(&nFailed, sizeof(nFailed), 1, psFile);
+        fwrite(&sArchive.members, sizeof(sArchive.members), 1, psFile);
+        write_string(psFile, sArchive.names);
+    }
+
+    bool bResult = !ferror(psFile);
+    if (fclose(psFile) || !bResult || rename(cTemp.c_str(), pzPath) < 0)
+    {
+        *pcError = std::string(pzPath) + ": " + strerror(errno);
+        unlink(cTemp.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,75 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _NRUSLAN_CATALOG_H_
+#define _NRUSLAN_CATALOG_H_
+
+//
+// Catalog - member names of all archives in folder trees, so finding the
+// archive which has a file is a lookup instead of listing everything.
+// Archives are keyed by absolute path and re-listed only when their size
+// or mtime changes. Member names of an archive are sorted and front coded
+// (length of the prefix shared with the previous name, then the rest).
+//
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "extract.h"
+#include "search.h"
+
+#define EXPANDER_CATALOG "config/FileExpander.catalog" // relative to $HOME
+
+struct catalog_archive
+{
+    std::string path;
+    std::string format;
+    uint64_t size;
+    int64_t mtime;
+    uint32_t members;
+    std::string names; // front coded member names
+    bool failed; // not listed completely (listed again by the next update)
+};
+
+class Catalog
+{
+    public:
+        Catalog();
+        bool Load(const char *pzPath); // false if there is none (or it is damaged)
+        bool Save(const char *pzPath, std::string *pcError) const;
+        // re-listing new and changed archives below pzRoot (nWorkers < 0 - by processors count)
+        bool Update(const char *pzRoot, search_format pfFormat, void *pData, int nWorkers, volatile bool *pbCancel,
+                    extract_log pfLog, void *pLogData);
+        // reporting members (below pzRoot) whose names match; returns count of hits
+        unsigned int Find(const Matcher *pcMatcher, const char *pzRoot, search_report pfReport, void *pData) const;
+        unsigned int GetArchiveCount() const { return m_asArchive.size(); }
+        uint64_t GetMemberCount() const;
+        unsigned int GetListedCount() const { return m_nListed; } // by the last update
+    private:
+        struct list_work;
+
+        static void *Worker(void *pData);
+        static void ListArchive(catalog_archive *psArchive, list_work *psWork);
+
+        std::vector<catalog_archive> m_asArchive; // sorted by path
+        unsigned int m_nListed;
+};
+
+#endif /* _NRUSLAN_CATALOG_H_ */
@@ -0,0 +1,760 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <zlib.h>
+#include <bzlib.h>
+#include "convert.h"
+
+enum Convert_Settings
+{
+    CONVERT_QUEUE = 32, // items between threads (data items are ARCHIVE_BUFSIZE each)
+    TAR_RECORD = 20 * TAR_BLOCK,
+    TAR_MAX_OCTAL = 077777777777LL // 11 octal digits
+};
+
+// Target file name suffixes
+static const struct convert_suffix
+{
+    const char *suffix;
+    const char *format;
+} g_asConvertSuffix[] = {
+    { ".tar", "tar" }, { ".tar.gz", "tar.gz" }, { ".tgz", "tar.gz" },
+    { ".tar.bz2", "tar.bz2" }, { ".tbz", "tar.bz2" }, { ".tbz2", "tar.bz2" },
+    { ".tar.xz", "tar.xz" }, { ".txz", "tar.xz" },
+    { ".tar.zst", "tar.zst" }, { ".tzst", "tar.zst" },
+    { NULL, NULL }
+};
+
+const char *GetConvertFormat(const char *pzPath)
+{
+    size_t nLength = strlen(pzPath);
+    for (const convert_suffix *psSuffix = g_asConvertSuffix; psSuffix->suffix; psSuffix++)
+    {
+        size_t nSuffix = strlen(psSuffix->suffix);
+        if (nLength > nSuffix && !strcmp(pzPath + nLength - nSuffix, psSuffix->suffix))
+            return psSuffix->format;
+    }
+    return NULL;
+}
+
+//
+// ByteSink
+//
+ByteSink::ByteSink()
+{
+}
+
+ByteSink::~ByteSink()
+{
+}
+
+static bool write_all(int nFd, const void *pBuf, size_t nSize, std::string *pcError)
+{
+    while (nSize)
+    {
+        ssize_t nWritten = write(nFd, pBuf, nSize);
+        if (nWritten < 0 && errno == EINTR)
+            continue;
+        if (nWritten < 0)
+        {
+            *pcError = strerror(errno);
+            return false;
+        }
+        pBuf = (const char *)pBuf + nWritten;
+        nSize -= nWritten;
+    }
+    return true;
+}
+
+// Plain file
+class FdSink : public ByteSink
+{
+    public:
+        FdSink(int nFd) : m_nFd(nFd) {}
+        virtual ~FdSink() { if (m_nFd >= 0) close(m_nFd); }
+        virtual bool Write(const void *pBuf, size_t nSize) { return write_all(m_nFd, pBuf, nSize, &m_cError); }
+        virtual bool Close();
+    private:
+        int m_nFd;
+};
+
+bool FdSink::Close()
+{
+    int nResult = close(m_nFd);
+    m_nFd = -1;
+    if (nResult < 0)
+        m_cError = strerror(errno);
+    return nResult == 0;
+}
+
+// gzip
+class GzipSink : public ByteSink
+{
+    public:
+        GzipSink(int nFd);
+        virtual ~GzipSink();
+        virtual bool Write(const void *pBuf, size_t nSize);
+        virtual bool Close();
+    private:
+        bool Deflate(int nFlush);
+
+        int m_nFd;
+        z_stream m_sStream;
+        unsigned char m_aOutput[ARCHIVE_BUFSIZE];
+};
+
+GzipSink::GzipSink(int nFd)
+  : m_nFd(nFd)
+{
+    memset(&m_sStream, 0, sizeof(m_sStream));
+    if (deflateInit2(&m_sStream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+        m_cError = "Unable to start compressor";
+}
+
+GzipSink::~GzipSink()
+{
+    deflateEnd(&m_sStream);
+    if (m_nFd >= 0)
+        close(m_nFd);
+}
+
+bool GzipSink::Deflate(int nFlush)
+{
+    int nResult;
+    do
+    {
+        m_sStream.next_out = m_aOutput;
+        m_sStream.avail_out = sizeof(m_aOutput);
+        nResult = deflate(&m_sStream, nFlush);
+        if (nResult == Z_STREAM_ERROR)
+        {
+            m_cError = "Compressor failed";
+            return false;
+        }
+        if (!write_all(m_nFd, m_aOutput, sizeof(m_aOutput) - m_sStream.avail_out, &m_cError))
+            return false;
+    }
+    while (m_sStream.avail_out == 0 || (nFlush == Z_FINISH && nResult != Z_STREAM_END));
+    return true;
+}
+
+bool GzipSink::Write(const void *pBuf, size_t nSize)
+{
+    m_sStream.next_in = (Bytef *)pBuf;
+    m_sStream.avail_in = nSize;
+    return Deflate(Z_NO_FLUSH);
+}
+
+bool GzipSink::Close()
+{
+    bool bResult = Deflate(Z_FINISH);
+    if (close(m_nFd) < 0 && bResult)
+    {
+        m_cError = strerror(errno);
+        bResult = false;
+    }
+    m_nFd = -1;
+    return bResult;
+}
+
+// bzip2
+class Bzip2Sink : public ByteSink
+{
+    public:
+        Bzip2Sink(int nFd);
+        virtual ~Bzip2Sink();
+        virtual bool Write(const void *pBuf, size_t nSize);
+        virtual bool Close();
+    private:
+        bool Compress(int nAction);
+
+        int m_nFd;
+        bz_stream m_sStream;
+        char m_aOutput[ARCHIVE_BUFSIZE];
+};
+
+Bzip2Sink::Bzip2Sink(int nFd)
+  : m_nFd(nFd)
+{
+    memset(&m_sStream, 0, sizeof(m_sStream));
+    if (BZ2_bzCompressInit(&m_sStream, 9, 0, 0) != BZ_OK)
+        m_cError = "Unable to start compressor";
+}
+
+Bzip2Sink::~Bzip2Sink()
+{
+    BZ2_bzCompressEnd(&m_sStream);
+    if (m_nFd >= 0)
+        close(m_nFd);
+}
+
+bool Bzip2Sink::Compress(int nAction)
+{
+    int nResult;
+    do
+    {
+        m_sStream.next_out = m_aOutput;
+        m_sStream.avail_out = sizeof(m_aOutput);
+        nResult = BZ2_bzCompress(&m_sStream, nAction);
+        if (nResult < 0)
+        {
+            m_cError = "Compressor failed";
+            return false;
+        }
+        if (!write_all(m_nFd, m_aOutput, sizeof(m_aOutput) - m_sStream.avail_out, &m_cError))
+            return false;
+    }
+    while (nAction == BZ_RUN ? m_sStream.avail_in > 0 : nResult != BZ_STREAM_END);
+    return true;
+}
+
+bool Bzip2Sink::Write(const void *pBuf, size_t nSize)
+{
+    m_sStream.next_in = (char *)pBuf;
+    m_sStream.avail_in = nSize;
+    return Compress(BZ_RUN);
+}
+
+bool Bzip2Sink::Close()
+{
+    bool bResult = Compress(BZ_FINISH);
+    if (close(m_nFd) < 0 && bResult)
+    {
+        m_cError = strerror(errno);
+        bResult = false;
+    }
+    m_nFd = -1;
+    return bResult;
+}
+
+// External compressor (xz, zstd) writing to the file
+class CommandSink : public ByteSink
+{
+    public:
+        CommandSink(int nFd, const char *pzCommand);
+        virtual ~CommandSink();
+        virtual bool Write(const void *pBuf, size_t nSize);
+        virtual bool Close();
+    private:
+        int m_nPipe;
+        pid_t m_nPid;
+};
+
+CommandSink::CommandSink(int nFd, const char *pzCommand)
+  : m_nPipe(-1), m_nPid(-1)
+{
+    int aPipe[2];
+
+    if (pipe(aPipe) == 0)
+    {
+        m_nPid = fork();
+        if (!m_nPid)
+        {
+            dup2(aPipe[0], STDIN_FILENO);
+            dup2(nFd, STDOUT_FILENO);
+            close(aPipe[0]);
+            close(aPipe[1]);
+            close(nFd);
+            execlp("/bin/sh", "/bin/sh", "-c", pzCommand, (char *)NULL);
+            _exit(127);
+        }
+        close(aPipe[0]);
+        m_nPipe = aPipe[1];
+        if (m_nPid < 0)
+        {
+            close(m_nPipe);
+            m_nPipe = -1;
+        }
+    }
+    close(nFd);
+    if (m_nPipe < 0)
+        m_cError = "Unable to start compressor";
+}
+
+CommandSink::~CommandSink()
+{
+    if (m_nPipe >= 0)
+        close(m_nPipe);
+    if (m_nPid > 0)
+    {
+        kill(m_nPid, SIGTERM);
+        waitpid(m_nPid, NULL, 0);
+    }
+}
+
+// Write - SIGPIPE is blocked, so a failed compressor gives EPIPE
+bool CommandSink::Write(const void *pBuf, size_t nSize)
+{
+    sigset_t sPipe, sOld;
+    struct timespec sNoWait = { 0, 0 };
+
+    sigemptyset(&sPipe);
+    sigaddset(&sPipe, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &sPipe, &sOld);
+    bool bResult = write_all(m_nPipe, pBuf, nSize, &m_cError);
+    if (!bResult && errno == EPIPE)
+    {
+        sigtimedwait(&sPipe, NULL, &sNoWait);
+        m_cError = "Compressor failed";
+    }
+    pthread_sigmask(SIG_SETMASK, &sOld, NULL);
+    return bResult;
+}
+
+bool CommandSink::Close()
+{
+    int nStatus;
+
+    close(m_nPipe);
+    m_nPipe = -1;
+    waitpid(m_nPid, &nStatus, 0);
+    m_nPid = -1;
+    if (!WIFEXITED(nStatus) || WEXITSTATUS(nStatus))
+    {
+        m_cError = "Compressor failed";
+        return false;
+    }
+    return true;
+}
+
+ByteSink *OpenSink(const char *pzFilter, int nFd, std::string *pcError)
+{
+    ByteSink *psSink;
+
+    if (!*pzFilter)
+        psSink = new FdSink(nFd);
+    else if (!strcmp(pzFilter, "gz"))
+        psSink = new GzipSink(nFd);
+    else if (!strcmp(pzFilter, "bz2"))
+        psSink = new Bzip2Sink(nFd);
+    else if (!strcmp(pzFilter, "xz"))
+        psSink = new CommandSink(nFd, "xz -c");
+    else if (!strcmp(pzFilter, "zst"))
+        psSink = new CommandSink(nFd, "zstd -q -c -T0");
+    else
+    {
+        close(nFd);
+        *pcError = "Unknown compression format";
+        return NULL;
+    }
+
+    if (*psSink->GetError())
+    {
+        *pcError = psSink->GetError();
+        delete psSink;
+        return NULL;
+    }
+    return psSink;
+}
+
+//
+// ConvertJob
+//
+ConvertJob::ConvertJob(extract_log pfLog, void *pData)
+  : m_pfLog(pfLog), m_pData(pData), m_bCancel(false), m_nErrors(0), m_nBytes(0), m_nFiles(0), m_pcReader(NULL)
+{
+    pthread_mutex_init(&m_hLock, NULL);
+    pthread_cond_init(&m_hChanged, NULL);
+}
+
+ConvertJob::~ConvertJob()
+{
+    for (unsigned int i = 0; i < m_asQueue.size(); i++)
+    {
+        delete m_asQueue[i].entry;
+        delete [] m_asQueue[i].data;
+    }
+    for (unsigned int i = 0; i < m_apFree.size(); i++)
+        delete [] m_apFree[i];
+    pthread_cond_destroy(&m_hChanged);
+    pthread_mutex_destroy(&m_hLock);
+}
+
+void ConvertJob::Cancel()
+{
+    pthread_mutex_lock(&m_hLock);
+    m_bCancel = true;
+    pthread_cond_broadcast(&m_hChanged);
+    pthread_mutex_unlock(&m_hLock);
+}
+
+// Error - called by both threads
+void ConvertJob::Error(const std::string &cText)
+{
+    pthread_mutex_lock(&m_hLock);
+    m_nErrors++;
+    if (m_pfLog)
+        m_pfLog(m_pData, (cText + "\n").c_str());
+    pthread_mutex_unlock(&m_hLock);
+}
+
+bool ConvertJob::Push(const convert_item &sItem)
+{
+    pthread_mutex_lock(&m_hLock);
+    while (m_asQueue.size() >= CONVERT_QUEUE && !m_bCancel)
+        pthread_cond_wait(&m_hChanged, &m_hLock);
+    if (m_bCancel)
+    {
+        pthread_mutex_unlock(&m_hLock);
+        delete sItem.entry;
+        delete [] sItem.data;
+        return false;
+    }
+    m_asQueue.push_back(sItem);
+    pthread_cond_broadcast(&m_hChanged);
+    pthread_mutex_unlock(&m_hLock);
+    return true;
+}
+
+bool ConvertJob::Pop(convert_item *psItem)
+{
+    pthread_mutex_lock(&m_hLock);
+    while (m_asQueue.empty() && !m_bCancel)
+        pthread_cond_wait(&m_hChanged, &m_hLock);
+    if (m_bCancel)
+    {
+        pthread_mutex_unlock(&m_hLock);
+        return false;
+    }
+    *psItem = m_asQueue.front();
+    m_asQueue.pop_front();
+    pthread_cond_broadcast(&m_hChanged);
+    pthread_mutex_unlock(&m_hLock);
+    return true;
+}
+
+void *ConvertJob::Decoder(void *pData)
+{
+    ((ConvertJob *)pData)->Decode();
+    return NULL;
+}
+
+// Decode - decoding thread: member headers and data go to the queue
+void ConvertJob::Decode()
+{
+    archive_entry sEntry;
+    std::string cLastError;
+    int nResult = 0;
+
+    while (!m_bCancel && (nResult = m_pcReader->NextEntry(&sEntry)) > 0)
+    {
+        if (sEntry.type == ENTRY_OTHER)
+        {
+            Error("Skipping special file: " + sEntry.name);
+            continue;
+        }
+
+        convert_item sItem = { ITEM_ENTRY, new archive_entry(sEntry), NULL, 0 };
+        if (!Push(sItem))
+            return;
+
+        while (sEntry.type == ENTRY_FILE && !m_bCancel)
+        {
+            char *pBuffer = NULL;
+            pthread_mutex_lock(&m_hLock);
+            if (!m_apFree.empty())
+            {
+                pBuffer = m_apFree.back();
+                m_apFree.pop_back();
+            }
+            pthread_mutex_unlock(&m_hLock);
+            if (!pBuffer)
+                pBuffer = new char[ARCHIVE_BUFSIZE];
+
+            ssize_t nRead = m_pcReader->ReadData(pBuffer, ARCHIVE_BUFSIZE);
+            if (nRead <= 0)
+            {
+                delete [] pBuffer;
+                if (nRead < 0)
+                {
+                    cLastError = m_pcReader->GetError();
+                    Error(cLastError);
+                }
+                break;
+            }
+            convert_item sData = { ITEM_DATA, NULL, pBuffer, (size_t)nRead };
+            if (!Push(sData))
+                return;
+        }
+    }
+    if (nResult < 0 && cLastError != m_pcReader->GetError())
+        Error(m_pcReader->GetError());
+
+    convert_item sEnd = { ITEM_END, NULL, NULL, 0 };
+    Push(sEnd);
+}
+
+// tar header field helpers
+static void tar_octal(char *pField, size_t nSize, uint64_t nValue)
+{
+    char zBuf[24];
+    sprintf(zBuf, "%0*llo", (int)nSize - 1, (unsigned long long)nValue);
+    memcpy(pField, zBuf, nSize - 1);
+}
+
+// pax record "<length> <key>=<value>\n" (length counts itself)
+static void pax_record(std::string *pcPax, const char *pzKey, const std::string &cValue)
+{
+    size_t nLength = strlen(pzKey) + cValue.size() + 3, nTotal = nLength + 1;
+    char zLength[24];
+
+    while (nTotal != nLength + (size_t)sprintf(zLength, "%lu", (unsigned long)nTotal))
+        nTotal = nLength + strlen(zLength);
+    *pcPax += zLength;
+    *pcPax += ' ';
+    *pcPax += pzKey;
+    *pcPax += '=';
+    *pcPax += cValue;
+    *pcPax += '\n';
+}
+
+static void tar_checksum(char *pHeader)
+{
+    unsigned int nSum = 0;
+    memset(pHeader + 148, ' ', 8);
+    for (int i = 0; i < TAR_BLOCK; i++)
+        nSum += (unsigned char)pHeader[i];
+    sprintf(pHeader + 148, "%06o", nSum);
+    pHeader[155] = ' ';
+}
+
+static void tar_header(char *pHeader, const std::string &cName, const std::string &cPrefix, const std::string &cLink,
+                       char cType, mode_t nMode, uint64_t nSize, time_t nTime)
+{
+    memset(pHeader, 0, TAR_BLOCK);
+    memcpy(pHeader, cName.c_str(), cName.size());
+    tar_octal(pHeader + 100, 8, nMode & 07777);
+    tar_octal(pHeader + 108, 8, 0);
+    tar_octal(pHeader + 116, 8, 0);
+    tar_octal(pHeader + 124, 12, nSize);
+    tar_octal(pHeader + 136, 12, nTime);
+    pHeader[156] = cType;
+    memcpy(pHeader + 157, cLink.c_str(), cLink.size());
+    memcpy(pHeader + 257, "ustar", 6);
+    memcpy(pHeader + 263, "00", 2);
+    memcpy(pHeader + 345, cPrefix.c_str(), cPrefix.size());
+    tar_checksum(pHeader);
+}
+
+// WriteHeader - ustar header (with pax extended header for long names, big sizes and old times)
+bool ConvertJob::WriteHeader(ByteSink *psSink, const archive_entry &sEntry)
+{
+    char aHeader[TAR_BLOCK];
+    std::string cName = sEntry.name, cPrefix, cLink = sEntry.link, cPax;
+    uint64_t nSize = sEntry.type == ENTRY_FILE ? sEntry.size : 0;
+    time_t nTime = sEntry.mtime;
+    char cType;
+
+    switch (sEntry.type)
+    {
+        case ENTRY_DIR: cType = '5'; cName += '/'; break;
+        case ENTRY_SYMLINK: cType = '2'; break;
+        case ENTRY_HARDLINK: cType = '1'; break;
+        default: cType = '0'; break;
+    }
+
+    // name: up to 100 characters, or prefix (155) and name split at '/'
+    if (cName.size() > 100)
+    {
+        size_t nSlash = cName.find('/', cName.size() > 101 ? cName.size() - 101 : 0);
+        if (nSlash != std::string::npos && nSlash <= 155 && nSlash + 1 < cName.size())
+        {
+            cPrefix = cName.substr(0, nSlash);
+            cName.erase(0, nSlash + 1);
+        }
+        else
+        {
+            pax_record(&cPax, "path", cName);
+            cName.erase(100);
+        }
+    }
+    if (cLink.size() > 100)
+    {
+        pax_record(&cPax, "linkpath", cLink);
+        cLink.erase(100);
+    }
+    if (nSize > (uint64_t)TAR_MAX_OCTAL)
+    {
+        char zSize[24];
+        sprintf(zSize, "%llu", (unsigned long long)nSize);
+        pax_record(&cPax, "size", zSize);
+    }
+    if (nTime < 0 || (uint64_t)nTime > (uint64_t)TAR_MAX_OCTAL)
+    {
+        char zTime[24];
+        sprintf(zTime, "%lld", (long long)nTime);
+        pax_record(&cPax, "mtime", zTime);
+        nTime = 0;
+    }
+
+    if (!cPax.empty())
+    {
+        std::string cBase = sEntry.name.substr(sEntry.name.rfind('/') + 1);
+        std::string cPaxName = ("PaxHeaders/" + cBase).substr(0, 100);
+        tar_header(aHeader, cPaxName, "", "", 'x', 0644, cPax.size(), nTime);
+        if (!psSink->Write(aHeader, TAR_BLOCK) || !psSink->Write(cPax.data(), cPax.size()) ||
+            !WritePadding(psSink, cPax.size()))
+            return false;
+    }
+
+    tar_header(aHeader, cName, cPrefix, cLink, cType, sEntry.mode, nSize > (uint64_t)TAR_MAX_OCTAL ? 0 : nSize, nTime);
+    return psSink->Write(aHeader, TAR_BLOCK);
+}
+
+// WritePadding - zeros up to the block boundary after nSize bytes
+bool ConvertJob::WritePadding(ByteSink *psSink, uint64_t nSize)
+{
+    static const char aZero[TAR_BLOCK] = { 0 };
+    size_t nPadding = (TAR_BLOCK - nSize % TAR_BLOCK) % TAR_BLOCK;
+    return !nPadding || psSink->Write(aZero, nPadding);
+}
+
+// Encode - encoding thread: writing tar stream from the queue
+bool ConvertJob::Encode(ByteSink *psSink)
+{
+    static const char aZero[TAR_BLOCK] = { 0 };
+    archive_entry *psEntry = NULL;
+    uint64_t nLeft = 0, nOut = 0;
+    convert_item sItem;
+    bool bResult = true;
+
+    while (bResult && Pop(&sItem))
+    {
+        // finishing the previous member (missing data is filled with zeros)
+        if (sItem.kind != ITEM_DATA && psEntry)
+        {
+            if (nLeft)
+                Error("Member data is incomplete: " + psEntry->name);
+            for (; bResult && nLeft; nLeft -= nLeft < TAR_BLOCK ? nLeft : TAR_BLOCK)
+                bResult = psSink->Write(aZero, nLeft < TAR_BLOCK ? nLeft : TAR_BLOCK);
+            if (psEntry->type == ENTRY_FILE)
+            {
+                bResult = bResult && WritePadding(psSink, psEntry->size);
+                nOut += psEntry->size + (TAR_BLOCK - psEntry->size % TAR_BLOCK) % TAR_BLOCK;
+            }
+            delete psEntry;
+            psEntry = NULL;
+        }
+
+        switch (sItem.kind)
+        {
+            case ITEM_ENTRY:
+                psEntry = sItem.entry;
+                nLeft = psEntry->type == ENTRY_FILE ? psEntry->size : 0;
+                bResult = bResult && WriteHeader(psSink, *psEntry);
+                nOut += 2 * TAR_BLOCK; // with possible pax header it is only a bit off
+                m_nFiles++;
+                break;
+
+            case ITEM_DATA:
+            {
+                size_t nPart = sItem.size < nLeft ? sItem.size : nLeft;
+                if (nPart < sItem.size && psEntry)
+                    Error("Member data is longer than its size: " + psEntry->name);
+                bResult = !nPart || psSink->Write(sItem.data, nPart);
+                nLeft -= nPart;
+                m_nBytes += nPart;
+
+                pthread_mutex_lock(&m_hLock);
+                m_apFree.push_back(sItem.data);
+                pthread_mutex_unlock(&m_hLock);
+                break;
+            }
+
+            case ITEM_END:
+            {
+                // end of archive: two zero blocks, padded to the record size
+                uint64_t nEnd = nOut + 2 * TAR_BLOCK;
+                nEnd += (TAR_RECORD - nEnd % TAR_RECORD) % TAR_RECORD;
+                for (; bResult && nOut < nEnd; nOut += TAR_BLOCK)
+                    bResult = psSink->Write(aZero, TAR_BLOCK);
+                return bResult;
+            }
+        }
+    }
+    delete psEntry;
+    if (!bResult && *psSink->GetError())
+        Error(psSink->GetError());
+    return false;
+}
+
+bool ConvertJob::Run(ArchiveReader *pcReader, const char *pzFormat, const char *pzTarget)
+{
+    std::string cError, cTemp = std::string(pzTarget) + ".XXXXXX";
+    pthread_t hDecoder;
+
+    if (strncmp(pzFormat, "tar", 3) || (pzFormat[3] && pzFormat[3] != '.'))
+    {
+        Error(std::string("Unknown target format: ") + pzFormat);
+        return false;
+    }
+
+    // the target appears only when it is complete
+    int nFd = mkstemp(&cTemp[0]);
+    if (nFd < 0)
+    {
+        Error(std::string(pzTarget) + ": " + strerror(errno));
+        return false;
+    }
+    fchmod(nFd, 0644);
+
+    ByteSink *psSink = OpenSink(pzFormat[3] ? pzFormat + 4 : "", nFd, &cError);
+    if (!psSink)
+    {
+        Error(cError);
+        unlink(cTemp.c_str());
+        return false;
+    }
+
+    m_pcReader = pcReader;
+    bool bResult = pthread_create(&hDecoder, NULL, Decoder, this) == 0;
+    if (bResult)
+    {
+        bResult = Encode(psSink);
+        if (!bResult)
+            Cancel(); // stopping decoder
+        pthread_join(hDecoder, NULL);
+    }
+    else
+        Error("Unable to start decoding thread");
+
+    if (!psSink->Close() && bResult)
+    {
+        Error(psSink->GetError());
+        bResult = false;
+    }
+    delete psSink;
+
+    if (bResult && !m_nErrors && !m_bCancel && rename(cTemp.c_str(), pzTarget) == 0)
+        return true;
+    if (bResult && !m_nErrors && !m_bCancel)
+        Error(std::string(pzTarget) + ": " + strerror(errno));
+    unlink(cTemp.c_str());
+    return false;
+}
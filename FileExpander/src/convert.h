@@ -0,0 +1,112 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _NRUSLAN_CONVERT_H_
+#define _NRUSLAN_CONVERT_H_
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <string>
+#include <deque>
+#include <vector>
+#include "archive.h"
+#include "extract.h"
+
+//
+// ByteSink - compressed output stream
+//
+class ByteSink
+{
+    public:
+        ByteSink();
+        virtual ~ByteSink();
+        virtual bool Write(const void *pBuf, size_t nSize) = 0;
+        virtual bool Close() = 0; // flushing compressor (false on error)
+        const char *GetError() const { return m_cError.c_str(); }
+    protected:
+        std::string m_cError;
+};
+
+// pzFilter: "" (none), "gz", "bz2", "xz", "zst"; takes the file descriptor
+ByteSink *OpenSink(const char *pzFilter, int nFd, std::string *pcError);
+
+// Target format by file name ("tar.zst" for "x.tar.zst" or "x.tzst"), NULL if unknown
+const char *GetConvertFormat(const char *pzPath);
+
+//
+// ConvertJob - re-encoding archive members into a new tar archive (tar,
+// tar.gz, tar.bz2, tar.xz, tar.zst) without extracting them. A decoding
+// thread reads members and passes their data through a bounded queue to
+// the encoding (calling) thread, so memory use doesn't depend on sizes.
+// Names, link targets, modes and modification times are kept.
+//
+class ConvertJob
+{
+    public:
+        ConvertJob(extract_log pfLog, void *pData);
+        ~ConvertJob();
+        // the archive is written to a temporary file renamed to pzTarget when done
+        bool Run(ArchiveReader *pcReader, const char *pzFormat, const char *pzTarget);
+        void Cancel();
+        bool IsCancelled() const { return m_bCancel; }
+        int GetErrorCount() const { return m_nErrors; }
+        uint64_t GetBytes() const { return m_nBytes; }
+        unsigned int GetFileCount() const { return m_nFiles; }
+    private:
+        struct convert_item
+        {
+            int kind;
+            archive_entry *entry; // ITEM_ENTRY
+            char *data; // ITEM_DATA
+            size_t size;
+        };
+
+        enum Item_Kind
+        {
+            ITEM_ENTRY, // member header, its data follows
+            ITEM_DATA,
+            ITEM_END // no more members
+        };
+
+        static void *Decoder(void *pData);
+        void Decode();
+        bool Push(const convert_item &sItem); // false if cancelled
+        bool Pop(convert_item *psItem);
+        void Error(const std::string &cText);
+        bool Encode(ByteSink *psSink);
+        bool WriteHeader(ByteSink *psSink, const archive_entry &sEntry);
+        bool WritePadding(ByteSink *psSink, uint64_t nSize);
+
+        extract_log m_pfLog;
+        void *m_pData;
+        volatile bool m_bCancel;
+        int m_nErrors;
+        uint64_t m_nBytes;
+        unsigned int m_nFiles;
+        ArchiveReader *m_pcReader;
+
+        // queue between decoding and encoding threads
+        pthread_mutex_t m_hLock;
+        pthread_cond_t m_hChanged;
+        std::deque<convert_item> m_asQueue;
+        std::vector<char *> m_apFree; // data buffers
+};
+
+#endif /* _NRUSLAN_CONVERT_H_ */
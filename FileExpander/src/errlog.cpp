@@ -0,0 +1,287 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <algorithm>
+#include "errlog.h"
+
+// Templates by count (most frequent first)
+static bool more_frequent(const std::pair<std::string, uint64_t> &a, const std::pair<std::string, uint64_t> &b)
+{
+    return a.second > b.second;
+}
+
+ErrorLog::ErrorLog()
+    : m_bPartialCut(false), m_nBytes(0), m_nLines(0), m_nTailNext(0), m_nOther(0), m_nSpilled(0)
+{
+    char zPath[] = ERRLOG_SPILL_DIR "/FileExpander-log.XXXXXX";
+
+    pthread_mutex_init(&m_hLock, NULL);
+
+    // nobody else needs the name
+    m_nSpillFd = mkstemp(zPath);
+    if (m_nSpillFd >= 0)
+        unlink(zPath);
+}
+
+ErrorLog::~ErrorLog()
+{
+    if (m_nSpillFd >= 0)
+        close(m_nSpillFd);
+    pthread_mutex_destroy(&m_hLock);
+}
+
+// Template - the line without what differs between messages of one kind:
+// "tool: some/file: message" loses the file name, numbers become "#"
+std::string ErrorLog::Template(const std::string &cLine)
+{
+    std::string cTemplate, cMiddle = cLine;
+    size_t nFirst = cLine.find(": "), nLast = cLine.rfind(": ");
+
+    if (nFirst != std::string::npos && nLast != nFirst)
+        cMiddle = cLine.substr(0, nFirst + 2) + "*" + cLine.substr(nLast);
+
+    for (size_t i = 0; i < cMiddle.size(); i++)
+    {
+        if (isdigit((unsigned char)cMiddle[i]))
+        {
+            while (i + 1 < cMiddle.size() && isdigit((unsigned char)cMiddle[i + 1]))
+                i++;
+            cTemplate += '#';
+        }
+        else
+            cTemplate += cMiddle[i];
+    }
+    return cTemplate;
+}
+
+void ErrorLog::AddLine(const std::string &cLine)
+{
+    log_line sLine;
+
+    sLine.number = m_nLines++;
+    sLine.text = cLine;
+    if (m_asHead.size() < ERRLOG_KEEP)
+        m_asHead.push_back(sLine);
+    if (m_asTail.size() < ERRLOG_KEEP)
+        m_asTail.push_back(sLine);
+    else
+        m_asTail[m_nTailNext] = sLine;
+    m_nTailNext = (m_nTailNext + 1) % ERRLOG_KEEP;
+
+    std::string cTemplate = Template(cLine);
+    std::map<std::string, log_template>::iterator i = m_cTemplate.find(cTemplate);
+    if (i != m_cTemplate.end())
+        i->second.count++;
+    else if (m_cTemplate.size() < ERRLOG_TEMPLATES)
+    {
+        log_template &sTemplate = m_cTemplate[cTemplate];
+        sTemplate.count = 1;
+        sTemplate.example = cLine;
+    }
+    else
+        m_nOther++;
+}
+
+void ErrorLog::Add(const char *pData, size_t nSize)
+{
+    pthread_mutex_lock(&m_hLock);
+    m_nBytes += nSize;
+
+    // the whole log (up to the limit)
+    if (m_nSpillFd >= 0 && m_nSpilled < ERRLOG_SPILL_MAX)
+    {
+        size_t nSpill = nSize;
+        if (nSpill > ERRLOG_SPILL_MAX - m_nSpilled)
+            nSpill = ERRLOG_SPILL_MAX - m_nSpilled;
+        for (size_t nDone = 0; nDone < nSpill;)
+        {
+            ssize_t nWritten = write(m_nSpillFd, pData + nDone, nSpill - nDone);
+            if (nWritten < 0 && errno == EINTR)
+                continue;
+            if (nWritten <= 0)
+            {
+                m_nSpilled = ERRLOG_SPILL_MAX; // disk full: the rest is left out
+                break;
+            }
+            nDone += nWritten;
+            m_nSpilled += nWritten;
+        }
+    }
+
+    for (const char *pEnd = pData + nSize; pData < pEnd;)
+    {
+        const char *pNewLine = (const char *)memchr(pData, '\n', pEnd - pData);
+        const char *pStop = pNewLine ? pNewLine : pEnd;
+        size_t nRoom = ERRLOG_MAX_LINE - m_cPartial.size();
+
+        if ((size_t)(pStop - pData) > nRoom)
+        {
+            m_cPartial.append(pData, nRoom);
+            m_bPartialCut = true;
+        }
+        else
+            m_cPartial.append(pData, pStop - pData);
+        if (!pNewLine)
+            break;
+        if (m_bPartialCut)
+            m_cPartial += "...";
+        AddLine(m_cPartial);
+        m_cPartial.clear();
+        m_bPartialCut = false;
+        pData = pNewLine + 1;
+    }
+    pthread_mutex_unlock(&m_hLock);
+}
+
+void ErrorLog::Finish()
+{
+    pthread_mutex_lock(&m_hLock);
+    if (!m_cPartial.empty())
+    {
+        AddLine(m_cPartial);
+        m_cPartial.clear();
+        m_bPartialCut = false;
+    }
+    pthread_mutex_unlock(&m_hLock);
+}
+
+std::string ErrorLog::GetText()
+{
+    std::string cText;
+    char zLine[64];
+
+    pthread_mutex_lock(&m_hLock);
+    for (unsigned int i = 0; i < m_asHead.size(); i++)
+        cText += m_asHead[i].text + "\n";
+
+    // tail lines in order (those shown as the head already are skipped)
+    std::vector<const log_line *> apsTail;
+    for (unsigned int i = 0; i < m_asTail.size(); i++)
+    {
+        const log_line &sLine = m_asTail[(m_asTail.size() < ERRLOG_KEEP ? 0 : m_nTailNext + i) % m_asTail.size()];
+        if (sLine.number >= m_asHead.size())
+            apsTail.push_back(&sLine);
+    }
+
+    uint64_t nOmitted = m_nLines - m_asHead.size() - apsTail.size();
+    if (nOmitted)
+    {
+        // lines which are shown don't count
+        std::map<std::string, uint64_t> cShown;
+        for (unsigned int i = 0; i < m_asHead.size(); i++)
+            cShown[Template(m_asHead[i].text)]++;
+        for (unsigned int i = 0; i < apsTail.size(); i++)
+            cShown[Template(apsTail[i]->text)]++;
+
+        std::vector<std::pair<std::string, uint64_t> > acCount;
+        for (std::map<std::string, log_template>::const_iterator j = m_cTemplate.begin(); j != m_cTemplate.end(); j++)
+        {
+            uint64_t nShown = cShown[j->first];
+            if (j->second.count > nShown)
+                acCount.push_back(std::make_pair(j->first, j->second.count - nShown));
+        }
+        std::sort(acCount.begin(), acCount.end(), more_frequent);
+
+        sprintf(zLine, "\n... %llu lines omitted:\n", (unsigned long long)nOmitted);
+        cText += zLine;
+        for (unsigned int i = 0; i < acCount.size() && i < ERRLOG_SHOWN; i++)
+        {
+            sprintf(zLine, "%llu more like this: ", (unsigned long long)acCount[i].second);
+            cText += zLine + m_cTemplate[acCount[i].first].example + "\n";
+        }
+        uint64_t nRest = m_nOther;
+        for (unsigned int i = ERRLOG_SHOWN; i < acCount.size(); i++)
+            nRest += acCount[i].second;
+        if (nRest)
+        {
+            sprintf(zLine, "%llu other lines\n", (unsigned long long)nRest);
+            cText += zLine;
+        }
+        cText += "\n";
+    }
+
+    for (unsigned int i = 0; i < apsTail.size(); i++)
+        cText += apsTail[i]->text + "\n";
+    pthread_mutex_unlock(&m_hLock);
+    return cText;
+}
+
+bool ErrorLog::Save(const char *pzPath, std::string *pcError)
+{
+    char aBuffer[65536];
+    off_t nOffset = 0;
+    bool bResult = true;
+
+    pthread_mutex_lock(&m_hLock);
+    int nFd = m_nSpillFd >= 0 ? open(pzPath, O_WRONLY | O_CREAT | O_TRUNC, 0644) : -1;
+    if (nFd < 0)
+    {
+        *pcError = m_nSpillFd >= 0 ? strerror(errno) : "Log wasn't kept";
+        pthread_mutex_unlock(&m_hLock);
+        return false;
+    }
+
+    while (bResult)
+    {
+        ssize_t nRead = pread(m_nSpillFd, aBuffer, sizeof(aBuffer), nOffset);
+        if (nRead < 0 && errno == EINTR)
+            continue;
+        if (nRead <= 0)
+        {
+            if (nRead < 0)
+                *pcError = strerror(errno);
+            bResult = nRead == 0;
+            break;
+        }
+        for (ssize_t nDone = 0; nDone < nRead && bResult;)
+        {
+            ssize_t nWritten = write(nFd, aBuffer + nDone, nRead - nDone);
+            if (nWritten < 0 && errno == EINTR)
+                continue;
+            if (nWritten <= 0)
+            {
+                *pcError = strerror(errno);
+                bResult = false;
+            }
+            else
+                nDone += nWritten;
+        }
+        nOffset += nRead;
+    }
+    if (bResult && m_nSpilled < m_nBytes)
+    {
+        sprintf(aBuffer, "\n[%llu more bytes were not kept]\n", (unsigned long long)(m_nBytes - m_nSpilled));
+        write(nFd, aBuffer, strlen(aBuffer));
+    }
+    pthread_mutex_unlock(&m_hLock);
+
+    if (close(nFd) < 0 && bResult)
+    {
+        *pcError = strerror(errno);
+        bResult = false;
+    }
+    return bResult;
+}
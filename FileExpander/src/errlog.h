@@ -0,0 +1,90 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _NRUSLAN_ERRLOG_H_
+#define _NRUSLAN_ERRLOG_H_
+
+//
+// ErrorLog - bounded capture of error messages (stderr of extract commands,
+// errors of in-process jobs). The first and the last lines are kept as
+// they are; the rest is only counted by message template (file names and
+// numbers left out), so the error window costs the same however noisy the
+// tool is. The whole log goes to an unlinked temporary file and is copied
+// out by Save().
+//
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <string>
+#include <vector>
+#include <map>
+
+enum ErrorLog_Settings
+{
+    ERRLOG_KEEP = 50, // lines kept at the beginning and at the end
+    ERRLOG_MAX_LINE = 1024, // longer lines are cut
+    ERRLOG_TEMPLATES = 256, // templates counted (others are counted together)
+    ERRLOG_SHOWN = 20 // templates shown
+};
+
+#define ERRLOG_SPILL_MAX (1024ULL * 1048576) // full log size limit
+#define ERRLOG_SPILL_DIR "/tmp"
+
+class ErrorLog
+{
+    public:
+        ErrorLog();
+        ~ErrorLog();
+        void Add(const char *pData, size_t nSize); // text in pieces of any size
+        void Finish(); // the last line may have no new line
+        uint64_t GetBytes() const { return m_nBytes; }
+        uint64_t GetLineCount() const { return m_nLines; }
+        std::string GetText(); // what the error window shows
+        bool Save(const char *pzPath, std::string *pcError); // full log
+        static std::string Template(const std::string &cLine);
+    private:
+        struct log_line
+        {
+            uint64_t number;
+            std::string text;
+        };
+
+        struct log_template
+        {
+            uint64_t count;
+            std::string example;
+        };
+
+        void AddLine(const std::string &cLine);
+
+        pthread_mutex_t m_hLock;
+        std::string m_cPartial; // line being received
+        bool m_bPartialCut;
+        uint64_t m_nBytes, m_nLines;
+        std::vector<log_line> m_asHead;
+        std::vector<log_line> m_asTail; // ring of the last lines
+        unsigned int m_nTailNext;
+        std::map<std::string, log_template> m_cTemplate;
+        uint64_t m_nOther; // lines of templates which didn't fit
+        int m_nSpillFd;
+        uint64_t m_nSpilled;
+};
+
+#endif /* _NRUSLAN_ERRLOG_H_ */
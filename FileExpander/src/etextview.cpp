@@ -43,7 +43,7 @@ struct g_sMenuItem {
 };
 
 EtextView::EtextView(const os::Rect &cFrame, const os::String &cTitle, const char *pzBuffer, uint32 nResizeMask, uint32 nFlags)
-  : os::TextView(cFrame, cTitle, pzBuffer, nResizeMask, nFlags)
+  : os::TextView(cFrame, cTitle, pzBuffer, nResizeMask, nFlags), m_pcOpenMessage(NULL)
 {
 
     struct g_sMenuItem *psMenuItem = g_asMenuItem, *psMenuItemEnd = g_asMenuItem + MENUITEMS_COUNT;
@@ -141,11 +141,26 @@ void EtextView::MouseDown(const os::Point &cPosition, uint32 nButtons)
         }
 
         default:
+        {
             os::TextView::MouseDown(cPosition, nButtons);
+
+            // double click opens the line (cursor is already moved to it)
+            int32 nClicks;
+            os::Message *pcCurrent = GetLooper()->GetCurrentMessage();
+            if (m_pcOpenMessage && nButtons == 1 && pcCurrent && pcCurrent->FindInt32("clicks", &nClicks) == 0 && nClicks == 2)
+                GetWindow()->PostMessage(new os::Message(*m_pcOpenMessage), GetWindow());
             break;
+        }
     }
 }
 
+void EtextView::SetOpenMessage(os::Message *pcMessage)
+{
+    delete m_pcOpenMessage;
+    m_pcOpenMessage = pcMessage;
+}
+
 EtextView::~EtextView()
 {
+    delete m_pcOpenMessage;
 }
@@ -31,9 +31,11 @@ class EtextView : public os::TextView
 	          uint32 nFlags = os::WID_WILL_DRAW | os::WID_FULL_UPDATE_ON_RESIZE);
         virtual void MouseDown(const os::Point &cPosition, uint32 nButtons);
         virtual void HandleMessage(os::Message *pcMessage);
+        void SetOpenMessage(os::Message *pcMessage); // sent to the window on double click
         virtual ~EtextView();
     private:
         os::Menu *m_pcMenu, *m_pcReadOnlyMenu, *m_pcPasswordMenu;
+        os::Message *m_pcOpenMessage;
 
         enum m_eTextManip {
             M_ETEXT_CUT,
@@ -0,0 +1,1553 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <sys/time.h>
+#include <signal.h>
+#include <dirent.h>
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+#include <deque>
+#include "pipeline.h"
+#include "throttle.h"
+#include "trace.h"
+#include "extract.h"
+#include "cache.h"
+
+enum Extract_Settings
+{
+    HASH_MAX_WORKERS = 8,
+    HASH_CHUNKS_PER_WORKER = 4,
+    DEDUP_PREFIX = 16384, // bytes of the beginning in the duplicate key
+    DEDUP_CANDIDATES = 4, // different files kept for one key
+    PIPE_CHUNKS = 16, // decoded data waiting to be written (ARCHIVE_BUFSIZE each)
+    PIPE_ITEMS = 64, // members and data chunks between decoding and writing
+    PIPE_FILES = 64, // written files waiting for metadata (open descriptors)
+    DURABLE_BATCH = 8 * 1048576 // bytes of a file written back at once
+};
+
+#define STAGE_PREFIX ".fe-stage-"
+
+// counter of hidden folders (several jobs may expand into one destination)
+static unsigned int stage_count = 0;
+
+// Data chunk waiting to be hashed (data == NULL finishes the entry)
+struct hash_chunk
+{
+    manifest_entry *entry;
+    char *data;
+    size_t size;
+};
+
+//
+// HashPool - hash workers; all chunks of one entry go to the same worker
+// in order, chunk buffers are taken from a bounded pool
+//
+class HashPool
+{
+    public:
+        HashPool(int nWorkers);
+        ~HashPool();
+        int GetWorkerCount() const { return m_asQueue.size(); }
+        char *GetBuffer();
+        void Submit(int nWorker, manifest_entry *psEntry, char *pData, size_t nSize);
+        void Wait();
+    private:
+        struct worker_info
+        {
+            HashPool *pool;
+            int index;
+        };
+
+        static void *Worker(void *pData);
+
+        pthread_mutex_t m_hLock;
+        pthread_cond_t m_hWork, m_hDone;
+        std::vector<char *> m_apBuffer, m_apFree;
+        std::vector<std::deque<hash_chunk> > m_asQueue;
+        std::vector<pthread_t> m_ahThread;
+        std::vector<worker_info> m_asInfo;
+        int m_nBusy;
+        bool m_bQuit;
+};
+
+HashPool::HashPool(int nWorkers)
+  : m_asQueue(nWorkers), m_asInfo(nWorkers), m_nBusy(0), m_bQuit(false)
+{
+    pthread_mutex_init(&m_hLock, NULL);
+    pthread_cond_init(&m_hWork, NULL);
+    pthread_cond_init(&m_hDone, NULL);
+
+    for (int i = 0; i < nWorkers * HASH_CHUNKS_PER_WORKER + 1; i++)
+    {
+        m_apBuffer.push_back(new char[ARCHIVE_BUFSIZE]);
+        m_apFree.push_back(m_apBuffer.back());
+    }
+
+    for (int i = 0; i < nWorkers; i++)
+    {
+        pthread_t hThread;
+        m_asInfo[i].pool = this;
+        m_asInfo[i].index = i;
+        if (pthread_create(&hThread, NULL, Worker, &m_asInfo[i]) == 0)
+            m_ahThread.push_back(hThread);
+    }
+
+    // all queues need a worker
+    m_asQueue.resize(m_ahThread.size());
+}
+
+HashPool::~HashPool()
+{
+    pthread_mutex_lock(&m_hLock);
+    m_bQuit = true;
+    pthread_cond_broadcast(&m_hWork);
+    pthread_mutex_unlock(&m_hLock);
+
+    for (unsigned int i = 0; i < m_ahThread.size(); i++)
+        pthread_join(m_ahThread[i], NULL);
+    for (unsigned int i = 0; i < m_apBuffer.size(); i++)
+        delete [] m_apBuffer[i];
+
+    pthread_cond_destroy(&m_hDone);
+    pthread_cond_destroy(&m_hWork);
+    pthread_mutex_destroy(&m_hLock);
+}
+
+// GetBuffer - taking a free chunk buffer (waits for workers if there is none)
+char *HashPool::GetBuffer()
+{
+    pthread_mutex_lock(&m_hLock);
+    while (m_apFree.empty())
+        pthread_cond_wait(&m_hDone, &m_hLock);
+    char *pBuffer = m_apFree.back();
+    m_apFree.pop_back();
+    pthread_mutex_unlock(&m_hLock);
+    return pBuffer;
+}
+
+// Submit - queueing a chunk (the buffer is returned to the pool by the worker)
+void HashPool::Submit(int nWorker, manifest_entry *psEntry, char *pData, size_t nSize)
+{
+    hash_chunk sChunk = { psEntry, pData, nSize };
+
+    pthread_mutex_lock(&m_hLock);
+    m_asQueue[nWorker % m_asQueue.size()].push_back(sChunk);
+    pthread_cond_broadcast(&m_hWork);
+    pthread_mutex_unlock(&m_hLock);
+}
+
+// Wait - waiting until all queued chunks are hashed
+void HashPool::Wait()
+{
+    pthread_mutex_lock(&m_hLock);
+    while (true)
+    {
+        bool bEmpty = !m_nBusy;
+        for (unsigned int i = 0; bEmpty && i < m_asQueue.size(); i++)
+            bEmpty = m_asQueue[i].empty();
+        if (bEmpty)
+            break;
+        pthread_cond_wait(&m_hDone, &m_hLock);
+    }
+    pthread_mutex_unlock(&m_hLock);
+}
+
+// Worker - hash thread
+void *HashPool::Worker(void *pData)
+{
+    worker_info *psInfo = (worker_info *)pData;
+    HashPool *pcPool = psInfo->pool;
+    std::deque<hash_chunk> &cQueue = pcPool->m_asQueue[psInfo->index];
+
+    pthread_mutex_lock(&pcPool->m_hLock);
+    while (true)
+    {
+        while (cQueue.empty() && !pcPool->m_bQuit)
+            pthread_cond_wait(&pcPool->m_hWork, &pcPool->m_hLock);
+        if (cQueue.empty())
+            break;
+
+        hash_chunk sChunk = cQueue.front();
+        cQueue.pop_front();
+        pcPool->m_nBusy++;
+        pthread_mutex_unlock(&pcPool->m_hLock);
+
+        if (sChunk.data)
+            sha256_update(&sChunk.entry->ctx, sChunk.data, sChunk.size);
+        else
+            sha256_final(&sChunk.entry->ctx, sChunk.entry->digest);
+
+        pthread_mutex_lock(&pcPool->m_hLock);
+        if (sChunk.data)
+            pcPool->m_apFree.push_back(sChunk.data);
+        pcPool->m_nBusy--;
+        pthread_cond_broadcast(&pcPool->m_hDone);
+    }
+    pthread_mutex_unlock(&pcPool->m_hLock);
+    return NULL;
+}
+
+//
+// ExtractJob
+//
+ExtractJob::ExtractJob(int nDestFd, extract_log pfLog, void *pData)
+  : m_nDestFd(nDestFd), m_pfLog(pfLog), m_pData(pData), m_bCancel(false),
+    m_nErrors(0), m_nBytes(0), m_nFiles(0), m_bUpdate(false), m_bCompareCrc(false),
+    m_nSkipped(0), m_nSkippedBytes(0), m_nTemp(0), m_bDedup(false), m_nLinked(0), m_nSavedBytes(0),
+    m_pPending(NULL), m_nPending(0), m_nSameFd(-1), m_nSame(0), m_nSameDone(0), m_nDurability(DURABLE_FAST), m_nFinalFd(-1), m_bBackground(false), m_nLimit(0), m_pcThrottle(NULL),
+    m_nWorkers(0), m_pcPool(NULL),
+    m_bPipeline(true), m_bPipelined(false), m_pcSource(NULL), m_psData(NULL), m_psFree(NULL), m_psMeta(NULL),
+    m_psTrace(NULL)
+{
+    m_pBuffer = new char[ARCHIVE_BUFSIZE];
+}
+
+ExtractJob::~ExtractJob()
+{
+    delete m_pcPool;
+    delete m_pcThrottle;
+    for (unsigned int i = 0; i < m_apsManifest.size(); i++)
+        delete m_apsManifest[i];
+    delete [] m_pBuffer;
+    delete [] m_pPending;
+    if (m_nSameFd >= 0)
+        close(m_nSameFd);
+    if (m_nDestFd >= 0)
+        close(m_nDestFd);
+    if (m_nFinalFd >= 0)
+        close(m_nFinalFd);
+}
+
+// SetManifest - writing <pzName>.sha256 and <pzName>.sha256.json when done
+void ExtractJob::SetManifest(const char *pzName, int nWorkers)
+{
+    m_cManifest = pzName;
+
+    // the extracting thread is busy with decompression itself
+    if (nWorkers < 0)
+        nWorkers = sysconf(_SC_NPROCESSORS_ONLN) - 1;
+    if (nWorkers > HASH_MAX_WORKERS)
+        nWorkers = HASH_MAX_WORKERS;
+    m_nWorkers = nWorkers > 0 ? nWorkers : 0;
+}
+
+// SetUpdate - files with the same size and time (and CRC-32 if it is asked
+// and the archive stores it) are left as they are
+void ExtractJob::SetUpdate(bool bCompareCrc)
+{
+    m_bUpdate = true;
+    m_bCompareCrc = bCompareCrc;
+}
+
+// SetDedup - a member with the same contents as an earlier file is made a
+// hard link to it (a reflink if permissions or times differ)
+void ExtractJob::SetDedup()
+{
+    m_bDedup = true;
+    if (!m_pPending)
+        m_pPending = new char[ARCHIVE_BUFSIZE];
+}
+
+// SetBackground - the job gets lower CPU and I/O priority when it is run,
+// and writing backs off when the disk is busy (and never goes over nLimit)
+void ExtractJob::SetBackground(uint64_t nLimit)
+{
+    m_bBackground = true;
+    m_nLimit = nLimit;
+}
+
+uint64_t ExtractJob::GetThrottleTime() const
+{
+    return m_pcThrottle ? m_pcThrottle->GetWaitTime() : 0;
+}
+
+// Error - reporting (also called by the metadata stage)
+void ExtractJob::Error(const std::string &cText)
+{
+    __sync_fetch_and_add(&m_nErrors, 1);
+    if (m_pfLog)
+        m_pfLog(m_pData, (cText + "\n").c_str());
+}
+
+std::string SafePath(const std::string &cName)
+{
+    std::string cPath;
+    size_t nPos = 0;
+
+    while (nPos < cName.size())
+    {
+        size_t nEnd = cName.find('/', nPos);
+        if (nEnd == std::string::npos)
+            nEnd = cName.size();
+        std::string cPart = cName.substr(nPos, nEnd - nPos);
+        nPos = nEnd + 1;
+
+        if (cPart.empty() || cPart == ".")
+            continue;
+        if (cPart == "..")
+            return "";
+        if (!cPath.empty())
+            cPath += '/';
+        cPath += cPart;
+    }
+    return cPath;
+}
+
+// ReaderError - reporting the reader's error once (a member error may come
+// back from the next entry)
+void ExtractJob::ReaderError(ArchiveReader *pcReader)
+{
+    if (m_cReadError != pcReader->GetError())
+        Error(pcReader->GetError());
+    m_cReadError = pcReader->GetError();
+}
+
+// MakeParents - creating missing parent folders (never through symbolic links)
+bool ExtractJob::MakeParents(const std::string &cPath)
+{
+    struct stat stbuf;
+    size_t nPos = 0;
+
+    while ((nPos = cPath.find('/', nPos)) != std::string::npos)
+    {
+        std::string cDir = cPath.substr(0, nPos++);
+        if (fstatat(m_nDestFd, cDir.c_str(), &stbuf, AT_SYMLINK_NOFOLLOW) == 0)
+        {
+            if (S_ISDIR(stbuf.st_mode))
+                continue;
+            Error("Not a folder: " + cDir);
+            return false;
+        }
+        if (mkdirat(m_nDestFd, cDir.c_str(), 0755) < 0 && errno != EEXIST)
+        {
+            Error(cDir + ": " + strerror(errno));
+            return false;
+        }
+    }
+    return true;
+}
+
+// IsInside - all parent folders of the existing path are real folders
+// (a name which goes through a symbolic link may point anywhere)
+bool ExtractJob::IsInside(const std::string &cPath)
+{
+    struct stat stbuf;
+    size_t nPos = 0;
+
+    while ((nPos = cPath.find('/', nPos)) != std::string::npos)
+    {
+        std::string cDir = cPath.substr(0, nPos++);
+        if (fstatat(m_nDestFd, cDir.c_str(), &stbuf, AT_SYMLINK_NOFOLLOW) < 0 || !S_ISDIR(stbuf.st_mode))
+            return false;
+    }
+    return true;
+}
+
+void ExtractJob::SetTimes(const std::string &cPath, time_t nTime, int nFlags)
+{
+    struct timespec asTime[2];
+
+    asTime[0].tv_sec = asTime[1].tv_sec = nTime;
+    asTime[0].tv_nsec = asTime[1].tv_nsec = 0;
+    utimensat(m_nDestFd, cPath.c_str(), asTime, nFlags);
+}
+
+std::string ExtractJob::ReadLink(const std::string &cPath)
+{
+    char zLink[PATH_MAX];
+    ssize_t nSize = readlinkat(m_nDestFd, cPath.c_str(), zLink, sizeof(zLink));
+    return (nSize > 0 && nSize < (ssize_t)sizeof(zLink)) ? std::string(zLink, nSize) : std::string();
+}
+
+manifest_entry *ExtractJob::FindManifest(const std::string &cPath)
+{
+    std::map<std::string, manifest_entry *>::iterator i = m_cManifestIndex.find(cPath);
+    return i != m_cManifestIndex.end() ? i->second : NULL;
+}
+
+// IsUnchanged - comparing the member with the existing regular file
+bool ExtractJob::IsUnchanged(const archive_entry &sEntry, const std::string &cPath, const struct stat &sStat)
+{
+    if (!S_ISREG(sStat.st_mode) || (uint64_t)sStat.st_size != sEntry.size || sStat.st_mtime != sEntry.mtime)
+        return false;
+    if (!m_bCompareCrc || !sEntry.has_crc)
+        return true;
+
+    int nFd = openat(m_nDestFd, cPath.c_str(), O_RDONLY | O_NOFOLLOW);
+    if (nFd < 0)
+        return false;
+
+    uint32_t nCrc = 0;
+    ssize_t nRead;
+    while ((nRead = read(nFd, m_pBuffer, ARCHIVE_BUFSIZE)) > 0 && !m_bCancel)
+        nCrc = archive_crc32(nCrc, m_pBuffer, nRead);
+    close(nFd);
+    return nRead == 0 && nCrc == sEntry.crc;
+}
+
+// Deduplicate - looking for an earlier file with the same contents; the data
+// is compared with the candidates while it is decoded, so nothing is
+// written unless all of them turn out to differ
+int ExtractJob::Deduplicate(ArchiveReader *pcReader, const archive_entry &sEntry, const std::string &cPath, dedup_key *psKey, std::string *pcSame)
+{
+    struct stat stbuf;
+    size_t nPrefix = sEntry.size < DEDUP_PREFIX ? sEntry.size : DEDUP_PREFIX;
+
+    // cheap key: size and CRC-32 of the beginning
+    m_nPending = 0;
+    while (m_nPending < nPrefix)
+    {
+        ssize_t nRead = pcReader->ReadData(m_pPending + m_nPending, nPrefix - m_nPending);
+        if (nRead < 0)
+        {
+            ReaderError(pcReader);
+            m_nPending = 0;
+            return DEDUP_FAILED;
+        }
+        if (!nRead)
+            break;
+        m_nPending += nRead;
+    }
+    *psKey = dedup_key(sEntry.size, archive_crc32(0, m_pPending, m_nPending));
+
+    // earlier files must still be the ones which were written
+    std::vector<dedup_candidate> asAlive;
+    std::pair<dedup_map::iterator, dedup_map::iterator> cRange = m_cDedup.equal_range(*psKey);
+    for (dedup_map::iterator i = cRange.first; i != cRange.second;)
+    {
+        int nSameFd = openat(m_nDestFd, i->second.name.c_str(), O_RDONLY | O_NOFOLLOW);
+        if (nSameFd >= 0 && fstat(nSameFd, &stbuf) == 0 && stbuf.st_dev == i->second.dev &&
+            stbuf.st_ino == i->second.ino && (uint64_t)stbuf.st_size == sEntry.size)
+        {
+            dedup_candidate sCandidate = { &i->second, nSameFd };
+            asAlive.push_back(sCandidate);
+            ++i;
+            continue;
+        }
+        if (nSameFd >= 0)
+            close(nSameFd);
+        m_cDedup.erase(i++);
+    }
+    if (asAlive.empty())
+        return DEDUP_NONE;
+
+    // comparing all of the data (CRC-32 of the beginning may collide); the
+    // last candidate to differ has the longest equal beginning
+    dedup_candidate sLast = { NULL, -1 };
+    uint64_t nOffset = 0;
+    int nResult = DEDUP_DIFFERENT;
+    while (!asAlive.empty() && !m_bCancel)
+    {
+        if (!m_nPending)
+        {
+            ssize_t nRead = pcReader->ReadData(m_pPending, ARCHIVE_BUFSIZE);
+            if (nRead < 0)
+            {
+                ReaderError(pcReader);
+                nResult = DEDUP_FAILED;
+                break;
+            }
+            if (!nRead)
+                break;
+            m_nPending = nRead;
+        }
+        for (unsigned int i = asAlive.size(); i-- > 0;)
+        {
+            ssize_t nSame = pread(asAlive[i].fd, m_pBuffer, m_nPending, nOffset);
+            if (nSame == (ssize_t)m_nPending && !memcmp(m_pBuffer, m_pPending, m_nPending))
+                continue;
+            if (sLast.fd >= 0)
+                close(sLast.fd);
+            sLast = asAlive[i];
+            asAlive.erase(asAlive.begin() + i);
+        }
+        if (!asAlive.empty())
+        {
+            nOffset += m_nPending;
+            m_nPending = 0;
+        }
+    }
+    if (m_bCancel)
+        nResult = DEDUP_FAILED;
+
+    // all data is read and equal to the candidates which are left
+    if (nResult == DEDUP_DIFFERENT && !asAlive.empty() && nOffset == sEntry.size)
+    {
+        for (unsigned int i = 0; i < asAlive.size(); i++)
+        {
+            if (LinkDuplicate(*asAlive[i].file, asAlive[i].fd, sEntry, cPath))
+            {
+                *pcSame = asAlive[i].file->name;
+                nResult = DEDUP_LINKED;
+                break;
+            }
+        }
+    }
+
+    // the equal beginning is copied from one of them (the others are closed)
+    if (!asAlive.empty())
+    {
+        if (sLast.fd >= 0)
+            close(sLast.fd);
+        sLast = asAlive.back();
+        asAlive.pop_back();
+    }
+    for (unsigned int i = 0; i < asAlive.size(); i++)
+        close(asAlive[i].fd);
+    if (nResult != DEDUP_DIFFERENT)
+    {
+        close(sLast.fd);
+        m_nPending = 0;
+        return nResult;
+    }
+    m_nSameFd = sLast.fd;
+    m_nSame = nOffset;
+    m_nSameDone = 0;
+    return DEDUP_DIFFERENT;
+}
+
+// LinkDuplicate - creating the member as a link to the earlier file
+bool ExtractJob::LinkDuplicate(const dedup_file &sSame, int nSameFd, const archive_entry &sEntry, const std::string &cPath)
+{
+    mode_t nMode = (sEntry.mode & 0777) ? (sEntry.mode & 0777) : 0644;
+
+    // a hard link shares permissions and times as well
+    if (nMode == sSame.mode && sEntry.mtime == sSame.mtime &&
+        linkat(m_nDestFd, sSame.name.c_str(), m_nDestFd, cPath.c_str(), 0) == 0)
+        return true;
+
+#ifdef FICLONE
+    // a reflink shares only the data (copy-on-write file systems)
+    int nFd = openat(m_nDestFd, cPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0600);
+    if (nFd < 0)
+        return false;
+    if (ioctl(nFd, FICLONE, nSameFd) == 0)
+    {
+        struct timespec asTime[2];
+        asTime[0].tv_sec = asTime[1].tv_sec = sEntry.mtime;
+        asTime[0].tv_nsec = asTime[1].tv_nsec = 0;
+        fchmod(nFd, nMode);
+        futimens(nFd, asTime);
+        if (close(nFd) == 0)
+            return true;
+    }
+    else
+        close(nFd);
+    unlinkat(m_nDestFd, cPath.c_str(), 0);
+#endif
+    return false;
+}
+
+// ReadChunk - next part of the member data: the beginning which is the same
+// as in the earlier file, data read while comparing, then the reader's
+// (errors are reported)
+ssize_t ExtractJob::ReadChunk(ArchiveReader *pcReader, char *pBuffer)
+{
+    if (m_nSameFd >= 0)
+    {
+        if (m_nSameDone < m_nSame)
+        {
+            size_t nSize = (m_nSame - m_nSameDone < ARCHIVE_BUFSIZE) ? m_nSame - m_nSameDone : ARCHIVE_BUFSIZE;
+            ssize_t nRead = pread(m_nSameFd, pBuffer, nSize, m_nSameDone);
+            if (nRead > 0)
+            {
+                m_nSameDone += nRead;
+                return nRead;
+            }
+            Error(std::string("Reading earlier copy: ") + (nRead < 0 ? strerror(errno) : "file was truncated"));
+            DropPending();
+            return -1;
+        }
+        close(m_nSameFd);
+        m_nSameFd = -1;
+    }
+    if (m_nPending)
+    {
+        size_t nSize = m_nPending;
+        memcpy(pBuffer, m_pPending, nSize);
+        m_nPending = 0;
+        return nSize;
+    }
+
+    // (the decoding stage traces itself when pipelined)
+    trace_job *psTrace = m_psData ? NULL : m_psTrace;
+    uint64_t nStart = TraceStart(psTrace);
+    ssize_t nRead = pcReader->ReadData(pBuffer, ARCHIVE_BUFSIZE);
+    TraceSpan(psTrace, TRACE_DECODE, nStart);
+    if (nRead < 0)
+        ReaderError(pcReader);
+    return nRead;
+}
+
+// DropPending - forgetting the data of a member which is left
+void ExtractJob::DropPending()
+{
+    if (m_nSameFd >= 0)
+        close(m_nSameFd);
+    m_nSameFd = -1;
+    m_nPending = 0;
+}
+
+// StartWriteback - the system starts writing the range to disk (0 - to the end), not waiting for it
+static void StartWriteback(int nFd, uint64_t nOffset, uint64_t nSize)
+{
+#ifdef SYNC_FILE_RANGE_WRITE
+    sync_file_range(nFd, nOffset, nSize, SYNC_FILE_RANGE_WRITE);
+#endif
+}
+
+bool SyncFolder(int nFd)
+{
+#ifdef SYNC_FILE_RANGE_WRITE
+    return syncfs(nFd) == 0;
+#else
+    sync();
+    return true;
+#endif
+}
+
+// ExtractFile - writing member data (and hashing it)
+bool ExtractJob::ExtractFile(ArchiveReader *pcReader, const archive_entry &sEntry, const std::string &cPath, int nMode)
+{
+    manifest_entry *psManifest = NULL;
+    int nWorker = m_nFiles + m_nSkipped;
+    bool bResult = true;
+    std::string cTarget = cPath;
+    int nFd = -1;
+    dedup_key sKey;
+    bool bKey = false;
+    uint64_t nWritten = 0, nSynced = 0; // written back while writing (safe durability)
+
+    if (nMode == FILE_REPLACE)
+    {
+        // hidden name in the same folder, so rename() stays atomic
+        char zName[64];
+        size_t nSlash = cPath.rfind('/');
+        sprintf(zName, ".fe-%ld-%u", (long)getpid(), m_nTemp++);
+        cTarget = (nSlash == std::string::npos) ? zName : cPath.substr(0, nSlash + 1) + zName;
+    }
+    if (m_bDedup && nMode == FILE_CREATE && sEntry.size)
+    {
+        std::string cSame;
+        int nDedup = Deduplicate(pcReader, sEntry, cPath, &sKey, &cSame);
+        if (nDedup == DEDUP_FAILED)
+            return false;
+        if (nDedup == DEDUP_LINKED)
+        {
+            m_nFiles++;
+            m_nLinked++;
+            m_nSavedBytes += sEntry.size;
+            if (!m_cManifest.empty() && FindManifest(cSame))
+            {
+                psManifest = new manifest_entry;
+                psManifest->name = cPath;
+                psManifest->same = FindManifest(cSame);
+                if (psManifest->same->same)
+                    psManifest->same = psManifest->same->same; // the data is kept by the first one
+                psManifest->size = psManifest->same->size;
+                psManifest->failed = false;
+                m_apsManifest.push_back(psManifest);
+                m_cManifestIndex[cPath] = psManifest;
+            }
+            return true;
+        }
+        bKey = true; // also a copy of an equal file (its permissions or times differ)
+    }
+    if (nMode != FILE_HASH)
+    {
+        nFd = openat(m_nDestFd, cTarget.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW, 0600);
+        if (nFd < 0)
+        {
+            Error(cPath + ": " + strerror(errno));
+            DropPending();
+            return false;
+        }
+        m_nFiles++;
+    }
+    else if (m_cManifest.empty())
+        return true;
+
+    if (!m_cManifest.empty())
+    {
+        psManifest = new manifest_entry;
+        psManifest->name = cPath;
+        psManifest->size = 0;
+        psManifest->same = NULL;
+        psManifest->failed = false;
+        sha256_init(&psManifest->ctx);
+        m_apsManifest.push_back(psManifest);
+        m_cManifestIndex[cPath] = psManifest;
+    }
+
+    while (!m_bCancel)
+    {
+        char *pBuffer = m_pcPool ? m_pcPool->GetBuffer() : m_pBuffer;
+        ssize_t nRead = ReadChunk(pcReader, pBuffer);
+        if (nRead <= 0)
+        {
+            if (nRead < 0)
+                bResult = false;
+            if (m_pcPool)
+                m_pcPool->Submit(nWorker, psManifest, pBuffer, 0);
+            break;
+        }
+
+        if (m_pcThrottle && nFd >= 0)
+            m_pcThrottle->Wait(nRead, &m_bCancel);
+        uint64_t nWriteStart = m_pcThrottle ? pipe_time() : 0, nTraceStart = TraceStart(m_psTrace);
+        for (ssize_t nDone = 0; nFd >= 0 && nDone < nRead;)
+        {
+            ssize_t nWritten = write(nFd, pBuffer + nDone, nRead - nDone);
+            if (nWritten < 0 && errno == EINTR)
+                continue;
+            if (nWritten < 0)
+            {
+                if (bResult)
+                    Error(cPath + ": " + strerror(errno));
+                bResult = false;
+                break;
+            }
+            nDone += nWritten;
+        }
+        if (nFd >= 0)
+        {
+            TraceSpan(m_psTrace, TRACE_WRITE, nTraceStart);
+            m_nBytes += nRead;
+            nWritten += nRead;
+            if (m_nDurability != DURABLE_FAST && nWritten - nSynced >= DURABLE_BATCH)
+            {
+                StartWriteback(nFd, nSynced, nWritten - nSynced);
+                nSynced = nWritten;
+            }
+        }
+        if (m_pcThrottle && nFd >= 0)
+            m_pcThrottle->Written(nRead, pipe_time() - nWriteStart);
+
+        if (psManifest)
+        {
+            psManifest->size += nRead;
+            if (m_pcPool)
+                m_pcPool->Submit(nWorker, psManifest, pBuffer, nRead);
+            else
+                sha256_update(&psManifest->ctx, pBuffer, nRead);
+        }
+        if (!bResult)
+            break;
+    }
+
+    DropPending();
+
+    // finishing digest
+    if (psManifest)
+    {
+        psManifest->failed = !bResult || m_bCancel;
+        if (m_pcPool)
+            m_pcPool->Submit(nWorker, psManifest, NULL, 0);
+        else
+            sha256_final(&psManifest->ctx, psManifest->digest);
+    }
+
+    if (nFd < 0)
+        return bResult;
+
+    // a member which failed leaves nothing behind (a file being replaced
+    // is kept, see below)
+    if (!bResult && !m_bCancel && nMode == FILE_CREATE && unlinkat(m_nDestFd, cPath.c_str(), 0) == 0)
+        m_nFiles--;
+
+    // later members with the same contents may be linked to it
+    mode_t nFileMode = (sEntry.mode & 0777) ? (sEntry.mode & 0777) : 0644;
+    struct stat stbuf;
+    if (bKey && bResult && !m_bCancel && m_cDedup.count(sKey) < DEDUP_CANDIDATES &&
+        fstat(nFd, &stbuf) == 0 && (uint64_t)stbuf.st_size == sEntry.size)
+    {
+        dedup_file sFile = { cPath, stbuf.st_dev, stbuf.st_ino, nFileMode, sEntry.mtime };
+        m_cDedup.insert(std::make_pair(sKey, sFile));
+    }
+
+    // the rest is written back when the file is finished (by the metadata
+    // stage if there is one); a file renamed over an old one must be on disk
+    // before the rename
+    if (m_nDurability != DURABLE_FAST)
+    {
+        if (nMode == FILE_REPLACE && bResult && !m_bCancel)
+            fdatasync(nFd);
+        else if (!m_psMeta || nMode != FILE_CREATE)
+            StartWriteback(nFd, nSynced, 0);
+    }
+
+    // new files are finished by the metadata stage (if there is one)
+    if (m_psMeta && nMode == FILE_CREATE)
+    {
+        meta_item *psItem = new meta_item;
+        psItem->fd = nFd;
+        psItem->mode = nFileMode;
+        psItem->mtime = sEntry.mtime;
+        psItem->name = cPath;
+        m_psMeta->Push(psItem, NULL, &m_asStage[STAGE_WRITE].wait);
+        return bResult;
+    }
+
+    struct timespec asTime[2];
+    uint64_t nTraceStart = TraceStart(m_psTrace);
+    asTime[0].tv_sec = asTime[1].tv_sec = sEntry.mtime;
+    asTime[0].tv_nsec = asTime[1].tv_nsec = 0;
+    fchmod(nFd, nFileMode);
+    futimens(nFd, asTime);
+    if (close(nFd) < 0 && bResult)
+    {
+        Error(cPath + ": " + strerror(errno));
+        bResult = false;
+    }
+    TraceSpan(m_psTrace, TRACE_METADATA, nTraceStart);
+
+    // the old file stays untouched unless the new one is complete
+    if (nMode == FILE_REPLACE)
+    {
+        if (!bResult || m_bCancel)
+            unlinkat(m_nDestFd, cTarget.c_str(), 0);
+        else if (renameat(m_nDestFd, cTarget.c_str(), m_nDestFd, cPath.c_str()) < 0)
+        {
+            Error(cPath + ": " + strerror(errno));
+            unlinkat(m_nDestFd, cTarget.c_str(), 0);
+            bResult = false;
+        }
+        if (!bResult)
+            m_nFiles--;
+    }
+    return bResult;
+}
+
+// ExtractEntry - extracting one member (the reader is positioned at it)
+bool ExtractJob::ExtractEntry(ArchiveReader *pcReader, const archive_entry &sEntry)
+{
+    struct stat stbuf;
+    int nErrors = m_nErrors;
+    int nMode = FILE_CREATE;
+
+    m_cReadError.clear();
+    std::string cPath = SafePath(sEntry.name);
+    if (cPath.empty())
+    {
+        if (sEntry.type != ENTRY_DIR)
+            Error("Skipping unsafe name: " + sEntry.name);
+        return m_nErrors == nErrors;
+    }
+    if (sEntry.type == ENTRY_OTHER)
+    {
+        Error("Skipping special file: " + cPath);
+        return false;
+    }
+    if (!MakeParents(cPath))
+        return false;
+
+    // replacing existing files (but not folders)
+    if (fstatat(m_nDestFd, cPath.c_str(), &stbuf, AT_SYMLINK_NOFOLLOW) == 0)
+    {
+        if (S_ISDIR(stbuf.st_mode))
+        {
+            if (sEntry.type != ENTRY_DIR)
+                Error("Folder is in the way: " + cPath);
+            else
+            {
+                dir_entry sDir = { cPath, sEntry.mode, sEntry.mtime };
+                m_asDir.push_back(sDir);
+            }
+            return m_nErrors == nErrors;
+        }
+        if (m_bUpdate && sEntry.type == ENTRY_FILE)
+        {
+            if (!IsUnchanged(sEntry, cPath, stbuf))
+                nMode = FILE_REPLACE;
+            else
+            {
+                m_nSkipped++;
+                m_nSkippedBytes += sEntry.size;
+                nMode = FILE_HASH;
+            }
+        }
+        else if (m_bUpdate && sEntry.type == ENTRY_SYMLINK && S_ISLNK(stbuf.st_mode) &&
+                 ReadLink(cPath) == sEntry.link)
+        {
+            m_nSkipped++;
+            return true;
+        }
+        else
+            unlinkat(m_nDestFd, cPath.c_str(), 0);
+    }
+
+    // encrypted data is authenticated only at its end (WinZip AES), so it is
+    // written under a hidden name and appears only when it turned out right
+    if (nMode == FILE_CREATE && sEntry.type == ENTRY_FILE && sEntry.encrypted)
+        nMode = FILE_REPLACE;
+
+    switch (sEntry.type)
+    {
+        case ENTRY_DIR:
+        {
+            if (mkdirat(m_nDestFd, cPath.c_str(), 0700) < 0)
+                Error(cPath + ": " + strerror(errno));
+            else
+            {
+                dir_entry sDir = { cPath, sEntry.mode, sEntry.mtime };
+                m_asDir.push_back(sDir);
+            }
+            break;
+        }
+        case ENTRY_SYMLINK:
+            if (symlinkat(sEntry.link.c_str(), m_nDestFd, cPath.c_str()) < 0)
+                Error(cPath + ": " + strerror(errno));
+            else
+                SetTimes(cPath, sEntry.mtime, AT_SYMLINK_NOFOLLOW);
+            break;
+        case ENTRY_HARDLINK:
+        {
+            std::string cTarget = SafePath(sEntry.link);
+            if (cTarget.empty() || !IsInside(cTarget))
+                Error("Skipping unsafe link: " + sEntry.link);
+            else if (linkat(m_nDestFd, cTarget.c_str(), m_nDestFd, cPath.c_str(), 0) < 0)
+                Error(cPath + ": " + strerror(errno));
+            else
+            {
+                // the data of a hard link is written once
+                if (fstatat(m_nDestFd, cPath.c_str(), &stbuf, AT_SYMLINK_NOFOLLOW) == 0 && S_ISREG(stbuf.st_mode))
+                {
+                    m_nLinked++;
+                    m_nSavedBytes += stbuf.st_size;
+                }
+                if (m_cManifest.empty() || !FindManifest(cTarget))
+                    break;
+                manifest_entry *psManifest = new manifest_entry;
+                psManifest->name = cPath;
+                psManifest->same = FindManifest(cTarget);
+                if (psManifest->same->same)
+                    psManifest->same = psManifest->same->same; // the data is kept by the first one
+                psManifest->size = psManifest->same->size;
+                psManifest->failed = false;
+                m_apsManifest.push_back(psManifest);
+                m_cManifestIndex[cPath] = psManifest;
+            }
+            break;
+        }
+        default:
+            ExtractFile(pcReader, sEntry, cPath, nMode);
+            break;
+    }
+    return m_nErrors == nErrors;
+}
+
+// Run - extracting all members
+bool ExtractJob::Run(ArchiveReader *pcReader)
+{
+    archive_entry sEntry;
+    int nResult = 0;
+
+    // update mode replaces files in place, each one atomically already
+    if (m_nDurability == DURABLE_ATOMIC && !m_bUpdate && !MakeStage())
+        return false;
+
+    // the other threads of the job are started later, so they inherit the priority
+    if (m_bBackground)
+    {
+        SetBackgroundPriority();
+        m_pcThrottle = new WriteThrottle(m_nLimit);
+    }
+
+    if (!m_cManifest.empty() && m_nWorkers)
+    {
+        m_pcPool = new HashPool(m_nWorkers);
+        if (!m_pcPool->GetWorkerCount())
+        {
+            delete m_pcPool;
+            m_pcPool = NULL;
+        }
+    }
+
+    if (!m_bPipeline || m_bUpdate || !RunPipeline(pcReader))
+    {
+        uint64_t nStart = TraceStart(m_psTrace);
+        while (!m_bCancel && (nResult = pcReader->NextEntry(&sEntry)) > 0)
+        {
+            TraceSpan(m_psTrace, TRACE_DECODE, nStart);
+            TraceFirstByte(m_psTrace);
+            ExtractEntry(pcReader, sEntry);
+            nStart = TraceStart(m_psTrace);
+        }
+        if (nResult < 0)
+            ReaderError(pcReader);
+    }
+
+    Finish();
+    return !m_nErrors && !m_bCancel;
+}
+
+//
+// PipeReader - members coming from the decoding stage
+//
+class PipeReader : public ArchiveReader
+{
+    public:
+        PipeReader(ExtractJob *psJob) : m_psJob(psJob), m_psChunk(NULL), m_nOffset(0), m_bData(false), m_bEnd(false) {}
+        virtual ~PipeReader();
+        virtual int NextEntry(archive_entry *psEntry);
+        virtual ssize_t ReadData(void *pBuf, size_t nSize);
+    private:
+        ExtractJob::pipe_chunk *Pop();
+
+        ExtractJob *m_psJob;
+        ExtractJob::pipe_chunk *m_psChunk; // data being read
+        size_t m_nOffset;
+        bool m_bData; // data of the current member isn't read to its end
+        bool m_bEnd;
+};
+
+PipeReader::~PipeReader()
+{
+    if (m_psChunk)
+        m_psJob->FreeChunk(m_psChunk);
+}
+
+// Pop - next decoded item (NULL if cancelled)
+ExtractJob::pipe_chunk *PipeReader::Pop()
+{
+    return (ExtractJob::pipe_chunk *)m_psJob->m_psData->Pop(&m_psJob->m_bCancel, &m_psJob->m_asStage[STAGE_WRITE].wait);
+}
+
+int PipeReader::NextEntry(archive_entry *psEntry)
+{
+    ExtractJob::pipe_chunk *psChunk;
+
+    if (m_psChunk)
+    {
+        m_psJob->FreeChunk(m_psChunk);
+        m_psChunk = NULL;
+    }
+    while (!m_bEnd && (psChunk = Pop()))
+    {
+        int nKind = psChunk->kind;
+        if (nKind == ExtractJob::CHUNK_ENTRY)
+        {
+            *psEntry = *psChunk->entry;
+            m_bData = psEntry->type == ENTRY_FILE;
+        }
+        else if (nKind == ExtractJob::CHUNK_END)
+        {
+            m_cError = psChunk->error;
+            m_bEnd = true;
+        }
+        // (data which wasn't asked for is dropped)
+        m_psJob->FreeChunk(psChunk);
+        if (nKind == ExtractJob::CHUNK_ENTRY)
+            return 1;
+        if (nKind == ExtractJob::CHUNK_END)
+            return m_cError.empty() ? 0 : -1;
+    }
+    return 0;
+}
+
+ssize_t PipeReader::ReadData(void *pBuf, size_t nSize)
+{
+    if (!m_bData || (!m_psChunk && !(m_psChunk = Pop())))
+        return 0;
+
+    ssize_t nResult = 0;
+    if (m_psChunk->kind == ExtractJob::CHUNK_ERROR)
+    {
+        m_cError = m_psChunk->error;
+        nResult = -1;
+    }
+    else if (m_psChunk->size)
+    {
+        nResult = (m_psChunk->size - m_nOffset < nSize) ? m_psChunk->size - m_nOffset : nSize;
+        memcpy(pBuf, m_psChunk->data + m_nOffset, nResult);
+        m_nOffset += nResult;
+        if (m_nOffset < m_psChunk->size)
+            return nResult;
+    }
+    if (nResult <= 0)
+        m_bData = false;
+    m_psJob->FreeChunk(m_psChunk);
+    m_psChunk = NULL;
+    m_nOffset = 0;
+    return nResult;
+}
+
+// FreeChunk - data chunks go back to the decoding stage
+void ExtractJob::FreeChunk(pipe_chunk *psChunk)
+{
+    if (psChunk->data)
+        m_psFree->Push(psChunk, NULL, NULL); // there is room for all of them
+    else
+    {
+        delete psChunk->entry;
+        delete psChunk;
+    }
+}
+
+// RunPipeline - extracting with decoding and metadata stages in their own
+// threads (false if the decoding thread can't be started)
+bool ExtractJob::RunPipeline(ArchiveReader *pcReader)
+{
+    pthread_t hDecoder, hFinisher;
+    uint64_t nStart = pipe_time();
+    archive_entry sEntry;
+    int nResult = 0;
+
+    memset(m_asStage, 0, sizeof(m_asStage));
+    m_pcSource = pcReader;
+    m_psData = new PipeQueue(PIPE_ITEMS);
+    m_psFree = new PipeQueue(PIPE_CHUNKS);
+    for (int i = 0; i < PIPE_CHUNKS; i++)
+    {
+        pipe_chunk *psChunk = new pipe_chunk;
+        psChunk->entry = NULL;
+        psChunk->data = new char[ARCHIVE_BUFSIZE];
+        m_apsChunk.push_back(psChunk);
+        m_psFree->Push(psChunk, NULL, NULL);
+    }
+
+    bool bStarted = pthread_create(&hDecoder, NULL, Decoder, this) == 0;
+    if (bStarted)
+    {
+        // without the metadata stage files are finished by the writing one
+        m_psMeta = new PipeQueue(PIPE_FILES);
+        if (pthread_create(&hFinisher, NULL, Finisher, this) != 0)
+        {
+            delete m_psMeta;
+            m_psMeta = NULL;
+        }
+
+        PipeReader *pcPipe = new PipeReader(this);
+        while (!m_bCancel && (nResult = pcPipe->NextEntry(&sEntry)) > 0)
+            ExtractEntry(pcPipe, sEntry);
+        if (nResult < 0)
+            ReaderError(pcPipe);
+        delete pcPipe;
+
+        // the decoder is done (or sees the cancel); the finisher gets the last item
+        pthread_join(hDecoder, NULL);
+        if (m_psMeta)
+        {
+            meta_item *psLast = new meta_item;
+            psLast->fd = -1;
+            m_psMeta->Push(psLast, NULL, &m_asStage[STAGE_WRITE].wait);
+            pthread_join(hFinisher, NULL);
+            delete m_psMeta;
+            m_psMeta = NULL;
+        }
+        m_asStage[STAGE_WRITE].busy = pipe_time() - nStart - m_asStage[STAGE_WRITE].wait;
+        m_bPipelined = true;
+    }
+
+    pipe_chunk *psChunk;
+    while ((psChunk = (pipe_chunk *)m_psData->TryPop()))
+        FreeChunk(psChunk);
+    for (unsigned int i = 0; i < m_apsChunk.size(); i++)
+    {
+        delete [] m_apsChunk[i]->data;
+        delete m_apsChunk[i];
+    }
+    m_apsChunk.clear();
+    delete m_psData;
+    delete m_psFree;
+    m_psData = m_psFree = NULL;
+    return bStarted;
+}
+
+void *ExtractJob::Decoder(void *pData)
+{
+    ((ExtractJob *)pData)->Decode();
+    return NULL;
+}
+
+// Decode - decoding stage: members and their data in archive order
+void ExtractJob::Decode()
+{
+    uint64_t nStart = pipe_time(), &nWait = m_asStage[STAGE_DECODE].wait;
+    int nResult = 0;
+
+    TraceThread("decode");
+    while (!m_bCancel)
+    {
+        archive_entry *psEntry = new archive_entry;
+        uint64_t nTraceStart = TraceStart(m_psTrace);
+        if ((nResult = m_pcSource->NextEntry(psEntry)) <= 0)
+        {
+            delete psEntry;
+            break;
+        }
+        TraceSpan(m_psTrace, TRACE_DECODE, nTraceStart);
+        TraceFirstByte(m_psTrace);
+        bool bFile = psEntry->type == ENTRY_FILE;
+        pipe_chunk *psItem = new pipe_chunk;
+        psItem->kind = CHUNK_ENTRY;
+        psItem->entry = psEntry;
+        psItem->data = NULL;
+        if (!m_psData->Push(psItem, &m_bCancel, &nWait))
+        {
+            FreeChunk(psItem);
+            break;
+        }
+
+        // file data ends with an empty chunk or an error
+        while (bFile)
+        {
+            pipe_chunk *psChunk = (pipe_chunk *)m_psFree->Pop(&m_bCancel, &nWait);
+            if (!psChunk)
+                break;
+            uint64_t nTraceStart = TraceStart(m_psTrace);
+            ssize_t nRead = m_pcSource->ReadData(psChunk->data, ARCHIVE_BUFSIZE);
+            TraceSpan(m_psTrace, TRACE_DECODE, nTraceStart);
+            psChunk->kind = nRead < 0 ? CHUNK_ERROR : CHUNK_DATA;
+            psChunk->size = nRead > 0 ? nRead : 0;
+            if (nRead < 0)
+                psChunk->error = m_pcSource->GetError();
+            if (!m_psData->Push(psChunk, &m_bCancel, &nWait))
+                break; // the chunk is freed with the others (the free queue is the writer's)
+            bFile = nRead > 0;
+        }
+    }
+
+    pipe_chunk *psEnd = new pipe_chunk;
+    psEnd->kind = CHUNK_END;
+    psEnd->entry = NULL;
+    psEnd->data = NULL;
+    if (nResult < 0)
+        psEnd->error = m_pcSource->GetError();
+    if (!m_psData->Push(psEnd, &m_bCancel, &nWait))
+        FreeChunk(psEnd);
+    m_asStage[STAGE_DECODE].busy = pipe_time() - nStart - nWait;
+}
+
+void *ExtractJob::Finisher(void *pData)
+{
+    ((ExtractJob *)pData)->FinishFiles();
+    return NULL;
+}
+
+// FinishFiles - metadata stage: permissions and times of written files,
+// closing them (which may wait for the file system)
+void ExtractJob::FinishFiles()
+{
+    uint64_t nStart = pipe_time(), &nWait = m_asStage[STAGE_METADATA].wait;
+    meta_item *psItem;
+
+    TraceThread("metadata");
+    while ((psItem = (meta_item *)m_psMeta->Pop(NULL, &nWait))->fd >= 0)
+    {
+        uint64_t nTraceStart = TraceStart(m_psTrace);
+        struct timespec asTime[2];
+        asTime[0].tv_sec = asTime[1].tv_sec = psItem->mtime;
+        asTime[0].tv_nsec = asTime[1].tv_nsec = 0;
+        if (m_nDurability != DURABLE_FAST)
+            StartWriteback(psItem->fd, 0, 0);
+        fchmod(psItem->fd, psItem->mode);
+        futimens(psItem->fd, asTime);
+        if (close(psItem->fd) < 0)
+            Error(psItem->name + ": " + strerror(errno));
+        delete psItem;
+        TraceSpan(m_psTrace, TRACE_METADATA, nTraceStart);
+    }
+    delete psItem;
+    m_asStage[STAGE_METADATA].busy = pipe_time() - nStart - nWait;
+}
+
+bool ExtractJob::GetStageTimes(stage_time *psTimes) const
+{
+    if (!m_bPipelined)
+        return false;
+    memcpy(psTimes, m_asStage, sizeof(m_asStage));
+    return true;
+}
+
+// Finish - applying folder metadata and writing manifest
+void ExtractJob::Finish()
+{
+    uint64_t nTraceStart = TraceStart(m_psTrace);
+
+    // children first
+    for (unsigned int i = m_asDir.size(); i-- > 0;)
+    {
+        fchmodat(m_nDestFd, m_asDir[i].name.c_str(), (m_asDir[i].mode & 0777) | 0700, 0);
+        SetTimes(m_asDir[i].name, m_asDir[i].mtime, 0);
+        if (m_nFinalFd >= 0)
+            m_cStageDirs.insert(m_asDir[i].name);
+    }
+    m_asDir.clear();
+
+    if (m_pcPool)
+        m_pcPool->Wait();
+    if (!m_cManifest.empty() && !m_bCancel)
+        WriteManifest();
+
+    if (m_nDurability != DURABLE_FAST && !m_bCancel && !SyncFolder(m_nDestFd))
+        Error(std::string("Syncing files: ") + strerror(errno));
+    if (m_nFinalFd >= 0)
+        CommitStage();
+    TraceSpan(m_psTrace, TRACE_FINISH, nTraceStart);
+}
+
+// MakeStage - expanding into a hidden folder of the destination, named
+// after the host and process and locked while it is used; folders left by
+// interrupted jobs are removed first, but only when their owner is surely
+// gone (the destination may be shared by other hosts)
+bool ExtractJob::MakeStage()
+{
+    int nFd = dup(m_nDestFd);
+    DIR *psDir = (nFd >= 0) ? fdopendir(nFd) : NULL;
+    struct dirent *psEntry;
+    char zHost[HOST_NAME_MAX + 1], zNumber[32];
+
+    if (gethostname(zHost, sizeof(zHost)) < 0)
+        strcpy(zHost, "localhost");
+    zHost[HOST_NAME_MAX] = '\0';
+    std::string cOwn = std::string(STAGE_PREFIX) + zHost + "-";
+
+    if (psDir)
+    {
+        std::vector<std::string> acStale;
+        while ((psEntry = readdir(psDir)))
+        {
+            // (a longer host name ending with "-<number>" doesn't pass)
+            long nPid;
+            unsigned int nCount;
+            int nEnd = 0;
+            if (!strncmp(psEntry->d_name, cOwn.c_str(), cOwn.size()) &&
+                sscanf(psEntry->d_name + cOwn.size(), "%ld-%u%n", &nPid, &nCount, &nEnd) == 2 &&
+                !psEntry->d_name[cOwn.size() + nEnd] && nPid != (long)getpid() &&
+                kill(nPid, 0) < 0 && errno == ESRCH)
+                acStale.push_back(psEntry->d_name);
+        }
+        closedir(psDir);
+
+        // the lock tells apart a process of another pid namespace
+        for (unsigned int i = 0; i < acStale.size(); i++)
+        {
+            nFd = openat(m_nDestFd, acStale[i].c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+            if (nFd < 0)
+                continue;
+            if (flock(nFd, LOCK_EX | LOCK_NB) == 0)
+                RemoveTree(m_nDestFd, acStale[i].c_str());
+            close(nFd);
+        }
+    }
+    else if (nFd >= 0)
+        close(nFd);
+
+    sprintf(zNumber, "%ld-%u", (long)getpid(), __sync_fetch_and_add(&stage_count, 1));
+    std::string cName = cOwn + zNumber;
+    if (mkdirat(m_nDestFd, cName.c_str(), 0700) < 0 ||
+        (nFd = openat(m_nDestFd, cName.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW)) < 0)
+    {
+        Error(std::string("Creating hidden folder: ") + strerror(errno));
+        unlinkat(m_nDestFd, cName.c_str(), AT_REMOVEDIR);
+        return false;
+    }
+
+    // held until the folder is committed (where there are no locks, stale
+    // folders are never taken for gone)
+    flock(nFd, LOCK_EX | LOCK_NB);
+    m_cStage = cName;
+    m_nFinalFd = m_nDestFd;
+    m_nDestFd = nFd;
+    return true;
+}
+
+// CommitStage - moving the expanded tree into the destination (only if it
+// is complete; otherwise nothing of it appears there)
+void ExtractJob::CommitStage()
+{
+    if (!m_nErrors && !m_bCancel && MoveTree(m_nDestFd, m_nFinalFd, "") && !SyncFolder(m_nFinalFd))
+        Error(std::string("Syncing files: ") + strerror(errno));
+    close(m_nDestFd);
+    m_nDestFd = m_nFinalFd;
+    m_nFinalFd = -1;
+    RemoveTree(m_nDestFd, m_cStage.c_str());
+}
+
+// MoveTree - renaming the contents of a hidden folder into the destination
+// folder; folders which are there already get the contents merged into them
+// (like expanding over them does), other things are replaced
+bool ExtractJob::MoveTree(int nFromFd, int nToFd, const std::string &cPath)
+{
+    int nFd = dup(nFromFd);
+    DIR *psDir = (nFd >= 0) ? fdopendir(nFd) : NULL;
+    struct dirent *psEntry;
+    bool bResult = true;
+
+    if (!psDir)
+    {
+        if (nFd >= 0)
+            close(nFd);
+        Error(cPath + ": " + strerror(errno));
+        return false;
+    }
+
+    // names are collected first, the folder changes while they are moved
+    std::vector<std::string> acName;
+    while ((psEntry = readdir(psDir)))
+    {
+        if (strcmp(psEntry->d_name, ".") && strcmp(psEntry->d_name, ".."))
+            acName.push_back(psEntry->d_name);
+    }
+    closedir(psDir);
+
+    for (unsigned int i = 0; i < acName.size(); i++)
+    {
+        const char *pzName = acName[i].c_str();
+        std::string cName = cPath.empty() ? acName[i] : cPath + "/" + acName[i];
+        struct stat sFrom, sTo;
+
+        if (fstatat(nFromFd, pzName, &sFrom, AT_SYMLINK_NOFOLLOW) < 0)
+            continue;
+        if (fstatat(nToFd, pzName, &sTo, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(sTo.st_mode))
+        {
+            if (!S_ISDIR(sFrom.st_mode))
+            {
+                Error("Folder is in the way: " + cName);
+                bResult = false;
+                continue;
+            }
+            int nSubFrom = openat(nFromFd, pzName, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+            int nSubTo = openat(nToFd, pzName, O_RDONLY | O_DIRECTORY | O_NOFOLLOW);
+            if (nSubFrom < 0 || nSubTo < 0 || !MoveTree(nSubFrom, nSubTo, cName))
+                bResult = false;
+            else if (m_cStageDirs.count(cName))
+            {
+                // the folder gets the member's permissions and time, as when expanded over it
+                // (folders which were only parents of members are left as they are)
+                struct timespec asTime[2];
+                asTime[0] = sFrom.st_atim;
+                asTime[1] = sFrom.st_mtim;
+                fchmod(nSubTo, sFrom.st_mode & 07777);
+                futimens(nSubTo, asTime);
+            }
+            if (nSubFrom >= 0)
+                close(nSubFrom);
+            if (nSubTo >= 0)
+                close(nSubTo);
+            continue;
+        }
+
+        // a folder can't be renamed over a file
+        if (S_ISDIR(sFrom.st_mode))
+            unlinkat(nToFd, pzName, 0);
+        if (renameat(nFromFd, pzName, nToFd, pzName) < 0)
+        {
+            Error(cName + ": " + strerror(errno));
+            bResult = false;
+        }
+    }
+    return bResult;
+}
+
+// JSON string
+static std::string json_string(const std::string &cText)
+{
+    std::string cResult = "\"";
+    char zBuf[8];
+
+    for (unsigned int i = 0; i < cText.size(); i++)
+    {
+        unsigned char ch = cText[i];
+        if (ch == '\"' || ch == '\\')
+        {
+            cResult += '\\';
+            cResult += ch;
+        }
+        else if (ch < 0x20)
+        {
+            sprintf(zBuf, "\\u%04x", ch);
+            cResult += zBuf;
+        }
+        else
+            cResult += ch;
+    }
+    return cResult + "\"";
+}
+
+// WriteManifest - sha256sum compatible list and JSON manifest
+bool ExtractJob::WriteManifest()
+{
+    std::string cText, cJson;
+    char zHex[SHA256_HEX + 1], zSize[32];
+    bool bFirst = true;
+
+    cJson = "{\n  \"archive\": " + json_string(m_cManifest) + ",\n  \"algorithm\": \"sha256\",\n  \"files\": [";
+    for (unsigned int i = 0; i < m_apsManifest.size(); i++)
+    {
+        manifest_entry *psEntry = m_apsManifest[i];
+        manifest_entry *psData = psEntry->same ? psEntry->same : psEntry;
+        if (psData->failed)
+            continue;
+        sha256_hex(psData->digest, zHex);
+
+        // sha256sum escapes names with backslashes and new lines
+        std::string cName;
+        bool bEscaped = false;
+        for (unsigned int j = 0; j < psEntry->name.size(); j++)
+        {
+            if (psEntry->name[j] == '\\')
+                cName += "\\\\";
+            else if (psEntry->name[j] == '\n')
+                cName += "\\n";
+            else
+            {
+                cName += psEntry->name[j];
+                continue;
+            }
+            bEscaped = true;
+        }
+        cText += (bEscaped ? "\\" : "") + std::string(zHex) + "  " + cName + "\n";
+
+        sprintf(zSize, "%llu", (unsigned long long)psData->size);
+        cJson += std::string(bFirst ? "\n" : ",\n") + "    { \"path\": " + json_string(psEntry->name) +
+                 ", \"size\": " + zSize + ", \"sha256\": \"" + zHex + "\" }";
+        bFirst = false;
+    }
+    cJson += "\n  ]\n}\n";
+
+    const char *apzName[2] = { ".sha256", ".sha256.json" };
+    const std::string *apcText[2] = { &cText, &cJson };
+    for (int i = 0; i < 2; i++)
+    {
+        std::string cPath = m_cManifest + apzName[i];
+        int nFd = openat(m_nDestFd, cPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW, 0644);
+        if (nFd < 0 || write(nFd, apcText[i]->data(), apcText[i]->size()) != (ssize_t)apcText[i]->size())
+        {
+            Error(cPath + ": " + strerror(errno));
+            if (nFd >= 0)
+                close(nFd);
+            return false;
+        }
+        close(nFd);
+    }
+    return true;
+}
@@ -0,0 +1,270 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _NRUSLAN_EXTRACT_H_
+#define _NRUSLAN_EXTRACT_H_
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include "archive.h"
+#include "sha256.h"
+
+// Message callback (errors and notes for the error window)
+typedef void (*extract_log)(void *pData, const char *pzText);
+
+// Manifest entry (digest is computed by hash workers)
+struct manifest_entry
+{
+    std::string name;
+    uint64_t size;
+    sha256_ctx ctx;
+    unsigned char digest[SHA256_DIGEST];
+    manifest_entry *same; // hard link target (digest is taken from it)
+    bool failed; // not written completely (left out of the manifest)
+};
+
+// Durability of expanded files
+enum Extract_Durability
+{
+    DURABLE_FAST, // written back whenever the system likes
+    DURABLE_SAFE, // written back while expanding, the file system is synced at the end
+    DURABLE_ATOMIC // safe, expanded into a hidden folder which is moved into place when complete
+};
+
+// Stages of pipelined extraction
+enum Extract_Stage
+{
+    STAGE_DECODE, // reading and decoding the archive
+    STAGE_WRITE, // creating files and writing their data
+    STAGE_METADATA, // permissions, times and closing files
+    STAGE_COUNT
+};
+
+// Time of a stage (microseconds): working and waiting for its neighbours
+struct stage_time
+{
+    uint64_t busy;
+    uint64_t wait;
+};
+
+class HashPool;
+class WriteThrottle;
+class PipeQueue;
+class PipeReader;
+struct trace_job;
+
+//
+// ExtractJob - extracting archive members into the destination folder.
+// All files are created relative to the destination descriptor; leading
+// slashes are removed and names with ".." or going through symbolic links
+// are refused. Run() decodes, writes and finishes files in three threads
+// connected by bounded queues (except in update mode, which decides per
+// member whether its data is read at all).
+//
+class ExtractJob
+{
+    public:
+        ExtractJob(int nDestFd, extract_log pfLog, void *pData); // takes the descriptor
+        ~ExtractJob();
+        void SetManifest(const char *pzName, int nWorkers); // nWorkers < 0 - by processors count
+        void SetUpdate(bool bCompareCrc); // skipping unchanged files, replacing others atomically
+        void SetDedup(); // files with the contents of an earlier one are linked to it
+        void SetPipeline(bool bPipeline) { m_bPipeline = bPipeline; } // on by default
+        void SetBackground(uint64_t nLimit); // low priority, writing throttled (bytes per second, 0 - no fixed limit)
+        void SetDurability(int nDurability) { m_nDurability = nDurability; } // DURABLE_FAST by default
+        void SetTrace(trace_job *psTrace) { m_psTrace = psTrace; } // phases are timed into it (NULL - not traced)
+        bool Run(ArchiveReader *pcReader);
+        bool ExtractEntry(ArchiveReader *pcReader, const archive_entry &sEntry);
+        void Finish();
+        void Cancel() { m_bCancel = true; }
+        bool IsCancelled() const { return m_bCancel; }
+        int GetErrorCount() const { return m_nErrors; }
+        uint64_t GetBytes() const { return m_nBytes; }
+        unsigned int GetFileCount() const { return m_nFiles; }
+        uint64_t GetSkippedBytes() const { return m_nSkippedBytes; }
+        unsigned int GetSkippedCount() const { return m_nSkipped; }
+        uint64_t GetSavedBytes() const { return m_nSavedBytes; } // not written thanks to links
+        unsigned int GetLinkedCount() const { return m_nLinked; }
+        bool GetStageTimes(stage_time *psTimes) const; // STAGE_COUNT items; false if not pipelined
+        uint64_t GetThrottleTime() const; // microseconds writing waited for the background limit
+    private:
+        friend class PipeReader;
+
+        enum File_Mode
+        {
+            FILE_CREATE, // new file
+            FILE_REPLACE, // temporary file renamed over the old one
+            FILE_HASH // data is only hashed (unchanged file in update mode)
+        };
+
+        struct dir_entry
+        {
+            std::string name;
+            mode_t mode;
+            time_t mtime;
+        };
+
+        enum Dedup_Result
+        {
+            DEDUP_NONE, // no earlier file with this size and beginning
+            DEDUP_LINKED,
+            DEDUP_DIFFERENT, // the equal part is copied from the earlier file
+            DEDUP_FAILED
+        };
+
+        typedef std::pair<uint64_t, uint32_t> dedup_key; // size, CRC-32 of the beginning
+
+        // written file which later members may be linked to
+        struct dedup_file
+        {
+            std::string name;
+            dev_t dev;
+            ino_t ino;
+            mode_t mode;
+            time_t mtime;
+        };
+
+        enum Chunk_Kind
+        {
+            CHUNK_ENTRY, // member header, data of files follows
+            CHUNK_DATA, // size 0 - end of the member data
+            CHUNK_ERROR,
+            CHUNK_END // no more members (error is set if reading failed)
+        };
+
+        // item passed from the decoding stage
+        struct pipe_chunk
+        {
+            int kind;
+            archive_entry *entry;
+            char *data;
+            size_t size;
+            std::string error;
+        };
+
+        // written file to be finished by the metadata stage (fd < 0 - the last one)
+        struct meta_item
+        {
+            int fd;
+            mode_t mode;
+            time_t mtime;
+            std::string name;
+        };
+
+        typedef std::multimap<dedup_key, dedup_file> dedup_map;
+
+        // earlier file being compared with the member
+        struct dedup_candidate
+        {
+            dedup_file *file;
+            int fd;
+        };
+
+        void Error(const std::string &cText);
+        void ReaderError(ArchiveReader *pcReader);
+        bool MakeParents(const std::string &cPath);
+        bool IsInside(const std::string &cPath);
+        bool ExtractFile(ArchiveReader *pcReader, const archive_entry &sEntry, const std::string &cPath, int nMode);
+        bool IsUnchanged(const archive_entry &sEntry, const std::string &cPath, const struct stat &sStat);
+        int Deduplicate(ArchiveReader *pcReader, const archive_entry &sEntry, const std::string &cPath, dedup_key *psKey, std::string *pcSame);
+        bool LinkDuplicate(const dedup_file &sSame, int nSameFd, const archive_entry &sEntry, const std::string &cPath);
+        ssize_t ReadChunk(ArchiveReader *pcReader, char *pBuffer);
+        void DropPending();
+        bool RunPipeline(ArchiveReader *pcReader);
+        static void *Decoder(void *pData);
+        void Decode();
+        static void *Finisher(void *pData);
+        void FinishFiles();
+        void FreeChunk(pipe_chunk *psChunk);
+        bool MakeStage();
+        void CommitStage();
+        bool MoveTree(int nFromFd, int nToFd, const std::string &cPath);
+        std::string ReadLink(const std::string &cPath);
+        void SetTimes(const std::string &cPath, time_t nTime, int nFlags);
+        manifest_entry *FindManifest(const std::string &cPath);
+        bool WriteManifest();
+
+        int m_nDestFd;
+        extract_log m_pfLog;
+        void *m_pData;
+        volatile bool m_bCancel;
+        int m_nErrors;
+        std::string m_cReadError; // reader error reported for the current member
+        uint64_t m_nBytes;
+        unsigned int m_nFiles;
+        std::vector<dir_entry> m_asDir; // metadata is applied at the end
+        char *m_pBuffer;
+
+        // update mode
+        bool m_bUpdate;
+        bool m_bCompareCrc;
+        unsigned int m_nSkipped;
+        uint64_t m_nSkippedBytes;
+        unsigned int m_nTemp; // temporary names counter
+
+        // identical contents
+        bool m_bDedup;
+        unsigned int m_nLinked;
+        uint64_t m_nSavedBytes;
+        dedup_map m_cDedup;
+        char *m_pPending; // data read while an earlier file was compared
+        size_t m_nPending;
+        int m_nSameFd; // the earlier file (its equal beginning is copied)
+        uint64_t m_nSame, m_nSameDone;
+
+        // durability (the real destination while expanding into the hidden folder)
+        int m_nDurability;
+        int m_nFinalFd;
+        std::string m_cStage;
+        std::set<std::string> m_cStageDirs; // folders which are members (their metadata is moved)
+
+        // background job
+        bool m_bBackground;
+        uint64_t m_nLimit;
+        WriteThrottle *m_pcThrottle;
+
+        // manifest
+        std::string m_cManifest;
+        int m_nWorkers;
+        HashPool *m_pcPool;
+        std::vector<manifest_entry *> m_apsManifest;
+        std::map<std::string, manifest_entry *> m_cManifestIndex;
+
+        // pipeline
+        bool m_bPipeline, m_bPipelined;
+        ArchiveReader *m_pcSource; // read by the decoding stage
+        PipeQueue *m_psData, *m_psFree, *m_psMeta; // decoded items, empty data chunks, written files
+        std::vector<pipe_chunk *> m_apsChunk; // data chunks
+        stage_time m_asStage[STAGE_COUNT];
+
+        trace_job *m_psTrace;
+};
+
+// Normalizing member name (empty if it must not be extracted)
+std::string SafePath(const std::string &cName);
+
+// Waiting until everything written to the file system of the folder is on disk
+bool SyncFolder(int nFd);
+
+#endif /* _NRUSLAN_EXTRACT_H_ */
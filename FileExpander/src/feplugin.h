@@ -0,0 +1,86 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _NRUSLAN_FEPLUGIN_H_
+#define _NRUSLAN_FEPLUGIN_H_
+
+/*
+ * Decoder plugin interface (plain C, stable). A plugin is a shared object
+ * named by a rule:
+ *
+ *   "" "" "application/x-foo" ".foo" format:"foo" plugin:"foo.so"
+ *
+ * Relative names are looked up in ~/config/FileExpander/plugins and then
+ * in /usr/lib/FileExpander. The plugin exports fe_decoder_get() returning
+ * its decoder table; the table is never freed. One handle is used by one
+ * thread at a time, but different handles may be used at the same time.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define FE_PLUGIN_ABI 1
+#define FE_PLUGIN_SYMBOL "fe_decoder_get"
+
+/* Entry types (the same as FileExpander's own) */
+enum fe_entry_type
+{
+    FE_ENTRY_FILE,
+    FE_ENTRY_DIR,
+    FE_ENTRY_SYMLINK,
+    FE_ENTRY_HARDLINK,
+    FE_ENTRY_OTHER
+};
+
+/* Archive member; strings must stay valid until the next call with the handle */
+struct fe_entry
+{
+    const char *name; /* relative path ('/' separated) */
+    const char *link; /* symbolic or hard link target (NULL if none) */
+    int type;
+    unsigned int mode; /* permission bits */
+    int64_t mtime;
+    uint64_t size; /* uncompressed size (0 if unknown) */
+    uint64_t csize; /* compressed size (or size) */
+    uint32_t crc; /* CRC-32 of the data (if has_crc) */
+    int has_crc;
+    int encrypted;
+};
+
+struct fe_decoder
+{
+    unsigned int abi; /* FE_PLUGIN_ABI */
+    const char *name; /* shown in error messages */
+
+    /* opening archive file; NULL on error (message is put into error) */
+    void *(*open)(const char *path, char *error, size_t error_size);
+    /* next member: 1 - entry, 0 - end, -1 - error */
+    int (*next_entry)(void *handle, struct fe_entry *entry);
+    /* data of the current member: count of bytes, 0 at its end, -1 on error */
+    long (*read)(void *handle, void *buffer, size_t size);
+    void (*close)(void *handle);
+
+    /* optional (may be NULL) */
+    const char *(*error)(void *handle); /* message of the last error */
+    void (*set_password)(void *handle, const char *password); /* before the first next_entry */
+};
+
+typedef const struct fe_decoder *(*fe_decoder_get_t)(void);
+
+#endif /* _NRUSLAN_FEPLUGIN_H_ */
@@ -0,0 +1,283 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "cache.h"
+#include "launch.h"
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+// Reply of the serving instance
+static const char g_cAck = '+';
+
+LaunchForward::LaunchForward()
+    : m_nLockFd(-1), m_nSocket(-1), m_bServing(false), m_pfOpen(NULL), m_pData(NULL)
+{
+    m_anWake[0] = m_anWake[1] = -1;
+}
+
+LaunchForward::~LaunchForward()
+{
+    Stop();
+    if (m_nLockFd >= 0)
+    {
+        // the socket is only removed by its owner
+        unlink(m_cPath.c_str());
+        close(m_nLockFd);
+    }
+}
+
+// SocketAddress - filling the address (false if the path is too long)
+static bool SocketAddress(const std::string &cPath, struct sockaddr_un *psAddr)
+{
+    if (cPath.size() >= sizeof(psAddr->sun_path))
+        return false;
+    memset(psAddr, 0, sizeof(*psAddr));
+    psAddr->sun_family = AF_UNIX;
+    strcpy(psAddr->sun_path, cPath.c_str());
+    return true;
+}
+
+// IsComplete - whether the request ends with an empty path
+static bool IsComplete(const std::string &cMessage)
+{
+    size_t nSize = cMessage.size();
+    return nSize && !cMessage[nSize - 1] && (nSize == 1 || !cMessage[nSize - 2]);
+}
+
+// WaitFor - waiting for the descriptor (false on timeout or error)
+static bool WaitFor(int nFd, short nEvents, int nTimeout)
+{
+    struct pollfd sPoll;
+
+    sPoll.fd = nFd;
+    sPoll.events = nEvents;
+    int nResult;
+    while ((nResult = poll(&sPoll, 1, nTimeout)) < 0 && errno == EINTR)
+        ;
+    return nResult > 0;
+}
+
+int LaunchForward::Forward(int nCount, char **ppzParams)
+{
+    std::string cRoot, cError, cMessage;
+
+    if (!GetCacheRoot(&cRoot, &cError))
+        return LAUNCH_ALONE;
+    m_cPath = cRoot + "/" LAUNCH_SOCKET;
+
+    // paths separated by NUL, an empty one at the end; the running
+    // instance may have another current folder
+    char *pzCWD = getcwd(NULL, 0);
+    for (int i = 0; i < nCount; i++)
+    {
+        if (!*ppzParams[i])
+            continue;
+        if (*ppzParams[i] != '/' && pzCWD)
+            cMessage += std::string(pzCWD) + "/";
+        cMessage += ppzParams[i];
+        cMessage += '\0';
+    }
+    cMessage += '\0';
+    free(pzCWD);
+    if (cMessage.size() > LAUNCH_MAX_MESSAGE)
+        return LAUNCH_ALONE;
+
+    for (int i = 0; i < LAUNCH_TRIES; i++)
+    {
+        if (Send(cMessage))
+            return LAUNCH_FORWARDED;
+
+        // nobody answers: whoever holds the lock serves (or is about to)
+        if (m_nLockFd < 0)
+        {
+            m_nLockFd = open((m_cPath + LAUNCH_LOCK_SUFFIX).c_str(), O_RDWR | O_CREAT, 0600);
+            if (m_nLockFd < 0)
+                return LAUNCH_ALONE;
+            fcntl(m_nLockFd, F_SETFD, FD_CLOEXEC);
+        }
+        struct flock sLock;
+        memset(&sLock, 0, sizeof(sLock));
+        sLock.l_type = F_WRLCK;
+        sLock.l_whence = SEEK_SET;
+        if (fcntl(m_nLockFd, F_SETLK, &sLock) == 0)
+            return LAUNCH_PRIMARY;
+        usleep(LAUNCH_RETRY_DELAY * 1000);
+    }
+    close(m_nLockFd);
+    m_nLockFd = -1;
+    return LAUNCH_ALONE;
+}
+
+// Send - giving the paths to the running instance (true if it took them)
+bool LaunchForward::Send(const std::string &cMessage)
+{
+    struct sockaddr_un sAddr;
+    char cReply = 0;
+
+    if (!SocketAddress(m_cPath, &sAddr))
+        return false;
+    int nFd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (nFd < 0)
+        return false;
+    if (connect(nFd, (struct sockaddr *)&sAddr, sizeof(sAddr)) < 0)
+    {
+        close(nFd);
+        return false;
+    }
+
+    bool bSent = true;
+    for (size_t nDone = 0; bSent && nDone < cMessage.size(); )
+    {
+        ssize_t nWritten = send(nFd, cMessage.data() + nDone, cMessage.size() - nDone, MSG_NOSIGNAL);
+        if (nWritten > 0)
+            nDone += nWritten;
+        else if (nWritten < 0 && errno != EINTR)
+            bSent = false;
+    }
+    if (bSent && WaitFor(nFd, POLLIN, LAUNCH_TIMEOUT))
+        bSent = read(nFd, &cReply, 1) == 1 && cReply == g_cAck;
+    else
+        bSent = false;
+    close(nFd);
+    return bSent;
+}
+
+bool LaunchForward::Serve(launch_open pfOpen, void *pData)
+{
+    struct sockaddr_un sAddr;
+
+    if (m_nLockFd < 0 || m_bServing || !SocketAddress(m_cPath, &sAddr))
+        return false;
+    m_pfOpen = pfOpen;
+    m_pData = pData;
+
+    // a socket left by a crashed instance is replaced
+    m_nSocket = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (m_nSocket < 0)
+        return false;
+    fcntl(m_nSocket, F_SETFD, FD_CLOEXEC);
+    unlink(m_cPath.c_str());
+    if (bind(m_nSocket, (struct sockaddr *)&sAddr, sizeof(sAddr)) < 0 || listen(m_nSocket, 8) < 0 || pipe(m_anWake) < 0)
+    {
+        close(m_nSocket);
+        m_nSocket = -1;
+        return false;
+    }
+    fcntl(m_anWake[0], F_SETFD, FD_CLOEXEC);
+    fcntl(m_anWake[1], F_SETFD, FD_CLOEXEC);
+
+    if (pthread_create(&m_hThread, NULL, Thread, this) != 0)
+    {
+        close(m_anWake[0]);
+        close(m_anWake[1]);
+        close(m_nSocket);
+        m_nSocket = m_anWake[0] = m_anWake[1] = -1;
+        return false;
+    }
+    m_bServing = true;
+    return true;
+}
+
+void LaunchForward::Stop()
+{
+    if (!m_bServing)
+        return;
+
+    // launches coming now are refused and retry until the lock is free
+    write(m_anWake[1], "", 1);
+    pthread_join(m_hThread, NULL);
+    close(m_anWake[0]);
+    close(m_anWake[1]);
+    close(m_nSocket);
+    m_nSocket = m_anWake[0] = m_anWake[1] = -1;
+    m_bServing = false;
+}
+
+// Receive - reading one request and opening its windows
+void LaunchForward::Receive(int nFd)
+{
+    std::string cMessage;
+    char zBuffer[4096];
+    ssize_t nRead = 0;
+
+    while (cMessage.size() <= LAUNCH_MAX_MESSAGE && !IsComplete(cMessage))
+    {
+        if (!WaitFor(nFd, POLLIN, LAUNCH_TIMEOUT))
+            return;
+        if ((nRead = read(nFd, zBuffer, sizeof(zBuffer))) <= 0)
+        {
+            if (nRead < 0 && errno == EINTR)
+                continue;
+            return;
+        }
+        cMessage.append(zBuffer, nRead);
+    }
+    if (!IsComplete(cMessage))
+        return;
+
+    std::vector<std::string> acPaths;
+    for (size_t nStart = 0; nStart < cMessage.size() && cMessage[nStart]; )
+    {
+        size_t nEnd = cMessage.find('\0', nStart);
+        acPaths.push_back(cMessage.substr(nStart, nEnd - nStart));
+        nStart = nEnd + 1;
+    }
+    m_pfOpen(m_pData, acPaths);
+    send(nFd, &g_cAck, 1, MSG_NOSIGNAL);
+}
+
+void *LaunchForward::Thread(void *pData)
+{
+    LaunchForward *psLaunch = (LaunchForward *)pData;
+    struct pollfd asPoll[2];
+
+    asPoll[0].fd = psLaunch->m_nSocket;
+    asPoll[1].fd = psLaunch->m_anWake[0];
+    asPoll[0].events = asPoll[1].events = POLLIN;
+    for (;;)
+    {
+        if (poll(asPoll, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+        if (asPoll[1].revents)
+            break;
+        if (asPoll[0].revents & POLLIN)
+        {
+            int nFd = accept(psLaunch->m_nSocket, NULL, NULL);
+            if (nFd >= 0)
+            {
+                psLaunch->Receive(nFd);
+                close(nFd);
+            }
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,80 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _NRUSLAN_LAUNCH_H_
+#define _NRUSLAN_LAUNCH_H_
+
+//
+// Launch forwarding - the first FileExpander of the user serves a Unix
+// socket in the user's private folder; later launches send their archives
+// to it and exit at once, and the running instance opens a window for
+// each of them. A lock held by the serving process tells a socket left
+// by a crash from one which is still being set up.
+//
+
+#include <pthread.h>
+#include <string>
+#include <vector>
+
+#define LAUNCH_SOCKET "launch" // in the private folder (see cache.h)
+#define LAUNCH_LOCK_SUFFIX ".lock"
+
+enum Launch_Settings
+{
+    LAUNCH_MAX_MESSAGE = 262144, // bytes of forwarded paths
+    LAUNCH_TRIES = 20, // connecting while another instance is starting
+    LAUNCH_RETRY_DELAY = 100, // ms
+    LAUNCH_TIMEOUT = 5000 // ms for the reply (and for a request)
+};
+
+// Result of Forward()
+enum Launch_Result
+{
+    LAUNCH_FORWARDED, // the running instance took the paths
+    LAUNCH_PRIMARY, // no instance is running; Serve() may be called
+    LAUNCH_ALONE // neither (no private folder, or no reply)
+};
+
+// Opening windows for the forwarded paths (none - an empty window);
+// called by the serving thread
+typedef void (*launch_open)(void *pData, const std::vector<std::string> &acPaths);
+
+class LaunchForward
+{
+    public:
+        LaunchForward();
+        ~LaunchForward(); // stops serving and gives the lock up
+        int Forward(int nCount, char **ppzParams); // relative paths are sent as full ones
+        bool Serve(launch_open pfOpen, void *pData); // after LAUNCH_PRIMARY
+        void Stop(); // other launches wait until Serve() or destruction
+    private:
+        bool Send(const std::string &cMessage);
+        void Receive(int nFd);
+        static void *Thread(void *pData);
+
+        std::string m_cPath;
+        int m_nLockFd, m_nSocket;
+        int m_anWake[2]; // stopping the thread
+        bool m_bServing;
+        pthread_t m_hThread;
+        launch_open m_pfOpen;
+        void *m_pData;
+};
+
+#endif /* _NRUSLAN_LAUNCH_H_ */
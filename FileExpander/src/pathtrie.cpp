@@ -0,0 +1,384 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "pathtrie.h"
+#include "space.h"
+
+// FNV-1a
+static uint32_t hash_name(const char *pzName, size_t nLength)
+{
+    uint32_t nHash = 2166136261U;
+
+    for (size_t i = 0; i < nLength; i++)
+        nHash = (nHash ^ (unsigned char)pzName[i]) * 16777619U;
+    return nHash;
+}
+
+static uint32_t hash_child(uint32_t nParent, uint32_t nName)
+{
+    uint64_t nKey = ((uint64_t)nParent << 32) | nName;
+
+    nKey ^= nKey >> 33;
+    nKey *= 0xff51afd7ed558ccdULL;
+    nKey ^= nKey >> 33;
+    return (uint32_t)nKey;
+}
+
+// Children order: directories first, then by name
+struct child_order
+{
+    const PathTrie *trie;
+
+    bool operator()(uint32_t a, uint32_t b) const
+    {
+        bool bDirA = trie->IsDirectory(a), bDirB = trie->IsDirectory(b);
+
+        if (bDirA != bDirB)
+            return bDirA;
+        return strcmp(trie->GetName(a), trie->GetName(b)) < 0;
+    }
+};
+
+PathTrie::PathTrie()
+    : m_nNodes(0), m_nPoolUsed(TRIE_NAME_CHUNK), m_anNameHash(1024, 0), m_nNames(0), m_anChildHash(1024, 0)
+{
+    // root: empty name, always open
+    uint32_t nRoot = NewNode();
+    trie_node &sRoot = GetNode(nRoot);
+
+    sRoot.name = Intern("", 0);
+    sRoot.parent = TRIE_NONE;
+    sRoot.type = ENTRY_DIR;
+    sRoot.expanded = 1;
+}
+
+PathTrie::~PathTrie()
+{
+    for (unsigned int i = 0; i < m_apsNode.size(); i++)
+        delete[] m_apsNode[i];
+    for (unsigned int i = 0; i < m_apzPool.size(); i++)
+        delete[] m_apzPool[i];
+}
+
+const char *PathTrie::GetName(uint32_t nNode) const
+{
+    uint32_t nName = GetNode(nNode).name;
+
+    return m_apzPool[nName / TRIE_NAME_CHUNK] + nName % TRIE_NAME_CHUNK;
+}
+
+std::string PathTrie::GetPath(uint32_t nNode) const
+{
+    std::vector<uint32_t> anPath;
+    std::string cPath;
+
+    for (; nNode != GetRoot() && nNode != TRIE_NONE; nNode = GetNode(nNode).parent)
+        anPath.push_back(nNode);
+    for (unsigned int i = anPath.size(); i > 0; i--)
+    {
+        if (!cPath.empty())
+            cPath += '/';
+        cPath += GetName(anPath[i - 1]);
+    }
+    return cPath;
+}
+
+size_t PathTrie::GetMemoryUsage() const
+{
+    return m_apsNode.size() * (size_t)TRIE_NODE_CHUNK * sizeof(trie_node) + m_apzPool.size() * (size_t)TRIE_NAME_CHUNK
+           + (m_anNameHash.size() + m_anChildHash.size()) * sizeof(uint32_t);
+}
+
+uint32_t PathTrie::NewNode()
+{
+    if (m_nNodes % TRIE_NODE_CHUNK == 0)
+        m_apsNode.push_back(new trie_node[TRIE_NODE_CHUNK]);
+
+    uint32_t nNode = m_nNodes++;
+    trie_node &sNode = GetNode(nNode);
+
+    memset(&sNode, 0, sizeof(sNode));
+    sNode.child = sNode.sibling = TRIE_NONE;
+    return nNode;
+}
+
+void PathTrie::GrowNames()
+{
+    std::vector<uint32_t> anHash(m_anNameHash.size() * 2, 0);
+    uint32_t nMask = anHash.size() - 1;
+
+    for (unsigned int i = 0; i < m_anNameHash.size(); i++)
+    {
+        if (!m_anNameHash[i])
+            continue;
+        uint32_t nName = m_anNameHash[i] - 1;
+        const char *pzName = m_apzPool[nName / TRIE_NAME_CHUNK] + nName % TRIE_NAME_CHUNK;
+        uint32_t j = hash_name(pzName, strlen(pzName)) & nMask;
+
+        while (anHash[j])
+            j = (j + 1) & nMask;
+        anHash[j] = m_anNameHash[i];
+    }
+    m_anNameHash.swap(anHash);
+}
+
+uint32_t PathTrie::Intern(const char *pzName, size_t nLength)
+{
+    if (nLength > TRIE_MAX_NAME)
+        nLength = TRIE_MAX_NAME;
+
+    uint32_t nMask = m_anNameHash.size() - 1;
+    uint32_t i = hash_name(pzName, nLength) & nMask;
+
+    for (; m_anNameHash[i]; i = (i + 1) & nMask)
+    {
+        uint32_t nName = m_anNameHash[i] - 1;
+        const char *pzOld = m_apzPool[nName / TRIE_NAME_CHUNK] + nName % TRIE_NAME_CHUNK;
+
+        if (!strncmp(pzOld, pzName, nLength) && !pzOld[nLength])
+            return nName;
+    }
+
+    // new name goes to the pool (a chunk never splits a name)
+    if (m_nPoolUsed + nLength + 1 > TRIE_NAME_CHUNK)
+    {
+        m_apzPool.push_back(new char[TRIE_NAME_CHUNK]);
+        m_nPoolUsed = 0;
+    }
+
+    uint32_t nName = (m_apzPool.size() - 1) * TRIE_NAME_CHUNK + m_nPoolUsed;
+    char *pzNew = m_apzPool.back() + m_nPoolUsed;
+
+    memcpy(pzNew, pzName, nLength);
+    pzNew[nLength] = '\0';
+    m_nPoolUsed += nLength + 1;
+
+    m_anNameHash[i] = nName + 1;
+    if (++m_nNames * 2 > m_anNameHash.size())
+        GrowNames();
+    return nName;
+}
+
+void PathTrie::GrowChildren()
+{
+    std::vector<uint32_t> anHash(m_anChildHash.size() * 2, 0);
+    uint32_t nMask = anHash.size() - 1;
+
+    for (unsigned int i = 0; i < m_anChildHash.size(); i++)
+    {
+        if (!m_anChildHash[i])
+            continue;
+        const trie_node &sNode = GetNode(m_anChildHash[i] - 1);
+        uint32_t j = hash_child(sNode.parent, sNode.name) & nMask;
+
+        while (anHash[j])
+            j = (j + 1) & nMask;
+        anHash[j] = m_anChildHash[i];
+    }
+    m_anChildHash.swap(anHash);
+}
+
+// Finding or adding a child node
+uint32_t PathTrie::Child(uint32_t nParent, uint32_t nName, bool bDirectory)
+{
+    uint32_t nMask = m_anChildHash.size() - 1;
+    uint32_t i = hash_child(nParent, nName) & nMask;
+
+    for (; m_anChildHash[i]; i = (i + 1) & nMask)
+    {
+        uint32_t nNode = m_anChildHash[i] - 1;
+        trie_node &sNode = GetNode(nNode);
+
+        if (sNode.parent == nParent && sNode.name == nName)
+        {
+            // "a" listed as a file, then "a/b" (directory wins)
+            if (bDirectory && sNode.type != ENTRY_DIR && !sNode.files)
+                sNode.type = ENTRY_DIR;
+            return nNode;
+        }
+    }
+
+    uint32_t nNode = NewNode();
+    trie_node &sNode = GetNode(nNode);
+    trie_node &sParent = GetNode(nParent);
+
+    sNode.name = nName;
+    sNode.parent = nParent;
+    sNode.type = bDirectory ? ENTRY_DIR : ENTRY_OTHER;
+    sNode.sibling = sParent.child;
+    sParent.child = nNode;
+
+    m_anChildHash[i] = nNode + 1;
+    if (m_nNodes * 2 > m_anChildHash.size())
+        GrowChildren();
+    return nNode;
+}
+
+uint32_t PathTrie::Add(const archive_entry &sEntry)
+{
+    const char *pzName = sEntry.name.c_str();
+    uint32_t nNode = GetRoot(), nLast = TRIE_NONE;
+    bool bDirectory = sEntry.type == ENTRY_DIR;
+
+    while (*pzName)
+    {
+        const char *pzEnd = strchr(pzName, '/');
+        size_t nLength = pzEnd ? pzEnd - pzName : strlen(pzName);
+
+        // empty and "." components are left out
+        if (nLength && !(nLength == 1 && *pzName == '.'))
+        {
+            pzEnd = pzName + nLength;
+            while (*pzEnd == '/')
+                pzEnd++;
+            nLast = nNode = Child(nNode, Intern(pzName, nLength), bDirectory || *pzEnd);
+        }
+        pzName += nLength;
+        while (*pzName == '/')
+            pzName++;
+    }
+    if (nLast == TRIE_NONE || bDirectory)
+        return nLast;
+
+    // a member listed again (appended to tar) replaces the earlier one
+    trie_node &sNode = GetNode(nLast);
+    if (sNode.type == ENTRY_DIR)
+        return nLast;
+
+    uint64_t nSize = sEntry.size - sNode.size, nCompressed = sEntry.csize - sNode.csize; // modulo 2^64
+    uint32_t nFiles = sNode.files ? 0 : 1;
+
+    sNode.type = sEntry.type;
+    for (nNode = nLast; nNode != TRIE_NONE; nNode = GetNode(nNode).parent)
+    {
+        trie_node &sUp = GetNode(nNode);
+        sUp.size += nSize;
+        sUp.csize += nCompressed;
+        sUp.files += nFiles;
+    }
+    return nLast;
+}
+
+uint32_t PathTrie::GetChildren(uint32_t nNode, std::vector<uint32_t> *panChild, uint32_t nMax) const
+{
+    child_order sOrder = { this };
+    uint32_t nCount;
+
+    panChild->clear();
+    for (uint32_t nChild = GetNode(nNode).child; nChild != TRIE_NONE; nChild = GetNode(nChild).sibling)
+        panChild->push_back(nChild);
+
+    // only the shown ones have to be in order
+    nCount = panChild->size();
+    if (nCount > nMax)
+    {
+        std::partial_sort(panChild->begin(), panChild->begin() + nMax, panChild->end(), sOrder);
+        panChild->resize(nMax);
+    }
+    else
+        std::sort(panChild->begin(), panChild->end(), sOrder);
+    return nCount;
+}
+
+bool PathTrie::Toggle(uint32_t nNode)
+{
+    if (nNode == TRIE_NONE || nNode == GetRoot() || !IsDirectory(nNode))
+        return false;
+    GetNode(nNode).expanded ^= 1;
+    return true;
+}
+
+void PathTrie::RenderNode(uint32_t nNode, int nDepth, std::string *pcText, std::vector<uint32_t> *panLine) const
+{
+    const trie_node &sNode = GetNode(nNode);
+    char zSize[32], zCompressed[32], zLine[96];
+
+    FormatSize(sNode.size, zSize);
+    FormatSize(sNode.csize, zCompressed);
+    snprintf(zLine, sizeof(zLine), "%10s %10s  ", zSize, zCompressed);
+
+    *pcText += zLine;
+    pcText->append(nDepth * 2, ' ');
+    if (sNode.type == ENTRY_DIR)
+    {
+        *pcText += sNode.expanded ? "- " : "+ ";
+        *pcText += GetName(nNode);
+        snprintf(zLine, sizeof(zLine), "/ (%u files)", sNode.files);
+        *pcText += zLine;
+    }
+    else
+    {
+        *pcText += "  ";
+        *pcText += GetName(nNode);
+    }
+    *pcText += '\n';
+    panLine->push_back(nNode);
+}
+
+// Visible lines in depth first order; explicit stack as paths may be
+// thousands of components deep
+void PathTrie::Render(std::string *pcText, std::vector<uint32_t> *panLine) const
+{
+    struct render_level
+    {
+        std::vector<uint32_t> children;
+        uint32_t next;
+        uint32_t total;
+    };
+    std::vector<render_level> asStack(1);
+
+    pcText->clear();
+    panLine->clear();
+    asStack[0].total = GetChildren(GetRoot(), &asStack[0].children, TRIE_SHOW_CHILDREN);
+    asStack[0].next = 0;
+
+    while (!asStack.empty())
+    {
+        render_level &sLevel = asStack.back();
+        int nDepth = asStack.size() - 1;
+
+        if (sLevel.next == sLevel.children.size())
+        {
+            if (sLevel.total > sLevel.children.size())
+            {
+                char zLine[96];
+                snprintf(zLine, sizeof(zLine), "%10s %10s  ", "", "");
+                *pcText += zLine;
+                pcText->append(nDepth * 2, ' ');
+                snprintf(zLine, sizeof(zLine), "  ... %u more\n", (unsigned int)(sLevel.total - sLevel.children.size()));
+                *pcText += zLine;
+                panLine->push_back(TRIE_NONE);
+            }
+            asStack.pop_back();
+            continue;
+        }
+
+        uint32_t nNode = sLevel.children[sLevel.next++];
+        RenderNode(nNode, nDepth, pcText, panLine);
+        if (IsDirectory(nNode) && GetNode(nNode).expanded)
+        {
+            asStack.resize(asStack.size() + 1); // sLevel is not used after this
+            asStack.back().total = GetChildren(nNode, &asStack.back().children, TRIE_SHOW_CHILDREN);
+            asStack.back().next = 0;
+        }
+    }
+}
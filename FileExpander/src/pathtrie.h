@@ -0,0 +1,98 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _NRUSLAN_PATHTRIE_H_
+#define _NRUSLAN_PATHTRIE_H_
+
+//
+// PathTrie - archive listing as a tree of path components. Every component
+// string is stored once (interned) and nodes are taken from fixed-size
+// chunks, so a listing of millions of members costs a few dozen bytes per
+// member. Directory nodes keep totals of their subtree (files, size and
+// compressed size), updated as members are added.
+//
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "archive.h"
+
+enum PathTrie_Settings
+{
+    TRIE_NODE_CHUNK = 65536, // nodes per chunk
+    TRIE_NAME_CHUNK = 1048576, // bytes of the name pool per chunk
+    TRIE_MAX_NAME = 65535, // longer components are cut
+    TRIE_SHOW_CHILDREN = 1000 // children shown per directory (then "... N more")
+};
+
+#define TRIE_NONE 0xffffffffU
+
+struct trie_node
+{
+    uint32_t name; // interned component
+    uint32_t parent;
+    uint32_t child; // first child
+    uint32_t sibling; // next child of the parent
+    uint64_t size; // of the file, or of all files below the directory
+    uint64_t csize; // compressed size (the same way)
+    uint32_t files; // files below the directory (1 for files)
+    uint8_t type; // Archive_EntryType
+    uint8_t expanded; // directory is shown open
+};
+
+class PathTrie
+{
+    public:
+        PathTrie();
+        ~PathTrie();
+        uint32_t Add(const archive_entry &sEntry); // node of the member (TRIE_NONE if the name is empty)
+        uint32_t GetRoot() const { return 0; }
+        trie_node &GetNode(uint32_t nNode) { return m_apsNode[nNode / TRIE_NODE_CHUNK][nNode % TRIE_NODE_CHUNK]; }
+        const trie_node &GetNode(uint32_t nNode) const { return m_apsNode[nNode / TRIE_NODE_CHUNK][nNode % TRIE_NODE_CHUNK]; }
+        const char *GetName(uint32_t nNode) const;
+        std::string GetPath(uint32_t nNode) const; // member name ('/' separated)
+        bool IsDirectory(uint32_t nNode) const { return GetNode(nNode).type == ENTRY_DIR; }
+        // children sorted (directories first, then by name); at most nMax of them
+        uint32_t GetChildren(uint32_t nNode, std::vector<uint32_t> *panChild, uint32_t nMax) const;
+        uint32_t GetNodeCount() const { return m_nNodes; }
+        uint32_t GetNameCount() const { return m_nNames; }
+        size_t GetMemoryUsage() const;
+        bool Toggle(uint32_t nNode); // opening or closing a directory; false for files
+        // text of the visible lines; panLine[i] is the node shown by line i
+        // (TRIE_NONE for "... N more" lines)
+        void Render(std::string *pcText, std::vector<uint32_t> *panLine) const;
+    private:
+        uint32_t Intern(const char *pzName, size_t nLength);
+        uint32_t Child(uint32_t nParent, uint32_t nName, bool bDirectory);
+        uint32_t NewNode();
+        void GrowNames();
+        void GrowChildren();
+        void RenderNode(uint32_t nNode, int nDepth, std::string *pcText, std::vector<uint32_t> *panLine) const;
+
+        std::vector<trie_node *> m_apsNode;
+        uint32_t m_nNodes;
+        std::vector<char *> m_apzPool; // name chunks; name id is offset in the pool
+        uint32_t m_nPoolUsed; // in the last chunk
+        std::vector<uint32_t> m_anNameHash; // name ids + 1 (open addressing)
+        uint32_t m_nNames;
+        std::vector<uint32_t> m_anChildHash; // (parent, name) -> node + 1
+};
+
+#endif /* _NRUSLAN_PATHTRIE_H_ */
@@ -0,0 +1,154 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <time.h>
+#include <sched.h>
+#include "pipeline.h"
+
+PipeQueue::PipeQueue(unsigned int nSize)
+  : m_nHead(0), m_nTail(0), m_nWaiting(0)
+{
+    unsigned int nRing = 2;
+    while (nRing < nSize)
+        nRing <<= 1;
+    m_ppItem = new void *[nRing];
+    m_nMask = nRing - 1;
+    pthread_mutex_init(&m_hLock, NULL);
+    pthread_cond_init(&m_hMoved, NULL);
+}
+
+PipeQueue::~PipeQueue()
+{
+    pthread_cond_destroy(&m_hMoved);
+    pthread_mutex_destroy(&m_hLock);
+    delete [] m_ppItem;
+}
+
+// IsBlocked - the queue is full (pushing side) or empty (popping side)
+bool PipeQueue::IsBlocked(bool bPush)
+{
+    if (bPush)
+        return m_nTail - __atomic_load_n(&m_nHead, __ATOMIC_SEQ_CST) > m_nMask;
+    return m_nHead == __atomic_load_n(&m_nTail, __ATOMIC_SEQ_CST);
+}
+
+// Backoff - waiting for the other side: spinning first, then sleeping on
+// the condition (for a while only, the caller checks cancellation)
+void PipeQueue::Backoff(unsigned int *pnSpins, bool bPush)
+{
+    if (++*pnSpins < PIPE_SPINS)
+    {
+        sched_yield();
+        return;
+    }
+
+    struct timespec sUntil;
+    clock_gettime(CLOCK_REALTIME, &sUntil);
+    sUntil.tv_nsec += PIPE_RECHECK * 1000000;
+    if (sUntil.tv_nsec >= 1000000000)
+    {
+        sUntil.tv_sec++;
+        sUntil.tv_nsec -= 1000000000;
+    }
+
+    // the other side checks the waiters after moving, so either it sees
+    // this one or this one sees the move
+    pthread_mutex_lock(&m_hLock);
+    __atomic_add_fetch(&m_nWaiting, 1, __ATOMIC_SEQ_CST);
+    if (IsBlocked(bPush))
+        pthread_cond_timedwait(&m_hMoved, &m_hLock, &sUntil);
+    __atomic_sub_fetch(&m_nWaiting, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&m_hLock);
+}
+
+// Wake - waking the other side if it is blocked
+void PipeQueue::Wake()
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&m_nWaiting, __ATOMIC_RELAXED))
+    {
+        pthread_mutex_lock(&m_hLock);
+        pthread_cond_broadcast(&m_hMoved);
+        pthread_mutex_unlock(&m_hLock);
+    }
+}
+
+bool PipeQueue::Push(void *pItem, volatile bool *pbCancel, uint64_t *pnWait)
+{
+    unsigned int nTail = m_nTail, nSpins = 0;
+    uint64_t nStart = 0;
+
+    while (nTail - __atomic_load_n(&m_nHead, __ATOMIC_ACQUIRE) > m_nMask)
+    {
+        if (pbCancel && *pbCancel)
+            return false;
+        if (!nStart)
+            nStart = pipe_time();
+        Backoff(&nSpins, true);
+    }
+    if (nStart && pnWait)
+        *pnWait += pipe_time() - nStart;
+
+    // the item must be visible before the new tail
+    m_ppItem[nTail & m_nMask] = pItem;
+    __atomic_store_n(&m_nTail, nTail + 1, __ATOMIC_RELEASE);
+    Wake();
+    return true;
+}
+
+void *PipeQueue::Pop(volatile bool *pbCancel, uint64_t *pnWait)
+{
+    unsigned int nSpins = 0;
+    uint64_t nStart = 0;
+    void *pItem;
+
+    while (!(pItem = TryPop()))
+    {
+        if (pbCancel && *pbCancel)
+            return NULL;
+        if (!nStart)
+            nStart = pipe_time();
+        Backoff(&nSpins, false);
+    }
+    if (nStart && pnWait)
+        *pnWait += pipe_time() - nStart;
+    return pItem;
+}
+
+void *PipeQueue::TryPop()
+{
+    unsigned int nHead = m_nHead;
+
+    if (nHead == __atomic_load_n(&m_nTail, __ATOMIC_ACQUIRE))
+        return NULL;
+    void *pItem = m_ppItem[nHead & m_nMask];
+
+    // the slot may be reused after the new head is seen
+    __atomic_store_n(&m_nHead, nHead + 1, __ATOMIC_RELEASE);
+    Wake();
+    return pItem;
+}
+
+uint64_t pipe_time()
+{
+    struct timespec sTime;
+
+    clock_gettime(CLOCK_MONOTONIC, &sTime);
+    return (uint64_t)sTime.tv_sec * 1000000 + sTime.tv_nsec / 1000;
+}
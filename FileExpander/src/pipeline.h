@@ -0,0 +1,65 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _NRUSLAN_PIPELINE_H_
+#define _NRUSLAN_PIPELINE_H_
+
+//
+// PipeQueue - bounded queue of pointers between two threads (one pushes,
+// the other pops). It is a lock-free ring: a side which can't go on spins
+// for a while and then blocks until the other side moves, so a full queue
+// holds the producer back and memory stays bounded. Time spent waiting is
+// added to the caller's counter, which gives the stage utilisation.
+//
+
+#include <stdint.h>
+#include <pthread.h>
+
+enum Pipe_Settings
+{
+    PIPE_SPINS = 64, // yields before blocking
+    PIPE_RECHECK = 20 // milliseconds a blocked side waits before checking cancellation
+};
+
+class PipeQueue
+{
+    public:
+        PipeQueue(unsigned int nSize); // rounded up to a power of two
+        ~PipeQueue();
+        // false (NULL) if *pbCancel was set while waiting; pbCancel may be NULL
+        bool Push(void *pItem, volatile bool *pbCancel, uint64_t *pnWait);
+        void *Pop(volatile bool *pbCancel, uint64_t *pnWait);
+        void *TryPop(); // NULL if empty
+    private:
+        bool IsBlocked(bool bPush);
+        void Backoff(unsigned int *pnSpins, bool bPush);
+        void Wake();
+
+        void **m_ppItem;
+        unsigned int m_nMask;
+        volatile unsigned int m_nHead, m_nTail; // popping and pushing side
+        volatile unsigned int m_nWaiting; // sides blocked on the condition
+        pthread_mutex_t m_hLock;
+        pthread_cond_t m_hMoved;
+};
+
+// Monotonic time in microseconds
+uint64_t pipe_time();
+
+#endif /* _NRUSLAN_PIPELINE_H_ */
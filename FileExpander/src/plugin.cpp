@@ -0,0 +1,232 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <map>
+#include "plugin.h"
+#include "feplugin.h"
+
+enum Plugin_Settings
+{
+    PLUGIN_ERROR = 256 // error message buffer given to open()
+};
+
+struct plugin_format
+{
+    std::string path; // as given by the rule
+    const fe_decoder *decoder; // NULL until loaded
+    std::string error; // why it couldn't be loaded
+};
+
+// Formats given to plugins (shared objects are never unloaded: readers
+// of older rules may still use them)
+static std::map<std::string, plugin_format> plugin_formats;
+static pthread_mutex_t plugin_lock = PTHREAD_MUTEX_INITIALIZER;
+
+//
+// PluginReader - archive members given by a plugin
+//
+class PluginReader : public ArchiveReader
+{
+    public:
+        PluginReader(const fe_decoder *psDecoder, void *pHandle);
+        virtual ~PluginReader();
+        virtual int NextEntry(archive_entry *psEntry);
+        virtual ssize_t ReadData(void *pBuf, size_t nSize);
+        virtual void SetPassword(const char *pzPassword);
+    private:
+        void SetError(const char *pzDefault);
+
+        const fe_decoder *m_psDecoder;
+        void *m_pHandle;
+};
+
+PluginReader::PluginReader(const fe_decoder *psDecoder, void *pHandle)
+    : m_psDecoder(psDecoder), m_pHandle(pHandle)
+{
+}
+
+PluginReader::~PluginReader()
+{
+    m_psDecoder->close(m_pHandle);
+}
+
+void PluginReader::SetError(const char *pzDefault)
+{
+    const char *pzError = m_psDecoder->error ? m_psDecoder->error(m_pHandle) : NULL;
+
+    m_cError = std::string(m_psDecoder->name ? m_psDecoder->name : "plugin") + ": " + (pzError && *pzError ? pzError : pzDefault);
+}
+
+int PluginReader::NextEntry(archive_entry *psEntry)
+{
+    fe_entry sEntry;
+
+    memset(&sEntry, 0, sizeof(sEntry));
+    int nResult = m_psDecoder->next_entry(m_pHandle, &sEntry);
+    if (nResult < 0)
+        SetError("damaged archive");
+    if (nResult <= 0)
+        return nResult < 0 ? -1 : 0;
+
+    psEntry->name = sEntry.name ? sEntry.name : "";
+    psEntry->link = sEntry.link ? sEntry.link : "";
+    psEntry->type = (sEntry.type >= FE_ENTRY_FILE && sEntry.type <= FE_ENTRY_OTHER) ? sEntry.type : ENTRY_OTHER;
+    psEntry->mode = sEntry.mode & 07777;
+    psEntry->mtime = sEntry.mtime;
+    psEntry->size = sEntry.size;
+    psEntry->csize = sEntry.csize;
+    psEntry->crc = sEntry.crc;
+    psEntry->has_crc = sEntry.has_crc != 0;
+    psEntry->encrypted = sEntry.encrypted != 0;
+    psEntry->offset = 0;
+    return 1;
+}
+
+ssize_t PluginReader::ReadData(void *pBuf, size_t nSize)
+{
+    long nRead = m_psDecoder->read(m_pHandle, pBuf, nSize);
+
+    if (nRead < 0)
+        SetError("read error");
+    return nRead < 0 ? -1 : nRead;
+}
+
+void PluginReader::SetPassword(const char *pzPassword)
+{
+    if (m_psDecoder->set_password)
+        m_psDecoder->set_password(m_pHandle, pzPassword);
+}
+
+// LoadPlugin - loading the shared object of the format (under plugin_lock)
+static const fe_decoder *LoadPlugin(plugin_format *psFormat)
+{
+    std::string cPath = psFormat->path;
+    void *pHandle = NULL;
+
+    if (psFormat->decoder || !psFormat->error.empty())
+        return psFormat->decoder;
+
+    // relative names: personal plugins first
+    if (cPath.find('/') == std::string::npos)
+    {
+        const char *pzHome = getenv("HOME");
+        std::string cUser = std::string(pzHome ? pzHome : "") + "/" + EXPANDER_USER_PLUGINS + "/" + cPath;
+        cPath = std::string(EXPANDER_PLUGINS) + "/" + cPath;
+        if (pzHome && access(cUser.c_str(), F_OK) == 0)
+            cPath = cUser;
+    }
+
+    pHandle = dlopen(cPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!pHandle)
+    {
+        const char *pzError = dlerror();
+        psFormat->error = pzError ? pzError : cPath + ": can't be loaded";
+        return NULL;
+    }
+
+    fe_decoder_get_t pfGet = (fe_decoder_get_t)dlsym(pHandle, FE_PLUGIN_SYMBOL);
+    const fe_decoder *psDecoder = pfGet ? pfGet() : NULL;
+    if (!psDecoder || psDecoder->abi != FE_PLUGIN_ABI || !psDecoder->open || !psDecoder->next_entry ||
+        !psDecoder->read || !psDecoder->close)
+    {
+        psFormat->error = cPath + ": not a decoder plugin of this version";
+        dlclose(pHandle);
+        return NULL;
+    }
+    psFormat->decoder = psDecoder;
+    return psDecoder;
+}
+
+bool RegisterPlugin(const char *pzFormat, const char *pzPlugin)
+{
+    if (!pzFormat || !*pzFormat || !pzPlugin || !*pzPlugin || IsBuiltinFormat(pzFormat))
+        return false;
+
+    pthread_mutex_lock(&plugin_lock);
+    plugin_format &sFormat = plugin_formats[pzFormat];
+    if (sFormat.path != pzPlugin)
+    {
+        // changed rule: the new plugin is loaded by the next open
+        sFormat.path = pzPlugin;
+        sFormat.decoder = NULL;
+        sFormat.error.clear();
+    }
+    pthread_mutex_unlock(&plugin_lock);
+    return true;
+}
+
+bool IsPluginFormat(const char *pzFormat)
+{
+    if (!pzFormat)
+        return false;
+
+    pthread_mutex_lock(&plugin_lock);
+    bool bResult = plugin_formats.find(pzFormat) != plugin_formats.end();
+    pthread_mutex_unlock(&plugin_lock);
+    return bResult;
+}
+
+bool PluginHasPasswords(const char *pzFormat)
+{
+    const fe_decoder *psDecoder = NULL;
+
+    if (!pzFormat)
+        return false;
+
+    pthread_mutex_lock(&plugin_lock);
+    std::map<std::string, plugin_format>::iterator i = plugin_formats.find(pzFormat);
+    if (i != plugin_formats.end())
+        psDecoder = LoadPlugin(&i->second);
+    pthread_mutex_unlock(&plugin_lock);
+    return psDecoder && psDecoder->set_password;
+}
+
+ArchiveReader *OpenPlugin(const char *pzFormat, const char *pzPath, std::string *pcError)
+{
+    const fe_decoder *psDecoder = NULL;
+    char zError[PLUGIN_ERROR] = "";
+
+    pthread_mutex_lock(&plugin_lock);
+    std::map<std::string, plugin_format>::iterator i = plugin_formats.find(pzFormat);
+    if (i != plugin_formats.end())
+    {
+        psDecoder = LoadPlugin(&i->second);
+        if (!psDecoder)
+            *pcError = i->second.error;
+    }
+    else
+        *pcError = "Unknown archive format";
+    pthread_mutex_unlock(&plugin_lock);
+    if (!psDecoder)
+        return NULL;
+
+    void *pHandle = psDecoder->open(pzPath, zError, sizeof(zError));
+    if (!pHandle)
+    {
+        zError[sizeof(zError) - 1] = '\0';
+        *pcError = std::string(psDecoder->name ? psDecoder->name : "plugin") + ": " + (*zError ? zError : "can't open archive");
+        return NULL;
+    }
+    return new PluginReader(psDecoder, pHandle);
+}
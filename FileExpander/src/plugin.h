@@ -0,0 +1,41 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _NRUSLAN_PLUGIN_H_
+#define _NRUSLAN_PLUGIN_H_
+
+//
+// Decoder plugins - formats read by shared objects named in rules
+// (plugin:"..." field, see feplugin.h). They are loaded on the first use
+// and stay loaded; to the rest of FileExpander they are native formats.
+//
+
+#include <string>
+#include "archive.h"
+
+#define EXPANDER_PLUGINS "/usr/lib/FileExpander"
+#define EXPANDER_USER_PLUGINS "config/FileExpander/plugins" // relative to $HOME
+
+// Giving the format to a plugin (false for formats read by FileExpander itself)
+bool RegisterPlugin(const char *pzFormat, const char *pzPlugin);
+bool IsPluginFormat(const char *pzFormat);
+bool PluginHasPasswords(const char *pzFormat); // false if the plugin can't be loaded
+ArchiveReader *OpenPlugin(const char *pzFormat, const char *pzPath, std::string *pcError);
+
+#endif /* _NRUSLAN_PLUGIN_H_ */
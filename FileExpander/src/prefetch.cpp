@@ -0,0 +1,161 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/time.h>
+#include "prefetch.h"
+
+Prefetch::Prefetch()
+    : m_nFd(-1), m_pfFormat(NULL), m_pData(NULL), m_bCancel(false), m_bDone(false), m_psTree(NULL), m_nRefCount(1)
+{
+    pthread_mutex_init(&m_hLock, NULL);
+    pthread_cond_init(&m_hDone, NULL);
+}
+
+Prefetch::~Prefetch()
+{
+    delete m_psTree;
+    if (m_nFd >= 0)
+        close(m_nFd);
+    pthread_cond_destroy(&m_hDone);
+    pthread_mutex_destroy(&m_hLock);
+}
+
+Prefetch *Prefetch::Start(const char *pzPath, prefetch_format pfFormat, void *pData)
+{
+    pthread_t hThread;
+    Prefetch *psPrefetch = new Prefetch;
+
+    psPrefetch->m_cPath = pzPath;
+    psPrefetch->m_pfFormat = pfFormat;
+    psPrefetch->m_pData = pData;
+    psPrefetch->m_nFd = open(pzPath, O_RDONLY);
+    if (psPrefetch->m_nFd < 0 || fstat(psPrefetch->m_nFd, &psPrefetch->m_sStat) < 0 || !S_ISREG(psPrefetch->m_sStat.st_mode))
+    {
+        delete psPrefetch;
+        return NULL;
+    }
+
+    // asking for the data before the thread is even scheduled
+    off_t nSize = psPrefetch->m_sStat.st_size;
+    posix_fadvise(psPrefetch->m_nFd, 0, nSize < PREFETCH_HEAD ? nSize : PREFETCH_HEAD, POSIX_FADV_WILLNEED);
+    if (nSize > PREFETCH_HEAD)
+        posix_fadvise(psPrefetch->m_nFd, nSize - PREFETCH_TAIL, PREFETCH_TAIL, POSIX_FADV_WILLNEED);
+
+    psPrefetch->AddRef(); // worker's reference
+    if (pthread_create(&hThread, NULL, Worker, psPrefetch) != 0)
+    {
+        psPrefetch->m_bDone = true;
+        psPrefetch->Release();
+        return psPrefetch;
+    }
+    pthread_detach(hThread);
+    return psPrefetch;
+}
+
+void *Prefetch::Worker(void *pData)
+{
+    Prefetch *psPrefetch = (Prefetch *)pData;
+    PathTrie *psTree = NULL;
+    std::string cFormat, cError;
+    archive_entry sEntry;
+    int nResult = -1;
+
+    if (psPrefetch->m_pfFormat(psPrefetch->m_pData, psPrefetch->m_cPath.c_str(), &cFormat) && !psPrefetch->m_bCancel)
+    {
+        ArchiveReader *pcReader = OpenArchive(cFormat.c_str(), psPrefetch->m_cPath.c_str(), &cError);
+        if (pcReader)
+        {
+            psTree = new PathTrie;
+            while (!psPrefetch->m_bCancel && (nResult = pcReader->NextEntry(&sEntry)) == 1)
+                psTree->Add(sEntry);
+            delete pcReader;
+        }
+    }
+
+    // only a complete listing is kept (errors are reported by the real one)
+    pthread_mutex_lock(&psPrefetch->m_hLock);
+    if (nResult == 0 && !psPrefetch->m_bCancel)
+    {
+        psPrefetch->m_cFormat = cFormat;
+        psPrefetch->m_psTree = psTree;
+        psTree = NULL;
+    }
+    psPrefetch->m_bDone = true;
+    pthread_cond_broadcast(&psPrefetch->m_hDone);
+    pthread_mutex_unlock(&psPrefetch->m_hLock);
+
+    delete psTree;
+    psPrefetch->Release();
+    return NULL;
+}
+
+bool Prefetch::Wait(int nMilliseconds)
+{
+    struct timeval sNow;
+    struct timespec sUntil;
+
+    gettimeofday(&sNow, NULL);
+    uint64_t nUntil = (uint64_t)sNow.tv_sec * 1000000 + sNow.tv_usec + (uint64_t)nMilliseconds * 1000;
+    sUntil.tv_sec = nUntil / 1000000;
+    sUntil.tv_nsec = (nUntil % 1000000) * 1000;
+
+    pthread_mutex_lock(&m_hLock);
+    while (!m_bDone)
+    {
+        if (pthread_cond_timedwait(&m_hDone, &m_hLock, &sUntil) == ETIMEDOUT)
+            break;
+    }
+    bool bDone = m_bDone;
+    pthread_mutex_unlock(&m_hLock);
+    return bDone;
+}
+
+PathTrie *Prefetch::TakeTree(const char *pzPath, const char *pzFormat)
+{
+    struct stat stbuf;
+    PathTrie *psTree = NULL;
+
+    // the file may have been replaced since it was chosen
+    if (m_cPath != pzPath || stat(pzPath, &stbuf) < 0 || stbuf.st_dev != m_sStat.st_dev || stbuf.st_ino != m_sStat.st_ino ||
+        stbuf.st_size != m_sStat.st_size || stbuf.st_mtime != m_sStat.st_mtime)
+        return NULL;
+
+    pthread_mutex_lock(&m_hLock);
+    if (m_psTree && m_cFormat == pzFormat)
+    {
+        psTree = m_psTree;
+        m_psTree = NULL;
+    }
+    pthread_mutex_unlock(&m_hLock);
+    return psTree;
+}
+
+void Prefetch::AddRef()
+{
+    __sync_add_and_fetch(&m_nRefCount, 1);
+}
+
+void Prefetch::Release()
+{
+    if (__sync_sub_and_fetch(&m_nRefCount, 1) == 0)
+        delete this;
+}
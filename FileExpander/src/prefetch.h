@@ -0,0 +1,75 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _NRUSLAN_PREFETCH_H_
+#define _NRUSLAN_PREFETCH_H_
+
+//
+// Prefetch - speculative work on a source as soon as it is chosen: the
+// kernel is asked to read the archive ahead (its head, and its tail where
+// zip keeps the central directory) and a native archive is listed into a
+// folder tree in the background, so "Show contents" takes the result
+// instead of starting over. Reference counted: the worker thread keeps
+// its own reference, so Cancel() and Release() never wait for it.
+//
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <string>
+#include "pathtrie.h"
+
+enum Prefetch_Settings
+{
+    PREFETCH_HEAD = 64 * 1048576, // bytes read ahead from the beginning
+    PREFETCH_TAIL = 1048576 // and from the end
+};
+
+// Format of the file (false if it is not to be listed); called by the worker
+typedef bool (*prefetch_format)(void *pData, const char *pzPath, std::string *pcFormat);
+
+class Prefetch
+{
+    public:
+        static Prefetch *Start(const char *pzPath, prefetch_format pfFormat, void *pData); // NULL if the file can't be opened
+        void Cancel() { m_bCancel = true; }
+        bool Wait(int nMilliseconds); // true when the work is done
+        // taking the listing if it is of the same (unchanged) file and format
+        PathTrie *TakeTree(const char *pzPath, const char *pzFormat);
+        void AddRef();
+        void Release();
+    private:
+        Prefetch();
+        ~Prefetch();
+        static void *Worker(void *pData);
+
+        std::string m_cPath, m_cFormat;
+        int m_nFd;
+        struct stat m_sStat;
+        prefetch_format m_pfFormat;
+        void *m_pData;
+        volatile bool m_bCancel;
+        bool m_bDone;
+        PathTrie *m_psTree;
+        pthread_mutex_t m_hLock;
+        pthread_cond_t m_hDone;
+        volatile int m_nRefCount;
+};
+
+#endif /* _NRUSLAN_PREFETCH_H_ */
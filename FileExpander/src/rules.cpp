@@ -0,0 +1,378 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sched.h>
+#include <string.h>
+#include <ctype.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+#include "rules.h"
+#include "plugin.h"
+
+// Published rules and count of threads which are taking them now
+static RuleTable *volatile current_rules = NULL;
+static volatile int rules_readers = 0;
+
+// Optional named fields (key:"value") which follow positional ones
+static const char *named_fields[RULE_SLOTS - RULE_COUNT] = { "format", "size", "plugin" };
+
+// Hash function
+static unsigned int hash(const char *p)
+{
+    unsigned int h = 0;
+    const unsigned char *ptr = (const unsigned char *)p;
+    while (*ptr)
+        h = HASH_MULTIPLIER * h + *ptr++;
+    return h % HASH_SIZE;
+}
+
+// RuleTable constructor
+RuleTable::RuleTable()
+  : m_nBufCount(0), m_nRefCount(1)
+{
+    memset(m_apsHash, 0, sizeof(m_apsHash));
+    memset(m_asStamp, 0, sizeof(m_asStamp));
+
+    // root of the name matcher (patterns without literal tail)
+    match_node sRoot = { 0, -1, -1, -1 };
+    m_asNode.push_back(sRoot);
+}
+
+// RuleTable destructor
+RuleTable::~RuleTable()
+{
+    struct hash_struct *elem, *tmpelem;
+
+    // every rule has exactly one mime type entry
+    for (int i = 0; i < HASH_SIZE; i++)
+    {
+        for (elem = m_apsHash[i]; elem; elem = tmpelem)
+        {
+            delete [] elem->rule;
+            tmpelem = elem->next;
+            delete elem;
+        }
+    }
+
+    while (m_nBufCount)
+        delete [] m_apzBuf[--m_nBufCount];
+}
+
+// Load - reading rules files (NULL if the system rules file is absent)
+RuleTable *RuleTable::Load(const char *pzSystemPath, const char *pzUserPath)
+{
+    RuleTable *psRules = new RuleTable;
+
+    if (!psRules->Parse(pzSystemPath))
+    {
+        delete psRules;
+        return NULL;
+    }
+
+    // per-user overlay is optional
+    GetStamp(pzUserPath, &psRules->m_asStamp[1]);
+    if (pzUserPath)
+        psRules->Parse(pzUserPath);
+    return psRules;
+}
+
+// GetStamp - getting file identity (zero if the file is absent)
+void RuleTable::GetStamp(const char *pzPath, rules_stamp *psStamp)
+{
+    struct stat stbuf;
+
+    memset(psStamp, 0, sizeof(*psStamp));
+    if (pzPath && stat(pzPath, &stbuf) == 0)
+    {
+        psStamp->dev = stbuf.st_dev;
+        psStamp->ino = stbuf.st_ino;
+        psStamp->size = stbuf.st_size;
+        psStamp->mtime = stbuf.st_mtime;
+    }
+}
+
+// IsStale - whether rules files were changed since the table was built
+bool RuleTable::IsStale(const char *pzSystemPath, const char *pzUserPath) const
+{
+    rules_stamp sStamp;
+
+    GetStamp(pzSystemPath, &sStamp);
+    if (memcmp(&sStamp, &m_asStamp[0], sizeof(sStamp)))
+        return true;
+    GetStamp(pzUserPath, &sStamp);
+    return memcmp(&sStamp, &m_asStamp[1], sizeof(sStamp)) != 0;
+}
+
+// Parse - reading rules file and adding its rules to hash-tables
+bool RuleTable::Parse(const char *pzPath)
+{
+    struct stat stbuf;
+    unsigned int j;
+    char *FileBuf, *tmpFileBuf, *maxFileBuf, **rule;
+    struct hash_struct *elem, **hash_ptr;
+
+    int fd = open(pzPath, O_RDONLY);
+    if (fd < 0 || fstat(fd, &stbuf) < 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+
+    // creating and reading file buffer
+    FileBuf = new char[stbuf.st_size + 1];
+    ssize_t nSize = read(fd, FileBuf, stbuf.st_size);
+    close(fd);
+    if (nSize < 0)
+        nSize = 0;
+    m_apzBuf[m_nBufCount] = FileBuf;
+    if (m_nBufCount == 0)
+    {
+        m_asStamp[0].dev = stbuf.st_dev;
+        m_asStamp[0].ino = stbuf.st_ino;
+        m_asStamp[0].size = stbuf.st_size;
+        m_asStamp[0].mtime = stbuf.st_mtime;
+    }
+    m_nBufCount++;
+    maxFileBuf = FileBuf + nSize;
+    *maxFileBuf = '\n';
+
+    // every rule line has 4 quoted fields; incomplete lines are ignored
+    char *apzField[RULE_FIELDS];
+    tmpFileBuf = FileBuf;
+    while (tmpFileBuf < maxFileBuf)
+    {
+        while (*tmpFileBuf == ' ' || *tmpFileBuf == '\t') tmpFileBuf++;
+        if (*tmpFileBuf == '\"')
+        {
+            for (j = 0; j < RULE_FIELDS; j++)
+            {
+                while (*tmpFileBuf != '\"' && *tmpFileBuf != '\n') tmpFileBuf++;
+                if (*tmpFileBuf++ != '\"')
+                    break;
+                apzField[j] = tmpFileBuf;
+                while (*tmpFileBuf != '\"' && *tmpFileBuf != '\n') tmpFileBuf++;
+                if (*tmpFileBuf != '\"')
+                    break;
+                *tmpFileBuf++ = '\0';
+            }
+
+            if (j == RULE_FIELDS)
+            {
+                rule = new char*[RULE_SLOTS];
+                for (j = 0; j < RULE_COUNT; j++)
+                    rule[j] = apzField[j];
+                for (; j < RULE_SLOTS; j++)
+                    rule[j] = NULL;
+                ParseNamed(&tmpFileBuf, rule);
+                if (rule[RULE_PLUGIN])
+                    RegisterPlugin(rule[RULE_FORMAT], rule[RULE_PLUGIN]);
+
+                // mime type
+                elem = new hash_struct;
+                elem->name = apzField[RULE_COUNT];
+                elem->rule = rule;
+                hash_ptr = m_apsHash + hash(elem->name);
+                elem->next = *hash_ptr;
+                *hash_ptr = elem;
+
+                // file name patterns are separated by spaces
+                char *pzPattern = apzField[RULE_COUNT + 1], *pzEnd;
+                while (*pzPattern)
+                {
+                    for (pzEnd = pzPattern; *pzEnd && !isspace((unsigned char)*pzEnd); pzEnd++);
+                    if (pzEnd != pzPattern)
+                    {
+                        char nTmpSymbol = *pzEnd;
+                        *pzEnd = '\0';
+                        AddPattern(pzPattern, rule);
+                        if (!nTmpSymbol)
+                            break;
+                    }
+                    pzPattern = pzEnd + 1;
+                }
+            }
+            else
+                tmpFileBuf--; // stopped at new line
+        }
+        while (*tmpFileBuf++ != '\n');
+    }
+    return true;
+}
+
+// ParseNamed - reading optional key:"value" fields up to the end of line
+void RuleTable::ParseNamed(char **ppzBuf, char **rule)
+{
+    char *p = *ppzBuf, *pzKey;
+    unsigned int i;
+
+    while (true)
+    {
+        while (*p == ' ' || *p == '\t') p++;
+        for (pzKey = p; isalnum((unsigned char)*p) || *p == '_'; p++);
+        if (p == pzKey || p[0] != ':' || p[1] != '\"')
+            break;
+        *p = '\0';
+        char *pzValue = p + 2;
+        for (p = pzValue; *p != '\"' && *p != '\n'; p++);
+        if (*p != '\"')
+            break;
+        *p++ = '\0';
+
+        for (i = 0; i < RULE_SLOTS - RULE_COUNT; i++)
+        {
+            if (!strcmp(pzKey, named_fields[i]))
+                rule[RULE_COUNT + i] = pzValue;
+        }
+    }
+    *ppzBuf = p;
+}
+
+// AddPattern - adding file name pattern to the matcher
+void RuleTable::AddPattern(char *pzPattern, char **rule)
+{
+    match_pattern sPattern;
+    const char *pzTail = pzPattern, *pzChar;
+    int nNode = 0;
+
+    sPattern.glob = NULL;
+    sPattern.rule = rule;
+    sPattern.length = 0;
+    sPattern.order = m_asPattern.size();
+
+    // glob pattern is attached to the node of its literal tail
+    for (pzChar = pzPattern; *pzChar; pzChar++)
+    {
+        if (*pzChar == '*' || *pzChar == '?' || *pzChar == '[' || *pzChar == ']')
+        {
+            sPattern.glob = pzPattern;
+            pzTail = pzChar + 1;
+        }
+        if (*pzChar != '*' && *pzChar != '?')
+            sPattern.length++;
+    }
+
+    // inserting reversed tail
+    for (pzChar = pzTail + strlen(pzTail); pzChar != pzTail;)
+    {
+        unsigned char ch = *--pzChar;
+        int nChild = m_asNode[nNode].child;
+        while (nChild >= 0 && m_asNode[nChild].ch != ch)
+            nChild = m_asNode[nChild].sibling;
+        if (nChild < 0)
+        {
+            match_node sNode = { ch, -1, m_asNode[nNode].child, -1 };
+            nChild = m_asNode.size();
+            m_asNode.push_back(sNode);
+            m_asNode[nNode].child = nChild;
+        }
+        nNode = nChild;
+    }
+
+    sPattern.next = m_asNode[nNode].pattern;
+    m_asNode[nNode].pattern = m_asPattern.size();
+    m_asPattern.push_back(sPattern);
+}
+
+// MatchName - finding the most specific rule for a file name in one pass
+char **RuleTable::MatchName(const char *pzName) const
+{
+    const match_pattern *psBest = NULL;
+    const char *pzChar = pzName + strlen(pzName);
+    int nNode = 0;
+
+    while (true)
+    {
+        for (int i = m_asNode[nNode].pattern; i >= 0; i = m_asPattern[i].next)
+        {
+            const match_pattern *psPattern = &m_asPattern[i];
+
+            // priority: longer literal part, then plain suffix, then later rule
+            if (psBest && (psPattern->length < psBest->length || (psPattern->length == psBest->length &&
+               ((psPattern->glob && !psBest->glob) || (!psPattern->glob == !psBest->glob && psPattern->order < psBest->order)))))
+                continue;
+            if (psPattern->glob && fnmatch(psPattern->glob, pzName, 0))
+                continue;
+            psBest = psPattern;
+        }
+
+        if (pzChar == pzName)
+            break;
+        unsigned char ch = *--pzChar;
+        for (nNode = m_asNode[nNode].child; nNode >= 0 && m_asNode[nNode].ch != ch; nNode = m_asNode[nNode].sibling);
+        if (nNode < 0)
+            break;
+    }
+    return psBest ? psBest->rule : NULL;
+}
+
+// GetRule - looking for a rule by mime type or file name
+char **RuleTable::GetRule(unsigned int i, const char *pzText) const
+{
+    if (i == LOOKUP_NAME)
+        return MatchName(pzText);
+
+    struct hash_struct *elem = m_apsHash[hash(pzText)];
+    while (elem)
+    {
+        if (!strcmp(elem->name, pzText))
+            return elem->rule;
+        elem = elem->next;
+    }
+    return NULL;
+}
+
+// AddRef - taking a reference
+void RuleTable::AddRef()
+{
+    __sync_add_and_fetch(&m_nRefCount, 1);
+}
+
+// Release - dropping a reference (the last one removes tables)
+void RuleTable::Release()
+{
+    if (__sync_sub_and_fetch(&m_nRefCount, 1) == 0)
+        delete this;
+}
+
+// AcquireRules - taking a reference to the current rules (never blocks)
+RuleTable *AcquireRules()
+{
+    __sync_add_and_fetch(&rules_readers, 1);
+    RuleTable *psRules = current_rules;
+    if (psRules)
+        psRules->AddRef();
+    __sync_sub_and_fetch(&rules_readers, 1);
+    return psRules;
+}
+
+// PublishRules - replacing the current rules (takes caller's reference)
+void PublishRules(RuleTable *psRules)
+{
+    RuleTable *psOldRules = __sync_lock_test_and_set(&current_rules, psRules);
+
+    // old rules are released when nobody can be taking them anymore
+    __sync_synchronize();
+    while (rules_readers)
+        sched_yield();
+    if (psOldRules)
+        psOldRules->Release();
+}
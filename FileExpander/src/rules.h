@@ -0,0 +1,119 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _NRUSLAN_RULES_H_
+#define _NRUSLAN_RULES_H_
+
+#include <sys/types.h>
+#include <vector>
+
+#define EXPANDER_RULES "/etc/FileExpander.rules"
+#define EXPANDER_USER_RULES "config/FileExpander.rules" // relative to $HOME
+
+enum Rules_Settings
+{
+    RULE_COUNT = 2, // list and extract commands
+    RULE_FIELDS = RULE_COUNT + 2, // + mime type and file name patterns
+    RULE_FORMAT = RULE_COUNT, // optional named fields (NULL if absent)
+    RULE_SIZE,
+    RULE_PLUGIN,
+    RULE_SLOTS,
+    HASH_SIZE = 256,
+    HASH_MULTIPLIER = 31
+};
+
+// Rule lookup
+enum Rules_Lookup
+{
+    LOOKUP_MIME, // by mime type
+    LOOKUP_NAME  // by file name (extensions and glob patterns)
+};
+
+// Hash struct
+struct hash_struct
+{
+   char *name;
+   char **rule;
+   hash_struct *next;
+};
+
+// Name matcher node (names are matched from the last character)
+struct match_node
+{
+    unsigned char ch;
+    int child, sibling; // first child and next sibling (-1 if none)
+    int pattern; // first pattern which ends at this node (-1 if none)
+};
+
+// Name pattern (a plain suffix or a glob whose literal tail leads to its node)
+struct match_pattern
+{
+    const char *glob; // NULL for plain suffixes
+    char **rule;
+    int length; // count of literal characters (more is more specific)
+    int order; // later rules win among equally specific ones
+    int next; // next pattern of the same node
+};
+
+// Rules file identity (to find out whether the file was changed)
+struct rules_stamp
+{
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    time_t mtime;
+};
+
+//
+// RuleTable - immutable lookup tables built from the system rules file
+// and an optional per-user overlay (user rules take precedence).
+// Tables are reference counted; the current one is published with
+// PublishRules() and taken with AcquireRules() which never blocks.
+//
+class RuleTable
+{
+    public:
+        static RuleTable *Load(const char *pzSystemPath, const char *pzUserPath);
+        static void GetStamp(const char *pzPath, rules_stamp *psStamp);
+        bool IsStale(const char *pzSystemPath, const char *pzUserPath) const;
+        char **GetRule(unsigned int i, const char *pzText) const;
+        char **MatchName(const char *pzName) const;
+        void AddRef();
+        void Release();
+    private:
+        RuleTable();
+        ~RuleTable();
+        bool Parse(const char *pzPath);
+        void ParseNamed(char **ppzBuf, char **rule);
+        void AddPattern(char *pzPattern, char **rule);
+
+        hash_struct *m_apsHash[HASH_SIZE];
+        std::vector<match_node> m_asNode;
+        std::vector<match_pattern> m_asPattern;
+        char *m_apzBuf[2];
+        int m_nBufCount;
+        rules_stamp m_asStamp[2];
+        volatile int m_nRefCount;
+};
+
+// Current rules
+RuleTable *AcquireRules();
+void PublishRules(RuleTable *psRules);
+
+#endif /* _NRUSLAN_RULES_H_ */
@@ -0,0 +1,552 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <dirent.h>
+#include <unistd.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include "search.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// Member being scanned
+struct SearchJob::scan_state
+{
+    SearchJob *job;
+    const char *archive;
+    const archive_entry *entry;
+    uint64_t base; // member offset of the buffer start
+    uint64_t reported; // member offset after the last line hit (pieces of long lines overlap)
+    unsigned int hits; // hits in the member
+    bool archive_hit;
+};
+
+static void lower_case(char *pData, size_t nSize)
+{
+    for (size_t i = 0; i < nSize; i++)
+        pData[i] = tolower((unsigned char)pData[i]);
+}
+
+//
+// Matcher
+//
+Matcher::Matcher()
+  : m_nFlags(0), m_bRegex(false)
+{
+}
+
+Matcher::~Matcher()
+{
+    if (m_bRegex)
+        regfree(&m_sRegex);
+}
+
+// required_literal - the longest run of plain characters which every match
+// of the (extended) regular expression contains; empty if unknown
+static std::string required_literal(const char *pzPattern)
+{
+    std::string cBest, cRun;
+    int nDepth = 0;
+
+    // alternatives may not contain anything in common
+    for (const char *pz = pzPattern; *pz; pz++)
+    {
+        if (*pz == '\\' && pz[1])
+            pz++;
+        else if (*pz == '|')
+            return "";
+    }
+
+    for (const char *pz = pzPattern; *pz; pz++)
+    {
+        char c = *pz;
+        bool bLiteral = false;
+
+        switch (c)
+        {
+            case '\\':
+                // escaped punctuation is literal, \w, \b and the like are not
+                if (pz[1] && !isalnum((unsigned char)pz[1]))
+                {
+                    c = *++pz;
+                    bLiteral = true;
+                }
+                else if (pz[1])
+                    pz++;
+                break;
+            case '[':
+                // skipping bracket expression ("[]...]" and "[^]...]" included)
+                pz++;
+                if (*pz == '^')
+                    pz++;
+                if (*pz == ']')
+                    pz++;
+                while (*pz && *pz != ']')
+                    pz++;
+                if (!*pz)
+                    return "";
+                break;
+            case '(':
+                nDepth++;
+                break;
+            case ')':
+                nDepth--;
+                break;
+            case '*': case '?': case '{':
+                // the previous character is optional
+                if (!cRun.empty())
+                    cRun.erase(cRun.size() - 1);
+                if (c == '{')
+                    while (*pz && *pz != '}')
+                        pz++;
+                if (!*pz)
+                    pz--;
+                break;
+            case '+': case '.': case '^': case '$':
+                break;
+            default:
+                bLiteral = true;
+                break;
+        }
+
+        // text in groups may be optional as a whole
+        if (bLiteral && !nDepth)
+            cRun += c;
+        else
+        {
+            if (cRun.size() > cBest.size())
+                cBest = cRun;
+            cRun.clear();
+        }
+    }
+    return cRun.size() > cBest.size() ? cRun : cBest;
+}
+
+bool Matcher::Compile(const char *pzPattern, int nFlags, std::string *pcError)
+{
+    if (m_bRegex)
+        regfree(&m_sRegex);
+    m_bRegex = false;
+    m_nFlags = nFlags;
+
+    if (!*pzPattern)
+    {
+        *pcError = "Empty pattern";
+        return false;
+    }
+
+    // expressions without special characters are searched as literals
+    if ((nFlags & SEARCH_REGEX) && strpbrk(pzPattern, "\\[](){}.*+?^$|"))
+    {
+        int nResult = regcomp(&m_sRegex, pzPattern, REG_EXTENDED | ((nFlags & SEARCH_ICASE) ? REG_ICASE : 0));
+        if (nResult)
+        {
+            char zError[256];
+            regerror(nResult, &m_sRegex, zError, sizeof(zError));
+            *pcError = zError;
+            return false;
+        }
+        m_bRegex = true;
+        m_cLiteral = required_literal(pzPattern);
+    }
+    else
+        m_cLiteral = pzPattern;
+
+    if (nFlags & SEARCH_ICASE)
+        lower_case(&m_cLiteral[0], m_cLiteral.size());
+    return true;
+}
+
+const char *Matcher::FindLiteral(const char *pData, size_t nSize) const
+{
+    const char *pzLiteral = m_cLiteral.data();
+    size_t nLength = m_cLiteral.size();
+
+    if (!nLength)
+        return pData;
+    if (nSize < nLength)
+        return NULL;
+    if (nLength == 1)
+        return (const char *)memchr(pData, *pzLiteral, nSize);
+
+    size_t i = 0;
+#ifdef __SSE2__
+    // candidates have both the first and the last byte in place
+    const __m128i sFirst = _mm_set1_epi8(pzLiteral[0]);
+    const __m128i sLast = _mm_set1_epi8(pzLiteral[nLength - 1]);
+
+    for (; i + nLength - 1 + 16 <= nSize; i += 16)
+    {
+        __m128i sHead = _mm_loadu_si128((const __m128i *)(pData + i));
+        __m128i sTail = _mm_loadu_si128((const __m128i *)(pData + i + nLength - 1));
+        unsigned int nMask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(sHead, sFirst), _mm_cmpeq_epi8(sTail, sLast)));
+        while (nMask)
+        {
+            unsigned int nBit = __builtin_ctz(nMask);
+            if (!memcmp(pData + i + nBit + 1, pzLiteral + 1, nLength - 2))
+                return pData + i + nBit;
+            nMask &= nMask - 1;
+        }
+    }
+#endif
+    for (; i + nLength <= nSize; i++)
+    {
+        if (pData[i] == pzLiteral[0] && !memcmp(pData + i + 1, pzLiteral + 1, nLength - 1))
+            return pData + i;
+    }
+    return NULL;
+}
+
+bool Matcher::MatchLine(const char *pLine, size_t nSize, size_t *pnOffset) const
+{
+    regmatch_t sMatch;
+
+#ifdef REG_STARTEND
+    sMatch.rm_so = 0;
+    sMatch.rm_eo = nSize;
+    if (regexec(&m_sRegex, pLine, 1, &sMatch, REG_STARTEND))
+        return false;
+#else
+    std::string cLine(pLine, nSize);
+    if (regexec(&m_sRegex, cLine.c_str(), 1, &sMatch, 0))
+        return false;
+#endif
+    *pnOffset = sMatch.rm_so;
+    return true;
+}
+
+bool Matcher::MatchName(const std::string &cName) const
+{
+    std::string cText = cName;
+    size_t nOffset;
+
+    if (m_nFlags & SEARCH_ICASE)
+        lower_case(&cText[0], cText.size());
+    if (!FindLiteral(cText.data(), cText.size()))
+        return false;
+    return !m_bRegex || MatchLine(cText.data(), cText.size(), &nOffset);
+}
+
+void Matcher::MatchLines(const char *pData, size_t nSize, bool (*pfHit)(void *pData, size_t nOffset), void *pHitData) const
+{
+    const char *pEnd = pData + nSize, *pLine = pData, *pFound;
+    size_t nOffset;
+
+    // only lines with the required literal are given to regexec
+    while (pLine < pEnd && (pFound = FindLiteral(pLine, pEnd - pLine)))
+    {
+        const char *pStart = (const char *)memrchr(pLine, '\n', pFound - pLine);
+        pStart = pStart ? pStart + 1 : pLine;
+        const char *pStop = (const char *)memchr(pFound, '\n', pEnd - pFound);
+        if (!pStop)
+            pStop = pEnd;
+
+        if (MatchLine(pStart, pStop - pStart, &nOffset) && !pfHit(pHitData, pStart - pData + nOffset))
+            return;
+        pLine = pStop + 1;
+    }
+}
+
+//
+// SearchJob
+//
+SearchJob::SearchJob(const Matcher *pcMatcher, search_report pfReport, extract_log pfLog, void *pData)
+  : m_pcMatcher(pcMatcher), m_pfReport(pfReport), m_pfLog(pfLog), m_pData(pData), m_bCancel(false),
+    m_nHits(0), m_nArchives(0), m_nErrors(0), m_pasTarget(NULL), m_nNext(0)
+{
+    pthread_mutex_init(&m_hLock, NULL);
+}
+
+SearchJob::~SearchJob()
+{
+    pthread_mutex_destroy(&m_hLock);
+}
+
+void SearchJob::Error(const std::string &cText)
+{
+    pthread_mutex_lock(&m_hLock);
+    m_nErrors++;
+    if (m_pfLog)
+        m_pfLog(m_pData, (cText + "\n").c_str());
+    pthread_mutex_unlock(&m_hLock);
+}
+
+// Report - false if the rest of the member is not needed
+bool SearchJob::Report(scan_state *psState, uint64_t nOffset, bool bName)
+{
+    pthread_mutex_lock(&m_hLock);
+    m_nHits++;
+    if (!psState->archive_hit)
+    {
+        psState->archive_hit = true;
+        m_nArchives++;
+    }
+    if (psState->hits++ < SEARCH_MEMBER_HITS)
+    {
+        search_hit sHit = { psState->archive, psState->entry->name.c_str(), nOffset, bName };
+        m_pfReport(m_pData, sHit);
+    }
+    pthread_mutex_unlock(&m_hLock);
+    return !(m_pcMatcher->GetFlags() & SEARCH_NAMES_ONLY) && !m_bCancel;
+}
+
+bool SearchJob::LineHit(void *pData, size_t nOffset)
+{
+    scan_state *psState = (scan_state *)pData;
+    if (psState->base + nOffset < psState->reported)
+        return true;
+    psState->reported = psState->base + nOffset + 1;
+    return psState->job->Report(psState, psState->base + nOffset, false);
+}
+
+// ScanMember - false on read error
+bool SearchJob::ScanMember(ArchiveReader *pcReader, scan_state *psState, char *pBuffer)
+{
+    const bool bRegex = m_pcMatcher->IsRegex(), bLower = m_pcMatcher->GetFlags() & SEARCH_ICASE;
+    size_t nKeep = 0, nLiteral = m_pcMatcher->GetLiteralSize();
+    bool bEnd = false;
+
+    psState->base = psState->reported = 0;
+    while (!bEnd && !m_bCancel)
+    {
+        ssize_t nRead = pcReader->ReadData(pBuffer + nKeep, ARCHIVE_BUFSIZE);
+        if (nRead < 0)
+            return false;
+        bEnd = nRead == 0;
+        if (bLower)
+            lower_case(pBuffer + nKeep, nRead);
+        size_t nTotal = nKeep + nRead, nDone;
+
+        if (bRegex)
+        {
+            // complete lines only (the rest waits for the next block); a
+            // too long line is searched in pieces which overlap by half, so
+            // matches across a cut are found too
+            const char *pLast = (const char *)memrchr(pBuffer, '\n', nTotal);
+            bool bPiece = !bEnd && !pLast && nTotal >= SEARCH_MAX_LINE;
+            if (bEnd || bPiece)
+                nDone = nTotal;
+            else
+                nDone = pLast ? pLast - pBuffer + 1 : 0;
+
+            size_t nHits = psState->hits;
+            m_pcMatcher->MatchLines(pBuffer, nDone, LineHit, psState);
+            if (psState->hits > nHits && (m_pcMatcher->GetFlags() & SEARCH_NAMES_ONLY))
+                return true;
+
+            // the next piece starts after the hit of this one (only the first
+            // match of a piece is seen)
+            if (bPiece)
+            {
+                nDone = nTotal - SEARCH_MAX_LINE / 2;
+                if (psState->reported > psState->base + nDone)
+                    nDone = psState->reported - psState->base;
+            }
+        }
+        else
+        {
+            // the tail shorter than the literal is kept for the next block
+            const char *pFrom = pBuffer, *pFound;
+            while ((pFound = m_pcMatcher->FindLiteral(pFrom, pBuffer + nTotal - pFrom)))
+            {
+                if (!Report(psState, psState->base + (pFound - pBuffer), false))
+                    return true;
+                pFrom = pFound + 1;
+            }
+            nDone = nTotal > nLiteral - 1 ? nTotal - (nLiteral - 1) : 0;
+        }
+
+        nKeep = nTotal - nDone;
+        memmove(pBuffer, pBuffer + nDone, nKeep);
+        psState->base += nDone;
+    }
+    return true;
+}
+
+void SearchJob::SearchArchive(const search_target &sTarget, char *pBuffer)
+{
+    std::string cError;
+    ArchiveReader *pcReader = OpenArchive(sTarget.format.c_str(), sTarget.path.c_str(), &cError);
+    if (!pcReader)
+    {
+        Error(sTarget.path + ": " + cError);
+        return;
+    }
+
+    scan_state sState;
+    archive_entry sEntry;
+    unsigned int nEncrypted = 0;
+    int nResult = 0;
+
+    sState.job = this;
+    sState.archive = sTarget.path.c_str();
+    sState.archive_hit = false;
+    while (!m_bCancel && (nResult = pcReader->NextEntry(&sEntry)) > 0)
+    {
+        sState.entry = &sEntry;
+        sState.hits = 0;
+        if (m_pcMatcher->MatchName(sEntry.name) && !Report(&sState, 0, true))
+            continue;
+        if (sEntry.type != ENTRY_FILE)
+            continue;
+        if (sEntry.encrypted)
+        {
+            nEncrypted++;
+            continue;
+        }
+        if (!ScanMember(pcReader, &sState, pBuffer))
+        {
+            nResult = -1;
+            break;
+        }
+        if (sState.hits > SEARCH_MEMBER_HITS && m_pfLog)
+        {
+            char zMore[64];
+            sprintf(zMore, ": %u more hits\n", sState.hits - SEARCH_MEMBER_HITS);
+            pthread_mutex_lock(&m_hLock);
+            m_pfLog(m_pData, (sTarget.path + ": " + sEntry.name + zMore).c_str());
+            pthread_mutex_unlock(&m_hLock);
+        }
+    }
+    if (nResult < 0)
+        Error(sTarget.path + ": " + pcReader->GetError());
+    if (nEncrypted && m_pfLog)
+    {
+        char zCount[32];
+        sprintf(zCount, "%u", nEncrypted);
+        pthread_mutex_lock(&m_hLock);
+        m_pfLog(m_pData, (sTarget.path + ": " + zCount + " encrypted members searched by name only\n").c_str());
+        pthread_mutex_unlock(&m_hLock);
+    }
+    delete pcReader;
+}
+
+void *SearchJob::Worker(void *pData)
+{
+    ((SearchJob *)pData)->Work();
+    return NULL;
+}
+
+void SearchJob::Work()
+{
+    // carried line (regular expressions) + the new block
+    char *pBuffer = new char[SEARCH_MAX_LINE + ARCHIVE_BUFSIZE];
+
+    while (!m_bCancel)
+    {
+        pthread_mutex_lock(&m_hLock);
+        unsigned int nIndex = m_nNext++;
+        pthread_mutex_unlock(&m_hLock);
+        if (nIndex >= m_pasTarget->size())
+            break;
+        SearchArchive((*m_pasTarget)[nIndex], pBuffer);
+    }
+    delete [] pBuffer;
+}
+
+bool SearchJob::Run(const std::vector<search_target> &asTarget, int nWorkers)
+{
+    std::vector<pthread_t> ahThread;
+
+    m_pasTarget = &asTarget;
+    m_nNext = 0;
+    if (nWorkers < 0)
+        nWorkers = sysconf(_SC_NPROCESSORS_ONLN);
+    if (nWorkers > (int)asTarget.size())
+        nWorkers = asTarget.size();
+
+    // the calling thread is one of the workers
+    for (int i = 1; i < nWorkers; i++)
+    {
+        pthread_t hThread;
+        if (pthread_create(&hThread, NULL, Worker, this) == 0)
+            ahThread.push_back(hThread);
+    }
+    Work();
+    for (unsigned int i = 0; i < ahThread.size(); i++)
+        pthread_join(ahThread[i], NULL);
+    return !m_nErrors && !m_bCancel;
+}
+
+// Larger archives are searched first, so workers finish at about the same time
+struct sized_target
+{
+    off_t size;
+    search_target target;
+    bool operator<(const sized_target &sOther) const { return size > sOther.size; }
+};
+
+static void find_archives(const std::string &cDir, search_format pfFormat, void *pData, std::vector<sized_target> *pasFound)
+{
+    DIR *hDir = opendir(cDir.c_str());
+    struct dirent *psEntry;
+
+    if (!hDir)
+        return;
+    while ((psEntry = readdir(hDir)))
+    {
+        if (!strcmp(psEntry->d_name, ".") || !strcmp(psEntry->d_name, ".."))
+            continue;
+
+        std::string cPath = cDir + "/" + psEntry->d_name;
+        struct stat sStat;
+        if (lstat(cPath.c_str(), &sStat) < 0)
+            continue;
+        if (S_ISDIR(sStat.st_mode))
+            find_archives(cPath, pfFormat, pData, pasFound);
+        else if (S_ISREG(sStat.st_mode))
+        {
+            const char *pzFormat = pfFormat(pData, cPath.c_str());
+            if (pzFormat)
+            {
+                sized_target sFound;
+                sFound.size = sStat.st_size;
+                sFound.target.path = cPath;
+                sFound.target.format = pzFormat;
+                pasFound->push_back(sFound);
+            }
+        }
+    }
+    closedir(hDir);
+}
+
+bool FindArchives(const char *pzDir, search_format pfFormat, void *pData, std::vector<search_target> *pasTarget, std::string *pcError)
+{
+    std::vector<sized_target> asFound;
+    std::string cDir = pzDir;
+    struct stat sStat;
+
+    if (stat(pzDir, &sStat) < 0 || !S_ISDIR(sStat.st_mode))
+    {
+        *pcError = std::string(pzDir) + ": not a folder";
+        return false;
+    }
+    while (cDir.size() > 1 && cDir[cDir.size() - 1] == '/')
+        cDir.erase(cDir.size() - 1);
+
+    find_archives(cDir, pfFormat, pData, &asFound);
+    std::stable_sort(asFound.begin(), asFound.end());
+    for (unsigned int i = 0; i < asFound.size(); i++)
+        pasTarget->push_back(asFound[i].target);
+    return true;
+}
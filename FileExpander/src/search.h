@@ -0,0 +1,140 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _NRUSLAN_SEARCH_H_
+#define _NRUSLAN_SEARCH_H_
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <regex.h>
+#include <pthread.h>
+#include <string>
+#include <vector>
+#include "archive.h"
+#include "extract.h"
+
+// Search options
+enum Search_Flags
+{
+    SEARCH_REGEX = 01, // extended regular expression (matched line by line)
+    SEARCH_ICASE = 02,
+    SEARCH_NAMES_ONLY = 04 // only matching members are wanted (one hit per member)
+};
+
+enum Search_Settings
+{
+    SEARCH_MEMBER_HITS = 100, // hits reported per member
+    SEARCH_MAX_LINE = 65536 // longer lines are split (overlapping by half) for regular expressions
+};
+
+// Archive to be searched
+struct search_target
+{
+    std::string path;
+    std::string format;
+};
+
+// Match found
+struct search_hit
+{
+    const char *archive;
+    const char *member;
+    uint64_t offset; // in the member data
+    bool name; // member name matched (offset is not used)
+};
+
+typedef void (*search_report)(void *pData, const search_hit &sHit);
+
+// Archive format by file name (NULL if it can't be read natively)
+typedef const char *(*search_format)(void *pData, const char *pzPath);
+
+//
+// Matcher - literal or regular expression pattern. Literals are found
+// with SSE2 (first and last byte compared 16 positions at once); regular
+// expressions are only run on lines where their longest required literal
+// was found.
+//
+class Matcher
+{
+    public:
+        Matcher();
+        ~Matcher();
+        bool Compile(const char *pzPattern, int nFlags, std::string *pcError);
+        int GetFlags() const { return m_nFlags; }
+        // first literal occurrence in [pData, pData + nSize), NULL if none
+        const char *FindLiteral(const char *pData, size_t nSize) const;
+        bool MatchName(const std::string &cName) const;
+        // matching complete lines of [pData, pData + nSize); pfHit is called
+        // with offsets in the buffer until it returns false
+        void MatchLines(const char *pData, size_t nSize, bool (*pfHit)(void *pData, size_t nOffset), void *pHitData) const;
+        size_t GetLiteralSize() const { return m_cLiteral.size(); }
+        bool IsRegex() const { return m_bRegex; }
+    private:
+        bool MatchLine(const char *pLine, size_t nSize, size_t *pnOffset) const;
+
+        int m_nFlags;
+        std::string m_cLiteral; // whole pattern, or the regex prefilter (may be empty)
+        bool m_bRegex;
+        regex_t m_sRegex;
+};
+
+//
+// SearchJob - streaming members of archives through the matcher without
+// extracting them. Archives are shared between worker threads (one per
+// processor); hits are reported from the workers under a lock.
+//
+class SearchJob
+{
+    public:
+        SearchJob(const Matcher *pcMatcher, search_report pfReport, extract_log pfLog, void *pData);
+        ~SearchJob();
+        bool Run(const std::vector<search_target> &asTarget, int nWorkers); // nWorkers < 0 - by processors count
+        void Cancel() { m_bCancel = true; }
+        bool IsCancelled() const { return m_bCancel; }
+        unsigned int GetHitCount() const { return m_nHits; }
+        unsigned int GetArchiveCount() const { return m_nArchives; } // archives with hits
+        int GetErrorCount() const { return m_nErrors; }
+    private:
+        struct scan_state;
+
+        static void *Worker(void *pData);
+        void Work();
+        void SearchArchive(const search_target &sTarget, char *pBuffer);
+        bool ScanMember(ArchiveReader *pcReader, scan_state *psState, char *pBuffer);
+        static bool LineHit(void *pData, size_t nOffset);
+        bool Report(scan_state *psState, uint64_t nOffset, bool bName);
+        void Error(const std::string &cText);
+
+        const Matcher *m_pcMatcher;
+        search_report m_pfReport;
+        extract_log m_pfLog;
+        void *m_pData;
+        volatile bool m_bCancel;
+        unsigned int m_nHits;
+        unsigned int m_nArchives;
+        int m_nErrors;
+        const std::vector<search_target> *m_pasTarget;
+        unsigned int m_nNext; // next archive for workers
+        pthread_mutex_t m_hLock;
+};
+
+// Collecting archives of the folder tree (symbolic links are not followed)
+bool FindArchives(const char *pzDir, search_format pfFormat, void *pData, std::vector<search_target> *pasTarget, std::string *pcError);
+
+#endif /* _NRUSLAN_SEARCH_H_ */
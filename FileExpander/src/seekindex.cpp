@@ -0,0 +1,658 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <stdio.h>
+#include <zlib.h>
+#include <bzlib.h>
+#include "seekindex.h"
+
+#define SEEK_MAGIC "FEIX1"
+#define SEEK_NONE (~(uint64_t)0)
+
+// bzip2 block and end of stream signatures (48 bits)
+static const uint64_t BZIP2_BLOCK = 0x314159265359ULL;
+static const uint64_t BZIP2_END = 0x177245385090ULL;
+
+//
+// GzipIndexSource - gzip decoding which records checkpoints (zran style)
+//
+class GzipIndexSource : public ByteSource
+{
+    public:
+        GzipIndexSource(int nFd, std::vector<seek_point> *pasPoint);
+        virtual ~GzipIndexSource();
+        virtual ssize_t Read(void *pBuf, size_t nSize);
+    private:
+        void AddPoint();
+
+        int m_nFd;
+        z_stream m_sStream;
+        std::vector<seek_point> *m_pasPoint;
+        unsigned char m_aInput[ARCHIVE_BUFSIZE], m_aWindow[SEEK_WINDOW];
+        unsigned char *m_pPending; // decoded data not given to the reader yet
+        uint64_t m_nTotalIn, m_nTotalOut, m_nLast;
+        bool m_bEnd;
+};
+
+GzipIndexSource::GzipIndexSource(int nFd, std::vector<seek_point> *pasPoint)
+  : m_nFd(nFd), m_pasPoint(pasPoint), m_pPending(m_aWindow), m_nTotalIn(0), m_nTotalOut(0), m_nLast(0), m_bEnd(false)
+{
+    memset(&m_sStream, 0, sizeof(m_sStream));
+    inflateInit2(&m_sStream, 15 + 16);
+    m_sStream.next_out = m_aWindow;
+    m_sStream.avail_out = SEEK_WINDOW;
+}
+
+GzipIndexSource::~GzipIndexSource()
+{
+    inflateEnd(&m_sStream);
+    close(m_nFd);
+}
+
+// AddPoint - saving decoder state at the deflate block boundary
+void GzipIndexSource::AddPoint()
+{
+    unsigned char aWindow[SEEK_WINDOW];
+    size_t nLeft = m_sStream.avail_out;
+    seek_point sPoint;
+
+    sPoint.out = m_nTotalOut;
+    sPoint.in = m_nTotalIn;
+    sPoint.end = 0;
+    sPoint.bits = m_sStream.data_type & 7;
+    sPoint.level = 0;
+
+    // the window is a ring: the oldest data follows the write position
+    if (nLeft)
+        memcpy(aWindow, m_aWindow + SEEK_WINDOW - nLeft, nLeft);
+    if (nLeft < SEEK_WINDOW)
+        memcpy(aWindow + nLeft, m_aWindow, SEEK_WINDOW - nLeft);
+
+    uLongf nSize = compressBound(SEEK_WINDOW);
+    sPoint.window.resize(nSize);
+    compress2((Bytef *)&sPoint.window[0], &nSize, aWindow, SEEK_WINDOW, Z_BEST_SPEED);
+    sPoint.window.resize(nSize);
+    m_pasPoint->push_back(sPoint);
+}
+
+ssize_t GzipIndexSource::Read(void *pBuf, size_t nSize)
+{
+    while (m_pPending == m_sStream.next_out)
+    {
+        if (m_bEnd)
+            return 0;
+        if (!m_sStream.avail_out)
+        {
+            m_sStream.next_out = m_pPending = m_aWindow;
+            m_sStream.avail_out = SEEK_WINDOW;
+        }
+        if (!m_sStream.avail_in)
+        {
+            ssize_t nRead;
+            while ((nRead = read(m_nFd, m_aInput, sizeof(m_aInput))) < 0 && errno == EINTR);
+            if (nRead <= 0)
+            {
+                m_cError = nRead ? strerror(errno) : "Unexpected end of compressed data";
+                return -1;
+            }
+            m_sStream.next_in = m_aInput;
+            m_sStream.avail_in = nRead;
+        }
+
+        m_nTotalIn += m_sStream.avail_in;
+        m_nTotalOut += m_sStream.avail_out;
+        int nResult = inflate(&m_sStream, Z_BLOCK);
+        m_nTotalIn -= m_sStream.avail_in;
+        m_nTotalOut -= m_sStream.avail_out;
+
+        if (nResult == Z_STREAM_END)
+        {
+            // checkpoints can't cross gzip members (zeros after the last
+            // one are padding)
+            ssize_t nRead = 0;
+            do
+            {
+                for (; m_sStream.avail_in; m_sStream.avail_in--)
+                {
+                    if (*m_sStream.next_in++)
+                    {
+                        m_cError = "Archives of several gzip members are not indexed";
+                        return -1;
+                    }
+                }
+                while ((nRead = read(m_nFd, m_aInput, sizeof(m_aInput))) < 0 && errno == EINTR);
+                m_sStream.next_in = m_aInput;
+                m_sStream.avail_in = nRead > 0 ? nRead : 0;
+            }
+            while (nRead > 0);
+            m_bEnd = true;
+        }
+        else if (nResult != Z_OK && nResult != Z_BUF_ERROR)
+        {
+            m_cError = m_sStream.msg ? m_sStream.msg : "Compressed data is damaged";
+            return -1;
+        }
+        else if ((m_sStream.data_type & 128) && !(m_sStream.data_type & 64) &&
+                 (m_nTotalOut == 0 || m_nTotalOut - m_nLast > SEEK_SPAN))
+        {
+            AddPoint();
+            m_nLast = m_nTotalOut;
+        }
+    }
+
+    size_t nPart = m_sStream.next_out - m_pPending;
+    if (nPart > nSize)
+        nPart = nSize;
+    memcpy(pBuf, m_pPending, nPart);
+    m_pPending += nPart;
+    m_nPosition += nPart;
+    return nPart;
+}
+
+//
+// GzipSeekSource - raw deflate decoding from a checkpoint
+//
+class GzipSeekSource : public ByteSource
+{
+    public:
+        GzipSeekSource(int nFd, const seek_point &sPoint);
+        virtual ~GzipSeekSource();
+        virtual ssize_t Read(void *pBuf, size_t nSize);
+    private:
+        int m_nFd;
+        z_stream m_sStream;
+        unsigned char m_aInput[ARCHIVE_BUFSIZE];
+        bool m_bEnd;
+};
+
+GzipSeekSource::GzipSeekSource(int nFd, const seek_point &sPoint)
+  : m_nFd(nFd), m_bEnd(false)
+{
+    unsigned char aWindow[SEEK_WINDOW];
+    uLongf nSize = SEEK_WINDOW;
+
+    m_nPosition = sPoint.out;
+    memset(&m_sStream, 0, sizeof(m_sStream));
+    inflateInit2(&m_sStream, -15);
+
+    if (uncompress(aWindow, &nSize, (const Bytef *)sPoint.window.data(), sPoint.window.size()) != Z_OK || nSize != SEEK_WINDOW)
+    {
+        m_cError = "Damaged seek index";
+        return;
+    }
+
+    // the checkpoint may start in the middle of a byte
+    if (lseek(m_nFd, sPoint.in - (sPoint.bits ? 1 : 0), SEEK_SET) < 0)
+    {
+        m_cError = strerror(errno);
+        return;
+    }
+    if (sPoint.bits)
+    {
+        unsigned char ch;
+        if (read(m_nFd, &ch, 1) != 1)
+        {
+            m_cError = "Unexpected end of compressed data";
+            return;
+        }
+        inflatePrime(&m_sStream, sPoint.bits, ch >> (8 - sPoint.bits));
+    }
+    inflateSetDictionary(&m_sStream, aWindow, SEEK_WINDOW);
+}
+
+GzipSeekSource::~GzipSeekSource()
+{
+    inflateEnd(&m_sStream);
+    close(m_nFd);
+}
+
+ssize_t GzipSeekSource::Read(void *pBuf, size_t nSize)
+{
+    m_sStream.next_out = (Bytef *)pBuf;
+    m_sStream.avail_out = nSize;
+
+    while (m_sStream.avail_out == nSize && !m_bEnd)
+    {
+        if (!m_sStream.avail_in)
+        {
+            ssize_t nRead;
+            while ((nRead = read(m_nFd, m_aInput, sizeof(m_aInput))) < 0 && errno == EINTR);
+            if (nRead <= 0)
+            {
+                m_cError = nRead ? strerror(errno) : "Unexpected end of compressed data";
+                return -1;
+            }
+            m_sStream.next_in = m_aInput;
+            m_sStream.avail_in = nRead;
+        }
+        int nResult = inflate(&m_sStream, Z_NO_FLUSH);
+        if (nResult == Z_STREAM_END)
+            m_bEnd = true;
+        else if (nResult != Z_OK && nResult != Z_BUF_ERROR)
+        {
+            m_cError = m_sStream.msg ? m_sStream.msg : "Compressed data is damaged";
+            return -1;
+        }
+    }
+
+    size_t nRead = nSize - m_sStream.avail_out;
+    m_nPosition += nRead;
+    return nRead;
+}
+
+//
+// Bzip2BlockSource - decoding bzip2 blocks one by one
+//
+class Bzip2BlockSource : public ByteSource
+{
+    public:
+        Bzip2BlockSource(int nFd, std::vector<seek_point> *pasPoint, bool bRecord);
+        Bzip2BlockSource(int nFd, const std::vector<seek_point> &asPoint, unsigned int nFirst);
+        virtual ~Bzip2BlockSource() { close(m_nFd); }
+        virtual ssize_t Read(void *pBuf, size_t nSize);
+    private:
+        bool DecodeBlock(const seek_point &sPoint);
+
+        int m_nFd;
+        std::vector<seek_point> *m_pasPoint, m_asPoint;
+        unsigned int m_nBlock;
+        bool m_bRecord; // saving decoded offsets of blocks
+        std::vector<char> m_aData;
+        size_t m_nDataPos;
+};
+
+// Decoding all blocks (bRecord - saving their decoded offsets)
+Bzip2BlockSource::Bzip2BlockSource(int nFd, std::vector<seek_point> *pasPoint, bool bRecord)
+  : m_nFd(nFd), m_pasPoint(pasPoint), m_nBlock(0), m_bRecord(bRecord), m_nDataPos(0)
+{
+}
+
+// Decoding from the block nFirst (blocks are copied)
+Bzip2BlockSource::Bzip2BlockSource(int nFd, const std::vector<seek_point> &asPoint, unsigned int nFirst)
+  : m_nFd(nFd), m_asPoint(asPoint.begin() + nFirst, asPoint.end()), m_nBlock(0), m_bRecord(false), m_nDataPos(0)
+{
+    m_pasPoint = &m_asPoint;
+    if (!m_asPoint.empty())
+        m_nPosition = m_asPoint[0].out;
+}
+
+// Appending bits to a byte buffer
+static void put_bits(std::vector<unsigned char> *paBuf, uint64_t *pnBits, uint64_t nValue, int nCount)
+{
+    while (nCount--)
+    {
+        if (!(*pnBits & 7))
+            paBuf->push_back(0);
+        if ((nValue >> nCount) & 1)
+            paBuf->back() |= 0x80 >> (*pnBits & 7);
+        (*pnBits)++;
+    }
+}
+
+// DecodeBlock - decoding one block as a stream of its own
+bool Bzip2BlockSource::DecodeBlock(const seek_point &sPoint)
+{
+    uint64_t nFirst = sPoint.in / 8, nBits = sPoint.end - sPoint.in;
+    int nShift = sPoint.in % 8;
+    std::vector<unsigned char> aRaw((sPoint.end + 7) / 8 - nFirst + 1, 0), aStream;
+
+    ssize_t nRead = pread(m_nFd, &aRaw[0], aRaw.size() - 1, nFirst);
+    if (nRead < (ssize_t)aRaw.size() - 1)
+    {
+        m_cError = nRead < 0 ? strerror(errno) : "Unexpected end of compressed data";
+        return false;
+    }
+
+    // header, block bits moved to a byte boundary, end of stream and CRC
+    // (CRC of a single block stream is CRC of the block)
+    aStream.push_back('B');
+    aStream.push_back('Z');
+    aStream.push_back('h');
+    aStream.push_back(sPoint.level);
+    for (uint64_t i = 0; i < (nBits + 7) / 8; i++)
+        aStream.push_back((aRaw[i] << nShift) | (nShift ? aRaw[i + 1] >> (8 - nShift) : 0));
+    uint64_t nStreamBits = 32 + nBits;
+    aStream.resize((nStreamBits + 7) / 8);
+    if (nStreamBits & 7)
+        aStream.back() &= 0xff00 >> (nStreamBits & 7);
+    uint32_t nCrc = 0;
+    for (int i = 0; i < 4; i++)
+        nCrc = (nCrc << 8) | aStream[4 + 6 + i];
+    put_bits(&aStream, &nStreamBits, BZIP2_END, 48);
+    put_bits(&aStream, &nStreamBits, nCrc, 32);
+
+    bz_stream sStream;
+    memset(&sStream, 0, sizeof(sStream));
+    BZ2_bzDecompressInit(&sStream, 0, 0);
+    sStream.next_in = (char *)&aStream[0];
+    sStream.avail_in = aStream.size();
+
+    m_aData.resize(1 << 20);
+    size_t nOut = 0;
+    int nResult;
+    do
+    {
+        if (nOut == m_aData.size())
+            m_aData.resize(m_aData.size() * 2);
+        sStream.next_out = &m_aData[nOut];
+        sStream.avail_out = m_aData.size() - nOut;
+        nResult = BZ2_bzDecompress(&sStream);
+        nOut = m_aData.size() - sStream.avail_out;
+    }
+    while (nResult == BZ_OK && (sStream.avail_in || !sStream.avail_out));
+    BZ2_bzDecompressEnd(&sStream);
+
+    if (nResult != BZ_STREAM_END)
+    {
+        m_cError = "Compressed data is damaged";
+        return false;
+    }
+    m_aData.resize(nOut);
+    m_nDataPos = 0;
+    return true;
+}
+
+ssize_t Bzip2BlockSource::Read(void *pBuf, size_t nSize)
+{
+    while (m_nDataPos == m_aData.size())
+    {
+        if (m_nBlock >= m_pasPoint->size())
+            return 0;
+        if (m_bRecord)
+            (*m_pasPoint)[m_nBlock].out = m_nPosition;
+        if (!DecodeBlock((*m_pasPoint)[m_nBlock++]))
+            return -1;
+    }
+
+    size_t nPart = m_aData.size() - m_nDataPos;
+    if (nPart > nSize)
+        nPart = nSize;
+    memcpy(pBuf, &m_aData[m_nDataPos], nPart);
+    m_nDataPos += nPart;
+    m_nPosition += nPart;
+    return nPart;
+}
+
+//
+// SeekIndex
+//
+bool SeekIndex::IsIndexable(const char *pzFormat)
+{
+    return pzFormat && (!strcmp(pzFormat, "tar.gz") || !strcmp(pzFormat, "tar.bz2"));
+}
+
+// ScanBlocks - finding bit offsets of bzip2 blocks
+bool SeekIndex::ScanBlocks(int nFd, volatile bool *pbCancel, std::string *pcError)
+{
+    unsigned char aBuf[ARCHIVE_BUFSIZE];
+    uint64_t nReg = 0, nBit = 0;
+    bool bOpen = false;
+    int nLevel = '9';
+    ssize_t nRead;
+
+    while ((nRead = read(nFd, aBuf, sizeof(aBuf))) > 0 && !*pbCancel)
+    {
+        for (ssize_t i = 0; i < nRead; i++)
+        {
+            for (int j = 7; j >= 0; j--)
+            {
+                nReg = (nReg << 1) | ((aBuf[i] >> j) & 1);
+                nBit++;
+
+                uint64_t nTail = nReg & 0xffffffffffffULL;
+                if (nTail != BZIP2_BLOCK && nTail != BZIP2_END)
+                    continue;
+                if (bOpen)
+                    m_asPoint.back().end = nBit - 48;
+                bOpen = false;
+                if (nTail == BZIP2_END)
+                    continue;
+
+                // the first block of a stream follows "BZh<level>"
+                if (!(nBit & 7) && nBit >= 64 && ((nReg >> 56) & 0xff) == 'h')
+                    nLevel = (nReg >> 48) & 0xff;
+                seek_point sPoint;
+                sPoint.out = SEEK_NONE;
+                sPoint.in = nBit - 48;
+                sPoint.end = 0;
+                sPoint.bits = 0;
+                sPoint.level = nLevel;
+                m_asPoint.push_back(sPoint);
+                bOpen = true;
+            }
+        }
+    }
+
+    // a block without end is not complete
+    if (bOpen)
+        m_asPoint.pop_back();
+    if (nRead < 0)
+        *pcError = strerror(errno);
+    else if (m_asPoint.empty())
+        *pcError = "Not a bzip2 file";
+    return nRead == 0 && !m_asPoint.empty();
+}
+
+SeekIndex *SeekIndex::Build(const char *pzFormat, const char *pzPath, volatile bool *pbCancel, std::string *pcError)
+{
+    archive_entry sEntry;
+    ByteSource *psSource;
+    int nResult = 0;
+
+    if (!IsIndexable(pzFormat))
+    {
+        *pcError = "Only tar.gz and tar.bz2 archives are indexed";
+        return NULL;
+    }
+
+    int nFd = open(pzPath, O_RDONLY);
+    if (nFd < 0)
+    {
+        *pcError = strerror(errno);
+        return NULL;
+    }
+
+    SeekIndex *psIndex = new SeekIndex(!strcmp(pzFormat, "tar.gz") ? SEEK_GZIP : SEEK_BZIP2);
+    if (psIndex->m_nKind == SEEK_GZIP)
+        psSource = new GzipIndexSource(nFd, &psIndex->m_asPoint);
+    else
+    {
+        if (!psIndex->ScanBlocks(nFd, pbCancel, pcError))
+        {
+            close(nFd);
+            delete psIndex;
+            return NULL;
+        }
+        psSource = new Bzip2BlockSource(nFd, &psIndex->m_asPoint, true);
+    }
+
+    // member offsets (checkpoints are saved while decoding)
+    ArchiveReader *pcReader = OpenTar(psSource);
+    while (!*pbCancel && (nResult = pcReader->NextEntry(&sEntry)) > 0)
+    {
+        if (sEntry.type == ENTRY_FILE)
+        {
+            seek_member sMember = { sEntry.offset, sEntry.name };
+            psIndex->m_asMember.push_back(sMember);
+        }
+    }
+    if (nResult < 0 || *pbCancel)
+    {
+        *pcError = *pbCancel ? "Cancelled" : pcReader->GetError();
+        delete pcReader;
+        delete psIndex;
+        return NULL;
+    }
+    delete pcReader;
+    return psIndex;
+}
+
+// Binary fields (the index is used on the same machine only)
+static bool read_field(FILE *psFile, void *pData, size_t nSize)
+{
+    return fread(pData, 1, nSize, psFile) == nSize;
+}
+
+static bool read_string(FILE *psFile, std::string *pcString, uint32_t nMax)
+{
+    uint32_t nSize;
+    if (!read_field(psFile, &nSize, sizeof(nSize)) || nSize > nMax)
+        return false;
+    pcString->resize(nSize);
+    return !nSize || read_field(psFile, &(*pcString)[0], nSize);
+}
+
+static void write_string(FILE *psFile, const std::string &cString)
+{
+    uint32_t nSize = cString.size();
+    fwrite(&nSize, sizeof(nSize), 1, psFile);
+    fwrite(cString.data(), 1, nSize, psFile);
+}
+
+SeekIndex *SeekIndex::Load(const char *pzPath)
+{
+    char zMagic[sizeof(SEEK_MAGIC)];
+    uint32_t nKind;
+    uint64_t nCount;
+    bool bResult = false;
+
+    FILE *psFile = fopen(pzPath, "rb");
+    if (!psFile)
+        return NULL;
+
+    SeekIndex *psIndex = NULL;
+    if (read_field(psFile, zMagic, sizeof(zMagic)) && !memcmp(zMagic, SEEK_MAGIC, sizeof(zMagic)) &&
+        read_field(psFile, &nKind, sizeof(nKind)) && (nKind == SEEK_GZIP || nKind == SEEK_BZIP2) &&
+        read_field(psFile, &nCount, sizeof(nCount)))
+    {
+        psIndex = new SeekIndex(nKind);
+        bResult = true;
+        for (uint64_t i = 0; i < nCount && bResult; i++)
+        {
+            seek_point sPoint;
+            int32_t anValue[2];
+            bResult = read_field(psFile, &sPoint.out, sizeof(sPoint.out)) && read_field(psFile, &sPoint.in, sizeof(sPoint.in)) &&
+                      read_field(psFile, &sPoint.end, sizeof(sPoint.end)) && read_field(psFile, anValue, sizeof(anValue)) &&
+                      read_string(psFile, &sPoint.window, compressBound(SEEK_WINDOW));
+            sPoint.bits = anValue[0];
+            sPoint.level = anValue[1];
+            psIndex->m_asPoint.push_back(sPoint);
+        }
+        bResult = bResult && read_field(psFile, &nCount, sizeof(nCount));
+        for (uint64_t i = 0; i < nCount && bResult; i++)
+        {
+            seek_member sMember;
+            bResult = read_field(psFile, &sMember.offset, sizeof(sMember.offset)) && read_string(psFile, &sMember.name, 1 << 16);
+            psIndex->m_asMember.push_back(sMember);
+        }
+    }
+    fclose(psFile);
+
+    if (!bResult)
+    {
+        delete psIndex;
+        return NULL;
+    }
+    return psIndex;
+}
+
+// Save - writing index (replaced atomically)
+bool SeekIndex::Save(const char *pzPath) const
+{
+    std::string cTemp = std::string(pzPath) + ".tmp";
+    uint32_t nKind = m_nKind;
+    uint64_t nCount = m_asPoint.size();
+
+    FILE *psFile = fopen(cTemp.c_str(), "wb");
+    if (!psFile)
+        return false;
+
+    fwrite(SEEK_MAGIC, sizeof(SEEK_MAGIC), 1, psFile);
+    fwrite(&nKind, sizeof(nKind), 1, psFile);
+    fwrite(&nCount, sizeof(nCount), 1, psFile);
+    for (unsigned int i = 0; i < m_asPoint.size(); i++)
+    {
+        const seek_point &sPoint = m_asPoint[i];
+        int32_t anValue[2] = { sPoint.bits, sPoint.level };
+        fwrite(&sPoint.out, sizeof(sPoint.out), 1, psFile);
+        fwrite(&sPoint.in, sizeof(sPoint.in), 1, psFile);
+        fwrite(&sPoint.end, sizeof(sPoint.end), 1, psFile);
+        fwrite(anValue, sizeof(anValue), 1, psFile);
+        write_string(psFile, sPoint.window);
+    }
+    nCount = m_asMember.size();
+    fwrite(&nCount, sizeof(nCount), 1, psFile);
+    for (unsigned int i = 0; i < m_asMember.size(); i++)
+    {
+        fwrite(&m_asMember[i].offset, sizeof(m_asMember[i].offset), 1, psFile);
+        write_string(psFile, m_asMember[i].name);
+    }
+
+    bool bResult = !ferror(psFile);
+    if (fclose(psFile) || !bResult || rename(cTemp.c_str(), pzPath) < 0)
+    {
+        unlink(cTemp.c_str());
+        return false;
+    }
+    return true;
+}
+
+// OpenReader - tar reader which starts at the member header
+ArchiveReader *SeekIndex::OpenReader(const char *pzPath, uint64_t nOffset, std::string *pcError) const
+{
+    ByteSource *psSource;
+    int nPoint = -1;
+
+    // the nearest decoded checkpoint before the offset
+    for (unsigned int i = 0; i < m_asPoint.size(); i++)
+    {
+        if (m_asPoint[i].out != SEEK_NONE && m_asPoint[i].out <= nOffset)
+            nPoint = i;
+        else if (m_asPoint[i].out != SEEK_NONE)
+            break;
+    }
+    if (nPoint < 0)
+    {
+        *pcError = "No checkpoint before the member";
+        return NULL;
+    }
+
+    int nFd = open(pzPath, O_RDONLY);
+    if (nFd < 0)
+    {
+        *pcError = strerror(errno);
+        return NULL;
+    }
+    if (m_nKind == SEEK_GZIP)
+        psSource = new GzipSeekSource(nFd, m_asPoint[nPoint]);
+    else
+        psSource = new Bzip2BlockSource(nFd, m_asPoint, nPoint);
+
+    if (*psSource->GetError() || !psSource->Skip(nOffset - psSource->GetPosition()))
+    {
+        *pcError = psSource->GetError();
+        delete psSource;
+        return NULL;
+    }
+    return OpenTar(psSource);
+}
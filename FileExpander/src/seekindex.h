@@ -0,0 +1,86 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _NRUSLAN_SEEKINDEX_H_
+#define _NRUSLAN_SEEKINDEX_H_
+
+//
+// Seek index - random access into tar.gz and tar.bz2 archives.
+// gzip: inflate checkpoints at deflate block boundaries every SEEK_SPAN
+// bytes of output, each with the last 32K of output (the dictionary).
+// bzip2: bit offsets of all compressed blocks (every block is decoded
+// on its own). Tar members are mapped to decoded offsets, so a member
+// is read starting from the nearest checkpoint before it.
+//
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "archive.h"
+
+enum SeekIndex_Settings
+{
+    SEEK_SPAN = 8 << 20, // gzip checkpoint distance (decoded bytes)
+    SEEK_WINDOW = 32768
+};
+
+enum SeekIndex_Kind
+{
+    SEEK_GZIP = 1,
+    SEEK_BZIP2
+};
+
+// Checkpoint
+struct seek_point
+{
+    uint64_t out; // decoded offset (~0 if the block was never decoded)
+    uint64_t in; // gzip: byte offset of the next input; bzip2: block start bit
+    uint64_t end; // bzip2: block end bit
+    int bits; // gzip: bits of the byte before "in" which belong to the block
+    int level; // bzip2: block size level ('1'..'9')
+    std::string window; // gzip: compressed dictionary
+};
+
+// Tar member (regular files only)
+struct seek_member
+{
+    uint64_t offset; // decoded offset of the member header
+    std::string name;
+};
+
+class SeekIndex
+{
+    public:
+        static bool IsIndexable(const char *pzFormat);
+        static SeekIndex *Build(const char *pzFormat, const char *pzPath, volatile bool *pbCancel, std::string *pcError);
+        static SeekIndex *Load(const char *pzPath);
+        bool Save(const char *pzPath) const;
+        const std::vector<seek_member> &GetMembers() const { return m_asMember; }
+        ArchiveReader *OpenReader(const char *pzPath, uint64_t nOffset, std::string *pcError) const;
+        unsigned int GetPointCount() const { return m_asPoint.size(); }
+    private:
+        SeekIndex(int nKind) : m_nKind(nKind) {}
+        bool ScanBlocks(int nFd, volatile bool *pbCancel, std::string *pcError);
+
+        int m_nKind;
+        std::vector<seek_point> m_asPoint;
+        std::vector<seek_member> m_asMember;
+};
+
+#endif /* _NRUSLAN_SEEKINDEX_H_ */
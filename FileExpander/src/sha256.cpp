@@ -0,0 +1,244 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <string.h>
+#include "sha256.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && (__GNUC__ >= 5)
+#define SHA256_X86_SHA
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+static const uint32_t sha256_k[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+// Portable block function
+static void sha256_blocks_c(uint32_t *state, const unsigned char *p, size_t nBlocks)
+{
+    uint32_t w[64], a, b, c, d, e, f, g, h, t1, t2;
+    int i;
+
+    for (; nBlocks; nBlocks--, p += SHA256_BLOCK)
+    {
+        for (i = 0; i < 16; i++)
+            w[i] = ((uint32_t)p[4 * i] << 24) | ((uint32_t)p[4 * i + 1] << 16) | ((uint32_t)p[4 * i + 2] << 8) | p[4 * i + 3];
+        for (; i < 64; i++)
+            w[i] = w[i - 16] + (ROR(w[i - 15], 7) ^ ROR(w[i - 15], 18) ^ (w[i - 15] >> 3)) +
+                   w[i - 7] + (ROR(w[i - 2], 17) ^ ROR(w[i - 2], 19) ^ (w[i - 2] >> 10));
+
+        a = state[0]; b = state[1]; c = state[2]; d = state[3];
+        e = state[4]; f = state[5]; g = state[6]; h = state[7];
+
+        for (i = 0; i < 64; i++)
+        {
+            t1 = h + (ROR(e, 6) ^ ROR(e, 11) ^ ROR(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+            t2 = (ROR(a, 2) ^ ROR(a, 13) ^ ROR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g; g = f; f = e; e = d + t1;
+            d = c; c = b; b = a; a = t1 + t2;
+        }
+
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+}
+
+#ifdef SHA256_X86_SHA
+
+// Block function using SHA extensions (SHA256RNDS2/SHA256MSG1/SHA256MSG2)
+__attribute__((target("sha,sse4.1")))
+static void sha256_blocks_x86(uint32_t *state, const unsigned char *p, size_t nBlocks)
+{
+    const __m128i cMask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i cState0, cState1, cMsg, cTmp, cMsg0, cMsg1, cMsg2, cMsg3, cSave0, cSave1;
+
+    // state as ABEF/CDGH
+    cTmp = _mm_loadu_si128((const __m128i *)&state[0]);
+    cState1 = _mm_loadu_si128((const __m128i *)&state[4]);
+    cTmp = _mm_shuffle_epi32(cTmp, 0xB1);
+    cState1 = _mm_shuffle_epi32(cState1, 0x1B);
+    cState0 = _mm_alignr_epi8(cTmp, cState1, 8);
+    cState1 = _mm_blend_epi16(cState1, cTmp, 0xF0);
+
+    for (; nBlocks; nBlocks--, p += SHA256_BLOCK)
+    {
+        cSave0 = cState0;
+        cSave1 = cState1;
+
+        cMsg0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + 0)), cMask);
+        cMsg1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + 16)), cMask);
+        cMsg2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + 32)), cMask);
+        cMsg3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(p + 48)), cMask);
+
+        // 16 groups of 4 rounds; message schedule is kept in cMsg0..cMsg3
+        for (int i = 0; i < 16; i++)
+        {
+            cMsg = _mm_add_epi32(cMsg0, _mm_loadu_si128((const __m128i *)&sha256_k[4 * i]));
+            cState1 = _mm_sha256rnds2_epu32(cState1, cState0, cMsg);
+            cMsg = _mm_shuffle_epi32(cMsg, 0x0E);
+            cState0 = _mm_sha256rnds2_epu32(cState0, cState1, cMsg);
+
+            if (i < 12)
+            {
+                // W[i+16..] = msg2(msg1(W0, W1) + alignr(W3, W2), W3)
+                cTmp = _mm_add_epi32(_mm_sha256msg1_epu32(cMsg0, cMsg1), _mm_alignr_epi8(cMsg3, cMsg2, 4));
+                cMsg0 = cMsg1;
+                cMsg1 = cMsg2;
+                cMsg2 = cMsg3;
+                cMsg3 = _mm_sha256msg2_epu32(cTmp, cMsg2);
+            }
+            else
+            {
+                cMsg0 = cMsg1;
+                cMsg1 = cMsg2;
+                cMsg2 = cMsg3;
+            }
+        }
+
+        cState0 = _mm_add_epi32(cState0, cSave0);
+        cState1 = _mm_add_epi32(cState1, cSave1);
+    }
+
+    // back to ABCD/EFGH
+    cTmp = _mm_shuffle_epi32(cState0, 0x1B);
+    cState1 = _mm_shuffle_epi32(cState1, 0xB1);
+    cState0 = _mm_blend_epi16(cTmp, cState1, 0xF0);
+    cState1 = _mm_alignr_epi8(cState1, cTmp, 8);
+    _mm_storeu_si128((__m128i *)&state[0], cState0);
+    _mm_storeu_si128((__m128i *)&state[4], cState1);
+}
+
+static bool sha256_has_x86_sha()
+{
+    unsigned int a, b, c, d;
+    if (!__get_cpuid(1, &a, &b, &c, &d) || !(c & bit_SSE4_1) || __get_cpuid_max(0, NULL) < 7)
+        return false;
+    __cpuid_count(7, 0, a, b, c, d);
+    return (b & (1u << 29)) != 0;
+}
+
+#endif
+
+typedef void (*sha256_blocks_func)(uint32_t *, const unsigned char *, size_t);
+
+// choosing block function on the first use
+static sha256_blocks_func sha256_select()
+{
+    static sha256_blocks_func pfBlocks = NULL;
+    if (!pfBlocks)
+    {
+#ifdef SHA256_X86_SHA
+        pfBlocks = sha256_has_x86_sha() ? sha256_blocks_x86 : sha256_blocks_c;
+#else
+        pfBlocks = sha256_blocks_c;
+#endif
+    }
+    return pfBlocks;
+}
+
+bool sha256_accelerated()
+{
+    return sha256_select() != sha256_blocks_c;
+}
+
+void sha256_init(sha256_ctx *psCtx)
+{
+    static const uint32_t anInit[8] =
+    {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+    };
+    memcpy(psCtx->state, anInit, sizeof(anInit));
+    psCtx->length = 0;
+    psCtx->used = 0;
+}
+
+void sha256_update(sha256_ctx *psCtx, const void *pData, size_t nSize)
+{
+    const unsigned char *p = (const unsigned char *)pData;
+    sha256_blocks_func pfBlocks = sha256_select();
+
+    psCtx->length += nSize;
+    if (psCtx->used)
+    {
+        size_t nPart = SHA256_BLOCK - psCtx->used;
+        if (nPart > nSize)
+            nPart = nSize;
+        memcpy(psCtx->block + psCtx->used, p, nPart);
+        psCtx->used += nPart;
+        p += nPart;
+        nSize -= nPart;
+        if (psCtx->used < SHA256_BLOCK)
+            return;
+        pfBlocks(psCtx->state, psCtx->block, 1);
+        psCtx->used = 0;
+    }
+
+    if (nSize >= SHA256_BLOCK)
+    {
+        pfBlocks(psCtx->state, p, nSize / SHA256_BLOCK);
+        p += nSize & ~(size_t)(SHA256_BLOCK - 1);
+        nSize &= SHA256_BLOCK - 1;
+    }
+
+    memcpy(psCtx->block, p, nSize);
+    psCtx->used = nSize;
+}
+
+void sha256_final(sha256_ctx *psCtx, unsigned char *pDigest)
+{
+    uint64_t nBits = psCtx->length * 8;
+    unsigned char aPad[SHA256_BLOCK + 8];
+    size_t nPad = (psCtx->used < 56 ? 56 : 120) - psCtx->used;
+
+    memset(aPad, 0, sizeof(aPad));
+    aPad[0] = 0x80;
+    for (int i = 0; i < 8; i++)
+        aPad[nPad + i] = (unsigned char)(nBits >> (56 - 8 * i));
+    sha256_update(psCtx, aPad, nPad + 8);
+
+    for (int i = 0; i < 8; i++)
+    {
+        pDigest[4 * i] = psCtx->state[i] >> 24;
+        pDigest[4 * i + 1] = psCtx->state[i] >> 16;
+        pDigest[4 * i + 2] = psCtx->state[i] >> 8;
+        pDigest[4 * i + 3] = psCtx->state[i];
+    }
+}
+
+void sha256_hex(const unsigned char *pDigest, char *pzHex)
+{
+    static const char g_azHex[] = "0123456789abcdef";
+    for (int i = 0; i < SHA256_DIGEST; i++)
+    {
+        *pzHex++ = g_azHex[pDigest[i] >> 4];
+        *pzHex++ = g_azHex[pDigest[i] & 15];
+    }
+    *pzHex = '\0';
+}
@@ -0,0 +1,48 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _NRUSLAN_SHA256_H_
+#define _NRUSLAN_SHA256_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum SHA256_Settings
+{
+    SHA256_BLOCK = 64,
+    SHA256_DIGEST = 32,
+    SHA256_HEX = 2 * SHA256_DIGEST
+};
+
+struct sha256_ctx
+{
+    uint32_t state[8];
+    uint64_t length; // in bytes
+    unsigned char block[SHA256_BLOCK];
+    unsigned int used;
+};
+
+// SHA-256 (uses x86 SHA extensions when the processor has them)
+void sha256_init(sha256_ctx *psCtx);
+void sha256_update(sha256_ctx *psCtx, const void *pData, size_t nSize);
+void sha256_final(sha256_ctx *psCtx, unsigned char *pDigest);
+void sha256_hex(const unsigned char *pDigest, char *pzHex); // pzHex: SHA256_HEX + 1
+bool sha256_accelerated();
+
+#endif /* _NRUSLAN_SHA256_H_ */
@@ -0,0 +1,185 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#ifdef __linux__
+#include <mntent.h>
+#include <sys/quota.h>
+#endif
+#include "space.h"
+
+enum Space_Settings
+{
+    PROBE_OUTPUT_MAX = 4096,
+    QUOTA_BLOCK = 1024 // quota limits are counted in 1 KB blocks
+};
+
+// Free space and file slots available to the user
+struct space_info
+{
+    uint64_t bytes, files;
+    bool quota_bytes, quota_files; // limited by quota
+};
+
+bool ProbeSize(const char *pzCommand, archive_size *psSize, std::string *pcError)
+{
+    char zOutput[PROBE_OUTPUT_MAX + 1];
+    size_t nSize = 0, nRead;
+
+    FILE *hPipe = popen(pzCommand, "r");
+    if (!hPipe)
+    {
+        *pcError = strerror(errno);
+        return false;
+    }
+    while (nSize < PROBE_OUTPUT_MAX && (nRead = fread(zOutput + nSize, 1, PROBE_OUTPUT_MAX - nSize, hPipe)) > 0)
+        nSize += nRead;
+    zOutput[nSize] = '\0';
+    if (pclose(hPipe) != 0)
+    {
+        *pcError = "Size probe failed";
+        return false;
+    }
+
+    // the first number is the size, the second one (if any) is files count
+    char *pzText = zOutput + strcspn(zOutput, "0123456789");
+    if (!*pzText)
+    {
+        *pcError = "Size probe printed no size";
+        return false;
+    }
+    psSize->bytes = strtoull(pzText, &pzText, 10);
+    pzText += strcspn(pzText, "0123456789\n");
+    psSize->files = (*pzText && *pzText != '\n') ? strtoull(pzText, NULL, 10) : 0;
+    return true;
+}
+
+#ifdef __linux__
+// GetQuota - user's quota on the file system of the folder
+static bool GetQuota(const char *pzDest, uint64_t *pnBytes, uint64_t *pnFiles)
+{
+    struct stat stDest, stMount;
+    struct mntent *psEntry;
+    std::string cDevice;
+
+    if (stat(pzDest, &stDest) < 0)
+        return false;
+
+    FILE *hMounts = setmntent("/proc/mounts", "r");
+    if (!hMounts)
+        return false;
+    while ((psEntry = getmntent(hMounts)))
+    {
+        // the last mount wins (mounts over mounts)
+        if (stat(psEntry->mnt_dir, &stMount) == 0 && stMount.st_dev == stDest.st_dev)
+            cDevice = psEntry->mnt_fsname;
+    }
+    endmntent(hMounts);
+
+    struct dqblk sQuota;
+    if (cDevice.empty() || quotactl(QCMD(Q_GETQUOTA, USRQUOTA), cDevice.c_str(), getuid(), (caddr_t)&sQuota) < 0)
+        return false;
+
+    *pnBytes = *pnFiles = UINT64_MAX;
+    if (sQuota.dqb_bhardlimit)
+    {
+        uint64_t nLimit = sQuota.dqb_bhardlimit * QUOTA_BLOCK;
+        *pnBytes = nLimit > sQuota.dqb_curspace ? nLimit - sQuota.dqb_curspace : 0;
+    }
+    if (sQuota.dqb_ihardlimit)
+        *pnFiles = sQuota.dqb_ihardlimit > sQuota.dqb_curinodes ? sQuota.dqb_ihardlimit - sQuota.dqb_curinodes : 0;
+    return true;
+}
+#endif
+
+bool CheckSpace(const char *pzDest, const archive_size &sSize, std::string *pcMessage)
+{
+    struct statvfs sFs;
+    space_info sFree;
+
+    if (statvfs(pzDest, &sFs) < 0)
+        return true; // nothing to compare with
+
+    sFree.bytes = (uint64_t)sFs.f_bavail * sFs.f_frsize;
+    sFree.files = sFs.f_files ? sFs.f_favail : UINT64_MAX; // no inode limit if 0
+    sFree.quota_bytes = sFree.quota_files = false;
+
+#ifdef __linux__
+    uint64_t nQuotaBytes, nQuotaFiles;
+    if (GetQuota(pzDest, &nQuotaBytes, &nQuotaFiles))
+    {
+        if (nQuotaBytes < sFree.bytes)
+        {
+            sFree.bytes = nQuotaBytes;
+            sFree.quota_bytes = true;
+        }
+        if (nQuotaFiles < sFree.files)
+        {
+            sFree.files = nQuotaFiles;
+            sFree.quota_files = true;
+        }
+    }
+#endif
+
+    // every file wastes half of its last block on average
+    uint64_t nNeeded = sSize.bytes + sSize.files * (sFs.f_frsize / 2);
+    char zNeeded[32], zFree[32], zText[128];
+
+    if (nNeeded > sFree.bytes)
+    {
+        FormatSize(nNeeded, zNeeded);
+        FormatSize(sFree.bytes, zFree);
+        sprintf(zText, "about %s is needed, %s %s", zNeeded, zFree, sFree.quota_bytes ? "left in quota" : "available");
+        *pcMessage = std::string("Not enough space in ") + pzDest + ": " + zText;
+        return false;
+    }
+    if (sSize.files > sFree.files)
+    {
+        sprintf(zText, "%llu files, %llu %s", (unsigned long long)sSize.files, (unsigned long long)sFree.files,
+                sFree.quota_files ? "left in quota" : "can be created");
+        *pcMessage = std::string("Too many files for ") + pzDest + ": " + zText;
+        return false;
+    }
+    return true;
+}
+
+void FormatSize(uint64_t nSize, char *pzBuf)
+{
+    static const char *apzUnit[] = { "KB", "MB", "GB", "TB" };
+    double vSize = nSize;
+    int i = -1;
+
+    if (nSize < 1024)
+    {
+        sprintf(pzBuf, "%u B", (unsigned int)nSize);
+        return;
+    }
+    while (vSize >= 1024.0 && i < 3)
+    {
+        vSize /= 1024.0;
+        i++;
+    }
+    sprintf(pzBuf, "%.1f %s", vSize, apzUnit[i]);
+}
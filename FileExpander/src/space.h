@@ -0,0 +1,42 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _NRUSLAN_SPACE_H_
+#define _NRUSLAN_SPACE_H_
+
+//
+// Free space precheck - the uncompressed size of the archive (from its
+// metadata or from the size probe command of the rule) is compared with
+// free space and the user's quota of the destination before expanding.
+//
+
+#include <string>
+#include "archive.h"
+
+// Running size probe command: it prints the size in bytes, optionally
+// followed by the count of files
+bool ProbeSize(const char *pzCommand, archive_size *psSize, std::string *pcError);
+
+// Whether the contents fit into the pzDest folder (pcMessage tells why not)
+bool CheckSpace(const char *pzDest, const archive_size &sSize, std::string *pcMessage);
+
+// Human-readable byte count ("3.1 MB"); pzBuf: 32 bytes
+void FormatSize(uint64_t nSize, char *pzBuf);
+
+#endif /* _NRUSLAN_SPACE_H_ */
@@ -0,0 +1,174 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "spool.h"
+
+LineSpool::LineSpool()
+    : m_nSize(0), m_nLines(0), m_bPartial(false), m_bFailed(false), m_pMap(NULL), m_nMapStart(0), m_nMapSize(0)
+{
+    char zPath[] = SPOOL_DIR "/FileExpander-list.XXXXXX";
+
+    // nobody else needs the name
+    m_nFd = mkstemp(zPath);
+    if (m_nFd >= 0)
+        unlink(zPath);
+    m_cBuffer.reserve(SPOOL_BUFFER);
+}
+
+LineSpool::~LineSpool()
+{
+    if (m_pMap)
+        munmap(m_pMap, m_nMapSize);
+    if (m_nFd >= 0)
+        close(m_nFd);
+}
+
+bool LineSpool::Add(const char *pData, size_t nSize)
+{
+    if (m_nFd < 0 || m_bFailed)
+        return false;
+
+    for (const char *pEnd = pData + nSize; pData < pEnd;)
+    {
+        // a line starts here
+        if (!m_bPartial && m_nLines % SPOOL_STEP == 0)
+            m_anIndex.push_back(m_nSize);
+        m_bPartial = true;
+
+        const char *pNewLine = (const char *)memchr(pData, '\n', pEnd - pData);
+        const char *pStop = pNewLine ? pNewLine + 1 : pEnd;
+        m_cBuffer.append(pData, pStop - pData);
+        m_nSize += pStop - pData;
+        if (pNewLine)
+        {
+            m_nLines++;
+            m_bPartial = false;
+        }
+        if (m_cBuffer.size() >= SPOOL_BUFFER && !Flush())
+            return false;
+        pData = pStop;
+    }
+    return true;
+}
+
+void LineSpool::Finish()
+{
+    if (m_bPartial)
+        Add("\n", 1);
+    Flush();
+}
+
+// Flush - writing out the buffer (false if the disk is full)
+bool LineSpool::Flush()
+{
+    for (size_t nDone = 0; nDone < m_cBuffer.size();)
+    {
+        ssize_t nWritten = write(m_nFd, m_cBuffer.data() + nDone, m_cBuffer.size() - nDone);
+        if (nWritten < 0 && errno == EINTR)
+            continue;
+        if (nWritten <= 0)
+        {
+            m_bFailed = true; // lines which weren't written are lost
+            return false;
+        }
+        nDone += nWritten;
+    }
+    m_cBuffer.clear();
+    return true;
+}
+
+// Map - pointer to the data at the offset (and how much follows it in the
+// mapped window); NULL if it can't be mapped
+const char *LineSpool::Map(uint64_t nOffset, size_t *pnAvail)
+{
+    if (!m_pMap || nOffset < m_nMapStart || nOffset >= m_nMapStart + m_nMapSize)
+    {
+        static const uint64_t nPage = sysconf(_SC_PAGESIZE);
+        uint64_t nWritten = m_nSize - m_cBuffer.size();
+
+        if (m_pMap)
+            munmap(m_pMap, m_nMapSize);
+        m_pMap = NULL;
+        if (nOffset >= nWritten)
+            return NULL;
+        m_nMapStart = nOffset - nOffset % nPage;
+        m_nMapSize = (nWritten - m_nMapStart < SPOOL_WINDOW) ? nWritten - m_nMapStart : SPOOL_WINDOW;
+        void *pMap = mmap(NULL, m_nMapSize, PROT_READ, MAP_SHARED, m_nFd, m_nMapStart);
+        if (pMap == MAP_FAILED)
+            return NULL;
+        m_pMap = (char *)pMap;
+    }
+    *pnAvail = m_nMapStart + m_nMapSize - nOffset;
+    return m_pMap + (nOffset - m_nMapStart);
+}
+
+// ReadLine - the line at the offset with its new line (at most nMax bytes
+// are kept; pcLine may be NULL to skip it); false if it can't be read
+bool LineSpool::ReadLine(uint64_t *pnOffset, std::string *pcLine, size_t nMax)
+{
+    const char *pData, *pNewLine = NULL;
+    size_t nAvail;
+
+    if (pcLine)
+        pcLine->clear();
+    while (!pNewLine && (pData = Map(*pnOffset, &nAvail)))
+    {
+        pNewLine = (const char *)memchr(pData, '\n', nAvail);
+        size_t nSize = pNewLine ? pNewLine + 1 - pData : nAvail;
+        if (pcLine && pcLine->size() < nMax)
+            pcLine->append(pData, (nMax - pcLine->size() < nSize) ? nMax - pcLine->size() : nSize);
+        *pnOffset += nSize;
+    }
+    if (pcLine && pNewLine && (pcLine->empty() || (*pcLine)[pcLine->size() - 1] != '\n'))
+        *pcLine += '\n'; // cut
+    return pNewLine != NULL;
+}
+
+unsigned int LineSpool::GetLines(uint64_t nFirst, size_t nMaxBytes, std::string *pcText)
+{
+    unsigned int nTaken = 0;
+    std::string cLine;
+
+    pcText->clear();
+    if (m_nFd < 0 || nFirst >= m_nLines)
+        return 0;
+    Flush(); // if the disk got full, the lines written before are read
+
+    // skipping to the first line from the remembered one before it
+    uint64_t nLine = nFirst - nFirst % SPOOL_STEP, nOffset = m_anIndex[nLine / SPOOL_STEP];
+    for (; nLine < nFirst; nLine++)
+    {
+        if (!ReadLine(&nOffset, NULL, 0))
+            return 0;
+    }
+
+    // and taking lines while they fit (the first one always)
+    for (; nLine < m_nLines && ReadLine(&nOffset, &cLine, nMaxBytes); nLine++, nTaken++)
+    {
+        if (nTaken && pcText->size() + cLine.size() > nMaxBytes)
+            break;
+        *pcText += cLine;
+    }
+    return nTaken;
+}
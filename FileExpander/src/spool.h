@@ -0,0 +1,73 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _NRUSLAN_SPOOL_H_
+#define _NRUSLAN_SPOOL_H_
+
+//
+// LineSpool - text lines kept in an unlinked temporary file instead of
+// memory. Only every SPOOL_STEP-th line offset stays in memory; a range of
+// lines is read back by mapping the part of the file holding it, so
+// listings of tens of millions of lines cost a few megabytes. Lines are
+// added by one thread; they are read only when adding is finished.
+//
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+enum Spool_Settings
+{
+    SPOOL_STEP = 64, // lines between remembered offsets
+    SPOOL_BUFFER = 65536, // bytes written at once
+    SPOOL_WINDOW = 4 * 1048576 // bytes mapped at once
+};
+
+#define SPOOL_DIR "/tmp"
+
+class LineSpool
+{
+    public:
+        LineSpool();
+        ~LineSpool();
+        bool IsOpen() const { return m_nFd >= 0; }
+        bool Add(const char *pData, size_t nSize); // text in pieces of any size (false if the disk is full)
+        void Finish(); // the last line may have no new line
+        uint64_t GetLineCount() const { return m_nLines; }
+        // lines from nFirst which fit into nMaxBytes (at least one); how many were taken
+        unsigned int GetLines(uint64_t nFirst, size_t nMaxBytes, std::string *pcText);
+    private:
+        bool Flush();
+        const char *Map(uint64_t nOffset, size_t *pnAvail);
+        bool ReadLine(uint64_t *pnOffset, std::string *pcLine, size_t nMax);
+
+        int m_nFd;
+        std::string m_cBuffer; // added but not written yet
+        uint64_t m_nSize; // bytes written and buffered
+        uint64_t m_nLines; // complete lines
+        bool m_bPartial; // the last line has no new line yet
+        bool m_bFailed;
+        std::vector<uint64_t> m_anIndex; // offset of every SPOOL_STEP-th line
+        char *m_pMap;
+        uint64_t m_nMapStart;
+        size_t m_nMapSize;
+};
+
+#endif /* _NRUSLAN_SPOOL_H_ */
@@ -0,0 +1,141 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <time.h>
+#include "archive.h"
+#include "pipeline.h"
+#include "throttle.h"
+
+#ifdef SYS_ioprio_set
+// <linux/ioprio.h> is not always installed
+enum IoPrio_Settings
+{
+    IOPRIO_WHO_THREAD = 1, // IOPRIO_WHO_PROCESS takes a thread id
+    IOPRIO_IDLE = 3 << 13 // IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT
+};
+#endif
+
+bool SetBackgroundPriority()
+{
+#ifdef SYS_gettid
+    pid_t nThread = syscall(SYS_gettid); // both are per thread on Linux
+#else
+    pid_t nThread = 0;
+#endif
+    bool bResult = setpriority(PRIO_PROCESS, nThread, THROTTLE_NICE) == 0;
+#ifdef SYS_ioprio_set
+    if (syscall(SYS_ioprio_set, IOPRIO_WHO_THREAD, nThread, IOPRIO_IDLE) < 0)
+        bResult = false;
+#endif
+    return bResult;
+}
+
+WriteThrottle::WriteThrottle(uint64_t nLimit)
+  : m_nLimit(nLimit), m_nRate(nLimit), m_nTokens(0), m_nWaited(0),
+    m_nAverage(0), m_nUsual(0), m_nSamples(0), m_nPeriodBytes(0)
+{
+    m_nLast = m_nPeriod = pipe_time();
+}
+
+void WriteThrottle::Wait(size_t nSize, volatile bool *pbCancel)
+{
+    if (!m_nRate)
+        return;
+
+    uint64_t nNow = pipe_time();
+    int64_t nBurst = m_nRate * THROTTLE_BURST / 1000;
+    if (nBurst < (int64_t)nSize)
+        nBurst = nSize;
+    m_nTokens += (nNow - m_nLast) * m_nRate / 1000000;
+    if (m_nTokens > nBurst)
+        m_nTokens = nBurst;
+    m_nLast = nNow;
+
+    // sleeping for the missing tokens (in short steps, so cancelling is quick)
+    while (m_nTokens < (int64_t)nSize && !(pbCancel && *pbCancel))
+    {
+        uint64_t nDelay = ((int64_t)nSize - m_nTokens) * 1000000 / m_nRate;
+        if (nDelay > THROTTLE_PERIOD * 1000)
+            nDelay = THROTTLE_PERIOD * 1000;
+        struct timespec sDelay = { (time_t)(nDelay / 1000000), (long)(nDelay % 1000000) * 1000 };
+        nanosleep(&sDelay, NULL);
+
+        nNow = pipe_time();
+        m_nTokens += (nNow - m_nLast) * m_nRate / 1000000;
+        m_nWaited += nNow - m_nLast;
+        m_nLast = nNow;
+    }
+    m_nTokens -= nSize;
+}
+
+void WriteThrottle::Written(size_t nSize, uint64_t nLatency)
+{
+    m_nPeriodBytes += nSize;
+
+    // small writes say little about the disk
+    if (nSize >= ARCHIVE_BUFSIZE / 4)
+    {
+        nLatency = nLatency * ARCHIVE_BUFSIZE / nSize;
+        m_nAverage = m_nSamples ? m_nAverage - m_nAverage / 8 + nLatency / 8 : nLatency;
+        if (++m_nSamples == THROTTLE_SAMPLES)
+            m_nUsual = m_nAverage;
+        else if (m_nSamples > THROTTLE_SAMPLES)
+        {
+            // the usual latency follows the faster periods quickly, slower ones slowly
+            if (m_nAverage < m_nUsual)
+                m_nUsual = m_nAverage;
+            else
+                m_nUsual += (m_nAverage - m_nUsual) / 256;
+        }
+    }
+
+    uint64_t nNow = pipe_time();
+    if (nNow - m_nPeriod >= THROTTLE_PERIOD * 1000)
+        Adjust(nNow);
+}
+
+// Adjust - halving the rate when the disk is busy, raising it slowly otherwise
+void WriteThrottle::Adjust(uint64_t nNow)
+{
+    uint64_t nThroughput = m_nPeriodBytes * 1000000 / (nNow - m_nPeriod);
+    m_nPeriod = nNow;
+    m_nPeriodBytes = 0;
+    if (m_nSamples < THROTTLE_SAMPLES)
+        return;
+
+    if (m_nAverage > m_nUsual * THROTTLE_SLOW && m_nAverage > THROTTLE_MIN_LATENCY)
+    {
+        uint64_t nRate = (m_nRate && m_nRate < nThroughput) ? m_nRate : nThroughput;
+        m_nRate = nRate / 2 > THROTTLE_MIN_RATE ? nRate / 2 : THROTTLE_MIN_RATE;
+    }
+    else if (m_nRate && m_nAverage < m_nUsual * 2)
+    {
+        m_nRate += m_nRate / 4 + THROTTLE_MIN_RATE;
+
+        // the limit is reached, or without one the rate doesn't hold writing back anymore
+        if (m_nLimit && m_nRate > m_nLimit)
+            m_nRate = m_nLimit;
+        else if (!m_nLimit && m_nRate > nThroughput * 4)
+            m_nRate = 0;
+    }
+}
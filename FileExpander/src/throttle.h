@@ -0,0 +1,70 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _NRUSLAN_THROTTLE_H_
+#define _NRUSLAN_THROTTLE_H_
+
+//
+// Background expanding: lower CPU and I/O priority of the job and a token
+// bucket which limits how fast its files are written. The rate is lowered
+// when writes start taking longer (the disk is busy with other programs or
+// has too much dirty data to flush) and raised again when they are fast.
+//
+
+#include <sys/types.h>
+#include <stdint.h>
+
+enum Throttle_Settings
+{
+    THROTTLE_NICE = 10, // nice level of background jobs
+    THROTTLE_BURST = 100, // milliseconds of writing which may be done at once
+    THROTTLE_PERIOD = 250, // milliseconds between rate adjustments
+    THROTTLE_SAMPLES = 16, // writes measured before the usual latency is known
+    THROTTLE_SLOW = 4, // latency (times the usual one) meaning that the disk is busy
+    THROTTLE_MIN_LATENCY = 1000, // microseconds (faster writes are never too slow)
+    THROTTLE_MIN_RATE = 1048576 // bytes per second
+};
+
+// Lowering CPU (nice) and I/O (idle class) priority of the calling thread;
+// threads and processes started by it afterwards inherit them
+bool SetBackgroundPriority();
+
+class WriteThrottle
+{
+    public:
+        WriteThrottle(uint64_t nLimit); // bytes per second (0 - only backing off)
+        void Wait(size_t nSize, volatile bool *pbCancel); // before writing nSize bytes
+        void Written(size_t nSize, uint64_t nLatency); // latency of the write (microseconds)
+        uint64_t GetRate() const { return m_nRate; } // current rate (0 - not limited)
+        uint64_t GetWaitTime() const { return m_nWaited; } // microseconds spent waiting
+    private:
+        void Adjust(uint64_t nNow);
+
+        uint64_t m_nLimit, m_nRate;
+        int64_t m_nTokens; // bytes which may be written now
+        uint64_t m_nLast; // time of the last refill
+        uint64_t m_nWaited;
+
+        // latency of 64 KB writes: average of the recent ones and the usual one
+        uint64_t m_nAverage, m_nUsual;
+        unsigned int m_nSamples;
+        uint64_t m_nPeriod, m_nPeriodBytes; // start of the adjustment period, bytes written in it
+};
+
+#endif /* _NRUSLAN_THROTTLE_H_ */
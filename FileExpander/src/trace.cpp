@@ -0,0 +1,330 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <pthread.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include "trace.h"
+
+// Timed phase of a job
+struct trace_event
+{
+    uint64_t start, end; // nanoseconds
+    uint32_t job;
+    uint32_t thread;
+    uint32_t phase;
+};
+
+// Events of one thread; the thread alone writes them, the lock is only
+// contended while a finished job collects its events
+struct trace_ring
+{
+    pthread_mutex_t lock;
+    trace_event events[TRACE_RING_SIZE];
+    uint64_t count; // events ever recorded
+    bool used; // owned by a living thread (rings of finished threads are reused)
+    trace_ring *next;
+};
+
+struct trace_job
+{
+    uint32_t id;
+    std::string kind, name;
+    uint64_t start;
+    uint64_t total[TRACE_PHASES]; // nanoseconds (added by several threads)
+    uint32_t count[TRACE_PHASES];
+    uint32_t events;
+    int first_byte;
+};
+
+static const char *trace_names[TRACE_PHASES] = {
+    "rule", "command", "spawn", "first byte", "decode", "write", "metadata", "ui", "finish"
+};
+
+static volatile bool trace_on = false;
+static std::string trace_folder;
+static uint32_t trace_jobs = 0;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER; // rings, names
+static trace_ring *trace_rings = NULL;
+static std::map<uint32_t, std::string> trace_threads;
+static pthread_key_t trace_key;
+static pthread_once_t trace_once = PTHREAD_ONCE_INIT;
+
+static uint64_t trace_time()
+{
+    struct timespec sTime;
+
+    clock_gettime(CLOCK_MONOTONIC, &sTime);
+    return (uint64_t)sTime.tv_sec * 1000000000 + sTime.tv_nsec;
+}
+
+static uint32_t ThreadId()
+{
+#ifdef SYS_gettid
+    return syscall(SYS_gettid);
+#else
+    return (uint32_t)(uintptr_t)pthread_self();
+#endif
+}
+
+// ReleaseRing - the thread has finished (its events stay until they are overwritten)
+static void ReleaseRing(void *pData)
+{
+    pthread_mutex_lock(&trace_lock);
+    ((trace_ring *)pData)->used = false;
+    pthread_mutex_unlock(&trace_lock);
+}
+
+static void MakeKey()
+{
+    pthread_key_create(&trace_key, ReleaseRing);
+}
+
+// GetRing - ring of the calling thread
+static trace_ring *GetRing()
+{
+    pthread_once(&trace_once, MakeKey);
+    trace_ring *psRing = (trace_ring *)pthread_getspecific(trace_key);
+    if (psRing)
+        return psRing;
+
+    pthread_mutex_lock(&trace_lock);
+    for (psRing = trace_rings; psRing && psRing->used; psRing = psRing->next);
+    if (!psRing)
+    {
+        psRing = new trace_ring;
+        pthread_mutex_init(&psRing->lock, NULL);
+        psRing->count = 0;
+        psRing->next = trace_rings;
+        trace_rings = psRing;
+    }
+    psRing->used = true;
+    pthread_mutex_unlock(&trace_lock);
+    pthread_setspecific(trace_key, psRing);
+    return psRing;
+}
+
+void TraceEnable(const char *pzFolder)
+{
+    pthread_mutex_lock(&trace_lock);
+    trace_folder = pzFolder ? pzFolder : "";
+    pthread_mutex_unlock(&trace_lock);
+    trace_on = true;
+}
+
+void TraceDisable()
+{
+    trace_on = false;
+}
+
+bool IsTraceEnabled()
+{
+    return trace_on;
+}
+
+trace_job *TraceBegin(const char *pzKind, const char *pzName)
+{
+    if (!trace_on)
+        return NULL;
+
+    trace_job *psJob = new trace_job;
+    psJob->id = __sync_add_and_fetch(&trace_jobs, 1);
+    psJob->kind = pzKind;
+    psJob->name = pzName ? pzName : "";
+    psJob->start = trace_time();
+    memset(psJob->total, 0, sizeof(psJob->total));
+    memset(psJob->count, 0, sizeof(psJob->count));
+    psJob->events = 0;
+    psJob->first_byte = 0;
+    return psJob;
+}
+
+void TraceThread(const char *pzName)
+{
+    if (!trace_on)
+        return;
+    uint32_t nThread = ThreadId();
+    pthread_mutex_lock(&trace_lock);
+    trace_threads[nThread] = pzName;
+    pthread_mutex_unlock(&trace_lock);
+}
+
+uint64_t TraceStart(trace_job *psJob)
+{
+    return psJob ? trace_time() : 0;
+}
+
+void TraceSpan(trace_job *psJob, int nPhase, uint64_t nStart)
+{
+    if (!psJob)
+        return;
+
+    uint64_t nEnd = trace_time();
+    trace_ring *psRing = GetRing();
+    pthread_mutex_lock(&psRing->lock);
+    trace_event &sEvent = psRing->events[psRing->count++ % TRACE_RING_SIZE];
+    sEvent.start = nStart;
+    sEvent.end = nEnd;
+    sEvent.job = psJob->id;
+    sEvent.thread = ThreadId();
+    sEvent.phase = nPhase;
+    pthread_mutex_unlock(&psRing->lock);
+
+    __sync_add_and_fetch(&psJob->total[nPhase], nEnd - nStart);
+    __sync_add_and_fetch(&psJob->count[nPhase], 1);
+    __sync_add_and_fetch(&psJob->events, 1);
+}
+
+void TraceFirstByte(trace_job *psJob)
+{
+    if (psJob && __sync_bool_compare_and_swap(&psJob->first_byte, 0, 1))
+        TraceSpan(psJob, TRACE_FIRST_BYTE, psJob->start);
+}
+
+// json_text - string for JSON (quotes and control characters escaped)
+static std::string json_text(const std::string &cText)
+{
+    std::string cResult;
+    char zCode[8];
+
+    for (unsigned int i = 0; i < cText.size(); i++)
+    {
+        unsigned char nChar = cText[i];
+        if (nChar == '"' || nChar == '\\')
+        {
+            cResult += '\\';
+            cResult += nChar;
+        }
+        else if (nChar < 0x20)
+        {
+            sprintf(zCode, "\\u%04x", nChar);
+            cResult += zCode;
+        }
+        else
+            cResult += nChar;
+    }
+    return cResult;
+}
+
+static bool EventBefore(const trace_event &sA, const trace_event &sB)
+{
+    return sA.start < sB.start;
+}
+
+// WriteTrace - Chrome trace of the job's events (timestamps in microseconds)
+static bool WriteTrace(const std::string &cPath, trace_job *psJob, const std::vector<trace_event> &asEvent)
+{
+    FILE *psFile = fopen(cPath.c_str(), "w");
+    if (!psFile)
+        return false;
+
+    long nPid = getpid();
+    fprintf(psFile, "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"job\":\"%s\",\"name\":\"%s\"},\"traceEvents\":[\n",
+            json_text(psJob->kind).c_str(), json_text(psJob->name).c_str());
+
+    // thread names
+    std::map<uint32_t, bool> cSeen;
+    pthread_mutex_lock(&trace_lock);
+    for (unsigned int i = 0; i < asEvent.size(); i++)
+    {
+        uint32_t nThread = asEvent[i].thread;
+        if (cSeen[nThread])
+            continue;
+        cSeen[nThread] = true;
+        std::map<uint32_t, std::string>::iterator cName = trace_threads.find(nThread);
+        if (cName != trace_threads.end())
+            fprintf(psFile, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%ld,\"tid\":%u,\"args\":{\"name\":\"%s\"}},\n",
+                    nPid, nThread, json_text(cName->second).c_str());
+    }
+    pthread_mutex_unlock(&trace_lock);
+
+    for (unsigned int i = 0; i < asEvent.size(); i++)
+    {
+        const trace_event &sEvent = asEvent[i];
+        fprintf(psFile, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%ld,\"tid\":%u}%s\n",
+                trace_names[sEvent.phase], json_text(psJob->kind).c_str(), sEvent.start / 1000.0,
+                (sEvent.end - sEvent.start) / 1000.0, nPid, sEvent.thread, i + 1 < asEvent.size() ? "," : "");
+    }
+    fprintf(psFile, "]}\n");
+    return fclose(psFile) == 0;
+}
+
+void TraceEnd(trace_job *psJob)
+{
+    if (!psJob)
+        return;
+
+    uint64_t nTotal = trace_time() - psJob->start;
+
+    // events of the job which are still in the rings
+    std::vector<trace_event> asEvent;
+    std::map<uint32_t, bool> cThreads;
+    pthread_mutex_lock(&trace_lock);
+    std::string cFolder = trace_folder;
+    for (trace_ring *psRing = trace_rings; psRing; psRing = psRing->next)
+    {
+        pthread_mutex_lock(&psRing->lock);
+        uint64_t nFirst = psRing->count > TRACE_RING_SIZE ? psRing->count - TRACE_RING_SIZE : 0;
+        for (uint64_t i = nFirst; i < psRing->count; i++)
+        {
+            const trace_event &sEvent = psRing->events[i % TRACE_RING_SIZE];
+            if (sEvent.job == psJob->id)
+            {
+                asEvent.push_back(sEvent);
+                cThreads[sEvent.thread] = true;
+            }
+        }
+        pthread_mutex_unlock(&psRing->lock);
+    }
+    pthread_mutex_unlock(&trace_lock);
+    std::sort(asEvent.begin(), asEvent.end(), EventBefore);
+
+    // "FileExpander: trace 3 extract a.tar.gz 812.4 ms: rule 0.1 ms, ... (3 threads, 0 events dropped)"
+    std::string cLine;
+    char zText[128];
+    sprintf(zText, "FileExpander: trace %u ", psJob->id);
+    cLine = zText + psJob->kind + " " + psJob->name;
+    sprintf(zText, " %.1f ms:", nTotal / 1e6);
+    cLine += zText;
+    for (int i = 0, nShown = 0; i < TRACE_PHASES; i++)
+    {
+        if (!psJob->count[i])
+            continue;
+        sprintf(zText, "%s %s %.1f ms", nShown++ ? "," : "", trace_names[i], psJob->total[i] / 1e6);
+        cLine += zText;
+    }
+    sprintf(zText, " (%u threads, %u events dropped)", (unsigned int)cThreads.size(), psJob->events - (uint32_t)asEvent.size());
+    cLine += zText;
+
+    if (!cFolder.empty())
+    {
+        sprintf(zText, "/" TRACE_FILE_PREFIX "%ld-%u.json", (long)getpid(), psJob->id);
+        std::string cPath = cFolder + zText;
+        cLine += WriteTrace(cPath, psJob, asEvent) ? " -> " + cPath : " (can't write " + cPath + ")";
+    }
+    fprintf(stderr, "%s\n", cLine.c_str());
+    delete psJob;
+}
@@ -0,0 +1,67 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _NRUSLAN_TRACE_H_
+#define _NRUSLAN_TRACE_H_
+
+//
+// Job tracing - phases of list and extract jobs are timed into a ring of
+// events kept by each thread. While tracing is off no job is created and
+// every call only tests its NULL job. When a job ends a summary line goes
+// to stderr and its events are written as Chrome trace JSON (it can be
+// opened in chrome://tracing or Perfetto).
+//
+
+#include <stdint.h>
+
+#define TRACE_FILE_PREFIX "trace-" // + <pid>-<job>.json
+
+enum Trace_Phase
+{
+    TRACE_RULE, // finding the rule of the archive
+    TRACE_COMMAND, // building the command line
+    TRACE_SPAWN, // starting the command, or opening the archive
+    TRACE_FIRST_BYTE, // from the start of the job till its first output
+    TRACE_DECODE,
+    TRACE_WRITE,
+    TRACE_METADATA, // permissions, times and closing of files
+    TRACE_UI, // putting results into the window
+    TRACE_FINISH, // folder metadata, manifest, sync; giving the destination up
+    TRACE_PHASES
+};
+
+enum Trace_Settings
+{
+    TRACE_RING_SIZE = 16384, // events kept per thread (the oldest are overwritten)
+    TRACE_NAME_MAX = 32
+};
+
+struct trace_job;
+
+void TraceEnable(const char *pzFolder); // trace files go there (NULL - the summary only)
+void TraceDisable(); // jobs already begun are still reported
+bool IsTraceEnabled();
+trace_job *TraceBegin(const char *pzKind, const char *pzName); // NULL if tracing is off
+void TraceThread(const char *pzName); // name of the calling thread in trace files
+uint64_t TraceStart(trace_job *psJob); // nanoseconds (0 without a job)
+void TraceSpan(trace_job *psJob, int nPhase, uint64_t nStart); // the phase lasted from nStart till now
+void TraceFirstByte(trace_job *psJob); // only the first call counts
+void TraceEnd(trace_job *psJob); // reports and frees the job
+
+#endif /* _NRUSLAN_TRACE_H_ */
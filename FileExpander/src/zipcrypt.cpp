@@ -0,0 +1,499 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <string.h>
+#include "zipcrypt.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && (__GNUC__ >= 5)
+#define ZIPCRYPT_X86_AES
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+//
+// ZipCrypto
+//
+
+// CRC-32 table (the cipher uses plain table steps without inversion)
+struct crc_table
+{
+    uint32_t entry[256];
+    crc_table()
+    {
+        for (uint32_t i = 0; i < 256; i++)
+        {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++)
+                c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+            entry[i] = c;
+        }
+    }
+};
+
+static const crc_table g_sCrcTable;
+
+static inline uint32_t crc_step(uint32_t nCrc, unsigned char c)
+{
+    return g_sCrcTable.entry[(nCrc ^ c) & 0xff] ^ (nCrc >> 8);
+}
+
+static inline void zipcrypto_update(zipcrypto_ctx *psCtx, unsigned char c)
+{
+    psCtx->keys[0] = crc_step(psCtx->keys[0], c);
+    psCtx->keys[1] = (psCtx->keys[1] + (psCtx->keys[0] & 0xff)) * 134775813 + 1;
+    psCtx->keys[2] = crc_step(psCtx->keys[2], psCtx->keys[1] >> 24);
+}
+
+void zipcrypto_init(zipcrypto_ctx *psCtx, const char *pzPassword)
+{
+    psCtx->keys[0] = 0x12345678;
+    psCtx->keys[1] = 0x23456789;
+    psCtx->keys[2] = 0x34567890;
+    while (*pzPassword)
+        zipcrypto_update(psCtx, *pzPassword++);
+}
+
+void zipcrypto_decrypt(zipcrypto_ctx *psCtx, unsigned char *pData, size_t nSize)
+{
+    for (; nSize; nSize--, pData++)
+    {
+        uint32_t nTemp = (psCtx->keys[2] & 0xffff) | 2;
+        *pData ^= (nTemp * (nTemp ^ 1)) >> 8;
+        zipcrypto_update(psCtx, *pData);
+    }
+}
+
+//
+// SHA-1
+//
+
+#define ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void sha1_block(uint32_t *state, const unsigned char *p)
+{
+    uint32_t w[80], a, b, c, d, e, t;
+    int i;
+
+    for (i = 0; i < 16; i++)
+        w[i] = ((uint32_t)p[4 * i] << 24) | ((uint32_t)p[4 * i + 1] << 16) | ((uint32_t)p[4 * i + 2] << 8) | p[4 * i + 3];
+    for (; i < 80; i++)
+        w[i] = ROL(w[i - 3] ^ w[i - 8] ^ w[i - 14] ^ w[i - 16], 1);
+
+    a = state[0]; b = state[1]; c = state[2]; d = state[3]; e = state[4];
+    for (i = 0; i < 80; i++)
+    {
+        if (i < 20)
+            t = ((b & c) | (~b & d)) + 0x5a827999;
+        else if (i < 40)
+            t = (b ^ c ^ d) + 0x6ed9eba1;
+        else if (i < 60)
+            t = ((b & c) | (b & d) | (c & d)) + 0x8f1bbcdc;
+        else
+            t = (b ^ c ^ d) + 0xca62c1d6;
+        t += ROL(a, 5) + e + w[i];
+        e = d; d = c; c = ROL(b, 30); b = a; a = t;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d; state[4] += e;
+}
+
+void sha1_init(sha1_ctx *psCtx)
+{
+    psCtx->state[0] = 0x67452301;
+    psCtx->state[1] = 0xefcdab89;
+    psCtx->state[2] = 0x98badcfe;
+    psCtx->state[3] = 0x10325476;
+    psCtx->state[4] = 0xc3d2e1f0;
+    psCtx->length = 0;
+    psCtx->used = 0;
+}
+
+void sha1_update(sha1_ctx *psCtx, const void *pData, size_t nSize)
+{
+    const unsigned char *p = (const unsigned char *)pData;
+
+    psCtx->length += nSize;
+    if (psCtx->used)
+    {
+        size_t nPart = SHA1_BLOCK - psCtx->used;
+        if (nPart > nSize)
+            nPart = nSize;
+        memcpy(psCtx->block + psCtx->used, p, nPart);
+        psCtx->used += nPart;
+        p += nPart;
+        nSize -= nPart;
+        if (psCtx->used < SHA1_BLOCK)
+            return;
+        sha1_block(psCtx->state, psCtx->block);
+        psCtx->used = 0;
+    }
+    for (; nSize >= SHA1_BLOCK; nSize -= SHA1_BLOCK, p += SHA1_BLOCK)
+        sha1_block(psCtx->state, p);
+    memcpy(psCtx->block, p, nSize);
+    psCtx->used = nSize;
+}
+
+void sha1_final(sha1_ctx *psCtx, unsigned char *pDigest)
+{
+    uint64_t nBits = psCtx->length * 8;
+    unsigned char aPad[SHA1_BLOCK + 8];
+    size_t nPad = (psCtx->used < 56 ? 56 : 120) - psCtx->used;
+
+    memset(aPad, 0, sizeof(aPad));
+    aPad[0] = 0x80;
+    for (int i = 0; i < 8; i++)
+        aPad[nPad + i] = (unsigned char)(nBits >> (56 - 8 * i));
+    sha1_update(psCtx, aPad, nPad + 8);
+
+    for (int i = 0; i < 5; i++)
+    {
+        pDigest[4 * i] = psCtx->state[i] >> 24;
+        pDigest[4 * i + 1] = psCtx->state[i] >> 16;
+        pDigest[4 * i + 2] = psCtx->state[i] >> 8;
+        pDigest[4 * i + 3] = psCtx->state[i];
+    }
+}
+
+// HMAC-SHA1 (data goes to sha1_update(&inner))
+void hmac_sha1_init(hmac_sha1_ctx *psCtx, const void *pKey, size_t nKeySize)
+{
+    unsigned char aKey[SHA1_BLOCK], aPad[SHA1_BLOCK];
+
+    memset(aKey, 0, sizeof(aKey));
+    if (nKeySize > SHA1_BLOCK)
+    {
+        sha1_ctx sHash;
+        sha1_init(&sHash);
+        sha1_update(&sHash, pKey, nKeySize);
+        sha1_final(&sHash, aKey);
+    }
+    else
+        memcpy(aKey, pKey, nKeySize);
+
+    for (int i = 0; i < SHA1_BLOCK; i++)
+        aPad[i] = aKey[i] ^ 0x36;
+    sha1_init(&psCtx->inner);
+    sha1_update(&psCtx->inner, aPad, SHA1_BLOCK);
+    for (int i = 0; i < SHA1_BLOCK; i++)
+        aPad[i] = aKey[i] ^ 0x5c;
+    sha1_init(&psCtx->outer);
+    sha1_update(&psCtx->outer, aPad, SHA1_BLOCK);
+}
+
+void hmac_sha1_final(hmac_sha1_ctx *psCtx, unsigned char *pDigest)
+{
+    unsigned char aInner[SHA1_DIGEST];
+    sha1_final(&psCtx->inner, aInner);
+    sha1_update(&psCtx->outer, aInner, SHA1_DIGEST);
+    sha1_final(&psCtx->outer, pDigest);
+}
+
+//
+// AES
+//
+
+static const unsigned char aes_sbox[256] =
+{
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+static inline unsigned char xtime(unsigned char x)
+{
+    return (x << 1) ^ ((x >> 7) * 0x1b);
+}
+
+// Key expansion (round keys are kept as bytes, so AES-NI can load them)
+void aes_set_key(aes_ctx *psCtx, const unsigned char *pKey, int nBits)
+{
+    int nWords = nBits / 32, nTotal;
+    unsigned char *pRound = psCtx->round_keys, aTemp[4], nRcon = 1;
+
+    psCtx->rounds = nWords + 6;
+    nTotal = 4 * (psCtx->rounds + 1);
+    memcpy(pRound, pKey, 4 * nWords);
+
+    for (int i = nWords; i < nTotal; i++)
+    {
+        memcpy(aTemp, pRound + 4 * (i - 1), 4);
+        if (i % nWords == 0)
+        {
+            unsigned char c = aTemp[0];
+            aTemp[0] = aes_sbox[aTemp[1]] ^ nRcon;
+            aTemp[1] = aes_sbox[aTemp[2]];
+            aTemp[2] = aes_sbox[aTemp[3]];
+            aTemp[3] = aes_sbox[c];
+            nRcon = xtime(nRcon);
+        }
+        else if (nWords > 6 && i % nWords == 4)
+        {
+            for (int j = 0; j < 4; j++)
+                aTemp[j] = aes_sbox[aTemp[j]];
+        }
+        for (int j = 0; j < 4; j++)
+            pRound[4 * i + j] = pRound[4 * (i - nWords) + j] ^ aTemp[j];
+    }
+}
+
+// Portable block encryption (state is column-major: byte = row + 4 * column)
+void aes_encrypt(const aes_ctx *psCtx, const unsigned char *pIn, unsigned char *pOut)
+{
+    const unsigned char *pRound = psCtx->round_keys;
+    unsigned char s[AES_BLOCK], t[AES_BLOCK];
+    int i;
+
+    for (i = 0; i < AES_BLOCK; i++)
+        s[i] = pIn[i] ^ pRound[i];
+
+    for (int r = 1; r <= psCtx->rounds; r++)
+    {
+        pRound += AES_BLOCK;
+
+        // SubBytes and ShiftRows
+        for (i = 0; i < AES_BLOCK; i++)
+            t[i] = aes_sbox[s[(i & 3) + 4 * (((i >> 2) + (i & 3)) & 3)]];
+
+        // MixColumns (not in the last round)
+        if (r < psCtx->rounds)
+        {
+            for (i = 0; i < AES_BLOCK; i += 4)
+            {
+                unsigned char a0 = t[i], a1 = t[i + 1], a2 = t[i + 2], a3 = t[i + 3], x = a0 ^ a1 ^ a2 ^ a3;
+                t[i] ^= x ^ xtime(a0 ^ a1);
+                t[i + 1] ^= x ^ xtime(a1 ^ a2);
+                t[i + 2] ^= x ^ xtime(a2 ^ a3);
+                t[i + 3] ^= x ^ xtime(a3 ^ a0);
+            }
+        }
+
+        for (i = 0; i < AES_BLOCK; i++)
+            s[i] = t[i] ^ pRound[i];
+    }
+    memcpy(pOut, s, AES_BLOCK);
+}
+
+// WinZip counter: little-endian in the first 8 bytes
+static inline void ctr_increment(unsigned char *pCounter)
+{
+    for (int j = 0; j < 8 && !++pCounter[j]; j++);
+}
+
+// Key stream for nBlocks counter values
+static void aes_ctr_c(const aes_ctx *psCtx, unsigned char *pCounter, unsigned char *pStream, size_t nBlocks)
+{
+    for (; nBlocks; nBlocks--, pStream += AES_BLOCK)
+    {
+        ctr_increment(pCounter);
+        aes_encrypt(psCtx, pCounter, pStream);
+    }
+}
+
+#ifdef ZIPCRYPT_X86_AES
+
+// Key stream using AES-NI (four blocks at a time to fill the pipeline)
+__attribute__((target("aes,sse2")))
+static void aes_ctr_x86(const aes_ctx *psCtx, unsigned char *pCounter, unsigned char *pStream, size_t nBlocks)
+{
+    __m128i acKey[AES_MAX_ROUNDS + 1], c0, c1, c2, c3;
+    unsigned char aCounter[4][AES_BLOCK];
+    int nRounds = psCtx->rounds, r;
+
+    for (r = 0; r <= nRounds; r++)
+        acKey[r] = _mm_loadu_si128((const __m128i *)(psCtx->round_keys + r * AES_BLOCK));
+
+    for (; nBlocks >= 4; nBlocks -= 4, pStream += 4 * AES_BLOCK)
+    {
+        for (int i = 0; i < 4; i++)
+        {
+            ctr_increment(pCounter);
+            memcpy(aCounter[i], pCounter, AES_BLOCK);
+        }
+        c0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)aCounter[0]), acKey[0]);
+        c1 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)aCounter[1]), acKey[0]);
+        c2 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)aCounter[2]), acKey[0]);
+        c3 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)aCounter[3]), acKey[0]);
+        for (r = 1; r < nRounds; r++)
+        {
+            c0 = _mm_aesenc_si128(c0, acKey[r]);
+            c1 = _mm_aesenc_si128(c1, acKey[r]);
+            c2 = _mm_aesenc_si128(c2, acKey[r]);
+            c3 = _mm_aesenc_si128(c3, acKey[r]);
+        }
+        _mm_storeu_si128((__m128i *)(pStream + 0), _mm_aesenclast_si128(c0, acKey[nRounds]));
+        _mm_storeu_si128((__m128i *)(pStream + 16), _mm_aesenclast_si128(c1, acKey[nRounds]));
+        _mm_storeu_si128((__m128i *)(pStream + 32), _mm_aesenclast_si128(c2, acKey[nRounds]));
+        _mm_storeu_si128((__m128i *)(pStream + 48), _mm_aesenclast_si128(c3, acKey[nRounds]));
+    }
+
+    for (; nBlocks; nBlocks--, pStream += AES_BLOCK)
+    {
+        ctr_increment(pCounter);
+        c0 = _mm_xor_si128(_mm_loadu_si128((const __m128i *)pCounter), acKey[0]);
+        for (r = 1; r < nRounds; r++)
+            c0 = _mm_aesenc_si128(c0, acKey[r]);
+        _mm_storeu_si128((__m128i *)pStream, _mm_aesenclast_si128(c0, acKey[nRounds]));
+    }
+}
+
+static bool aes_has_x86_aes()
+{
+    unsigned int a, b, c, d;
+    return __get_cpuid(1, &a, &b, &c, &d) && (c & bit_AES) && (d & bit_SSE2);
+}
+
+#endif
+
+typedef void (*aes_ctr_func)(const aes_ctx *, unsigned char *, unsigned char *, size_t);
+
+// choosing key stream function on the first use
+static aes_ctr_func aes_select()
+{
+    static aes_ctr_func pfCtr = NULL;
+    if (!pfCtr)
+    {
+#ifdef ZIPCRYPT_X86_AES
+        pfCtr = aes_has_x86_aes() ? aes_ctr_x86 : aes_ctr_c;
+#else
+        pfCtr = aes_ctr_c;
+#endif
+    }
+    return pfCtr;
+}
+
+bool aes_accelerated()
+{
+    return aes_select() != aes_ctr_c;
+}
+
+//
+// WinZip AES
+//
+
+static int wzaes_key_size(int nStrength)
+{
+    return (nStrength >= 1 && nStrength <= 3) ? 8 + 8 * nStrength : 0;
+}
+
+int wzaes_salt_size(int nStrength)
+{
+    return wzaes_key_size(nStrength) / 2;
+}
+
+// PBKDF2-HMAC-SHA1: encryption key, authentication key, password verifier
+void wzaes_derive(const char *pzPassword, int nStrength, const unsigned char *pSalt, unsigned char *pKeys)
+{
+    int nKey = wzaes_key_size(nStrength), nLength = 2 * nKey + WZAES_VERIFIER;
+    hmac_sha1_ctx sPassword, sHmac;
+    unsigned char aU[SHA1_DIGEST], aT[SHA1_DIGEST];
+
+    hmac_sha1_init(&sPassword, pzPassword, strlen(pzPassword));
+    for (uint32_t nBlock = 1; nLength > 0; nBlock++)
+    {
+        unsigned char aIndex[4] = { (unsigned char)(nBlock >> 24), (unsigned char)(nBlock >> 16), (unsigned char)(nBlock >> 8), (unsigned char)nBlock };
+
+        sHmac = sPassword;
+        sha1_update(&sHmac.inner, pSalt, wzaes_salt_size(nStrength));
+        sha1_update(&sHmac.inner, aIndex, 4);
+        hmac_sha1_final(&sHmac, aU);
+        memcpy(aT, aU, SHA1_DIGEST);
+
+        for (int i = 1; i < WZAES_ITERATIONS; i++)
+        {
+            sHmac = sPassword;
+            sha1_update(&sHmac.inner, aU, SHA1_DIGEST);
+            hmac_sha1_final(&sHmac, aU);
+            for (int j = 0; j < SHA1_DIGEST; j++)
+                aT[j] ^= aU[j];
+        }
+
+        int nPart = nLength < SHA1_DIGEST ? nLength : SHA1_DIGEST;
+        memcpy(pKeys, aT, nPart);
+        pKeys += nPart;
+        nLength -= nPart;
+    }
+    memset(&sPassword, 0, sizeof(sPassword));
+}
+
+bool wzaes_start(wzaes_ctx *psCtx, int nStrength, const unsigned char *pKeys, const unsigned char *pVerifier)
+{
+    int nKey = wzaes_key_size(nStrength);
+
+    if (!nKey || memcmp(pKeys + 2 * nKey, pVerifier, WZAES_VERIFIER))
+        return false;
+    aes_set_key(&psCtx->aes, pKeys, nKey * 8);
+    hmac_sha1_init(&psCtx->hmac, pKeys + nKey, nKey);
+    memset(psCtx->counter, 0, AES_BLOCK);
+    psCtx->used = AES_BLOCK;
+    return true;
+}
+
+void wzaes_decrypt(wzaes_ctx *psCtx, unsigned char *pData, size_t nSize)
+{
+    unsigned char aStream[64 * AES_BLOCK];
+    aes_ctr_func pfCtr = aes_select();
+
+    // authentication code is computed over the encrypted data
+    sha1_update(&psCtx->hmac.inner, pData, nSize);
+
+    // rest of the current key stream block
+    for (; nSize && psCtx->used < AES_BLOCK; nSize--)
+        *pData++ ^= psCtx->stream[psCtx->used++];
+
+    // whole blocks
+    while (nSize >= AES_BLOCK)
+    {
+        size_t nBlocks = nSize / AES_BLOCK;
+        if (nBlocks > sizeof(aStream) / AES_BLOCK)
+            nBlocks = sizeof(aStream) / AES_BLOCK;
+        pfCtr(&psCtx->aes, psCtx->counter, aStream, nBlocks);
+        for (size_t i = 0; i < nBlocks * AES_BLOCK; i++)
+            pData[i] ^= aStream[i];
+        pData += nBlocks * AES_BLOCK;
+        nSize -= nBlocks * AES_BLOCK;
+    }
+
+    // beginning of the next block
+    if (nSize)
+    {
+        pfCtr(&psCtx->aes, psCtx->counter, psCtx->stream, 1);
+        psCtx->used = 0;
+        for (; nSize; nSize--)
+            *pData++ ^= psCtx->stream[psCtx->used++];
+    }
+}
+
+bool wzaes_finish(wzaes_ctx *psCtx, const unsigned char *pAuth)
+{
+    unsigned char aDigest[SHA1_DIGEST];
+    hmac_sha1_final(&psCtx->hmac, aDigest);
+    return !memcmp(aDigest, pAuth, WZAES_AUTH);
+}
@@ -0,0 +1,105 @@
+/*
+ *  FileExpander 0.7 (GUI files extraction tool)
+ *  Copyright (c) 2004 Ruslan Nickolaev (nruslan@hotbox.ru)
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#ifndef _NRUSLAN_ZIPCRYPT_H_
+#define _NRUSLAN_ZIPCRYPT_H_
+
+//
+// Zip encryption: traditional PKWARE encryption (ZipCrypto) and WinZip AES
+// (AE-1/AE-2: PBKDF2-HMAC-SHA1 keys, AES-CTR, HMAC-SHA1 authentication).
+// AES uses x86 AES-NI instructions when the processor has them.
+//
+
+#include <stddef.h>
+#include <stdint.h>
+
+enum ZipCrypt_Settings
+{
+    ZIPCRYPTO_HEADER = 12,
+    AES_BLOCK = 16,
+    AES_MAX_ROUNDS = 14,
+    SHA1_BLOCK = 64,
+    SHA1_DIGEST = 20,
+    WZAES_MAX_KEY = 32,
+    WZAES_VERIFIER = 2,
+    WZAES_AUTH = 10, // stored part of HMAC-SHA1
+    WZAES_ITERATIONS = 1000,
+    WZAES_KEYS = 2 * WZAES_MAX_KEY + WZAES_VERIFIER // derived material
+};
+
+// ZipCrypto
+struct zipcrypto_ctx
+{
+    uint32_t keys[3];
+};
+
+void zipcrypto_init(zipcrypto_ctx *psCtx, const char *pzPassword);
+void zipcrypto_decrypt(zipcrypto_ctx *psCtx, unsigned char *pData, size_t nSize);
+
+// SHA-1 and HMAC-SHA1
+struct sha1_ctx
+{
+    uint32_t state[5];
+    uint64_t length;
+    unsigned char block[SHA1_BLOCK];
+    unsigned int used;
+};
+
+struct hmac_sha1_ctx
+{
+    sha1_ctx inner, outer;
+};
+
+void sha1_init(sha1_ctx *psCtx);
+void sha1_update(sha1_ctx *psCtx, const void *pData, size_t nSize);
+void sha1_final(sha1_ctx *psCtx, unsigned char *pDigest);
+void hmac_sha1_init(hmac_sha1_ctx *psCtx, const void *pKey, size_t nKeySize);
+void hmac_sha1_final(hmac_sha1_ctx *psCtx, unsigned char *pDigest);
+
+// AES (encryption direction only, CTR mode needs nothing else)
+struct aes_ctx
+{
+    unsigned char round_keys[(AES_MAX_ROUNDS + 1) * AES_BLOCK];
+    int rounds;
+};
+
+void aes_set_key(aes_ctx *psCtx, const unsigned char *pKey, int nBits);
+void aes_encrypt(const aes_ctx *psCtx, const unsigned char *pIn, unsigned char *pOut);
+bool aes_accelerated();
+
+// WinZip AES; nStrength: 1 - 128, 2 - 192, 3 - 256 bits
+struct wzaes_ctx
+{
+    aes_ctx aes;
+    hmac_sha1_ctx hmac;
+    unsigned char counter[AES_BLOCK], stream[AES_BLOCK];
+    unsigned int used; // of the key stream block
+};
+
+int wzaes_salt_size(int nStrength); // 0 if the strength is unknown
+
+// deriving keys (slow by design, may run in any thread); pKeys: WZAES_KEYS
+void wzaes_derive(const char *pzPassword, int nStrength, const unsigned char *pSalt, unsigned char *pKeys);
+
+// false if the password verifier doesn't match (wrong password)
+bool wzaes_start(wzaes_ctx *psCtx, int nStrength, const unsigned char *pKeys, const unsigned char *pVerifier);
+void wzaes_decrypt(wzaes_ctx *psCtx, unsigned char *pData, size_t nSize);
+bool wzaes_finish(wzaes_ctx *psCtx, const unsigned char *pAuth); // false if data was changed
+
+#endif /* _NRUSLAN_ZIPCRYPT_H_ */